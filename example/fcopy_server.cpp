@@ -7,6 +7,11 @@
 #include <acqua/iostreams/md5_filter.hpp>
 #include <acqua/iostreams/sha256_filter.hpp>
 #include <acqua/iostreams/transferred_counter.hpp>
+#ifdef ACQUA_HAVE_ZSTD_LZ4
+#include <acqua/iostreams/zstd_filter.hpp>
+#include <acqua/iostreams/lz4_filter.hpp>
+#include <acqua/iostreams/fused_filter.hpp>
+#endif
 #include <boost/blank.hpp>
 #include <boost/iostreams/filtering_stream.hpp>
 #include <boost/iostreams/device/back_inserter.hpp>
@@ -18,7 +23,7 @@
 #include <boost/spirit/include/qi.hpp>
 #include <boost/spirit/include/support_istream_iterator.hpp>
 
-enum class compress_type { none, zlib, gzip, bzip2 };
+enum class compress_type { none, zlib, gzip, bzip2, zstd, lz4 };
 enum class checksum_type { none, md5, sha256 };
 
 static boost::spirit::qi::symbols<char, compress_type> compress;
@@ -36,7 +41,7 @@ static boost::spirit::qi::symbols<char, checksum_type> checksum;
    - FILE は base64 エンコードされたファイルパス(ディレクトリを含んでもよい)
    - SIZE は ファイルサイズ
    - PERM は UNIXにおける8進数パーミッションコード。0 のときは受け側の任意で決められる
-   - COMPRESS は圧縮アルゴリズム (none, zlib, gzip, bzip2)
+   - COMPRESS は圧縮アルゴリズム (none, zlib, gzip, bzip2, zstd, lz4). zstd と lz4 は ACQUA_HAVE_ZSTD_LZ4 でビルドしたときだけ受け付ける
    - CHECKSUM は チェックサムアルゴリズム (none, md5, sha256)
    Step2. ファイルをバイナリで転送する１チャンクサイズを転送する
    -「NNN\r\n」
@@ -248,6 +253,15 @@ struct fcopy
             case compress_type::bzip2:
                 out_.push(boost::iostreams::bzip2_decompressor());
                 break;
+#ifdef ACQUA_HAVE_ZSTD_LZ4
+            case compress_type::zstd:
+                // 伸長、チェックサム、サイズの取得を１つのフィルタでまとめて行う. チェックサムとサイズは伸長後のデータで計算する
+                push_fused(acqua::iostreams::zstd_decompressor());
+                return true;
+            case compress_type::lz4:
+                push_fused(acqua::iostreams::lz4_decompressor());
+                return true;
+#endif
             default:
                 break;
         }
@@ -275,6 +289,28 @@ struct fcopy
         return true;
     }
 
+#ifdef ACQUA_HAVE_ZSTD_LZ4
+    template <typename Decompressor>
+    void push_fused(Decompressor decomp)
+    {
+        acqua::iostreams::transferred_counter counter(decompressed_size_);
+        switch(checksum_) {
+            case checksum_type::md5:
+                out_.push(acqua::iostreams::fuse_device(decomp, acqua::iostreams::md5_filter(verify_), counter));
+                break;
+            case checksum_type::sha256:
+                out_.push(acqua::iostreams::fuse_device(decomp, acqua::iostreams::sha256_filter(verify_), counter));
+                break;
+            default:
+                out_.push(acqua::iostreams::fuse_device(decomp, counter));
+                break;
+        }
+
+        oss_.str("");
+        out_.push(oss_);
+    }
+#endif
+
 private:
     socket_type socket_;
     boost::asio::streambuf recvbuf_;
@@ -299,6 +335,11 @@ int main(int argc, char ** argv)
         ("zlib", compress_type::zlib)
         ("gzip", compress_type::gzip)
         ("bzip2", compress_type::bzip2);
+#ifdef ACQUA_HAVE_ZSTD_LZ4
+    compress.add
+        ("zstd", compress_type::zstd)
+        ("lz4", compress_type::lz4);
+#endif
     checksum.add
         ("none", checksum_type::none)
         ("md5", checksum_type::md5)
@@ -8,12 +8,12 @@ public:
     explicit InotifyListener(boost::asio::io_service & io_service)
         : InotifyListener::base_type(io_service) {}
 
-    void on_open(std::string const & name)
+    void on_open(boost::string_view name)
     {
         std::cout << "open " << name << std::endl;
     }
 
-    void on_close(std::string const & name)
+    void on_close(boost::string_view name)
     {
         std::cout << "close " << name << std::endl;
     }
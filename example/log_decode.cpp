@@ -0,0 +1,19 @@
+#include <iostream>
+#include <acqua/log/binary_decoder.hpp>
+
+int main(int argc, char ** argv)
+{
+    if (argc < 2) {
+        std::cerr << "usage: " << argv[0] << " FILE [FORMAT]" << std::endl;
+        return 1;
+    }
+
+    try {
+        acqua::log::binary::decoder decoder(argv[1]);
+        decoder.write(std::cout, argc > 2 ? argv[2] : "%F %T.%u [%L] %t %l - %v");
+    } catch(std::exception & e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -51,5 +51,6 @@ int main()
     NetlinkListener netlink(io_service);
     boost::system::error_code ec;
     netlink.start(ec);
+    netlink.dump(ec);
     io_service.run();
 }
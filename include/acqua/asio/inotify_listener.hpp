@@ -10,28 +10,53 @@
 
 extern "C" {
 #include <sys/inotify.h>
+#include <dirent.h>
 }
 
-#include <array>
+#include <string>
+#include <algorithm>
+#include <memory>
 #include <mutex>
+#include <vector>
+#include <chrono>
+#include <cstring>
 #include <boost/bind.hpp>
+#include <boost/noncopyable.hpp>
 #include <boost/container/flat_map.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/utility/string_view.hpp>
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/steady_timer.hpp>
 #include <boost/asio/posix/stream_descriptor.hpp>
 
 namespace acqua { namespace asio {
 
+/*!
+  inotify のイベントを Derived のコールバックに通知するクラス.
+
+  コールバックに渡す名前は boost::string_view と std::string のどちらにも変換でき、コールバックから戻ると無効になる。
+  コールバックの引数を boost::string_view にすれば、通知ごとに文字列を確保しない。
+  add_recursive() で追加したディレクトリは、作成されたサブディレクトリも自動的に監視する。
+  イベントキューが溢れた (IN_Q_OVERFLOW) 場合は、add_recursive() で追加したディレクトリを走査し直して on_overflow() を通知する。
+  coalesce() で待ち時間を設定すると、その間に同じパスで発生したイベントを１つの通知にまとめる。
+  まとめている間の名前は使い回しのバッファに写し、(wd, 名前) のハッシュの索引で探すので、
+  イベントごとにメモリを確保せず、異なるパスが大量に届いても１件あたり定数時間でまとめる。
+ */
 template <typename Derived>
 class inotify_listener
     : private boost::noncopyable
 {
     using descriptor_type = boost::asio::posix::stream_descriptor;
+    using timer_type = boost::asio::steady_timer;
 
 protected:
     using base_type = inotify_listener<Derived>;
 
 public:
-    explicit inotify_listener(boost::asio::io_service & io_service)
-        : fd_(io_service)
+    using duration = timer_type::duration;
+
+    explicit inotify_listener(boost::asio::io_service & io_service, std::size_t buffer_size = 65536)
+        : fd_(io_service), timer_(io_service), buffer_(std::max<std::size_t>(buffer_size, sizeof(::inotify_event) + NAME_MAX + 1))
     {
     }
 
@@ -68,6 +93,10 @@ public:
 
     void close(boost::system::error_code & ec)
     {
+        timer_.cancel(ec);
+        pending_.clear();
+        names_.clear();
+        std::fill(index_.begin(), index_.end(), 0);
         fd_.close(ec);
     }
 
@@ -78,15 +107,18 @@ public:
         boost::asio::detail::throw_error(ec);
     }
 
+    /*!
+      同じパスのイベントをまとめる待ち時間を設定する.
+      0 の場合は、イベントを受信するたびに通知する
+     */
+    void coalesce(duration const & window) noexcept
+    {
+        window_ = window;
+    }
+
     void add(std::string const & path, int flags, boost::system::error_code & ec)
     {
-        int wd = ::inotify_add_watch(fd_.native_handle(), path.c_str(), static_cast<std::uint32_t>(flags) | IN_MASK_ADD);
-        if (wd >= 0) {
-            std::lock_guard<decltype(mutex_)> lock(mutex_);
-            files_.emplace(wd, path);
-        } else {
-            ec.assign(errno, boost::system::generic_category());
-        }
+        add_watch(path, static_cast<std::uint32_t>(flags), false, false, ec);
     }
 
     void add(std::string const & path)
@@ -96,15 +128,47 @@ public:
         boost::asio::detail::throw_error(ec);
     }
 
+    /*!
+      path 以下のディレクトリをすべて監視する.
+      作成や移動されてきたサブディレクトリも自動的に監視に追加する。
+      そのため inotify には IN_CREATE | IN_MOVED_TO | IN_ONLYDIR を加えて登録するが、
+      flags に含まれないイベントは Derived に通知しない
+     */
+    void add_recursive(std::string const & path, int flags, boost::system::error_code & ec)
+    {
+        add_tree(path, static_cast<std::uint32_t>(flags), true, ec);
+    }
+
+    void add_recursive(std::string const & path)
+    {
+        boost::system::error_code ec;
+        add_recursive(path, IN_ALL_EVENTS, ec);
+        boost::asio::detail::throw_error(ec);
+    }
+
     void remove(std::string const & path, boost::system::error_code & ec)
     {
         std::lock_guard<decltype(mutex_)> lock(mutex_);
         for(auto it = files_.begin(); it != files_.end(); ++it) {
-            if (it->second == path) {
+            if (*it->second.path_ == path) {
+                bool recursive = it->second.recursive_;
                 if (::inotify_rm_watch(fd_.native_handle(), it->first) == 0)
                     files_.erase(it);
                 else
                     ec.assign(errno, boost::system::generic_category());
+
+                // 再帰監視の場合は、サブディレクトリの監視も外す
+                if (recursive) {
+                    std::string prefix = path + '/';
+                    for(auto jt = files_.begin(); jt != files_.end();) {
+                        if (jt->second.path_->compare(0, prefix.size(), prefix) == 0) {
+                            ::inotify_rm_watch(fd_.native_handle(), jt->first);
+                            jt = files_.erase(jt);
+                        } else {
+                            ++jt;
+                        }
+                    }
+                }
                 return;
             }
         }
@@ -118,6 +182,95 @@ public:
     }
 
 private:
+    struct watch_type
+    {
+        std::shared_ptr<std::string const> path_;
+        std::uint32_t flags_;  // 利用者が指定したイベント
+        bool recursive_;
+        bool root_;  // add_recursive() で指定したディレクトリ
+    };
+
+    //! まとめているイベント. 名前は names_ の name_pos_ から name_len_ 文字
+    struct pending_type
+    {
+        int wd_;
+        std::size_t name_pos_;
+        std::size_t name_len_;
+        std::size_t hash_;
+        std::shared_ptr<std::string const> path_;
+        std::uint32_t mask_;
+    };
+
+    /*!
+      コールバックに渡す名前. boost::string_view と std::string のどちらの引数にも渡せる.
+      std::string に変換するときだけ文字列を確保する
+     */
+    struct name_type
+    {
+        boost::string_view name_;
+
+        operator boost::string_view() const noexcept { return name_; }
+        operator std::string() const { return name_.to_string(); }
+    };
+
+    static std::uint32_t const recursive_flags = IN_CREATE | IN_MOVED_TO | IN_ONLYDIR;
+
+    // 指定しなくても inotify が通知するイベント
+    static std::uint32_t const always_flags = IN_IGNORED | IN_UNMOUNT | IN_ISDIR;
+
+    void add_watch(std::string const & path, std::uint32_t flags, bool recursive, bool root, boost::system::error_code & ec)
+    {
+        std::uint32_t watch_flags = recursive ? (flags | recursive_flags) : flags;
+        int wd = ::inotify_add_watch(fd_.native_handle(), path.c_str(), watch_flags | IN_MASK_ADD);
+        if (wd >= 0) {
+            std::lock_guard<decltype(mutex_)> lock(mutex_);
+            auto & watch = files_[wd];
+            if (!watch.path_ || *watch.path_ != path)
+                watch.path_ = std::make_shared<std::string const>(path);
+            watch.flags_ |= flags;
+            watch.recursive_ = watch.recursive_ || recursive;
+            watch.root_ = watch.root_ || root;
+        } else {
+            ec.assign(errno, boost::system::generic_category());
+        }
+    }
+
+    void add_tree(std::string const & path, std::uint32_t flags, bool root, boost::system::error_code & ec)
+    {
+        add_watch(path, flags, true, root, ec);
+        if (ec) return;
+
+        std::unique_ptr<DIR, int(*)(DIR *)> dir(::opendir(path.c_str()), &::closedir);
+        if (!dir) return;  // 追加した直後に削除されたなど
+
+        std::string child;
+        while(auto * ent = ::readdir(dir.get())) {
+            if (ent->d_type != DT_DIR && ent->d_type != DT_UNKNOWN)
+                continue;
+            if (std::strcmp(ent->d_name, ".") == 0 || std::strcmp(ent->d_name, "..") == 0)
+                continue;
+            child.assign(path).append(1, '/').append(ent->d_name);
+            boost::system::error_code ignore;
+            add_tree(child, flags, false, ignore);  // ディレクトリでなければ IN_ONLYDIR で失敗する
+        }
+    }
+
+    //! add_recursive() で指定したディレクトリだけを走査し直す. サブディレクトリはそこからたどる
+    void rescan()
+    {
+        std::vector<std::pair<std::shared_ptr<std::string const>, std::uint32_t> > roots;
+        {
+            std::lock_guard<decltype(mutex_)> lock(mutex_);
+            for(auto const & e : files_)
+                if (e.second.root_)
+                    roots.emplace_back(e.second.path_, e.second.flags_);
+        }
+        for(auto const & e : roots) {
+            boost::system::error_code ec;
+            add_tree(*e.first, e.second, true, ec);
+        }
+    }
+
     void async_read()
     {
         fd_.async_read_some(boost::asio::buffer(buffer_), boost::bind(&inotify_listener::on_read, this, _1, _2));
@@ -143,71 +296,176 @@ private:
 
     void do_notify(inotify_event const * iev)
     {
-        std::string name;
+        if (iev->mask & IN_Q_OVERFLOW) {
+            rescan();
+            static_cast<Derived *>(this)->on_overflow();
+            return;
+        }
+
+        std::shared_ptr<std::string const> path;
+        std::uint32_t flags;
+        bool recursive;
         do {
             std::lock_guard<decltype(mutex_)> lock(mutex_);
             auto it = files_.find(iev->wd);
             if (it == files_.end())
                 return;
-            name = it->second;
+            path = it->second.path_;
+            flags = it->second.flags_;
+            recursive = it->second.recursive_;
             if (iev->mask & IN_IGNORED)
                 files_.erase(it);
         } while(false);
-        std::string in_name(iev->name, std::strlen(iev->name));
+        boost::string_view in_name(iev->name, iev->len ? std::strlen(iev->name) : 0);
+
+        if (recursive && (iev->mask & IN_ISDIR) && (iev->mask & (IN_CREATE | IN_MOVED_TO))) {
+            boost::system::error_code ec;
+            add_tree(*path + '/' + in_name.to_string(), flags, false, ec);
+        }
+
+        // 再帰監視のために加えたイベントは通知しない
+        std::uint32_t mask = iev->mask & (flags | always_flags);
+        if ((mask & ~static_cast<std::uint32_t>(IN_ISDIR)) == 0)
+            return;
+
+        if (window_ == duration::zero()) {
+            dispatch(*path, in_name, mask);
+            return;
+        }
 
+        // 待ち時間の間に届いた同じパスのイベントは、マスクをまとめて１回だけ通知する
+        std::size_t hash = boost::hash_range(in_name.begin(), in_name.end());
+        boost::hash_combine(hash, iev->wd);
+        std::size_t * slot = find_slot(iev->wd, in_name, hash);
+        if (*slot) {
+            pending_[*slot - 1].mask_ |= mask;
+            return;
+        }
+
+        bool first = pending_.empty();
+        pending_.push_back(pending_type{iev->wd, names_.size(), in_name.size(), hash, std::move(path), mask});
+        names_.append(in_name.data(), in_name.size());
+        *slot = pending_.size();
+        if (index_.size() < pending_.size() * 2)
+            rehash();
+        if (first) {
+            timer_.expires_from_now(window_);
+            timer_.async_wait(boost::bind(&inotify_listener::on_flush, this, _1));
+        }
+    }
+
+    void on_flush(boost::system::error_code const & error)
+    {
+        if (error)
+            return;
+
+        // コールバックの中で close() されてもよいように、入れ替えてから通知する. 確保した領域は使い回す
+        flushing_.swap(pending_);
+        flushing_names_.swap(names_);
+        std::fill(index_.begin(), index_.end(), 0);
+        for(auto const & e : flushing_)
+            dispatch(*e.path_, boost::string_view(flushing_names_.data() + e.name_pos_, e.name_len_), e.mask_);
+        flushing_.clear();
+        flushing_names_.clear();
+    }
+
+    /*!
+      pending_ の索引から (wd, in_name) の位置を探す. 索引は pending_ の添字 + 1 を持つ開番地法のハッシュ表で、0 は空き.
+      見つからなければ、追加すべき空きの位置を返す
+     */
+    std::size_t * find_slot(int wd, boost::string_view in_name, std::size_t hash)
+    {
+        if (index_.empty())
+            index_.resize(64);
+        std::size_t mask = index_.size() - 1;
+        for(std::size_t i = hash & mask;; i = (i + 1) & mask) {
+            std::size_t n = index_[i];
+            if (n == 0)
+                return &index_[i];
+            auto const & e = pending_[n - 1];
+            if (e.hash_ == hash && e.wd_ == wd && boost::string_view(names_.data() + e.name_pos_, e.name_len_) == in_name)
+                return &index_[i];
+        }
+    }
+
+    //! 索引を倍の大きさにして、pending_ を入れ直す
+    void rehash()
+    {
+        index_.assign(index_.size() * 2, 0);
+        std::size_t mask = index_.size() - 1;
+        for(std::size_t n = 0; n < pending_.size(); ++n) {
+            std::size_t i = pending_[n].hash_ & mask;
+            while(index_[i])
+                i = (i + 1) & mask;
+            index_[i] = n + 1;
+        }
+    }
+
+    void dispatch(boost::string_view name_view, boost::string_view in_name_view, std::uint32_t mask)
+    {
+        name_type name{name_view};
+        name_type in_name{in_name_view};
         static_cast<Derived *>(this)->on_event(name);
-        if (iev->mask & IN_ACCESS)
+        if (mask & IN_ACCESS)
             static_cast<Derived *>(this)->on_access(name);
-        if (iev->mask & IN_ATTRIB)
+        if (mask & IN_ATTRIB)
             static_cast<Derived *>(this)->on_attribute(name);
-        if (iev->mask & IN_CLOSE_WRITE)
+        if (mask & IN_CLOSE_WRITE)
             static_cast<Derived *>(this)->on_close_write(name);
-        if (iev->mask & IN_CLOSE_NOWRITE)
+        if (mask & IN_CLOSE_NOWRITE)
             static_cast<Derived *>(this)->on_close_nowrite(name);
-        if (iev->mask & IN_CLOSE)
+        if (mask & IN_CLOSE)
             static_cast<Derived *>(this)->on_close(name);
-        if (iev->mask & IN_MODIFY)
+        if (mask & IN_MODIFY)
             static_cast<Derived *>(this)->on_modify(name);
-        if (iev->mask & IN_OPEN)
+        if (mask & IN_OPEN)
             static_cast<Derived *>(this)->on_open(name);
-        if (iev->mask & IN_MOVE_SELF)
+        if (mask & IN_MOVE_SELF)
             static_cast<Derived *>(this)->on_move(name);
-        if (iev->mask * IN_DELETE_SELF)
+        if (mask & IN_DELETE_SELF)
             static_cast<Derived *>(this)->on_delete(name);
-        if (iev->mask & IN_MOVED_FROM)
+        if (mask & IN_MOVED_FROM)
             static_cast<Derived *>(this)->on_moved_from(name, in_name);
-        if (iev->mask & IN_MOVED_TO)
+        if (mask & IN_MOVED_TO)
             static_cast<Derived *>(this)->on_moved_to(name, in_name);
-        if (iev->mask & IN_CREATE)
+        if (mask & IN_CREATE)
             static_cast<Derived *>(this)->on_create_path(name, in_name);
-        if (iev->mask & IN_DELETE)
+        if (mask & IN_DELETE)
             static_cast<Derived *>(this)->on_remove_path(name, in_name);
-        if (iev->mask & IN_IGNORED)
+        if (mask & IN_IGNORED)
             static_cast<Derived *>(this)->on_disposed(name);
     }
 
 private:
-    void on_event(std::string const &) {}
-    void on_access(std::string const &) {}
-    void on_attribute(std::string const &) {}
-    void on_close_write(std::string const &) {}
-    void on_close_nowrite(std::string const &) {}
-    void on_close(std::string const &) {}
-    void on_modify(std::string const &) {}
-    void on_open(std::string const &) {}
-    void on_move(std::string const &) {}
-    void on_delete(std::string const &) {}
-    void on_moved_from(std::string const &, std::string const &) {}
-    void on_moved_to(std::string const &, std::string const &) {}
-    void on_create_path(std::string const &, std::string const &) {}
-    void on_remove_path(std::string const &, std::string const &) {}
-    void on_disposed(std::string const &) {}
+    void on_event(boost::string_view) {}
+    void on_access(boost::string_view) {}
+    void on_attribute(boost::string_view) {}
+    void on_close_write(boost::string_view) {}
+    void on_close_nowrite(boost::string_view) {}
+    void on_close(boost::string_view) {}
+    void on_modify(boost::string_view) {}
+    void on_open(boost::string_view) {}
+    void on_move(boost::string_view) {}
+    void on_delete(boost::string_view) {}
+    void on_moved_from(boost::string_view, boost::string_view) {}
+    void on_moved_to(boost::string_view, boost::string_view) {}
+    void on_create_path(boost::string_view, boost::string_view) {}
+    void on_remove_path(boost::string_view, boost::string_view) {}
+    void on_disposed(boost::string_view) {}
+    void on_overflow() {}
     void on_error(boost::system::error_code const &) {}
 
 private:
     descriptor_type fd_;
-    std::array<char, 4096> buffer_;
-    boost::container::flat_map<int, std::string> files_;
+    timer_type timer_;
+    std::vector<char> buffer_;
+    boost::container::flat_map<int, watch_type> files_;
+    std::vector<pending_type> pending_;
+    std::vector<pending_type> flushing_;
+    std::string names_;
+    std::string flushing_names_;
+    std::vector<std::size_t> index_;
+    duration window_ = duration::zero();
     std::mutex mutex_;
 };
 
@@ -0,0 +1,39 @@
+/*!
+  acqua library
+
+  Copyright (c) 2016 Haruhiko Uchida
+  The software is released under the MIT license.
+  http://opensource.org/licenses/mit-license.php
+ */
+
+#pragma once
+
+#include <utility>
+
+namespace acqua { namespace asio { namespace netlink { namespace detail {
+
+/*!
+  Derived が省略可能なコールバックを定義していれば呼び出し、定義していなければ何もしない関数を定義する.
+ */
+#define ACQUA_ASIO_NETLINK_OPTIONAL_CALLBACK(name)                      \
+    template <typename T, typename... Args>                             \
+    inline auto call_ ## name(T & t, int, Args &&... args)              \
+        -> decltype(t.name(std::forward<Args>(args)...), void())        \
+    {                                                                   \
+        t.name(std::forward<Args>(args)...);                            \
+    }                                                                   \
+    template <typename T, typename... Args>                             \
+    inline void call_ ## name(T &, long, Args &&...)                    \
+    {                                                                   \
+    }
+
+ACQUA_ASIO_NETLINK_OPTIONAL_CALLBACK(on_link_removed)
+ACQUA_ASIO_NETLINK_OPTIONAL_CALLBACK(on_ifaddr_removed)
+ACQUA_ASIO_NETLINK_OPTIONAL_CALLBACK(on_neighbor_removed)
+ACQUA_ASIO_NETLINK_OPTIONAL_CALLBACK(on_resync)
+ACQUA_ASIO_NETLINK_OPTIONAL_CALLBACK(on_dump_done)
+ACQUA_ASIO_NETLINK_OPTIONAL_CALLBACK(on_dispatched)
+
+#undef ACQUA_ASIO_NETLINK_OPTIONAL_CALLBACK
+
+} } } }
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <acqua/asio/netlink/categories.hpp>
+#include <acqua/asio/netlink/detail/callback.hpp>
 #include <acqua/network/internet4_address.hpp>
 #include <acqua/network/internet6_address.hpp>
 
@@ -15,17 +16,17 @@ protected:
     template <typename Tag, typename std::enable_if<(std::is_base_of<ifaddr_v4_tag, Tag>::value || std::is_base_of<ifaddr_v6_tag, Tag>::value)>::type * = nullptr>
     void dispatch_ifaddr(Tag, struct nlmsghdr * nlmsg)
     {
-        if (nlmsg->nlmsg_type != RTM_NEWADDR)
+        if (nlmsg->nlmsg_type != RTM_NEWADDR && nlmsg->nlmsg_type != RTM_DELADDR)
             return;
 
         auto ifa = reinterpret_cast<struct ::ifaddrmsg *>(NLMSG_DATA(nlmsg));
         std::size_t len = RTM_PAYLOAD(nlmsg);
         switch(ifa->ifa_family) {
             case AF_INET:
-                dispatch_ifaddr_v4(Tag(), ifa, len);
+                dispatch_ifaddr_v4(Tag(), ifa, len, nlmsg->nlmsg_type == RTM_DELADDR);
                 break;
             case AF_INET6:
-                dispatch_ifaddr_v6(Tag(), ifa, len);
+                dispatch_ifaddr_v6(Tag(), ifa, len, nlmsg->nlmsg_type == RTM_DELADDR);
                 break;
         }
     }
@@ -34,7 +35,7 @@ protected:
     void dispatch_ifaddr(Tag, struct nlmsghdr *) {}
 
     template <typename Tag, typename std::enable_if<std::is_base_of<ifaddr_v4_tag, Tag>::value>::type * = nullptr>
-    void dispatch_ifaddr_v4(Tag, struct ifaddrmsg * ifa, std::size_t len)
+    void dispatch_ifaddr_v4(Tag, struct ifaddrmsg * ifa, std::size_t len, bool removed)
     {
         acqua::network::internet4_address addr;
         std::string label;
@@ -56,14 +57,17 @@ protected:
         }
 
 #pragma GCC diagnostic pop
-        static_cast<Derived *>(this)->on_ifaddr(addr, label, prefixlen, flags);
+        if (removed)
+            detail::call_on_ifaddr_removed(*static_cast<Derived *>(this), 0, addr, label, prefixlen, flags);
+        else
+            static_cast<Derived *>(this)->on_ifaddr(addr, label, prefixlen, flags);
     }
 
     template <typename Tag, typename std::enable_if<!std::is_base_of<ifaddr_v4_tag, Tag>::value>::type * = nullptr>
-    void dispatch_ifaddr_v4(Tag, struct ifaddrmsg *, std::size_t) {}
+    void dispatch_ifaddr_v4(Tag, struct ifaddrmsg *, std::size_t, bool) {}
 
     template <typename Tag, typename std::enable_if<std::is_base_of<ifaddr_v6_tag, Tag>::value>::type * = nullptr>
-    void dispatch_ifaddr_v6(Tag, struct ifaddrmsg * ifa, std::size_t len)
+    void dispatch_ifaddr_v6(Tag, struct ifaddrmsg * ifa, std::size_t len, bool removed)
     {
         acqua::network::internet6_address addr;
         std::string label;
@@ -85,11 +89,14 @@ protected:
         }
 
 #pragma GCC diagnostic pop
-        static_cast<Derived *>(this)->on_ifaddr(addr, label, prefixlen, flags);
+        if (removed)
+            detail::call_on_ifaddr_removed(*static_cast<Derived *>(this), 0, addr, label, prefixlen, flags);
+        else
+            static_cast<Derived *>(this)->on_ifaddr(addr, label, prefixlen, flags);
     }
 
     template <typename Tag, typename std::enable_if<!std::is_base_of<ifaddr_v6_tag, Tag>::value>::type * = nullptr>
-    void dispatch_ifaddr_v6(Tag, struct ifaddrmsg *, std::size_t) {}
+    void dispatch_ifaddr_v6(Tag, struct ifaddrmsg *, std::size_t, bool) {}
 };
 
 } } }
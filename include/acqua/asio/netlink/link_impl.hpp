@@ -5,6 +5,7 @@ extern "C" {
 }
 
 #include <acqua/asio/netlink/categories.hpp>
+#include <acqua/asio/netlink/detail/callback.hpp>
 #include <acqua/network/linklayer_address.hpp>
 
 namespace acqua { namespace asio { namespace netlink {
@@ -18,7 +19,7 @@ protected:
     template <typename Tag, typename std::enable_if<(std::is_base_of<link_tag, Tag>::value || std::is_base_of<stats_tag, Tag>::value)>::type * = nullptr>
     void dispatch_link(Tag, struct nlmsghdr * nlmsg)
     {
-        if (nlmsg->nlmsg_type != RTM_NEWLINK)
+        if (nlmsg->nlmsg_type != RTM_NEWLINK && nlmsg->nlmsg_type != RTM_DELLINK)
             return;
 
 #pragma GCC diagnostic push
@@ -28,7 +29,7 @@ protected:
         std::size_t len = RTM_PAYLOAD(nlmsg);
         switch(ifi->ifi_family) {
             case AF_UNSPEC:
-                dispatch_link_unspec(Tag(), ifi, len);
+                dispatch_link_unspec(Tag(), ifi, len, nlmsg->nlmsg_type == RTM_DELLINK);
                 break;
         }
 
@@ -39,7 +40,7 @@ protected:
     void dispatch_link(Tag, struct nlmsghdr *) {}
 
     template <typename Tag>
-    void dispatch_link_unspec(Tag, struct ifinfomsg * ifi, std::size_t len)
+    void dispatch_link_unspec(Tag, struct ifinfomsg * ifi, std::size_t len, bool removed)
     {
         int type = ifi->ifi_type;
         uint flags = ifi->ifi_flags;
@@ -67,6 +68,10 @@ protected:
         }
 
 #pragma GCC diagnostic pop
+        if (removed) {
+            dispatch_link_removed(Tag(), ifname, addr, type, flags);
+            return;
+        }
         dispatch_link_changed(Tag(), ifname, addr, type, flags);
         dispatch_link_stats(Tag(), ifname, stats, type, flags);
     }
@@ -80,6 +85,15 @@ protected:
     template <typename Tag, typename std::enable_if<!std::is_base_of<link_tag, Tag>::value>::type * = nullptr>
     void dispatch_link_changed(Tag, std::string, acqua::network::linklayer_address, int, uint) {}
 
+    template <typename Tag, typename std::enable_if<std::is_base_of<link_tag, Tag>::value>::type * = nullptr>
+    void dispatch_link_removed(Tag, std::string const & ifname, acqua::network::linklayer_address const & addr, int type, uint flags)
+    {
+        detail::call_on_link_removed(*static_cast<Derived *>(this), 0, ifname, addr, type, flags);
+    }
+
+    template <typename Tag, typename std::enable_if<!std::is_base_of<link_tag, Tag>::value>::type * = nullptr>
+    void dispatch_link_removed(Tag, std::string, acqua::network::linklayer_address, int, uint) {}
+
     template <typename Tag, typename std::enable_if<std::is_base_of<stats_tag, Tag>::value>::type * = nullptr>
     void dispatch_link_stats(Tag, std::string const & ifname, struct ::rtnl_link_stats * stats, int type, uint flags)
     {
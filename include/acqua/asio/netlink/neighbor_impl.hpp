@@ -4,6 +4,7 @@
 #include <acqua/network/internet4_address.hpp>
 #include <acqua/network/internet6_address.hpp>
 #include <acqua/asio/netlink/categories.hpp>
+#include <acqua/asio/netlink/detail/callback.hpp>
 
 namespace acqua { namespace asio { namespace netlink {
 
@@ -16,7 +17,7 @@ protected:
     template <typename Tag, typename std::enable_if<(std::is_base_of<neighbor_v4_tag, Tag>::value || std::is_base_of<neighbor_v6_tag, Tag>::value)>::type * = nullptr>
     void dispatch_neighbor(Tag, struct nlmsghdr * nlmsg)
     {
-        if (nlmsg->nlmsg_type != RTM_NEWNEIGH)
+        if (nlmsg->nlmsg_type != RTM_NEWNEIGH && nlmsg->nlmsg_type != RTM_DELNEIGH)
             return;
 
 #pragma GCC diagnostic push
@@ -26,10 +27,10 @@ protected:
         std::size_t len = RTM_PAYLOAD(nlmsg);
         switch(ndm->ndm_family) {
             case AF_INET:
-                dispatch_neighbor_v4(Tag(), ndm, len);
+                dispatch_neighbor_v4(Tag(), ndm, len, nlmsg->nlmsg_type == RTM_DELNEIGH);
                 break;
             case AF_INET6:
-                dispatch_neighbor_v6(Tag(), ndm, len);
+                dispatch_neighbor_v6(Tag(), ndm, len, nlmsg->nlmsg_type == RTM_DELNEIGH);
                 break;
         }
 
@@ -40,7 +41,7 @@ protected:
     void dispatch_neighbor(Tag, struct nlmsghdr *) {}
 
     template <typename Tag, typename std::enable_if<std::is_base_of<neighbor_v4_tag, Tag>::value>::type * = nullptr>
-    void dispatch_neighbor_v4(Tag, struct ndmsg * ndm, std::size_t len)
+    void dispatch_neighbor_v4(Tag, struct ndmsg * ndm, std::size_t len, bool removed)
     {
         acqua::network::linklayer_address ll_addr;
         acqua::network::internet4_address in_addr;
@@ -62,14 +63,17 @@ protected:
         }
 
 #pragma GCC diagnostic pop
-        static_cast<Derived *>(this)->on_neighbor(in_addr, ll_addr, state);
+        if (removed)
+            detail::call_on_neighbor_removed(*static_cast<Derived *>(this), 0, in_addr, ll_addr, state);
+        else
+            static_cast<Derived *>(this)->on_neighbor(in_addr, ll_addr, state);
     }
 
     template <typename Tag, typename std::enable_if<!std::is_base_of<neighbor_v4_tag, Tag>::value>::type * = nullptr>
-    void dispatch_neighbor_v4(Tag, struct ndmsg *, std::size_t) {}
+    void dispatch_neighbor_v4(Tag, struct ndmsg *, std::size_t, bool) {}
 
     template <typename Tag, typename std::enable_if<std::is_base_of<neighbor_v6_tag, Tag>::value>::type * = nullptr>
-    void dispatch_neighbor_v6(Tag, struct ndmsg * ndm, std::size_t len)
+    void dispatch_neighbor_v6(Tag, struct ndmsg * ndm, std::size_t len, bool removed)
     {
         acqua::network::linklayer_address ll_addr;
         acqua::network::internet6_address in_addr;
@@ -91,32 +95,14 @@ protected:
         }
 
 #pragma GCC diagnostic pop
-        static_cast<Derived *>(this)->on_neighbor(in_addr, ll_addr, state);
+        if (removed)
+            detail::call_on_neighbor_removed(*static_cast<Derived *>(this), 0, in_addr, ll_addr, state);
+        else
+            static_cast<Derived *>(this)->on_neighbor(in_addr, ll_addr, state);
     }
 
     template <typename Tag, typename std::enable_if<!std::is_base_of<neighbor_v6_tag, Tag>::value>::type * = nullptr>
-    void dispatch_neighbor_v6(Tag, struct ndmsg *, std::size_t) {}
-
-// public:
-//     void get_neighbor_v4(boost::system::error_code & ec)
-//     {
-//         struct {
-//             struct ::nlmsghdr nlmsg;
-//             struct ::ndmsg ndm;
-//         } sendbuf;
-//         std::memset(&sendbuf, 0, sizeof(sendbuf));
-//         sendbuf.nlmsg.nlmsg_len = sizeof(sendbuf);
-//         sendbuf.nlmsg.nlmsg_pid = 0;
-//         sendbuf.nlmsg.nlmsg_seq = 0;
-//         sendbuf.nlmsg.nlmsg_flags = NLM_F_REQUEST;
-//         sendbuf.nlmsg.nlmsg_type = RTM_GETNEIGH;
-//         sendbuf.ndm.ndm_family = AF_INET;
-
-//         struct sockaddr_nl nl;
-//         std::memset(&nl, 0, sizeof(nl));
-//         nl.nl_family = AF_NETLINK;
-//         socket_.send_to(boost::asio::buffer(&sendbuf, sizeof(sendbuf)), endpoint_type(&nl, sizeof(nl)), 0, ec);
-//     }
+    void dispatch_neighbor_v6(Tag, struct ndmsg *, std::size_t, bool) {}
 };
 
 } } }
@@ -14,17 +14,36 @@ extern "C" {
 #include <sys/socket.h>
 }
 
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <vector>
 #include <type_traits>
 #include <functional>
 #include <boost/system/error_code.hpp>
+#include <boost/asio/io_service.hpp>
 #include <boost/asio/generic/raw_protocol.hpp>
 #include <acqua/asio/netlink/categories.hpp>
+#include <acqua/asio/netlink/detail/callback.hpp>
 #include <acqua/asio/netlink/link_impl.hpp>
 #include <acqua/asio/netlink/ifaddr_impl.hpp>
 #include <acqua/asio/netlink/neighbor_impl.hpp>
 
 namespace acqua { namespace asio { namespace netlink {
 
+/*!
+  NETLINK_ROUTE のイベントを Derived のコールバックに通知するクラス.
+
+  Derived::category に含まれるタグのマルチキャストグループを購読する。
+  dump() を呼ぶと、購読しているテーブルの全エントリを同じコールバックで通知するので、初期状態の構築に使える。
+  受信バッファが溢れた (ENOBUFS) 場合は、on_resync() を通知して自動的に dump() をやり直す。
+
+  以下のコールバックは、Derived で定義されていれば呼び出される。
+  - on_link_removed, on_ifaddr_removed, on_neighbor_removed : エントリの削除
+  - on_resync() : イベントの取りこぼしが発生し、dump をやり直す直前
+  - on_dump_done() : 要求したすべての dump が完了した
+  - on_dispatched() : 受信済みのメッセージをすべて通知し終えた
+ */
 template <typename Derived>
 class netlink_listener
     : private link_impl<Derived>, private ifaddr_impl<Derived>, private neighbor_impl<Derived>
@@ -43,13 +62,31 @@ protected:
 
     ~netlink_listener() = default;
 
+    //! コールバック中に、通知の元になったメッセージを返す.
+    struct ::nlmsghdr const * message() const noexcept
+    {
+        return nlmsg_;
+    }
+
 public:
     explicit netlink_listener(boost::asio::io_service & io_service)
-        : socket_(io_service) {}
+        : socket_(io_service), buffer_(initial_buffer_size) {}
 
     void open(boost::system::error_code & ec)
     {
         socket_.open(protocol_type(AF_NETLINK, NETLINK_ROUTE), ec);
+        if (ec) return;
+
+        // ソケットバッファはベストエフォートで拡張する (権限がなければ SO_RCVBUF の上限まで)
+        int size = static_cast<int>(rcvbuf_size_);
+        if (::setsockopt(socket_.native_handle(), SOL_SOCKET, SO_RCVBUFFORCE, &size, sizeof(size)) != 0)
+            ::setsockopt(socket_.native_handle(), SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    }
+
+    //! open() 時に設定するソケットの受信バッファサイズを変更する.
+    void receive_buffer_size(std::size_t size) noexcept
+    {
+        rcvbuf_size_ = size;
     }
 
     void bind(boost::system::error_code & ec)
@@ -86,57 +123,230 @@ public:
         boost::asio::detail::throw_error(ec);
     }
 
+    /*!
+      購読しているテーブルの全エントリを要求する.
+      結果は通常のイベントと同じコールバックで通知され、すべて完了すると on_dump_done() が呼ばれる
+     */
+    void dump(boost::system::error_code & ec)
+    {
+        bool idle = dumps_.empty();
+        queue_dumps();
+
+        // カーネルは1つのソケットで同時に1つの dump しか処理しないので、前の dump が終わってから次を送る
+        if (idle && !dumps_.empty())
+            send_dump(ec);
+    }
+
+    void dump()
+    {
+        boost::system::error_code ec;
+        dump(ec);
+        boost::asio::detail::throw_error(ec);
+    }
+
     void close(boost::system::error_code & ec)
     {
+        dumps_.clear();
         socket_.close(ec);
     }
 
     void close()
     {
         boost::system::error_code ec;
-        socket_.close();
+        close(ec);
         boost::asio::detail::throw_error(ec);
     }
 
 private:
+    static const std::size_t initial_buffer_size = 32768;
+    static const std::size_t default_rcvbuf_size = 4 * 1024 * 1024;
+
+    struct dump_request
+    {
+        std::uint16_t type_;
+        std::uint8_t family_;
+        bool interrupted_;
+    };
+
     void async_receive()
     {
-        socket_.async_receive(boost::asio::buffer(buffer_), std::bind(&netlink_listener::dispatch, this, std::placeholders::_1, std::placeholders::_2));
+        socket_.async_receive(boost::asio::null_buffers(), std::bind(&netlink_listener::dispatch, this, std::placeholders::_1, std::placeholders::_2));
     }
 
-    void dispatch(boost::system::error_code const & error, std::size_t size)
+    void dispatch(boost::system::error_code const & error, std::size_t)
     {
         if (error) {
-            on_error(error);
+            static_cast<Derived *>(this)->on_error(error);
             return;
         }
 
+        // 読み込めるデータグラムをまとめて処理する. コールバックから close() されたら止める
+        while(socket_.is_open()) {
+            ssize_t res = ::recv(socket_.native_handle(), buffer_.data(), buffer_.size(), MSG_DONTWAIT | MSG_TRUNC);
+            if (res < 0) {
+                if (errno == EINTR)
+                    continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK)
+                    break;
+                if (errno == ENOBUFS) {
+                    resync();
+                    continue;
+                }
+                static_cast<Derived *>(this)->on_error(boost::system::error_code(errno, boost::system::generic_category()));
+                return;
+            }
+
+            std::size_t size = static_cast<std::size_t>(res);
+            if (size > buffer_.size()) {
+                // データグラムが切り詰められたので、バッファを拡張して取りこぼした分を取り直す
+                buffer_.resize(size);
+                resync();
+                continue;
+            }
+
+            dispatch_messages(size);
+        }
+
+        detail::call_on_dispatched(*static_cast<Derived *>(this), 0);
+        if (socket_.is_open())
+            async_receive();
+    }
+
+    void dispatch_messages(std::size_t size)
+    {
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wcast-align"
 
         for(auto * nlmsg = reinterpret_cast<struct ::nlmsghdr *>(buffer_.data());
             NLMSG_OK(nlmsg, size); nlmsg = NLMSG_NEXT(nlmsg, size)) {
+            bool is_dump = !dumps_.empty() && nlmsg->nlmsg_seq == seq_ && nlmsg->nlmsg_pid != 0;
             if (nlmsg->nlmsg_type == NLMSG_DONE || nlmsg->nlmsg_type == NLMSG_ERROR) {
+                if (is_dump)
+                    finish_dump();
                 break;
             }
 
+            if (is_dump && (nlmsg->nlmsg_flags & NLM_F_DUMP_INTR))
+                dumps_.front().interrupted_ = true;
+
+            nlmsg_ = nlmsg;
             this->dispatch_link(typename Derived::category(), nlmsg);
             this->dispatch_ifaddr(typename Derived::category(), nlmsg);
             this->dispatch_neighbor(typename Derived::category(), nlmsg);
+            if (!socket_.is_open())
+                break;
         }
+        nlmsg_ = nullptr;
 
 #pragma GCC diagnostic pop
-        async_receive();
     }
 
+    void queue_dumps()
+    {
+        if (has_group<link_tag>() || has_group<stats_tag>())
+            dumps_.push_back(dump_request{RTM_GETLINK, AF_UNSPEC, false});
+        if (has_group<ifaddr_v4_tag>())
+            dumps_.push_back(dump_request{RTM_GETADDR, AF_INET, false});
+        if (has_group<ifaddr_v6_tag>())
+            dumps_.push_back(dump_request{RTM_GETADDR, AF_INET6, false});
+        if (has_group<neighbor_v4_tag>())
+            dumps_.push_back(dump_request{RTM_GETNEIGH, AF_INET, false});
+        if (has_group<neighbor_v6_tag>())
+            dumps_.push_back(dump_request{RTM_GETNEIGH, AF_INET6, false});
+    }
+
+    void send_dump(boost::system::error_code & ec)
+    {
+        struct {
+            struct ::nlmsghdr nlmsg;
+            union {
+                struct ::ifinfomsg ifi;
+                struct ::ifaddrmsg ifa;
+                struct ::ndmsg ndm;
+            };
+        } sendbuf;
+        std::memset(&sendbuf, 0, sizeof(sendbuf));
+
+        auto const & req = dumps_.front();
+        std::size_t len;
+        switch(req.type_) {
+            case RTM_GETLINK:
+                sendbuf.ifi.ifi_family = req.family_;
+                len = NLMSG_LENGTH(sizeof(sendbuf.ifi));
+                break;
+            case RTM_GETADDR:
+                sendbuf.ifa.ifa_family = req.family_;
+                len = NLMSG_LENGTH(sizeof(sendbuf.ifa));
+                break;
+            default:
+                sendbuf.ndm.ndm_family = req.family_;
+                len = NLMSG_LENGTH(sizeof(sendbuf.ndm));
+                break;
+        }
+        sendbuf.nlmsg.nlmsg_len = static_cast<std::uint32_t>(len);
+        sendbuf.nlmsg.nlmsg_type = req.type_;
+        sendbuf.nlmsg.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+        sendbuf.nlmsg.nlmsg_seq = ++seq_;
+
+        struct sockaddr_nl nl;
+        std::memset(&nl, 0, sizeof(nl));
+        nl.nl_family = AF_NETLINK;
+        socket_.send_to(boost::asio::buffer(&sendbuf, len), endpoint_type(&nl, sizeof(nl)), 0, ec);
+    }
+
+    void finish_dump()
+    {
+        // 途中でテーブルが変更された dump は、一貫性がないのでやり直す
+        if (dumps_.front().interrupted_) {
+            dumps_.front().interrupted_ = false;
+            dumps_.push_back(dumps_.front());
+        }
+        dumps_.pop_front();
+
+        boost::system::error_code ec;
+        if (!dumps_.empty()) {
+            send_dump(ec);
+            if (ec) static_cast<Derived *>(this)->on_error(ec);
+        } else {
+            detail::call_on_dump_done(*static_cast<Derived *>(this), 0);
+        }
+    }
+
+    void resync()
+    {
+        detail::call_on_resync(*static_cast<Derived *>(this), 0);
+        if (!socket_.is_open())
+            return;
+
+        // dump の応答は読み込みに合わせて生成されるので溢れない。実行中の dump は完了を待ってからやり直す
+        if (!dumps_.empty()) {
+            dumps_.erase(dumps_.begin() + 1, dumps_.end());
+            dumps_.front().interrupted_ = false;
+            queue_dumps();
+            return;
+        }
+
+        boost::system::error_code ec;
+        dump(ec);
+        if (ec) static_cast<Derived *>(this)->on_error(ec);
+    }
+
+    template <typename Tag>
+    static bool has_group() { return std::is_base_of<Tag, typename Derived::category>::value; }
+
     template <typename Tag, typename T>
     static uint find_group(T) { return std::is_base_of<Tag, T>::value ? Tag::group : 0; }
 
+    //! Derived が on_error を定義すると、受信や dump の要求のエラーを受け取れる
     void on_error(boost::system::error_code const &) {}
 
 private:
     socket_type socket_;
-    std::array<char, 4096> buffer_;
+    std::vector<char> buffer_;
+    std::size_t rcvbuf_size_ = default_rcvbuf_size;
+    std::deque<dump_request> dumps_;
+    std::uint32_t seq_ = 0;
+    struct ::nlmsghdr const * nlmsg_ = nullptr;
 };
 
 } } }
@@ -0,0 +1,456 @@
+/*!
+  acqua library
+
+  Copyright (c) 2016 Haruhiko Uchida
+  The software is released under the MIT license.
+  http://opensource.org/licenses/mit-license.php
+ */
+
+#pragma once
+
+#include <memory>
+#include <atomic>
+#include <string>
+#include <limits>
+#include <cstdint>
+#include <utility>
+#include <algorithm>
+#include <boost/container/flat_map.hpp>
+#include <boost/container/flat_set.hpp>
+#include <acqua/asio/netlink/netlink_listener.hpp>
+
+namespace acqua { namespace asio { namespace netlink {
+
+/*!
+  netlink のイベントから、インタフェース、アドレス、近隣キャッシュのテーブルを保持するクラス.
+
+  更新は io_service のスレッドで行い、受信したメッセージを処理し終えるたびに新しい snapshot をポインタの差し替えで公開する。
+  テーブルは公開した snapshot と共有し、公開後に最初に変更するときにだけコピーする (コピーオンライト)。
+  変更のないテーブルは前の snapshot と共有したままになる。
+  get() で取得した snapshot は変更されないので、保持している間はロックもシステムコールもなしで参照できる。
+  get() 自体は std::atomic_load を用いるため、libstdc++ などでは内部の mutex を短時間取る。
+  頻繁に参照するスレッドは reader を持ち、公開された version() が変わったときだけ get() し直すこと。
+  dump の途中は一貫性がないので、dump が完了するまで公開しない。
+ */
+class netlink_table
+    : public netlink_listener<netlink_table>
+{
+public:
+    struct category
+        : link_tag, ifaddr_tag, neighbor_tag
+    {};
+
+    struct link_type
+    {
+        std::string name_;
+        acqua::network::linklayer_address address_;
+        int type_;
+        uint flags_;
+    };
+
+    class snapshot
+    {
+        friend netlink_table;
+
+    public:
+        using link_map = boost::container::flat_map<int, link_type>;
+
+        //! (アドレス, インタフェースの index 番号) の組. 同じアドレスを複数のインタフェースが持てる
+        template <typename Address>
+        using address_set = boost::container::flat_set<std::pair<Address, int> >;
+
+        //! (アドレス, インタフェースの index 番号) から物理アドレスを引く近隣キャッシュ
+        template <typename Address>
+        using neighbor_map = boost::container::flat_map<std::pair<Address, int>, acqua::network::linklayer_address>;
+
+        //! インタフェースを index 番号で検索する. 見つからなければ nullptr を返す
+        link_type const * link(int index) const noexcept
+        {
+            auto it = links_->find(index);
+            return it != links_->end() ? &it->second : nullptr;
+        }
+
+        //! インタフェースを名前で検索して、index 番号を返す. 見つからなければ 0 を返す
+        int index(std::string const & name) const noexcept
+        {
+            for(auto const & e : *links_)
+                if (e.second.name_ == name)
+                    return e.first;
+            return 0;
+        }
+
+        //! アドレスを持つインタフェースの index 番号を返す. 複数あれば最も小さい番号を、見つからなければ 0 を返す
+        int owner(acqua::network::internet4_address const & addr) const noexcept
+        {
+            return find_owner(*addrs_v4_, addr);
+        }
+
+        int owner(acqua::network::internet6_address const & addr) const noexcept
+        {
+            return find_owner(*addrs_v6_, addr);
+        }
+
+        //! 近隣キャッシュから物理アドレスを検索する. 複数のインタフェースにあれば最も小さい番号のものを、見つからなければ nullptr を返す
+        acqua::network::linklayer_address const * neighbor(acqua::network::internet4_address const & addr) const noexcept
+        {
+            return find_neighbor(*neighbors_v4_, addr);
+        }
+
+        acqua::network::linklayer_address const * neighbor(acqua::network::internet6_address const & addr) const noexcept
+        {
+            return find_neighbor(*neighbors_v6_, addr);
+        }
+
+        //! インタフェース index の近隣キャッシュから物理アドレスを検索する. 見つからなければ nullptr を返す
+        acqua::network::linklayer_address const * neighbor(acqua::network::internet4_address const & addr, int index) const noexcept
+        {
+            return find_neighbor(*neighbors_v4_, addr, index);
+        }
+
+        acqua::network::linklayer_address const * neighbor(acqua::network::internet6_address const & addr, int index) const noexcept
+        {
+            return find_neighbor(*neighbors_v6_, addr, index);
+        }
+
+        link_map const & links() const noexcept
+        {
+            return *links_;
+        }
+
+        address_set<acqua::network::internet4_address> const & addresses_v4() const noexcept
+        {
+            return *addrs_v4_;
+        }
+
+        address_set<acqua::network::internet6_address> const & addresses_v6() const noexcept
+        {
+            return *addrs_v6_;
+        }
+
+        neighbor_map<acqua::network::internet4_address> const & neighbors_v4() const noexcept
+        {
+            return *neighbors_v4_;
+        }
+
+        neighbor_map<acqua::network::internet6_address> const & neighbors_v6() const noexcept
+        {
+            return *neighbors_v6_;
+        }
+
+        //! 公開された順番を返す. 最初の snapshot は 0
+        std::uint64_t version() const noexcept
+        {
+            return version_;
+        }
+
+    private:
+        //! Table の中で、キーのアドレスが addr である最初の要素を返す
+        template <typename Table, typename Address>
+        static typename Table::const_iterator find_first(Table const & table, Address const & addr) noexcept
+        {
+            auto it = table.lower_bound(typename Table::key_type(addr, std::numeric_limits<int>::min()));
+            return (it != table.end() && key_of(*it).first == addr) ? it : table.end();
+        }
+
+        template <typename Address>
+        static std::pair<Address, int> const & key_of(std::pair<Address, int> const & key) noexcept
+        {
+            return key;
+        }
+
+        template <typename Key, typename Value>
+        static Key const & key_of(std::pair<Key, Value> const & value) noexcept
+        {
+            return value.first;
+        }
+
+        template <typename Set, typename Address>
+        static int find_owner(Set const & set, Address const & addr) noexcept
+        {
+            auto it = find_first(set, addr);
+            return it != set.end() ? it->second : 0;
+        }
+
+        template <typename Map, typename Address>
+        static acqua::network::linklayer_address const * find_neighbor(Map const & map, Address const & addr) noexcept
+        {
+            auto it = find_first(map, addr);
+            return it != map.end() ? &it->second : nullptr;
+        }
+
+        template <typename Map, typename Address>
+        static acqua::network::linklayer_address const * find_neighbor(Map const & map, Address const & addr, int index) noexcept
+        {
+            auto it = map.find(std::make_pair(addr, index));
+            return it != map.end() ? &it->second : nullptr;
+        }
+
+    private:
+        std::shared_ptr<link_map const> links_ = std::make_shared<link_map const>();
+        std::shared_ptr<address_set<acqua::network::internet4_address> const> addrs_v4_ = std::make_shared<address_set<acqua::network::internet4_address> const>();
+        std::shared_ptr<address_set<acqua::network::internet6_address> const> addrs_v6_ = std::make_shared<address_set<acqua::network::internet6_address> const>();
+        std::shared_ptr<neighbor_map<acqua::network::internet4_address> const> neighbors_v4_ = std::make_shared<neighbor_map<acqua::network::internet4_address> const>();
+        std::shared_ptr<neighbor_map<acqua::network::internet6_address> const> neighbors_v6_ = std::make_shared<neighbor_map<acqua::network::internet6_address> const>();
+        std::uint64_t version_ = 0;
+    };
+
+    /*!
+      1つのスレッドから繰り返し参照するための、snapshot を保持するクラス.
+
+      get() は保持している snapshot の version() が table の version() と同じであれば、それをそのまま返す。
+      比較はアトミック変数の読み込みだけなので、公開がなければロックを取らない。
+      スレッド間で共有してはいけない
+     */
+    class reader
+    {
+    public:
+        explicit reader(netlink_table const & table)
+            : table_(table), snapshot_(table.get()) {}
+
+        std::shared_ptr<snapshot const> const & get()
+        {
+            if (snapshot_->version() != table_.version())
+                snapshot_ = table_.get();
+            return snapshot_;
+        }
+
+        snapshot const & operator*()
+        {
+            return *get();
+        }
+
+        snapshot const * operator->()
+        {
+            return get().get();
+        }
+
+    private:
+        netlink_table const & table_;
+        std::shared_ptr<snapshot const> snapshot_;
+    };
+
+public:
+    explicit netlink_table(boost::asio::io_service & io_service)
+        : base_type(io_service)
+        , current_(std::make_shared<snapshot const>())
+    {
+    }
+
+    //! イベントの受信を開始して、初期状態の dump を要求する.
+    void start(boost::system::error_code & ec)
+    {
+        base_type::start(ec);
+        if (ec) return;
+        syncing_ = true;
+        base_type::dump(ec);
+    }
+
+    void start()
+    {
+        boost::system::error_code ec;
+        start(ec);
+        boost::asio::detail::throw_error(ec);
+    }
+
+    //! 最新の snapshot を返す. 任意のスレッドから呼び出せる
+    std::shared_ptr<snapshot const> get() const noexcept
+    {
+        return std::atomic_load_explicit(&current_, std::memory_order_acquire);
+    }
+
+    //! 最新の snapshot の version() を返す. ロックを取らないので、保持している snapshot が古いかどうかの確認に使う
+    std::uint64_t version() const noexcept
+    {
+        return version_.load(std::memory_order_acquire);
+    }
+
+public:
+    // 以下は netlink_listener からのコールバック
+
+    void on_link(std::string const & ifname, acqua::network::linklayer_address const & addr, int type, uint flags)
+    {
+        modify(work_.links_, dirty_links)[link_index()] = link_type{ifname, addr, type, flags};
+    }
+
+    void on_link_removed(std::string const &, acqua::network::linklayer_address const &, int, uint)
+    {
+        int index = link_index();
+        modify(work_.links_, dirty_links).erase(index);
+        erase_owned(work_.addrs_v4_, dirty_addrs_v4, index);
+        erase_owned(work_.addrs_v6_, dirty_addrs_v6, index);
+        erase_owned(work_.neighbors_v4_, dirty_neighbors_v4, index);
+        erase_owned(work_.neighbors_v6_, dirty_neighbors_v6, index);
+    }
+
+    void on_ifaddr(acqua::network::internet4_address const & addr, std::string const &, uint, uint)
+    {
+        modify(work_.addrs_v4_, dirty_addrs_v4).emplace(addr, ifaddr_index());
+    }
+
+    void on_ifaddr(acqua::network::internet6_address const & addr, std::string const &, uint, uint)
+    {
+        modify(work_.addrs_v6_, dirty_addrs_v6).emplace(addr, ifaddr_index());
+    }
+
+    void on_ifaddr_removed(acqua::network::internet4_address const & addr, std::string const &, uint, uint)
+    {
+        modify(work_.addrs_v4_, dirty_addrs_v4).erase(std::make_pair(addr, ifaddr_index()));
+    }
+
+    void on_ifaddr_removed(acqua::network::internet6_address const & addr, std::string const &, uint, uint)
+    {
+        modify(work_.addrs_v6_, dirty_addrs_v6).erase(std::make_pair(addr, ifaddr_index()));
+    }
+
+    void on_neighbor(acqua::network::internet4_address const & addr, acqua::network::linklayer_address const & ll_addr, uint state)
+    {
+        update_neighbor(modify(work_.neighbors_v4_, dirty_neighbors_v4), addr, ll_addr, state);
+    }
+
+    void on_neighbor(acqua::network::internet6_address const & addr, acqua::network::linklayer_address const & ll_addr, uint state)
+    {
+        update_neighbor(modify(work_.neighbors_v6_, dirty_neighbors_v6), addr, ll_addr, state);
+    }
+
+    void on_neighbor_removed(acqua::network::internet4_address const & addr, acqua::network::linklayer_address const &, uint)
+    {
+        modify(work_.neighbors_v4_, dirty_neighbors_v4).erase(std::make_pair(addr, neighbor_index()));
+    }
+
+    void on_neighbor_removed(acqua::network::internet6_address const & addr, acqua::network::linklayer_address const &, uint)
+    {
+        modify(work_.neighbors_v6_, dirty_neighbors_v6).erase(std::make_pair(addr, neighbor_index()));
+    }
+
+    void on_resync()
+    {
+        // 取りこぼした削除を反映できないので、dump で作り直す
+        work_ = tables();
+        dirty_ = dirty_all;
+        syncing_ = true;
+    }
+
+    void on_dump_done()
+    {
+        syncing_ = false;
+        publish();
+    }
+
+    void on_dispatched()
+    {
+        if (!syncing_)
+            publish();
+    }
+
+private:
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wcast-align"
+
+    int link_index() const noexcept
+    {
+        return reinterpret_cast<struct ::ifinfomsg const *>(NLMSG_DATA(message()))->ifi_index;
+    }
+
+    int ifaddr_index() const noexcept
+    {
+        return static_cast<int>(reinterpret_cast<struct ::ifaddrmsg const *>(NLMSG_DATA(message()))->ifa_index);
+    }
+
+    int neighbor_index() const noexcept
+    {
+        return reinterpret_cast<struct ::ndmsg const *>(NLMSG_DATA(message()))->ndm_ifindex;
+    }
+
+#pragma GCC diagnostic pop
+
+    /*!
+      作業用のテーブルを変更のために返す.
+      公開した snapshot と共有しているテーブルは、公開後に最初に変更するときにコピーする
+     */
+    template <typename Table>
+    Table & modify(std::shared_ptr<Table> & table, unsigned int flag)
+    {
+        if (!(dirty_ & flag)) {
+            table = std::make_shared<Table>(*table);
+            dirty_ |= flag;
+        }
+        return *table;
+    }
+
+    //! インタフェース index に属する要素を取り除く. なければコピーしない
+    template <typename Table>
+    void erase_owned(std::shared_ptr<Table> & table, unsigned int flag, int index)
+    {
+        auto owned = [index](typename Table::value_type const & e) { return snapshot::key_of(e).second == index; };
+        if (std::none_of(table->begin(), table->end(), owned))
+            return;
+        Table & t = modify(table, flag);
+        for(auto it = t.begin(); it != t.end();) {
+            if (owned(*it))
+                it = t.erase(it);
+            else
+                ++it;
+        }
+    }
+
+    template <typename Map, typename Address>
+    void update_neighbor(Map & map, Address const & addr, acqua::network::linklayer_address const & ll_addr, uint state)
+    {
+        auto key = std::make_pair(addr, neighbor_index());
+        // 解決に失敗したエントリや、まだ解決していないエントリは保持しない
+        if ((state & (NUD_FAILED | NUD_INCOMPLETE)) || ll_addr.is_unspecified())
+            map.erase(key);
+        else
+            map[key] = ll_addr;
+    }
+
+    //! 変更のあったテーブルを、新しい snapshot として公開する
+    void publish()
+    {
+        if (!dirty_)
+            return;
+        auto next = std::make_shared<snapshot>(*current_);
+        if (dirty_ & dirty_links)
+            next->links_ = work_.links_;
+        if (dirty_ & dirty_addrs_v4)
+            next->addrs_v4_ = work_.addrs_v4_;
+        if (dirty_ & dirty_addrs_v6)
+            next->addrs_v6_ = work_.addrs_v6_;
+        if (dirty_ & dirty_neighbors_v4)
+            next->neighbors_v4_ = work_.neighbors_v4_;
+        if (dirty_ & dirty_neighbors_v6)
+            next->neighbors_v6_ = work_.neighbors_v6_;
+        next->version_ = current_->version_ + 1;
+        std::atomic_store_explicit(&current_, std::shared_ptr<snapshot const>(std::move(next)), std::memory_order_release);
+        version_.store(current_->version_, std::memory_order_release);
+        dirty_ = 0;
+    }
+
+private:
+    enum : unsigned int {
+        dirty_links = 1 << 0,
+        dirty_addrs_v4 = 1 << 1,
+        dirty_addrs_v6 = 1 << 2,
+        dirty_neighbors_v4 = 1 << 3,
+        dirty_neighbors_v6 = 1 << 4,
+        dirty_all = (1 << 5) - 1,
+    };
+
+    //! 作業用のテーブル. dirty_ の立っていないテーブルは、公開した snapshot と共有している
+    struct tables
+    {
+        std::shared_ptr<snapshot::link_map> links_ = std::make_shared<snapshot::link_map>();
+        std::shared_ptr<snapshot::address_set<acqua::network::internet4_address> > addrs_v4_ = std::make_shared<snapshot::address_set<acqua::network::internet4_address> >();
+        std::shared_ptr<snapshot::address_set<acqua::network::internet6_address> > addrs_v6_ = std::make_shared<snapshot::address_set<acqua::network::internet6_address> >();
+        std::shared_ptr<snapshot::neighbor_map<acqua::network::internet4_address> > neighbors_v4_ = std::make_shared<snapshot::neighbor_map<acqua::network::internet4_address> >();
+        std::shared_ptr<snapshot::neighbor_map<acqua::network::internet6_address> > neighbors_v6_ = std::make_shared<snapshot::neighbor_map<acqua::network::internet6_address> >();
+    };
+
+    std::shared_ptr<snapshot const> current_;
+    std::atomic<std::uint64_t> version_{0};
+    tables work_;
+    bool syncing_ = false;
+    unsigned int dirty_ = 0;
+};
+
+} } }
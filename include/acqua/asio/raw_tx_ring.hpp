@@ -0,0 +1,289 @@
+/*!
+  acqua library
+
+  Copyright (c) 2016 Haruhiko Uchida
+  The software is released under the MIT license.
+  http://opensource.org/licenses/mit-license.php
+ */
+
+#pragma once
+
+extern "C" {
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+}
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <boost/noncopyable.hpp>
+#include <boost/asio/buffer.hpp>
+#include <boost/asio/detail/throw_error.hpp>
+#include <acqua/asio/raw.hpp>
+
+namespace acqua { namespace asio {
+
+namespace detail {
+
+// <linux/if_packet.h> は <netpacket/packet.h> と同時にインクルードできないので、必要な定義だけを持つ
+
+struct tpacket_req
+{
+    unsigned int tp_block_size;
+    unsigned int tp_block_nr;
+    unsigned int tp_frame_size;
+    unsigned int tp_frame_nr;
+};
+
+struct tpacket2_hdr
+{
+    std::uint32_t tp_status;
+    std::uint32_t tp_len;
+    std::uint32_t tp_snaplen;
+    std::uint16_t tp_mac;
+    std::uint16_t tp_net;
+    std::uint32_t tp_sec;
+    std::uint32_t tp_nsec;
+    std::uint16_t tp_vlan_tci;
+    std::uint16_t tp_vlan_tpid;
+    std::uint8_t tp_padding[4];
+};
+
+static_assert(sizeof(tpacket2_hdr) == 32, "");
+
+enum tpacket_constants : std::uint32_t {
+    tpacket_v2 = 1,
+    tpacket_alignment = 16,
+    tp_status_available = 0,
+    tp_status_send_request = 1,
+    tp_status_wrong_format = 4,
+};
+
+constexpr std::size_t tpacket_align(std::size_t x) noexcept
+{
+    return (x + tpacket_alignment - 1) & ~static_cast<std::size_t>(tpacket_alignment - 1);
+}
+
+}
+
+/*!
+  PACKET_TX_RING を用いて、複数のフレームをまとめて送信するクラス.
+
+  prepare() で取得したリングバッファ上の領域に、acqua::network::parse などを用いて直接ヘッダーを組み立て、
+  commit() で送信待ちにする。flush() を呼ぶと、送信待ちのフレームを一度のシステムコールで送信する。
+  ソケットは、送信するインタフェースに bind 済みでなければならない。
+ */
+class raw_tx_ring
+    : private boost::noncopyable
+{
+public:
+    explicit raw_tx_ring(raw::socket & socket, std::size_t frame_size = 2048, std::size_t frame_nr = 256) noexcept
+        : socket_(socket)
+        , frame_size_(detail::tpacket_align(std::max<std::size_t>(frame_size, data_offset() + 64)))
+        , frame_nr_(frame_nr)
+    {
+    }
+
+    ~raw_tx_ring()
+    {
+        close();
+    }
+
+    bool is_open() const noexcept
+    {
+        return ring_ != nullptr;
+    }
+
+    void open()
+    {
+        boost::system::error_code ec;
+        open(ec);
+        boost::asio::detail::throw_error(ec, "raw_tx_ring::open");
+    }
+
+    void open(boost::system::error_code & ec) noexcept
+    {
+        if (ring_) {
+            ec = make_error_code(boost::asio::error::already_open);
+            return;
+        }
+
+        int fd = socket_.native_handle();
+        int version = detail::tpacket_v2;
+        if (::setsockopt(fd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) != 0) {
+            ec.assign(errno, boost::system::generic_category());
+            return;
+        }
+
+        // ブロックサイズはページサイズの倍数で、かつ1フレーム以上が入る大きさにする
+        std::size_t page = static_cast<std::size_t>(::getpagesize());
+        std::size_t block_size = (frame_size_ + page - 1) / page * page;
+        std::size_t per_block = block_size / frame_size_;
+        std::size_t block_nr = (std::max<std::size_t>(frame_nr_, 1) + per_block - 1) / per_block;
+
+        detail::tpacket_req req;
+        req.tp_block_size = static_cast<unsigned int>(block_size);
+        req.tp_block_nr = static_cast<unsigned int>(block_nr);
+        req.tp_frame_size = static_cast<unsigned int>(frame_size_);
+        req.tp_frame_nr = static_cast<unsigned int>(block_nr * per_block);
+        if (::setsockopt(fd, SOL_PACKET, PACKET_TX_RING, &req, sizeof(req)) != 0) {
+            ec.assign(errno, boost::system::generic_category());
+            return;
+        }
+
+        std::size_t length = block_size * block_nr;
+        void * ptr = ::mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (ptr == MAP_FAILED) {
+            ec.assign(errno, boost::system::generic_category());
+            std::memset(&req, 0, sizeof(req));
+            ::setsockopt(fd, SOL_PACKET, PACKET_TX_RING, &req, sizeof(req));
+            return;
+        }
+
+        ring_ = static_cast<char *>(ptr);
+        length_ = length;
+        block_size_ = block_size;
+        per_block_ = per_block;
+        frame_nr_ = block_nr * per_block;
+        head_ = 0;
+        pending_ = 0;
+        prepared_ = false;
+        ec.clear();
+    }
+
+    //! リングを解放する. 送信待ちのフレームは破棄され、再度 open() できる
+    void close() noexcept
+    {
+        if (ring_) {
+            ::munmap(ring_, length_);
+            ring_ = nullptr;
+
+            // PACKET_TX_RING を外さないと、次の open() が EBUSY になる
+            detail::tpacket_req req;
+            std::memset(&req, 0, sizeof(req));
+            ::setsockopt(socket_.native_handle(), SOL_PACKET, PACKET_TX_RING, &req, sizeof(req));
+        }
+        head_ = 0;
+        pending_ = 0;
+        prepared_ = false;
+    }
+
+    //! 1フレームに書き込めるデータの最大長を返す.
+    std::size_t max_frame_length() const noexcept
+    {
+        return frame_size_ - data_offset();
+    }
+
+    //! 送信待ちのフレーム数を返す.
+    std::size_t pending() const noexcept
+    {
+        return pending_;
+    }
+
+    /*!
+      次の空きフレームのデータ領域を返す.
+      空きフレームがない場合は、サイズ 0 のバッファを返すので、flush() してから再度呼び出すこと。
+      カーネルが不正な形式として送らなかったフレーム (TP_STATUS_WRONG_FORMAT) は、空きフレームとして再利用する
+     */
+    boost::asio::mutable_buffer prepare() noexcept
+    {
+        if (!ring_)
+            return boost::asio::mutable_buffer();
+
+        auto * hdr = frame(head_);
+        auto status = __atomic_load_n(&hdr->tp_status, __ATOMIC_ACQUIRE);
+        if (status & detail::tp_status_wrong_format) {
+            __atomic_store_n(&hdr->tp_status, static_cast<std::uint32_t>(detail::tp_status_available), __ATOMIC_RELEASE);
+            status = detail::tp_status_available;
+        }
+        if (status != detail::tp_status_available)
+            return boost::asio::mutable_buffer();
+        prepared_ = true;
+        return boost::asio::mutable_buffer(reinterpret_cast<char *>(hdr) + data_offset(), max_frame_length());
+    }
+
+    //! prepare() で取得した領域の先頭から size バイトを送信待ちにする.
+    void commit(std::size_t size)
+    {
+        boost::system::error_code ec;
+        commit(size, ec);
+        boost::asio::detail::throw_error(ec, "raw_tx_ring::commit");
+    }
+
+    /*!
+      prepare() で取得した領域の先頭から size バイトを送信待ちにする.
+      open() されていなければ bad_descriptor を、prepare() でフレームを取得していなければ invalid_argument を返す
+     */
+    void commit(std::size_t size, boost::system::error_code & ec) noexcept
+    {
+        if (!ring_) {
+            ec = make_error_code(boost::asio::error::bad_descriptor);
+            return;
+        }
+        if (!prepared_) {
+            ec = make_error_code(boost::asio::error::invalid_argument);
+            return;
+        }
+
+        auto * hdr = frame(head_);
+        hdr->tp_len = static_cast<std::uint32_t>(std::min(size, max_frame_length()));
+        __atomic_store_n(&hdr->tp_status, static_cast<std::uint32_t>(detail::tp_status_send_request), __ATOMIC_RELEASE);
+        head_ = (head_ + 1) % frame_nr_;
+        ++pending_;
+        prepared_ = false;
+        ec.clear();
+    }
+
+    //! 送信待ちのフレームを送信して、送信したバイト数を返す.
+    std::size_t flush()
+    {
+        boost::system::error_code ec;
+        auto size = flush(ec);
+        boost::asio::detail::throw_error(ec, "raw_tx_ring::flush");
+        return size;
+    }
+
+    std::size_t flush(boost::system::error_code & ec) noexcept
+    {
+        ec.clear();
+        if (pending_ == 0)
+            return 0;
+
+        ssize_t res;
+        while((res = ::send(socket_.native_handle(), nullptr, 0, 0)) < 0 && errno == EINTR)
+            ;
+        if (res < 0) {
+            ec.assign(errno, boost::system::generic_category());
+            return 0;
+        }
+        pending_ = 0;
+        return static_cast<std::size_t>(res);
+    }
+
+private:
+    static constexpr std::size_t data_offset() noexcept
+    {
+        return detail::tpacket_align(sizeof(detail::tpacket2_hdr));
+    }
+
+    detail::tpacket2_hdr * frame(std::size_t i) const noexcept
+    {
+        return reinterpret_cast<detail::tpacket2_hdr *>(ring_ + (i / per_block_) * block_size_ + (i % per_block_) * frame_size_);
+    }
+
+private:
+    raw::socket & socket_;
+    std::size_t frame_size_;
+    std::size_t frame_nr_;
+    std::size_t block_size_ = 0;
+    std::size_t per_block_ = 1;
+    std::size_t length_ = 0;
+    std::size_t head_ = 0;
+    std::size_t pending_ = 0;
+    bool prepared_ = false;
+    char * ring_ = nullptr;
+};
+
+} }
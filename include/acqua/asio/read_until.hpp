@@ -8,12 +8,224 @@
 
 #pragma once
 
+#include <cstring>
+#include <algorithm>
+#include <limits>
+#include <utility>
+#include <boost/version.hpp>
+#include <boost/assert.hpp>
 #include <boost/asio/read_until.hpp>
+#include <boost/asio/streambuf.hpp>
+#include <boost/asio/detail/handler_alloc_helpers.hpp>
+#include <boost/asio/detail/handler_cont_helpers.hpp>
+#include <boost/asio/detail/handler_invoke_helpers.hpp>
+#if BOOST_VERSION >= 106600
+# include <boost/asio/post.hpp>
+# include <boost/asio/associated_executor.hpp>
+#endif
+#include <boost/utility/string_view.hpp>
+#include <boost/type_traits/integral_constant.hpp>
 
 namespace acqua { namespace asio {
 
 namespace detail {
 
+/*!
+  data の offset バイト目から delim を探し、見つかれば delim の終端までの長さを返す.
+  見つからなければ 0 を返し、次回の検索を始める位置を offset に格納する. delim は空であってはならない
+ */
+inline std::size_t search_delimiter(char const * data, std::size_t size, std::size_t & offset, boost::string_view delim) noexcept
+{
+    BOOST_ASSERT(!delim.empty());
+    char const * end = data + size;
+    char const * it = data + offset;
+    while((it = static_cast<char const *>(std::memchr(it, delim[0], static_cast<std::size_t>(end - it)))) != nullptr) {
+        if (static_cast<std::size_t>(end - it) < delim.size()) {
+            // 区切り文字の途中で終わっているので、次回はここから検索する
+            offset = static_cast<std::size_t>(it - data);
+            return 0;
+        }
+        if (std::memcmp(it, delim.data(), delim.size()) == 0) {
+            offset = 0;
+            return static_cast<std::size_t>(it - data) + delim.size();
+        }
+        ++it;
+    }
+    offset = size;
+    return 0;
+}
+
+template <typename Allocator>
+inline std::size_t read_size_hint(boost::asio::basic_streambuf<Allocator> const & b, std::size_t max_size) noexcept
+{
+    std::size_t limit = std::min(max_size, b.max_size()) - b.size();
+    std::size_t avail = b.capacity() - b.size();
+    return std::min(std::max<std::size_t>(avail, 512), std::min<std::size_t>(limit, 65536));
+}
+
+template <typename AsyncReadStream, typename Allocator, typename ReadHandler>
+class read_delimiter_op
+{
+public:
+    read_delimiter_op(AsyncReadStream & s, boost::asio::basic_streambuf<Allocator> & b, boost::string_view delim, std::size_t max_size, ReadHandler handler)
+        : s_(s), b_(b), delim_(delim), max_size_(max_size), handler_(std::move(handler)) {}
+
+    void start()
+    {
+        if (delim_.empty()) {
+            error_ = make_error_code(boost::asio::error::invalid_argument);
+            post_completion();
+            return;
+        }
+
+        found_ = search_delimiter(boost::asio::buffer_cast<char const *>(b_.data()), b_.size(), offset_, delim_);
+        if (found_ != 0) {
+            post_completion();
+        } else {
+            read_some();
+        }
+    }
+
+    void operator()(boost::system::error_code const & error, std::size_t size)
+    {
+        cont_ = true;
+        if (error_) {
+            handler_(error_, boost::string_view());
+            return;
+        }
+        if (found_ != 0) {
+            complete(boost::system::error_code());
+            return;
+        }
+
+        b_.commit(size);
+        if (error) {
+            handler_(error, boost::string_view());
+            return;
+        }
+
+        found_ = search_delimiter(boost::asio::buffer_cast<char const *>(b_.data()), b_.size(), offset_, delim_);
+        if (found_ != 0) {
+            complete(error);
+        } else {
+            read_some();
+        }
+    }
+
+    ReadHandler const & handler() const noexcept
+    {
+        return handler_;
+    }
+
+    // 以下は handler_ のフックに転送する. strand などでラップしたハンドラーも、途中の読み込みで同じ文脈で呼ばれる
+
+#if !defined(BOOST_ASIO_NO_DEPRECATED)
+    friend void * asio_handler_allocate(std::size_t size, read_delimiter_op * this_handler)
+    {
+        return boost_asio_handler_alloc_helpers::allocate(size, this_handler->handler_);
+    }
+
+    friend void asio_handler_deallocate(void * pointer, std::size_t size, read_delimiter_op * this_handler)
+    {
+        boost_asio_handler_alloc_helpers::deallocate(pointer, size, this_handler->handler_);
+    }
+
+    template <typename Function>
+    friend void asio_handler_invoke(Function & function, read_delimiter_op * this_handler)
+    {
+        boost_asio_handler_invoke_helpers::invoke(function, this_handler->handler_);
+    }
+
+    template <typename Function>
+    friend void asio_handler_invoke(Function const & function, read_delimiter_op * this_handler)
+    {
+        boost_asio_handler_invoke_helpers::invoke(function, this_handler->handler_);
+    }
+#endif
+
+    friend bool asio_handler_is_continuation(read_delimiter_op * this_handler)
+    {
+        return this_handler->cont_ ? true : boost_asio_handler_cont_helpers::is_continuation(this_handler->handler_);
+    }
+
+private:
+    void read_some()
+    {
+        if (b_.size() >= std::min(max_size_, b_.max_size())) {
+            error_ = make_error_code(boost::asio::error::not_found);
+            if (cont_)
+                handler_(error_, boost::string_view());
+            else
+                post_completion();
+            return;
+        }
+        auto bufs = b_.prepare(read_size_hint(b_, max_size_));
+        s_.async_read_some(bufs, std::move(*this));
+    }
+
+    //! post_completion() で投げる関数オブジェクト. 受信なしで operator() を呼び、handler_ のフックを引き継ぐ
+    struct posted_completion
+    {
+        read_delimiter_op op_;
+
+        void operator()()
+        {
+            op_(boost::system::error_code(), 0);
+        }
+
+#if !defined(BOOST_ASIO_NO_DEPRECATED)
+        friend void * asio_handler_allocate(std::size_t size, posted_completion * this_handler)
+        {
+            return asio_handler_allocate(size, &this_handler->op_);
+        }
+
+        friend void asio_handler_deallocate(void * pointer, std::size_t size, posted_completion * this_handler)
+        {
+            asio_handler_deallocate(pointer, size, &this_handler->op_);
+        }
+
+        template <typename Function>
+        friend void asio_handler_invoke(Function & function, posted_completion * this_handler)
+        {
+            asio_handler_invoke(function, &this_handler->op_);
+        }
+
+        template <typename Function>
+        friend void asio_handler_invoke(Function const & function, posted_completion * this_handler)
+        {
+            asio_handler_invoke(function, &this_handler->op_);
+        }
+#endif
+    };
+
+    //! 受信せずに結果が決まったときは、handler_ に関連付けられた executor に投げて非同期に呼び出す
+    void post_completion()
+    {
+#if BOOST_VERSION >= 106600
+        auto ex = boost::asio::get_associated_executor(handler_, s_.get_executor());
+        boost::asio::post(ex, posted_completion{std::move(*this)});
+#else
+        s_.get_io_service().post(posted_completion{std::move(*this)});
+#endif
+    }
+
+    void complete(boost::system::error_code const & error)
+    {
+        handler_(error, boost::string_view(boost::asio::buffer_cast<char const *>(b_.data()), found_));
+    }
+
+private:
+    AsyncReadStream & s_;
+    boost::asio::basic_streambuf<Allocator> & b_;
+    boost::string_view delim_;
+    std::size_t max_size_;
+    std::size_t offset_ = 0;
+    std::size_t found_ = 0;
+    boost::system::error_code error_;
+    bool cont_ = false;
+    ReadHandler handler_;
+};
+
 class match_buffer_size
 {
     std::size_t size_;
@@ -38,7 +250,64 @@ public:
     }
 };
 
-} } }
+} // detail
+
+/*!
+  streambuf を使い、delim が現れるまで受信する.
+
+  区切り文字の検索は、前回までに検索した位置から memchr で再開するので、受信回数に対して線形の時間で済む。
+  戻り値は b の先頭から delim の終端までを指すビューで、b.consume() するまで有効。
+  max_size バイトを受信しても見つからない場合は boost::asio::error::not_found に、delim が空の場合は boost::asio::error::invalid_argument になる。
+ */
+template <typename SyncReadStream, typename Allocator>
+boost::string_view read_until(SyncReadStream & s, boost::asio::basic_streambuf<Allocator> & b, boost::string_view delim,
+                              std::size_t max_size, boost::system::error_code & ec)
+{
+    if (delim.empty()) {
+        ec = make_error_code(boost::asio::error::invalid_argument);
+        return boost::string_view();
+    }
+
+    std::size_t offset = 0;
+    for(;;) {
+        std::size_t found = detail::search_delimiter(boost::asio::buffer_cast<char const *>(b.data()), b.size(), offset, delim);
+        if (found != 0) {
+            ec.clear();
+            return boost::string_view(boost::asio::buffer_cast<char const *>(b.data()), found);
+        }
+        if (b.size() >= std::min(max_size, b.max_size())) {
+            ec = make_error_code(boost::asio::error::not_found);
+            return boost::string_view();
+        }
+        b.commit(s.read_some(b.prepare(detail::read_size_hint(b, max_size)), ec));
+        if (ec) return boost::string_view();
+    }
+}
+
+template <typename SyncReadStream, typename Allocator>
+boost::string_view read_until(SyncReadStream & s, boost::asio::basic_streambuf<Allocator> & b, boost::string_view delim,
+                              std::size_t max_size = std::numeric_limits<std::size_t>::max())
+{
+    boost::system::error_code ec;
+    auto res = read_until(s, b, delim, max_size, ec);
+    boost::asio::detail::throw_error(ec, "read_until");
+    return res;
+}
+
+/*!
+  streambuf を使い、delim が現れるまで非同期に受信する.
+  handler は void(boost::system::error_code const &, boost::string_view) の形式で、read_until と同じビューを受け取る。
+  delim の参照先は、ハンドラーが呼ばれるまで有効でなければならない。
+  途中の読み込みは、handler に関連付けられた executor やアロケータ、asio_handler_invoke などのフックを引き継ぐ。
+ */
+template <typename AsyncReadStream, typename Allocator, typename ReadHandler>
+void async_read_until(AsyncReadStream & s, boost::asio::basic_streambuf<Allocator> & b, boost::string_view delim,
+                      std::size_t max_size, ReadHandler handler)
+{
+    detail::read_delimiter_op<AsyncReadStream, Allocator, ReadHandler>(s, b, delim, max_size, std::move(handler)).start();
+}
+
+} }
 
 namespace boost { namespace asio {
 
@@ -48,6 +317,38 @@ struct is_match_condition<acqua::asio::detail::match_buffer_size>
 {
 };
 
+#if BOOST_VERSION >= 106600
+
+template <typename AsyncReadStream, typename Allocator, typename ReadHandler, typename Allocator1>
+struct associated_allocator<acqua::asio::detail::read_delimiter_op<AsyncReadStream, Allocator, ReadHandler>, Allocator1>
+{
+    using type = typename associated_allocator<ReadHandler, Allocator1>::type;
+
+    static type get(acqua::asio::detail::read_delimiter_op<AsyncReadStream, Allocator, ReadHandler> const & h,
+                    Allocator1 const & a = Allocator1()) noexcept
+    {
+        return associated_allocator<ReadHandler, Allocator1>::get(h.handler(), a);
+    }
+};
+
+// ReadHandler が executor を持たなければ、フック (asio_handler_invoke) で呼び出されるように未特殊化の印も引き継ぐ
+template <typename AsyncReadStream, typename Allocator, typename ReadHandler, typename Executor>
+struct associated_executor<acqua::asio::detail::read_delimiter_op<AsyncReadStream, Allocator, ReadHandler>, Executor>
+#if BOOST_VERSION >= 107400
+    : detail::associated_executor_forwarding_base<ReadHandler, Executor>
+#endif
+{
+    using type = typename associated_executor<ReadHandler, Executor>::type;
+
+    static type get(acqua::asio::detail::read_delimiter_op<AsyncReadStream, Allocator, ReadHandler> const & h,
+                    Executor const & ex = Executor()) noexcept
+    {
+        return associated_executor<ReadHandler, Executor>::get(h.handler(), ex);
+    }
+};
+
+#endif
+
 /*!
   streambuf を使い、size バイトまで受信する.
  */
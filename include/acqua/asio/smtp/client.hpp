@@ -69,7 +69,8 @@ public:
 
     /*!
       DATA コマンドを行い、メール内容を転送する.
-      is の最後は必ず ".\r\n" で終わらなければならない
+      is の改行 (CR, LF, CRLF) は CRLF にそろえ、行頭の '.' は ".." にして送る。
+      is の最後の行が "." だけであれば終端として扱い、なければ ".\r\n" を付け加える
      */
     uint data(boost::asio::yield_context yield, std::istream & is);
 
@@ -9,7 +9,9 @@
  */
 
 #include <acqua/asio/smtp/client.hpp>
+#include <acqua/asio/smtp/detail/data_filter.hpp>
 #include <acqua/iostreams/base64_filter.hpp>
+#include <acqua/iostreams/newline_filter.hpp>
 #include <acqua/iostreams/crypto/hmac_filter.hpp>
 #include <acqua/utility/hexstring.hpp>
 #include <boost/asio/connect.hpp>
@@ -59,11 +61,17 @@ struct client::impl
         return is_error(yield) ? 0 : 1;
     }
 
-    uint send_data(boost::asio::yield_context const & yield, std::istream & is)
+    //! 改行を CRLF にそろえ、ドット・スタッフィングして送る
+    uint send_data(boost::asio::yield_context const & yield, std::istream & src)
     {
         if (dump_) {
             *dump_ << std::endl << '>';
         }
+        boost::iostreams::filtering_istream is;
+        is.push(detail::data_filter());
+        is.push(acqua::iostreams::newline_filter(acqua::iostreams::newline::crln));
+        is.push(src);
+
         boost::asio::streambuf sendbuf;
         auto mbuf = sendbuf.prepare(4096);
         std::streamsize size;
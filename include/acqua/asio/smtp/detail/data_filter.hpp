@@ -0,0 +1,120 @@
+/*!
+  acqua library
+
+  Copyright (c) 2016 Haruhiko Uchida
+  The software is released under the MIT license.
+  http://opensource.org/licenses/mit-license.php
+ */
+
+#pragma once
+
+#include <acqua/iostreams/detail/codec_filter.hpp>
+#include <cstring>
+
+namespace acqua { namespace asio { namespace smtp { namespace detail {
+
+/*!
+  DATA で送る本文のドット・スタッフィング (RFC5321 4.5.2) を行う codec_filter の Codec.
+
+  入力の改行は CRLF にそろっていること。行頭の '.' は ".." にする。
+  ただし入力の最後の行が "." だけであれば、それを終端として扱いそのまま書き出す。
+  終端がなければ、最後の行を CRLF で閉じてから ".\r\n" を書き出す
+ */
+class data_codec
+{
+public:
+    void run(char const * s, std::size_t n, acqua::iostreams::detail::filter_buffer & out, bool finish)
+    {
+        char const * end = s + n;
+        while(s != end) {
+            switch(state_) {
+                case line_begin:
+                    if (*s == '.') {
+                        state_ = dot;
+                        ++s;
+                    } else {
+                        state_ = line_middle;
+                    }
+                    break;
+                case dot:
+                    if (*s == '\r') {
+                        state_ = dot_cr;
+                        ++s;
+                    } else {
+                        out.append("..", 2);
+                        state_ = line_middle;
+                    }
+                    break;
+                case dot_cr:
+                    if (*s == '\n') {
+                        state_ = dot_line;
+                        ++s;
+                    } else {
+                        out.append("..\r", 3);
+                        state_ = line_middle;
+                    }
+                    break;
+                case dot_line:
+                    // 後に続きがあるので、終端ではなく本文の "." の行
+                    out.append("..\r\n", 4);
+                    state_ = line_begin;
+                    break;
+                case line_middle: {
+                    char const * q = static_cast<char const *>(std::memchr(s, '\n', static_cast<std::size_t>(end - s)));
+                    if (q == nullptr) {
+                        out.append(s, static_cast<std::size_t>(end - s));
+                        s = end;
+                    } else {
+                        out.append(s, static_cast<std::size_t>(q + 1 - s));
+                        state_ = line_begin;
+                        s = q + 1;
+                    }
+                    break;
+                }
+            }
+        }
+
+        if (finish) {
+            switch(state_) {
+                case line_begin:
+                case dot_line:
+                    break;
+                case dot:
+                case dot_cr:
+                    out.append("..\r\n", 4);
+                    break;
+                case line_middle:
+                    out.append("\r\n", 2);
+                    break;
+            }
+            out.append(".\r\n", 3);
+            state_ = line_begin;
+        }
+    }
+
+    void reset() noexcept
+    {
+        state_ = line_begin;
+    }
+
+private:
+    enum state_type { line_begin, line_middle, dot, dot_cr, dot_line };
+    state_type state_ = line_begin;
+};
+
+
+/*!
+  DATA で送る本文を、ドット・スタッフィングして終端を付けるフィルタ.
+  改行を CRLF にそろえる acqua::iostreams::newline_filter の後につなぐ
+ */
+class data_filter
+    : public acqua::iostreams::detail::codec_filter<data_codec>
+{
+public:
+    data_filter()
+        : codec_filter(data_codec())
+    {
+    }
+};
+
+} } } }
@@ -9,102 +9,42 @@
 #pragma once
 
 #include <acqua/iostreams/newline_category.hpp>
-#include <boost/iostreams/operations.hpp>
-#include <boost/iostreams/categories.hpp>
+#include <acqua/iostreams/detail/codec_filter.hpp>
+#include <acqua/iostreams/detail/newline_codec.hpp>
 
 namespace acqua { namespace iostreams {
 
 /*!
   メールの 7bit foramt_flowed 指定におけるエンコードを行うクラス.
+
+  改行までの文字の並びはまとめて写し、1行が size 文字に達すると空白と改行コード nl を挟む。
+  入力の LF は nl にして、CR は取り除く。
+  input_filter と output_filter の両方を指定できるが、１つのインスタンスに対してどちらか片方しか使用してはいけない
  */
 class ascii_encoder
-    : public detail::newline_base< ascii_encoder >
+    : public detail::codec_filter<detail::ascii_encode_codec>
 {
-private:
-    using base_type = ascii_encoder::base_type;
-
-public:
-    using char_type = char;
-    using category = boost::iostreams::output_filter_tag;
-
 public:
     explicit ascii_encoder(newline nl = newline::crln, std::size_t size = 77)
-        : base_type(nl, size) {}
-
-    template <typename Sink>
-    bool put(Sink & sink, char ch)
+        : codec_filter(detail::ascii_encode_codec(nl, size))
     {
-        return (ch == '\r') ? true
-            :  (ch == '\n') ? base_type::put_ln(sink)
-            :  base_type::put(sink, ch);
-    }
-
-    template <typename Sink>
-    bool line_break(Sink & sink)
-    {
-        return boost::iostreams::put(sink, ' ') && base_type::put_ln(sink);
     }
 };
 
 /*!
   メールの 7bit foramt_flowed 指定におけるデコードを行うクラス.
+
+  空白に続く改行はソフト改行として空白ごと取り除き、それ以外の改行 (CR, LF, CRLF) は LF にする。
   input_filter と output_filter の両方を指定できるが、１つのインスタンスに対してどちらか片方しか使用してはいけない
  */
 class ascii_decoder
+    : public detail::codec_filter<detail::ascii_decode_codec>
 {
 public:
-    using char_type = char;
-    using category = boost::iostreams::dual_use_filter_tag;
-
-public:
-    template <typename Source>
-    int get(Source & src)
-    {
-        int ch;
-        if (prior_) {
-            ch = prior_;
-            prior_ = 0;
-        } else {
-            ch = boost::iostreams::get(src);
-        }
-
-        if (ch == ' ' || ch == '\t') {
-            prior_ = ch;
-            ch = boost::iostreams::get(src);
-            if (ch == '\r') { prior_ = 0; ch = boost::iostreams::get(src); }
-            if (ch == '\n') { prior_ = 0; ch = boost::iostreams::get(src); }
-            if (prior_) std::swap(ch, prior_);
-        } else if(ch == '\r') {
-            ch = boost::iostreams::get(src);
-            if (ch != '\n') {
-                prior_ = ch;
-                ch = '\n';
-            }
-        }
-
-        return ch;
-    }
-
-    template <typename Sink>
-    bool put(Sink & sink, char ch)
+    ascii_decoder()
+        : codec_filter(detail::ascii_decode_codec())
     {
-        if (prior_ == ' ' && ch == '\r') {
-            prior_ = '\r';
-            return true;
-        }
-
-        if (prior_ == '\r' && ch == '\n') {
-            prior_ = '\0';
-            return true;
-        }
-
-        if (ch == ' ' || ch == '\t')
-            prior_ = ' ';
-        return boost::iostreams::put(sink, ch);
     }
-
-private:
-    int prior_ = 0;
 };
 
 } }
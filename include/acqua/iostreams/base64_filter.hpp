@@ -9,11 +9,13 @@
  */
 
 #include <acqua/iostreams/newline_category.hpp>
+#include <acqua/iostreams/detail/base64_codec.hpp>
+#include <acqua/iostreams/detail/filter_buffer.hpp>
 #include <boost/iostreams/operations.hpp>
 #include <boost/iostreams/categories.hpp>
-#include <boost/scope_exit.hpp>
 #include <iostream>
 #include <algorithm>
+#include <limits>
 
 namespace acqua { namespace iostreams {
 
@@ -22,18 +24,21 @@ struct base64_traits
     static bool const padding = true;
     static int const npos = 64;
 
+    static detail::base64_table const & table() noexcept
+    {
+        static constexpr detail::base64_table tbl('+', '/');
+        return tbl;
+    }
+
     char enc(int ch) const
     {
-        return tbl[std::min<uint>(static_cast<uint>(ch), static_cast<uint>(npos))];
+        return (0 <= ch && ch < npos) ? table().enc[ch] : '\0';
     }
 
     int dec(char ch) const
     {
-        return static_cast<int>(std::find(tbl, tbl + npos, ch) - tbl);
+        return table().dec[static_cast<unsigned char>(ch)];
     }
-
-private:
-    char const * const tbl = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
 };
 
 
@@ -42,31 +47,44 @@ struct base64_url_traits
     static bool const padding = false;
     static int const npos = 64;
 
+    static detail::base64_table const & table() noexcept
+    {
+        static constexpr detail::base64_table tbl('-', '_');
+        return tbl;
+    }
+
     char enc(int ch) const
     {
-        return tbl[std::min<uint>(static_cast<uint>(ch), static_cast<uint>(npos))];
+        return (0 <= ch && ch < npos) ? table().enc[ch] : '\0';
     }
 
     int dec(char ch) const
     {
-        return static_cast<int>(std::find(tbl, tbl + npos, ch) - tbl);
+        return table().dec[static_cast<unsigned char>(ch)];
     }
-
-private:
-    char const * const tbl = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
 };
 
 
+/*!
+  base64 エンコーダ.
+
+  入力を 3 バイト単位のブロックでまとめて変換する。CPU が対応していれば AVX2 や SSSE3 を使う。
+  size を指定すると、改行コードを含めて size 文字を超えないように、4 の倍数の文字数で改行する。
+  改行コードを指定した場合は、最後の行の後にも改行を入れる。
+  input_filter と output_filter の両方を指定できるが、１つのインスタンスに対してどちらか片方しか使用してはいけない
+ */
 template <typename Traits>
 class basic_base64_encoder
     : private Traits
 {
 private:
-    using Traits::enc;
+    using Traits::table;
     using Traits::padding;
 
+    static std::size_t const block_size = 3 * 1024;
+
 public:
-    struct category : boost::iostreams::dual_use_filter_tag, boost::iostreams::closable_tag {};
+    struct category : boost::iostreams::multichar_dual_use_filter_tag, boost::iostreams::closable_tag {};
     using char_type = char;
     using traits_type = Traits;
 
@@ -74,251 +92,283 @@ public:
     explicit basic_base64_encoder(newline nl = newline::none, std::size_t size = std::numeric_limits<std::size_t>::max())
         : nl_(nl)
     {
-        if (size < 4) {
-            size = 4;
+        if (nl_ == newline::none) {
+            max_ = std::numeric_limits<std::size_t>::max();
         } else {
             // 改行コードを含んで、size を超えないように調整する
-            switch(nl_) {
-                case newline::none:
-                    size = std::numeric_limits<std::size_t>::max();
-                    break;
-                case newline::crln:
-                    --size;
-                    //break;
-                case newline::cr: case newline::ln:
-                    --size;
-                    break;
-            }
-            max_ = size - (size % 4);  // max_ は必ず4の倍数にする
+            std::size_t len = (nl_ == newline::crln) ? 2 : 1;
+            size = (size > len) ? size - len : 0;
+            max_ = std::max<std::size_t>(4, size - (size % 4));  // max_ は必ず4の倍数にする
         }
     }
 
     template <typename Source>
-    int get(Source & src)
+    std::streamsize read(Source & src, char * s, std::streamsize n)
     {
-        int res;
-        int ch;
-
-        switch(cnt_ % 4) {
-            case 0:
-                if (cnt_ >= max_)
-                    if ((ch = get_break()) != EOF)
-                        return ch;
-
-                if (prior_ == EOF) return EOF;
-                ch = boost::iostreams::get(src);
-                if (ch == EOF) {
-                    prior_ = EOF;
-                    if (cnt_ == 0) {
-                        return EOF;
-                    } else {
-                        max_ = cnt_;  // 最後に改行を入れる調整
-                        return get_break();
-                    }
-                }
-                res = enc((ch & 0xFC) >> 2);
-                prior_ = ch;
-                break;
-            case 1:
-                if (cnt_ >= max_)
-                    return get_break();
-                ch = boost::iostreams::get(src);
-                res = (ch == EOF) ? enc(((prior_ & 0x03)) << 4)
-                    : enc(((prior_ & 0x03) << 4) | ((ch & 0xF0) >> 4));
-                prior_ = ch;
-                break;
-            case 2:
-                if (prior_ == EOF) {
-                    if (padding) {
-                        res = '=';
-                    } else {
-                        max_ = cnt_;  // 最後に改行を入れる調整
-                        return get_break();
-                    }
-                } else {
-                    ch = boost::iostreams::get(src);
-                    res = (ch == EOF) ? enc((prior_ & 0x0F) << 2)
-                        : enc(((prior_ & 0x0F) << 2) | ((ch & 0xC0) >> 6));
-                    prior_ = ch;
-                }
-                break;
-            case 3:
-                if (prior_ == EOF) {
-                    if (padding) {
-                        res = '=';
-                        if (cnt_ > 0) max_ = cnt_ + 1;  // 最後に改行を入れる調整
-                    } else {
-                        max_ = cnt_;  // 最後に改行を入れる調整
-                        return get_break();
-                    }
-                } else {
-                    res = enc(prior_ & 0x3F);
-                }
-                break;
+        reading_ = true;
+        while(out_.empty()) {
+            if (eof_)
+                return -1;
+
+            char buf[block_size];
+            std::streamsize res = boost::iostreams::read(src, buf, block_size);
+            if (res < 0) {
+                finish();
+                eof_ = true;
+            } else if (res == 0) {
+                return 0;
+            } else {
+                encode(buf, static_cast<std::size_t>(res));
+            }
         }
-
-        ++cnt_;
-        return res;
+        return out_.take(s, n);
     }
 
     template <typename Sink>
-    bool put(Sink & sink, char ch)
+    std::streamsize write(Sink & sink, char const * s, std::streamsize n)
     {
-        bool res;
-
-        switch(cnt_ % 4) {
-            case 0:
-                if (cnt_ >= max_)
-                    if (!put_break(sink))
-                        return false;
-
-                res = boost::iostreams::put(sink, enc((ch & 0xFC) >> 2));
-                break;
-            case 1:
-                res = boost::iostreams::put(sink, enc(((prior_ & 0x03) << 4) | ((ch & 0xF0) >> 4)));
-                break;
-            case 2:
-                res =  boost::iostreams::put(sink, enc(((prior_ & 0x0F) << 2) | ((ch & 0xC0) >> 6)))
-                    && boost::iostreams::put(sink, enc(ch & 0x3F));
-                ++cnt_;
+        if (!out_.flush(sink))
+            return 0;
+
+        std::streamsize done = 0;
+        while(done < n) {
+            std::size_t len = std::min(static_cast<std::size_t>(n - done), std::size_t(block_size));
+            encode(s + done, len);
+            done += static_cast<std::streamsize>(len);
+            if (!out_.flush(sink))
                 break;
         }
-
-        ++cnt_;
-        prior_ = ch;
-        return res;
+        return done;
     }
 
     template <typename Device>
     void close(Device & dev, std::ios_base::openmode which)
     {
-        if (which == std::ios_base::out && cnt_ > 0) {
-            switch(cnt_ % 4) {
-                case 1:
-                    boost::iostreams::put(dev, enc((prior_ & 0x03) << 4));
-                    if (padding) {
-                        boost::iostreams::put(dev, '=');
-                        boost::iostreams::put(dev, '=');
-                    }
-                    break;
-                case 2:
-                    boost::iostreams::put(dev, enc((prior_ & 0x0F) << 2));
-                    if (padding) {
-                        boost::iostreams::put(dev, '=');
-                    }
-                    break;
-            }
-
-            // 最後に改行を入れる
-            put_break(dev);
+        if (which == std::ios_base::out && !reading_) {
+            finish();
+            out_.flush(dev);
         }
+        if ((which == std::ios_base::in) == reading_)
+            reset();
     }
 
 private:
-    template <typename Sink>
-    bool put_break(Sink & sink)
+    void encode(char const * s, std::size_t n)
     {
-        cnt_ = 0;
-        switch(nl_) {
-            case newline::none:
-                return true;
-            case newline::ln:
-                return boost::iostreams::put(sink, '\n');
-            case newline::cr:
-                return boost::iostreams::put(sink, '\r');
-            case newline::crln:
-                return boost::iostreams::put(sink, '\r')
-                    && boost::iostreams::put(sink, '\n');
+        auto const * in = reinterpret_cast<unsigned char const *>(s);
+
+        // 前回の残りを 3 バイトにしてから変換する
+        while(npending_ > 0 && npending_ < 3 && n > 0) {
+            pending_[npending_++] = *in++;
+            --n;
+        }
+        if (npending_ == 3) {
+            put_groups(pending_, 1);
+            npending_ = 0;
+        }
+
+        put_groups(in, n / 3);
+        in += n / 3 * 3;
+        for(n %= 3; n > 0; --n)
+            pending_[npending_++] = *in++;
+    }
+
+    //! 1行に収まる分ずつ、まとめて変換する
+    void put_groups(unsigned char const * in, std::size_t groups)
+    {
+        while(groups > 0) {
+            if (col_ >= max_)
+                put_break();
+            std::size_t len = std::min(groups, (max_ - col_) / 4);
+            char * out = out_.prepare(len * 4);
+            detail::base64_encode_groups(table(), in, len, out);
+            col_ += len * 4;
+            in += len * 3;
+            groups -= len;
         }
+        written_ = true;
     }
 
-    int get_break()
+    //! 残りのバイトをパディングとともに書き込んで、最後に改行を入れる
+    void finish()
     {
+        if (npending_ > 0) {
+            if (col_ >= max_)
+                put_break();
+            unsigned char last[3] = { pending_[0], npending_ > 1 ? pending_[1] : static_cast<unsigned char>(0), 0 };
+            char group[4];
+            detail::base64_encode_scalar(table(), last, 1, group);
+            std::size_t len = padding ? 4 : npending_ + 1;
+            for(std::size_t i = npending_ + 1; i < 4; ++i)
+                group[i] = '=';
+            out_.append(group, len);
+            npending_ = 0;
+            written_ = true;
+        }
+        if (written_)
+            put_break();
+        written_ = false;
+    }
+
+    void put_break()
+    {
+        col_ = 0;
         switch(nl_) {
+            case newline::none:
+                break;
             case newline::ln:
-                cnt_ = 0;
-                return '\n';
+                out_.push_back('\n');
+                break;
             case newline::cr:
-                cnt_ = 0;
-                return  '\r';
+                out_.push_back('\r');
+                break;
             case newline::crln:
-                if (cnt_ == max_) {
-                    ++cnt_;  // 改行を入れる調整
-                    return '\r';
-                } else {
-                    cnt_ = 0;
-                    return '\n';
-                }
-            default:
-                cnt_ = 0;
-                return EOF;
+                out_.append("\r\n", 2);
+                break;
         }
     }
 
+    void reset()
+    {
+        out_.clear();
+        col_ = 0;
+        npending_ = 0;
+        written_ = false;
+        eof_ = false;
+        reading_ = false;
+    }
+
 private:
     newline nl_;
     std::size_t max_;
-    std::size_t cnt_ = 0;
-    int prior_ = {};
+    std::size_t col_ = 0;
+    unsigned char pending_[3] = {};
+    std::size_t npending_ = 0;
+    bool written_ = false;
+    bool eof_ = false;
+    bool reading_ = false;
+    detail::filter_buffer out_;
 };
 
 
 /*!
   base64 デコーダ.
+
+  改行や '=' などの base64 以外の文字は読み飛ばす。
+  改行を含まない 16 文字または 32 文字のブロックは、CPU が対応していれば SIMD でまとめて変換する。
+  input_filter と output_filter の両方を指定できるが、１つのインスタンスに対してどちらか片方しか使用してはいけない
 */
 template <typename Traits = base64_traits>
 class basic_base64_decoder
     : private Traits
 {
 private:
-    using Traits::dec;
+    using Traits::table;
     using Traits::npos;
 
+    static std::size_t const block_size = 4 * 1024;
+
 public:
     using char_type = char;
-    using category = boost::iostreams::dual_use_filter_tag;
+    struct category : boost::iostreams::multichar_dual_use_filter_tag, boost::iostreams::closable_tag {};
 
 public:
     template <typename Source>
-    int get(Source & src)
+    std::streamsize read(Source & src, char * s, std::streamsize n)
     {
-        int ch;
-        while((ch = boost::iostreams::get(src)) != EOF && ch != boost::iostreams::WOULD_BLOCK) {
-            if (ch == '\r' || ch == '\n' || ch == '=' || (ch = dec(static_cast<char>(ch))) < 0 || npos <= ch)
-                continue;
-            BOOST_SCOPE_EXIT_ALL(this, ch) { prior_ = ch; };
-            switch(cnt_++ % 4) {
-                case 1:
-                    return ((prior_ & 0x3F) << 2 | (ch & 0x30) >> 4);
-                case 2:
-                    return ((prior_ & 0x0F) << 4 | (ch & 0x3C) >> 2);
-                case 3:
-                    return ((prior_ & 0x0F) << 6 | (ch & 0x3F) >> 0);
-            }
+        reading_ = true;
+        while(out_.empty()) {
+            if (eof_)
+                return -1;
+
+            char buf[block_size];
+            std::streamsize res = boost::iostreams::read(src, buf, block_size);
+            if (res < 0)
+                eof_ = true;
+            else if (res == 0)
+                return 0;
+            else
+                decode(buf, static_cast<std::size_t>(res));
         }
-        return ch;
+        return out_.take(s, n);
     }
 
     template <typename Sink>
-    bool put(Sink & sink, char ch)
+    std::streamsize write(Sink & sink, char const * s, std::streamsize n)
+    {
+        if (!out_.flush(sink))
+            return 0;
+
+        std::streamsize done = 0;
+        while(done < n) {
+            std::size_t len = std::min(static_cast<std::size_t>(n - done), std::size_t(block_size));
+            decode(s + done, len);
+            done += static_cast<std::streamsize>(len);
+            if (!out_.flush(sink))
+                break;
+        }
+        return done;
+    }
+
+    template <typename Device>
+    void close(Device & dev, std::ios_base::openmode which)
     {
-        if (ch == '\r' || ch == '\n' || ch == '=' || (ch = static_cast<char>(dec(ch))) < 0 || npos <= ch)
-            return true;
-        BOOST_SCOPE_EXIT_ALL(this, ch) { prior_ = ch; };
-        switch(cnt_++ % 4) {
-            case 1:
-                return boost::iostreams::put(sink, static_cast<char>((prior_ & 0x3F) << 2 | (ch & 0x30) >> 4));
-            case 2:
-                return boost::iostreams::put(sink, static_cast<char>((prior_ & 0x0F) << 4 | (ch & 0x3C) >> 2));
-            case 3:
-                return boost::iostreams::put(sink, static_cast<char>((prior_ & 0x0F) << 6 | (ch & 0x3F) >> 0));
+        if (which == std::ios_base::out && !reading_)
+            out_.flush(dev);
+        if ((which == std::ios_base::in) == reading_) {
+            out_.clear();
+            cnt_ = 0;
+            eof_ = false;
+            reading_ = false;
+        }
+    }
+
+private:
+    void decode(char const * in, std::size_t n)
+    {
+        auto const & tbl = table();
+        // SIMD は 16 文字を 12 バイトにするときに 16 バイトを書き込むので、その分の余裕を取る
+        char * beg = out_.prepare(n + 32);
+        char * out = beg;
+        std::size_t i = 0;
+        std::size_t scalar_end = 0;
+
+        while(i < n) {
+            if (cnt_ == 0 && i >= scalar_end) {
+                std::size_t done = detail::base64_decode_blocks(tbl, in + i, n - i, reinterpret_cast<unsigned char *>(out));
+                i += done;
+                out += done / 4 * 3;
+                // ブロックに改行などが含まれていたので、その範囲は1文字ずつ変換する
+                scalar_end = i + 32;
+                continue;
+            }
+
+            int ch = tbl.dec[static_cast<unsigned char>(in[i++])];
+            if (npos <= ch)
+                continue;
+            switch(cnt_++) {
+                case 1:
+                    *out++ = static_cast<char>((prior_ & 0x3F) << 2 | (ch & 0x30) >> 4);
+                    break;
+                case 2:
+                    *out++ = static_cast<char>((prior_ & 0x0F) << 4 | (ch & 0x3C) >> 2);
+                    break;
+                case 3:
+                    *out++ = static_cast<char>((prior_ & 0x03) << 6 | (ch & 0x3F) >> 0);
+                    cnt_ = 0;
+                    break;
+            }
+            prior_ = ch;
         }
-        return true;
+        out_.commit(out);
     }
 
 private:
     std::size_t cnt_ = 0;
     int prior_ = {};
+    bool eof_ = false;
+    bool reading_ = false;
+    detail::filter_buffer out_;
 };
 
 using base64_encoder = basic_base64_encoder<base64_traits>;
@@ -8,6 +8,7 @@
 
 #pragma once
 
+#include <acqua/iostreams/crypto/detail/context_allocator.hpp>
 #include <boost/iostreams/operations.hpp>
 #include <boost/iostreams/categories.hpp>
 #include <boost/system/system_error.hpp>
@@ -18,6 +19,10 @@
 
 namespace acqua { namespace iostreams { namespace crypto {
 
+/*!
+  ハッシュ値を計算するフィルタ.
+  Context はスレッドごとのプールから確保して、フィルタのコピーの間で共有する
+ */
 template <typename Context, std::size_t BufferSize>
 class basic_hash_filter
 {
@@ -28,7 +33,7 @@ public:
 
 public:
     explicit basic_hash_filter(unsigned char * buffer)
-        : impl_(new Context{})
+        : impl_(make_context())
         , buffer_(buffer)
     {
         boost::system::error_code ec;
@@ -37,7 +42,7 @@ public:
     }
 
     explicit basic_hash_filter(unsigned char * buffer, void const * key, std::size_t keylen)
-        : impl_(new Context{})
+        : impl_(make_context())
         , buffer_(buffer)
     {
         boost::system::error_code ec;
@@ -77,9 +82,10 @@ public:
         static_assert(N == buffer_size, "N must be longer buffer_size.");
     }
 
+    //! key は data() と size() を持つ鍵か、Context が init(key, ec) で受け取れる前処理済みの鍵
     template <typename CharT, std::size_t N, typename Key>
     explicit basic_hash_filter(std::array<CharT, N> & buffer, Key const & key)
-        : basic_hash_filter(reinterpret_cast<unsigned char *>(buffer.data()), key.data(), key.size())
+        : basic_hash_filter(reinterpret_cast<unsigned char *>(buffer.data()), key, key_tag{})
     {
         static_assert(sizeof(CharT) == 1, "CharT must be 1byte.");
         static_assert(N == buffer_size, "N must be longer buffer_size.");
@@ -87,7 +93,7 @@ public:
 
     template <typename CharT, std::size_t N, typename Key>
     explicit basic_hash_filter(CharT (&buffer)[N], Key const & key)
-        : basic_hash_filter(reinterpret_cast<unsigned char *>(buffer), key.data(), key.size())
+        : basic_hash_filter(reinterpret_cast<unsigned char *>(buffer), key, key_tag{})
     {
         static_assert(sizeof(CharT) == 1, "CharT must be 1byte.");
         static_assert(N == buffer_size, "N must be longer buffer_size.");
@@ -125,6 +131,37 @@ public:
         if (ec) throw boost::system::system_error(ec, "close");
     }
 
+private:
+    struct key_tag {};
+
+    static std::shared_ptr<Context> make_context()
+    {
+        return std::allocate_shared<Context>(detail::context_allocator<Context>());
+    }
+
+    template <typename Key>
+    basic_hash_filter(unsigned char * buffer, Key const & key, key_tag)
+        : impl_(make_context())
+        , buffer_(buffer)
+    {
+        boost::system::error_code ec;
+        init_key(*impl_, key, ec, 0);
+        if (ec) throw boost::system::system_error(ec, "init");
+    }
+
+    template <typename Key>
+    static auto init_key(Context & ctx, Key const & key, boost::system::error_code & ec, int)
+        -> decltype(ctx.init(key, ec))
+    {
+        ctx.init(key, ec);
+    }
+
+    template <typename Key>
+    static void init_key(Context & ctx, Key const & key, boost::system::error_code & ec, long)
+    {
+        ctx.init(key.data(), key.size(), ec);
+    }
+
 private:
     std::shared_ptr<Context> impl_;
     unsigned char * buffer_;
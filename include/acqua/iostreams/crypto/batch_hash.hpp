@@ -0,0 +1,218 @@
+/*!
+  acqua library
+
+  Copyright (c) 2016 Haruhiko Uchida
+  The software is released under the MIT license.
+  http://opensource.org/licenses/mit-license.php
+ */
+
+#pragma once
+
+#include <acqua/iostreams/crypto/sha256_filter.hpp>
+#include <acqua/iostreams/crypto/md5_filter.hpp>
+#include <acqua/iostreams/crypto/detail/hash_job.hpp>
+#include <acqua/iostreams/crypto/detail/sha256_x8.hpp>
+#include <acqua/iostreams/detail/worker_pool.hpp>
+#include <boost/system/system_error.hpp>
+#include <boost/system/error_code.hpp>
+#include <algorithm>
+#include <array>
+#include <memory>
+#include <vector>
+
+namespace acqua { namespace iostreams { namespace crypto {
+
+//! バッチで計算する1つの入力.
+struct hash_input
+{
+    void const * data;
+    std::size_t size;
+};
+
+
+namespace detail {
+
+//! Context の複数のメッセージを同時に計算する実装. 用意されていなければ1つずつ計算する
+template <typename Context>
+struct multi_buffer
+{
+    static constexpr std::size_t lanes = 1;
+
+    static bool supported() noexcept
+    {
+        return false;
+    }
+
+    static bool preferred() noexcept
+    {
+        return false;
+    }
+
+    static void run(hash_job const * const *, std::size_t) noexcept
+    {
+    }
+};
+
+template <>
+struct multi_buffer<sha256_context>
+{
+    static constexpr std::size_t lanes = 8;
+
+    static bool supported() noexcept
+    {
+        return sha256_x8_supported();
+    }
+
+    static bool preferred() noexcept
+    {
+        return sha256_x8_preferred();
+    }
+
+    static void run(hash_job const * const * jobs, std::size_t count) noexcept
+    {
+        sha256_x8(jobs, count);
+    }
+};
+
+}  // detail
+
+
+/*!
+  独立した複数の入力のハッシュをまとめて計算する.
+
+  Context に複数のメッセージを同時に計算する実装があり、CPU がそれに向いていれば使う
+  (SHA-256 では AVX2 による 8 レーンの計算)。そうでなければ Context で1つずつ計算する。
+  threads が 2 以上であれば、入力をスレッドごとに分けて並列に計算する。
+
+  1つの大きな入力は分割できないので、並列に計算したいときは basic_tree_hash を使う。
+ */
+template <typename Context, std::size_t DigestSize>
+class basic_batch_hash
+{
+public:
+    using context_type = Context;
+    static constexpr std::size_t digest_size = DigestSize;
+    using digest_type = std::array<unsigned char, DigestSize>;
+
+public:
+    //! threads は計算に使うスレッドの数. 呼び出し元のスレッドを含む
+    explicit basic_batch_hash(std::size_t threads = 1)
+        : pool_(threads > 1 ? std::make_shared<iostreams::detail::worker_pool>(threads) : nullptr)
+        , multi_buffer_(detail::multi_buffer<Context>::preferred())
+    {
+    }
+
+    std::size_t threads() const noexcept
+    {
+        return pool_ ? pool_->size() : 1;
+    }
+
+    //! 複数のメッセージを同時に計算するかどうか. CPU が対応していなければ有効にできない
+    void multi_buffer(bool enable) noexcept
+    {
+        multi_buffer_ = enable && detail::multi_buffer<Context>::supported();
+    }
+
+    bool multi_buffer() const noexcept
+    {
+        return multi_buffer_;
+    }
+
+    //! inputs[i] のハッシュを digests[i] に書き込む.
+    void compute(hash_input const * inputs, std::size_t count, digest_type * digests, boost::system::error_code & ec)
+    {
+        std::vector<detail::hash_job> jobs(count);
+        for(std::size_t i = 0; i < count; ++i)
+            jobs[i] = { static_cast<unsigned char const *>(inputs[i].data), inputs[i].size, -1, digests[i].data() };
+        compute(jobs.data(), count, ec);
+    }
+
+    void compute(hash_input const * inputs, std::size_t count, digest_type * digests)
+    {
+        boost::system::error_code ec;
+        compute(inputs, count, digests, ec);
+        if (ec) throw boost::system::system_error(ec, "compute");
+    }
+
+    //! data() と size() を持つ要素のコンテナのハッシュを返す.
+    template <typename Range>
+    std::vector<digest_type> compute(Range const & range)
+    {
+        std::vector<hash_input> inputs;
+        for(auto const & e : range)
+            inputs.push_back({ e.data(), e.size() * sizeof(*e.data()) });
+        std::vector<digest_type> digests(inputs.size());
+        compute(inputs.data(), inputs.size(), digests.data());
+        return digests;
+    }
+
+    /*!
+      jobs のハッシュを計算する.
+      長い入力から順に、スレッドとレーンへ交互に割り当てる
+     */
+    void compute(detail::hash_job const * jobs, std::size_t count, boost::system::error_code & ec)
+    {
+        std::vector<detail::hash_job const *> order(count);
+        for(std::size_t i = 0; i < count; ++i)
+            order[i] = &jobs[i];
+        std::stable_sort(order.begin(), order.end(), [](detail::hash_job const * lhs, detail::hash_job const * rhs) {
+            return lhs->size > rhs->size;
+        });
+
+        std::size_t shards = std::min(threads(), (count + lanes() - 1) / lanes());
+        if (shards <= 1) {
+            compute_shard(order.data(), count, ec);
+            return;
+        }
+
+        std::vector<std::vector<detail::hash_job const *>> shard_jobs(shards);
+        for(std::size_t i = 0; i < count; ++i)
+            shard_jobs[i % shards].push_back(order[i]);
+        std::vector<boost::system::error_code> errors(shards);
+        pool_->parallel_for(shards, [&](std::size_t i) {
+            compute_shard(shard_jobs[i].data(), shard_jobs[i].size(), errors[i]);
+        });
+        for(auto const & e : errors) {
+            if (e) {
+                ec = e;
+                return;
+            }
+        }
+    }
+
+private:
+    std::size_t lanes() const noexcept
+    {
+        return multi_buffer_ ? detail::multi_buffer<Context>::lanes : 1;
+    }
+
+    void compute_shard(detail::hash_job const * const * jobs, std::size_t count, boost::system::error_code & ec) const
+    {
+        if (multi_buffer_) {
+            detail::multi_buffer<Context>::run(jobs, count);
+            return;
+        }
+
+        for(std::size_t i = 0; i < count && !ec; ++i) {
+            Context ctx;
+            ctx.init(ec);
+            if (!ec && jobs[i]->prefix >= 0) {
+                char prefix = static_cast<char>(jobs[i]->prefix);
+                ctx.update(&prefix, 1, ec);
+            }
+            if (!ec)
+                ctx.update(reinterpret_cast<char const *>(jobs[i]->data), jobs[i]->size, ec);
+            if (!ec)
+                ctx.finish(jobs[i]->digest, DigestSize, ec);
+        }
+    }
+
+private:
+    std::shared_ptr<iostreams::detail::worker_pool> pool_;
+    bool multi_buffer_;
+};
+
+using sha256_batch = basic_batch_hash<sha256_context, 32>;
+using md5_batch = basic_batch_hash<md5_context, 16>;
+
+} } }
@@ -0,0 +1,129 @@
+/*!
+  acqua library
+
+  Copyright (c) 2016 Haruhiko Uchida
+  The software is released under the MIT license.
+  http://opensource.org/licenses/mit-license.php
+ */
+
+#pragma once
+
+#include <boost/noncopyable.hpp>
+#include <cstddef>
+#include <new>
+#include <vector>
+
+namespace acqua { namespace iostreams { namespace crypto { namespace detail {
+
+/*!
+  Size バイトのブロックをスレッドごとに溜めておくプール.
+  evp_md_ctx_pool と同じく、スレッドの終了時にプールが破棄された後は直接確保と解放をする
+ */
+template <std::size_t Size>
+class block_pool
+    : private boost::noncopyable
+{
+    static constexpr std::size_t max_size = 16;
+
+public:
+    ~block_pool()
+    {
+        destroyed() = true;
+        for(auto * block : free_)
+            ::operator delete(block);
+    }
+
+    static void * acquire()
+    {
+        if (!destroyed()) {
+            auto & free = instance().free_;
+            if (!free.empty()) {
+                auto * block = free.back();
+                free.pop_back();
+                return block;
+            }
+        }
+        return ::operator new(Size);
+    }
+
+    static void release(void * block) noexcept
+    {
+        if (!destroyed()) {
+            auto & free = instance().free_;
+            if (free.size() < max_size) {
+                free.push_back(block);
+                return;
+            }
+        }
+        ::operator delete(block);
+    }
+
+private:
+    block_pool()
+    {
+        free_.reserve(max_size);
+    }
+
+    static block_pool & instance()
+    {
+        static thread_local block_pool pool;
+        return pool;
+    }
+
+    static bool & destroyed() noexcept
+    {
+        static thread_local bool flag = false;
+        return flag;
+    }
+
+private:
+    std::vector<void *> free_;
+};
+
+
+/*!
+  block_pool から確保するアロケータ.
+  std::allocate_shared に渡すと、フィルタの Context と参照カウントを1つのブロックにまとめて使い回す
+ */
+template <typename T>
+class context_allocator
+{
+    static_assert(alignof(T) <= alignof(std::max_align_t), "T must not be over-aligned.");
+
+public:
+    using value_type = T;
+
+    context_allocator() = default;
+
+    template <typename U>
+    context_allocator(context_allocator<U> const &) noexcept {}
+
+    T * allocate(std::size_t n)
+    {
+        if (n != 1)
+            return static_cast<T *>(::operator new(n * sizeof(T)));
+        return static_cast<T *>(block_pool<sizeof(T)>::acquire());
+    }
+
+    void deallocate(T * p, std::size_t n) noexcept
+    {
+        if (n != 1)
+            ::operator delete(p);
+        else
+            block_pool<sizeof(T)>::release(p);
+    }
+
+    template <typename U>
+    bool operator==(context_allocator<U> const &) const noexcept
+    {
+        return true;
+    }
+
+    template <typename U>
+    bool operator!=(context_allocator<U> const &) const noexcept
+    {
+        return false;
+    }
+};
+
+} } } }
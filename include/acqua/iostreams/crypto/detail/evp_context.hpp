@@ -0,0 +1,172 @@
+/*!
+  acqua library
+
+  Copyright (c) 2016 Haruhiko Uchida
+  The software is released under the MIT license.
+  http://opensource.org/licenses/mit-license.php
+ */
+
+#pragma once
+
+#include <boost/noncopyable.hpp>
+#include <boost/system/error_code.hpp>
+#include <acqua/iostreams/error.hpp>
+#include <vector>
+
+extern "C" {
+#include <openssl/evp.h>
+#include <openssl/opensslv.h>
+}
+
+namespace acqua { namespace iostreams { namespace crypto { namespace detail {
+
+/*!
+  名前で EVP_MD を取得する.
+  OpenSSL 3 では EVP_sha256() などを渡すと初期化のたびに実装を探すので、一度だけ取得したものを使い回す。
+  取得したものは解放しない
+ */
+inline ::EVP_MD const * fetch_digest(char const * name, ::EVP_MD const * (*legacy)())
+{
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    if (::EVP_MD const * md = ::EVP_MD_fetch(nullptr, name, nullptr))
+        return md;
+#else
+    (void)name;
+#endif
+    return legacy();
+}
+
+
+/*!
+  EVP_MD_CTX をスレッドごとに溜めておくプール.
+  フィルタを作るたびに EVP_MD_CTX を確保しなくてよくなる
+ */
+class evp_md_ctx_pool
+    : private boost::noncopyable
+{
+    static constexpr std::size_t max_size = 16;
+
+public:
+    ~evp_md_ctx_pool()
+    {
+        destroyed() = true;
+        for(auto * ctx : free_)
+            ::EVP_MD_CTX_free(ctx);
+    }
+
+    static ::EVP_MD_CTX * acquire()
+    {
+        if (!destroyed()) {
+            auto & free = instance().free_;
+            if (!free.empty()) {
+                auto * ctx = free.back();
+                free.pop_back();
+                return ctx;
+            }
+        }
+        return ::EVP_MD_CTX_new();
+    }
+
+    /*!
+      ctx をプールに戻す.
+      同じダイジェストで初期化し直すときに OpenSSL の内部の状態を使い回せるように、通常は消去しない。
+      sensitive であれば、鍵から作った状態が残らないように消去してから戻す
+     */
+    static void release(::EVP_MD_CTX * ctx, bool sensitive) noexcept
+    {
+        if (ctx == nullptr)
+            return;
+        if (!destroyed()) {
+            auto & free = instance().free_;
+            if (free.size() < max_size) {
+                if (sensitive)
+                    ::EVP_MD_CTX_reset(ctx);
+                free.push_back(ctx);
+                return;
+            }
+        }
+        ::EVP_MD_CTX_free(ctx);
+    }
+
+private:
+    evp_md_ctx_pool()
+    {
+        free_.reserve(max_size);
+    }
+
+    static evp_md_ctx_pool & instance()
+    {
+        static thread_local evp_md_ctx_pool pool;
+        return pool;
+    }
+
+    //! スレッドの終了時にプールが破棄された後は、直接確保と解放をする
+    static bool & destroyed() noexcept
+    {
+        static thread_local bool flag = false;
+        return flag;
+    }
+
+private:
+    std::vector<::EVP_MD_CTX *> free_;
+};
+
+
+//! プールから借りた EVP_MD_CTX. HMAC の鍵などを扱うときは sensitive にする
+class evp_md_ctx
+    : private boost::noncopyable
+{
+public:
+    explicit evp_md_ctx(bool sensitive = false)
+        : ctx_(evp_md_ctx_pool::acquire())
+        , sensitive_(sensitive)
+    {
+    }
+
+    ~evp_md_ctx()
+    {
+        evp_md_ctx_pool::release(ctx_, sensitive_);
+    }
+
+    ::EVP_MD_CTX * get() const noexcept
+    {
+        return ctx_;
+    }
+
+private:
+    ::EVP_MD_CTX * ctx_;
+    bool sensitive_;
+};
+
+
+/*!
+  EVP によるハッシュの計算.
+  Engine は使う EVP_MD を返す evp() とエラーの errc を持つ
+ */
+template <typename Engine>
+class evp_digest_context
+{
+public:
+    void init(boost::system::error_code & ec) noexcept
+    {
+        if (!ctx_.get() || ::EVP_DigestInit_ex(ctx_.get(), Engine::evp(), nullptr) != 1)
+            ec = make_error_code(Engine::errc);
+    }
+
+    void update(char const * s, std::size_t n, boost::system::error_code & ec) noexcept
+    {
+        if (::EVP_DigestUpdate(ctx_.get(), s, n) != 1)
+            ec = make_error_code(Engine::errc);
+    }
+
+    void finish(unsigned char * buffer, std::size_t, boost::system::error_code & ec) noexcept
+    {
+        if (::EVP_DigestFinal_ex(ctx_.get(), buffer, nullptr) != 1)
+            ec = make_error_code(Engine::errc);
+    }
+
+private:
+    evp_md_ctx ctx_;
+};
+
+} } } }
@@ -0,0 +1,27 @@
+/*!
+  acqua library
+
+  Copyright (c) 2016 Haruhiko Uchida
+  The software is released under the MIT license.
+  http://opensource.org/licenses/mit-license.php
+ */
+
+#pragma once
+
+#include <cstddef>
+
+namespace acqua { namespace iostreams { namespace crypto { namespace detail {
+
+/*!
+  バッチで計算する1つのハッシュ.
+  prefix が 0 以上であれば、data の前にその1バイトを付けたもののハッシュを digest に書き込む
+ */
+struct hash_job
+{
+    unsigned char const * data;
+    std::size_t size;
+    int prefix;
+    unsigned char * digest;
+};
+
+} } } }
@@ -0,0 +1,236 @@
+/*!
+  acqua library
+
+  Copyright (c) 2016 Haruhiko Uchida
+  The software is released under the MIT license.
+  http://opensource.org/licenses/mit-license.php
+ */
+
+#pragma once
+
+#include <acqua/iostreams/crypto/detail/hash_job.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) && !defined(ACQUA_IOSTREAMS_CRYPTO_NO_SIMD)
+# define ACQUA_IOSTREAMS_CRYPTO_SHA256_X8 1
+# include <cpuid.h>
+# include <immintrin.h>
+#endif
+
+namespace acqua { namespace iostreams { namespace crypto { namespace detail {
+
+#if defined(ACQUA_IOSTREAMS_CRYPTO_SHA256_X8)
+
+/*
+  AVX2 による 8 レーンの SHA-256.
+
+  8つの独立したメッセージの同じ位置のワードを、1つの 256 ビットレジスタに並べて同時に圧縮する。
+  レーンが空くと次のメッセージを割り当てるので、長さの異なるメッセージを混ぜても無駄が少ない。
+ */
+
+alignas(32) static std::uint32_t const sha256_x8_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static std::uint32_t const sha256_x8_iv[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+};
+
+__attribute__((target("avx2")))
+inline __m256i sha256_x8_rotr(__m256i x, int n) noexcept
+{
+    return _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - n));
+}
+
+/*!
+  state[w][l] はレーン l の w 番目のワード.
+  blocks[l] から 64 バイトずつ読み込んで、8 レーンを同時に圧縮する
+ */
+__attribute__((target("avx2")))
+inline void sha256_x8_compress(std::uint32_t (&state)[8][8], unsigned char const * const (&blocks)[8]) noexcept
+{
+    __m256i const bswap = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+                                           3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    __m256i w[16];
+    for(int i = 0; i < 16; ++i) {
+        int v[8];
+        for(int l = 0; l < 8; ++l)
+            std::memcpy(&v[l], blocks[l] + i * 4, 4);
+        w[i] = _mm256_shuffle_epi8(_mm256_setr_epi32(v[0], v[1], v[2], v[3], v[4], v[5], v[6], v[7]), bswap);
+    }
+
+    __m256i s[8];
+    for(int i = 0; i < 8; ++i)
+        s[i] = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(state[i]));
+    __m256i a = s[0], b = s[1], c = s[2], d = s[3], e = s[4], f = s[5], g = s[6], h = s[7];
+
+    for(int i = 0; i < 64; ++i) {
+        if (i >= 16) {
+            __m256i w2 = w[(i - 2) & 15];
+            __m256i w15 = w[(i - 15) & 15];
+            __m256i s0 = _mm256_xor_si256(_mm256_xor_si256(sha256_x8_rotr(w15, 7), sha256_x8_rotr(w15, 18)), _mm256_srli_epi32(w15, 3));
+            __m256i s1 = _mm256_xor_si256(_mm256_xor_si256(sha256_x8_rotr(w2, 17), sha256_x8_rotr(w2, 19)), _mm256_srli_epi32(w2, 10));
+            w[i & 15] = _mm256_add_epi32(_mm256_add_epi32(w[i & 15], s0), _mm256_add_epi32(w[(i - 7) & 15], s1));
+        }
+
+        __m256i S1 = _mm256_xor_si256(_mm256_xor_si256(sha256_x8_rotr(e, 6), sha256_x8_rotr(e, 11)), sha256_x8_rotr(e, 25));
+        __m256i ch = _mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g));
+        __m256i t1 = _mm256_add_epi32(_mm256_add_epi32(_mm256_add_epi32(h, S1), _mm256_add_epi32(ch, w[i & 15])),
+                                      _mm256_set1_epi32(static_cast<int>(sha256_x8_k[i])));
+        __m256i S0 = _mm256_xor_si256(_mm256_xor_si256(sha256_x8_rotr(a, 2), sha256_x8_rotr(a, 13)), sha256_x8_rotr(a, 22));
+        __m256i maj = _mm256_or_si256(_mm256_and_si256(a, b), _mm256_and_si256(c, _mm256_or_si256(a, b)));
+        __m256i t2 = _mm256_add_epi32(S0, maj);
+        h = g;
+        g = f;
+        f = e;
+        e = _mm256_add_epi32(d, t1);
+        d = c;
+        c = b;
+        b = a;
+        a = _mm256_add_epi32(t1, t2);
+    }
+
+    __m256i r[8] = { a, b, c, d, e, f, g, h };
+    for(int i = 0; i < 8; ++i)
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(state[i]), _mm256_add_epi32(s[i], r[i]));
+}
+
+//! 1つのレーンに割り当てたメッセージの状態. メッセージは prefix と data を繋げたものになる
+struct sha256_x8_lane
+{
+    hash_job const * job = nullptr;
+    std::size_t length = 0;   //!< prefix を含むメッセージの長さ
+    std::size_t block = 0;
+    std::size_t nblocks = 0;
+    unsigned char scratch[64];
+
+    void assign(hash_job const * j) noexcept
+    {
+        job = j;
+        length = j->size + (j->prefix >= 0 ? 1 : 0);
+        block = 0;
+        nblocks = (length + 1 + 8 + 63) / 64;
+    }
+
+    //! block 番目の 64 バイトを返す. パディングや prefix を含むブロックは scratch に組み立てる
+    unsigned char const * next() noexcept
+    {
+        std::size_t plen = (job->prefix >= 0) ? 1 : 0;
+        std::size_t beg = block * 64;
+        if (beg >= plen && beg + 64 <= length)
+            return job->data + (beg - plen);
+
+        std::memset(scratch, 0, sizeof(scratch));
+        for(std::size_t i = beg; i < std::min(beg + 64, length); ++i)
+            scratch[i - beg] = (i < plen) ? static_cast<unsigned char>(job->prefix) : job->data[i - plen];
+        if (beg <= length && length < beg + 64)
+            scratch[length - beg] = 0x80;
+        if (block + 1 == nblocks) {
+            std::uint64_t bits = static_cast<std::uint64_t>(length) * 8;
+            for(int i = 0; i < 8; ++i)
+                scratch[63 - i] = static_cast<unsigned char>(bits >> (i * 8));
+        }
+        return scratch;
+    }
+};
+
+/*!
+  jobs のハッシュを 8 レーンで計算する.
+  長いメッセージから順に割り当てると、最後にレーンが余る時間が短くなる
+ */
+__attribute__((target("avx2")))
+inline void sha256_x8(hash_job const * const * jobs, std::size_t count) noexcept
+{
+    static unsigned char const zero[64] = {};
+    std::uint32_t state[8][8];
+    sha256_x8_lane lanes[8];
+    std::size_t next = 0;
+    std::size_t active = 0;
+
+    auto start = [&](std::size_t l) {
+        lanes[l].job = nullptr;
+        if (next < count) {
+            lanes[l].assign(jobs[next++]);
+            for(int w = 0; w < 8; ++w)
+                state[w][l] = sha256_x8_iv[w];
+            ++active;
+        }
+    };
+    for(std::size_t l = 0; l < 8; ++l)
+        start(l);
+
+    while(active > 0) {
+        unsigned char const * blocks[8];
+        for(std::size_t l = 0; l < 8; ++l)
+            blocks[l] = lanes[l].job ? lanes[l].next() : zero;
+        sha256_x8_compress(state, blocks);
+
+        for(std::size_t l = 0; l < 8; ++l) {
+            auto & lane = lanes[l];
+            if (lane.job == nullptr || ++lane.block < lane.nblocks)
+                continue;
+            for(int w = 0; w < 8; ++w) {
+                std::uint32_t v = state[w][l];
+                lane.job->digest[w * 4 + 0] = static_cast<unsigned char>(v >> 24);
+                lane.job->digest[w * 4 + 1] = static_cast<unsigned char>(v >> 16);
+                lane.job->digest[w * 4 + 2] = static_cast<unsigned char>(v >> 8);
+                lane.job->digest[w * 4 + 3] = static_cast<unsigned char>(v >> 0);
+            }
+            --active;
+            start(l);
+        }
+    }
+}
+
+/*!
+  8 レーンの計算を使うかどうか.
+  SHA 拡張命令があれば、OpenSSL の1レーンの計算の方が速いので使わない
+ */
+inline bool sha256_x8_preferred() noexcept
+{
+    static bool const preferred = [] {
+        __builtin_cpu_init();
+        if (!__builtin_cpu_supports("avx2"))
+            return false;
+        unsigned int eax, ebx, ecx, edx;
+        if (__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) && (ebx & (1u << 29)))
+            return false;
+        return true;
+    }();
+    return preferred;
+}
+
+inline bool sha256_x8_supported() noexcept
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+}
+
+#else
+
+inline void sha256_x8(hash_job const * const *, std::size_t) noexcept
+{
+}
+
+inline bool sha256_x8_preferred() noexcept
+{
+    return false;
+}
+
+inline bool sha256_x8_supported() noexcept
+{
+    return false;
+}
+
+#endif
+
+} } } }
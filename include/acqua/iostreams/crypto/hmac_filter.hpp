@@ -22,11 +22,19 @@ struct hmac_sha512_engine;
 template <typename Engine>
 class hmac_context;
 
+template <typename Engine>
+class hmac_key;
+
 using hmac_md5_filter = basic_hash_filter<hmac_context<hmac_md5_engine>, 16>;
 using hmac_sha1_filter = basic_hash_filter<hmac_context<hmac_sha1_engine>, 20>;
 using hmac_sha256_filter = basic_hash_filter<hmac_context<hmac_sha256_engine>, 32>;
 using hmac_sha512_filter = basic_hash_filter<hmac_context<hmac_sha512_engine>, 64>;
 
+using hmac_md5_key = hmac_key<hmac_md5_engine>;
+using hmac_sha1_key = hmac_key<hmac_sha1_engine>;
+using hmac_sha256_key = hmac_key<hmac_sha256_engine>;
+using hmac_sha512_key = hmac_key<hmac_sha512_engine>;
+
 } // crypto
 
 using hmac_md5_filter = crypto::hmac_md5_filter;
@@ -34,6 +42,11 @@ using hmac_sha1_filter = crypto::hmac_sha1_filter;
 using hmac_sha256_filter = crypto::hmac_sha256_filter;
 using hmac_sha512_filter = crypto::hmac_sha512_filter;
 
+using hmac_md5_key = crypto::hmac_md5_key;
+using hmac_sha1_key = crypto::hmac_sha1_key;
+using hmac_sha256_key = crypto::hmac_sha256_key;
+using hmac_sha512_key = crypto::hmac_sha512_key;
+
 } }
 
 #include <acqua/iostreams/crypto/hmac_filter.ipp>
@@ -9,74 +9,218 @@
  */
 
 #include <acqua/iostreams/crypto/hmac_filter.hpp>
-#include <acqua/iostreams/error.hpp>
+#include <acqua/iostreams/crypto/detail/evp_context.hpp>
+#include <boost/system/system_error.hpp>
+#include <cstring>
+#include <memory>
 
 extern "C" {
-#include <openssl/hmac.h>
+#include <openssl/crypto.h>
 }
 
 namespace acqua { namespace iostreams { namespace crypto {
 
 struct hmac_md5_engine
 {
-    ::EVP_MD const * evp() const { return ::EVP_md5(); }
+    static ::EVP_MD const * evp()
+    {
+        static ::EVP_MD const * md = detail::fetch_digest("MD5", ::EVP_md5);
+        return md;
+    }
+
     static const error::cryptographic_errors errc = error::hmac_md5_error;
 };
 
 struct hmac_sha1_engine
 {
-    ::EVP_MD const * evp() const { return ::EVP_sha1(); }
+    static ::EVP_MD const * evp()
+    {
+        static ::EVP_MD const * md = detail::fetch_digest("SHA1", ::EVP_sha1);
+        return md;
+    }
+
     static const error::cryptographic_errors errc = error::hmac_sha1_error;
 };
 
 struct hmac_sha256_engine
 {
-    ::EVP_MD const * evp() const { return ::EVP_sha256(); }
+    static ::EVP_MD const * evp()
+    {
+        static ::EVP_MD const * md = detail::fetch_digest("SHA256", ::EVP_sha256);
+        return md;
+    }
+
     static const error::cryptographic_errors errc = error::hmac_sha256_error;
 };
 
 struct hmac_sha512_engine
 {
-    ::EVP_MD const * evp() const { return ::EVP_sha512(); }
+    static ::EVP_MD const * evp()
+    {
+        static ::EVP_MD const * md = detail::fetch_digest("SHA512", ::EVP_sha512);
+        return md;
+    }
+
     static const error::cryptographic_errors errc = error::hmac_sha512_error;
 };
 
+
+namespace detail {
+
+/*!
+  HMAC の鍵から、内側と外側のハッシュの途中の状態を作る.
+  H(K ^ ipad) と H(K ^ opad) の最初のブロックを計算して、それぞれ inner と outer に残す
+ */
+template <typename Engine>
+inline void init_hmac_pads(::EVP_MD_CTX * inner, ::EVP_MD_CTX * outer, void const * key, std::size_t len, boost::system::error_code & ec) noexcept
+{
+    //! ダイジェストのブロック長の最大値 (SHA3-224 の 144 バイト)
+    constexpr std::size_t max_block_size = 144;
+
+    ::EVP_MD const * md = Engine::evp();
+    std::size_t block_size = static_cast<std::size_t>(::EVP_MD_block_size(md));
+    unsigned char kbuf[max_block_size] = {};
+    if (!inner || !outer || block_size > sizeof(kbuf)) {
+        ec = make_error_code(Engine::errc);
+        return;
+    }
+
+    // ブロック長より長い鍵は、ハッシュ値を鍵にする
+    if (len > block_size) {
+        if (::EVP_DigestInit_ex(inner, md, nullptr) != 1 ||
+            ::EVP_DigestUpdate(inner, key, len) != 1 ||
+            ::EVP_DigestFinal_ex(inner, kbuf, nullptr) != 1) {
+            ec = make_error_code(Engine::errc);
+            return;
+        }
+    } else if (len > 0) {
+        std::memcpy(kbuf, key, len);
+    }
+
+    unsigned char pad[max_block_size];
+    for(std::size_t i = 0; i < block_size; ++i)
+        pad[i] = static_cast<unsigned char>(kbuf[i] ^ 0x36);
+    if (::EVP_DigestInit_ex(inner, md, nullptr) != 1 ||
+        ::EVP_DigestUpdate(inner, pad, block_size) != 1)
+        ec = make_error_code(Engine::errc);
+    for(std::size_t i = 0; i < block_size; ++i)
+        pad[i] = static_cast<unsigned char>(kbuf[i] ^ 0x5c);
+    if (::EVP_DigestInit_ex(outer, md, nullptr) != 1 ||
+        ::EVP_DigestUpdate(outer, pad, block_size) != 1)
+        ec = make_error_code(Engine::errc);
+
+    ::OPENSSL_cleanse(kbuf, sizeof(kbuf));
+    ::OPENSSL_cleanse(pad, sizeof(pad));
+}
+
+
+/*!
+  前処理済みの鍵が持つ、内側と外側のハッシュの途中の状態.
+  メッセージごとに EVP_MD_CTX_copy_ex で複製する
+ */
 template <typename Engine>
-class hmac_context
-    : private Engine
+class hmac_pads
 {
 public:
-    hmac_context() noexcept
+    void init(void const * key, std::size_t len, boost::system::error_code & ec) noexcept
     {
-        ::HMAC_CTX_init(&context);
+        init_hmac_pads<Engine>(inner_.get(), outer_.get(), key, len, ec);
     }
 
-    ~hmac_context() noexcept
+    ::EVP_MD_CTX const * inner() const noexcept
     {
-        ::HMAC_CTX_cleanup(&context);
+        return inner_.get();
     }
 
+    ::EVP_MD_CTX const * outer() const noexcept
+    {
+        return outer_.get();
+    }
+
+private:
+    evp_md_ctx inner_{true};
+    evp_md_ctx outer_{true};
+};
+
+}  // detail
+
+
+/*!
+  前処理済みの HMAC の鍵.
+
+  同じ鍵で多くのメッセージを署名するときに一度だけ作っておき、フィルタに渡す。
+  鍵のパディングとその1ブロック分のハッシュ計算をメッセージごとにしなくてよくなる。
+  作った後は変更しないので、複数のスレッドのフィルタから同時に使える
+ */
+template <typename Engine>
+class hmac_key
+{
+public:
+    hmac_key(void const * key, std::size_t len)
+    {
+        boost::system::error_code ec;
+        auto pads = std::make_shared<detail::hmac_pads<Engine>>();
+        pads->init(key, len, ec);
+        if (ec) throw boost::system::system_error(ec, "hmac_key");
+        pads_ = std::move(pads);
+    }
+
+    template <typename Key>
+    explicit hmac_key(Key const & key)
+        : hmac_key(key.data(), key.size())
+    {
+    }
+
+private:
+    friend class hmac_context<Engine>;
+    std::shared_ptr<detail::hmac_pads<Engine> const> pads_;
+};
+
+
+/*!
+  HMAC の計算.
+  生の鍵で初期化したときは外側の状態を outer_ に持ち、前処理済みの鍵で初期化したときはその鍵の状態を参照する。
+  どちらの場合もヒープには確保せず、EVP_MD_CTX はスレッドごとのプールから借りる
+ */
+template <typename Engine>
+class hmac_context
+{
+public:
     void init(void const * key, std::size_t len, boost::system::error_code & ec) noexcept
     {
-        if (::HMAC_Init_ex(&context, key, static_cast<int>(len), Engine::evp(), NULL) != 1)
+        key_.reset();
+        detail::init_hmac_pads<Engine>(work_.get(), outer_.get(), key, len, ec);
+    }
+
+    void init(hmac_key<Engine> const & key, boost::system::error_code & ec) noexcept
+    {
+        key_ = key.pads_;
+        if (!work_.get() || ::EVP_MD_CTX_copy_ex(work_.get(), key_->inner()) != 1)
             ec = make_error_code(Engine::errc);
     }
 
     void update(char const * s, std::size_t n, boost::system::error_code & ec) noexcept
     {
-        if (::HMAC_Update(&context, reinterpret_cast<unsigned char const *>(s), n) != 1)
+        if (::EVP_DigestUpdate(work_.get(), s, n) != 1)
             ec = make_error_code(Engine::errc);
     }
 
-    void finish(unsigned char * buffer, std::size_t size, boost::system::error_code & ec) noexcept
+    void finish(unsigned char * buffer, std::size_t, boost::system::error_code & ec) noexcept
     {
-        unsigned int len = static_cast<unsigned int>(size);
-        if (::HMAC_Final(&context, buffer, &len) != 1)
+        unsigned char md[EVP_MAX_MD_SIZE];
+        unsigned int len = 0;
+        ::EVP_MD_CTX const * outer = key_ ? key_->outer() : outer_.get();
+        if (::EVP_DigestFinal_ex(work_.get(), md, &len) != 1 ||
+            ::EVP_MD_CTX_copy_ex(work_.get(), outer) != 1 ||
+            ::EVP_DigestUpdate(work_.get(), md, len) != 1 ||
+            ::EVP_DigestFinal_ex(work_.get(), buffer, nullptr) != 1)
             ec = make_error_code(Engine::errc);
     }
 
 private:
-    ::HMAC_CTX context;
+    std::shared_ptr<detail::hmac_pads<Engine> const> key_;
+    detail::evp_md_ctx work_{true};
+    detail::evp_md_ctx outer_{true};
 };
 
 } } }
@@ -9,36 +9,24 @@
  */
 
 #include <acqua/iostreams/crypto/md5_filter.hpp>
-#include <acqua/iostreams/error.hpp>
-
-extern "C" {
-#include <openssl/md5.h>
-}
+#include <acqua/iostreams/crypto/detail/evp_context.hpp>
 
 namespace acqua { namespace iostreams { namespace crypto {
 
-class md5_context
+struct md5_engine
 {
-public:
-    void init(boost::system::error_code & ec) noexcept
-    {
-        if (::MD5_Init(&context) != 1)
-            ec = make_error_code(error::md5_error);
-    }
-
-    void update(char const * s, std::size_t n, boost::system::error_code & ec) noexcept
+    static ::EVP_MD const * evp()
     {
-        if (::MD5_Update(&context, s, n) != 1)
-            ec = make_error_code(error::md5_error);
+        static ::EVP_MD const * md = detail::fetch_digest("MD5", ::EVP_md5);
+        return md;
     }
 
-    void finish(unsigned char * buffer, std::size_t, boost::system::error_code & ec) noexcept
-    {
-        if (::MD5_Final(buffer, &context) != 1)
-            ec = make_error_code(error::md5_error);
-    }
+    static const error::cryptographic_errors errc = error::md5_error;
+};
 
-    ::MD5_CTX context;
+class md5_context
+    : public detail::evp_digest_context<md5_engine>
+{
 };
 
 } } }
@@ -9,37 +9,28 @@
  */
 
 #include <acqua/iostreams/crypto/sha256_filter.hpp>
-#include <acqua/iostreams/error.hpp>
-
-extern "C" {
-#include <openssl/sha.h>
-}
+#include <acqua/iostreams/crypto/detail/evp_context.hpp>
 
 namespace acqua { namespace iostreams { namespace crypto {
 
-class sha256_context
+struct sha256_engine
 {
-public:
-    void init(boost::system::error_code & ec) noexcept
-    {
-        if (::SHA256_Init(&context) != 1)
-            ec = make_error_code(error::sha256_error);
-    }
-
-    void update(char const * s, std::size_t n, boost::system::error_code & ec) noexcept
+    static ::EVP_MD const * evp()
     {
-        if (::SHA256_Update(&context, s, n) != 1)
-            ec = make_error_code(error::sha256_error);
+        static ::EVP_MD const * md = detail::fetch_digest("SHA256", ::EVP_sha256);
+        return md;
     }
 
-    void finish(unsigned char * buffer, std::size_t, boost::system::error_code & ec) noexcept
-    {
-        if (::SHA256_Final(buffer, &context) != 1)
-            ec = make_error_code(error::sha256_error);
-    }
+    static const error::cryptographic_errors errc = error::sha256_error;
+};
 
-private:
-    ::SHA256_CTX context;
+/*!
+  EVP による SHA-256.
+  OpenSSL が CPU に合わせて SHA 拡張命令などの実装を選ぶ
+ */
+class sha256_context
+    : public detail::evp_digest_context<sha256_engine>
+{
 };
 
 } } }
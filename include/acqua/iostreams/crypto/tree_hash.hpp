@@ -0,0 +1,150 @@
+/*!
+  acqua library
+
+  Copyright (c) 2016 Haruhiko Uchida
+  The software is released under the MIT license.
+  http://opensource.org/licenses/mit-license.php
+ */
+
+#pragma once
+
+#include <acqua/iostreams/crypto/batch_hash.hpp>
+#include <acqua/iostreams/crypto/basic_hash_filter.hpp>
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace acqua { namespace iostreams { namespace crypto {
+
+/*!
+  入力を固定長のチャンクに分けて計算する木構造のハッシュ (Merkle tree).
+
+  葉は H(0x00 || チャンク)、節は H(0x01 || 左 || 右) で、RFC 6962 と同じく
+  n 個の葉を n 未満の最大の 2 のべき乗の位置で左右に分ける。空の入力は空のチャンク1つになる。
+  通常のハッシュ値とは異なるが、チャンクを basic_batch_hash で同時に計算できるので、
+  1つの大きな入力でも複数のレーンとスレッドを使える。
+
+  init(), update(), finish() を持つので、basic_hash_filter の Context としても使える。
+ */
+template <typename Context, std::size_t DigestSize>
+class basic_tree_hash
+{
+public:
+    using batch_type = basic_batch_hash<Context, DigestSize>;
+    using digest_type = typename batch_type::digest_type;
+    static constexpr std::size_t default_chunk_size = 1024 * 1024;
+
+public:
+    //! threads は葉の計算に使うスレッドの数. レーン数とスレッド数の積だけチャンクを溜めてから計算する
+    explicit basic_tree_hash(std::size_t chunk_size = default_chunk_size, std::size_t threads = 1)
+        : batch_(threads)
+        , chunk_size_(std::max(chunk_size, std::size_t(1)))
+    {
+        std::size_t lanes = batch_.multi_buffer() ? detail::multi_buffer<Context>::lanes : 1;
+        batch_chunks_ = lanes * batch_.threads();
+    }
+
+    std::size_t chunk_size() const noexcept
+    {
+        return chunk_size_;
+    }
+
+    void init(boost::system::error_code &) noexcept
+    {
+        pending_.clear();
+        stack_.clear();
+        leaves_ = 0;
+    }
+
+    void update(char const * s, std::size_t n, boost::system::error_code & ec)
+    {
+        std::size_t capacity = chunk_size_ * batch_chunks_;
+        while(n > 0) {
+            // 最後のチャンクはちょうど埋まっていても finish() まで残しておく
+            if (pending_.size() == capacity) {
+                flush(ec);
+                if (ec) return;
+            }
+            std::size_t len = std::min(n, capacity - pending_.size());
+            pending_.insert(pending_.end(), s, s + len);
+            s += len;
+            n -= len;
+        }
+    }
+
+    void finish(unsigned char * buffer, std::size_t, boost::system::error_code & ec)
+    {
+        if (!pending_.empty() || leaves_ == 0)
+            flush(ec);
+        if (ec) return;
+
+        digest_type root = stack_.back().second;
+        stack_.pop_back();
+        while(!stack_.empty() && !ec) {
+            root = combine(stack_.back().second, root, ec);
+            stack_.pop_back();
+        }
+        std::memcpy(buffer, root.data(), DigestSize);
+    }
+
+private:
+    //! 溜めたチャンクの葉をまとめて計算し、木に加える
+    void flush(boost::system::error_code & ec)
+    {
+        std::size_t count = std::max((pending_.size() + chunk_size_ - 1) / chunk_size_, std::size_t(1));
+        std::vector<digest_type> digests(count);
+        std::vector<detail::hash_job> jobs(count);
+        for(std::size_t i = 0; i < count; ++i) {
+            std::size_t beg = i * chunk_size_;
+            std::size_t len = std::min(chunk_size_, pending_.size() - beg);
+            jobs[i] = { pending_.data() + beg, len, 0x00, digests[i].data() };
+        }
+        batch_.compute(jobs.data(), count, ec);
+        if (ec) return;
+        pending_.clear();
+
+        for(auto const & digest : digests)
+            push(digest, ec);
+    }
+
+    //! 同じ高さの部分木が並んだら、節にまとめる
+    void push(digest_type digest, boost::system::error_code & ec)
+    {
+        ++leaves_;
+        std::size_t level = 0;
+        while(!stack_.empty() && stack_.back().first == level && !ec) {
+            digest = combine(stack_.back().second, digest, ec);
+            stack_.pop_back();
+            ++level;
+        }
+        stack_.emplace_back(level, digest);
+    }
+
+    digest_type combine(digest_type const & lhs, digest_type const & rhs, boost::system::error_code & ec)
+    {
+        char node[1 + DigestSize * 2];
+        node[0] = 0x01;
+        std::memcpy(node + 1, lhs.data(), DigestSize);
+        std::memcpy(node + 1 + DigestSize, rhs.data(), DigestSize);
+
+        digest_type res;
+        Context ctx;
+        ctx.init(ec);
+        if (!ec) ctx.update(node, sizeof(node), ec);
+        if (!ec) ctx.finish(res.data(), DigestSize, ec);
+        return res;
+    }
+
+private:
+    batch_type batch_;
+    std::size_t chunk_size_;
+    std::size_t batch_chunks_;
+    std::vector<unsigned char> pending_;
+    std::vector<std::pair<std::size_t, digest_type>> stack_;
+    std::size_t leaves_ = 0;
+};
+
+using sha256_tree_hash = basic_tree_hash<sha256_context, 32>;
+using sha256_tree_filter = basic_hash_filter<sha256_tree_hash, 32>;
+
+} } }
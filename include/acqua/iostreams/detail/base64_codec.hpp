@@ -0,0 +1,262 @@
+/*!
+  acqua library
+
+  Copyright (c) 2016 Haruhiko Uchida
+  The software is released under the MIT license.
+  http://opensource.org/licenses/mit-license.php
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) && !defined(ACQUA_IOSTREAMS_BASE64_NO_SIMD)
+# define ACQUA_IOSTREAMS_BASE64_X86 1
+# include <immintrin.h>
+#endif
+
+namespace acqua { namespace iostreams { namespace detail {
+
+/*!
+  base64 の変換表.
+  62 番目と 63 番目の文字だけが base64 と base64url で異なる。dec は base64 の文字でなければ 64 になる
+ */
+struct base64_table
+{
+    char enc[64];
+    unsigned char dec[256];
+    char c62;
+    char c63;
+
+    constexpr base64_table(char plus, char slash)
+        : enc(), dec(), c62(plus), c63(slash)
+    {
+        for(int i = 0; i < 256; ++i)
+            dec[i] = 64;
+        for(int i = 0; i < 26; ++i) {
+            enc[i] = static_cast<char>('A' + i);
+            enc[i + 26] = static_cast<char>('a' + i);
+            dec['A' + i] = static_cast<unsigned char>(i);
+            dec['a' + i] = static_cast<unsigned char>(i + 26);
+        }
+        for(int i = 0; i < 10; ++i) {
+            enc[i + 52] = static_cast<char>('0' + i);
+            dec['0' + i] = static_cast<unsigned char>(i + 52);
+        }
+        enc[62] = plus;
+        enc[63] = slash;
+        dec[static_cast<unsigned char>(plus)] = 62;
+        dec[static_cast<unsigned char>(slash)] = 63;
+    }
+};
+
+
+//! 3バイトずつ groups 個を、4文字ずつに変換する.
+inline void base64_encode_scalar(base64_table const & t, unsigned char const * in, std::size_t groups, char * out) noexcept
+{
+    for(; groups > 0; --groups, in += 3, out += 4) {
+        std::uint32_t v = static_cast<std::uint32_t>(in[0] << 16 | in[1] << 8 | in[2]);
+        out[0] = t.enc[(v >> 18) & 0x3F];
+        out[1] = t.enc[(v >> 12) & 0x3F];
+        out[2] = t.enc[(v >>  6) & 0x3F];
+        out[3] = t.enc[(v >>  0) & 0x3F];
+    }
+}
+
+
+#if defined(ACQUA_IOSTREAMS_BASE64_X86)
+
+/*
+  SIMD による変換.
+
+  エンコードは 12 バイトを 16 バイトのレジスタに並べ替え、乗算のシフトで 6 ビットずつに分けてから、
+  値の範囲ごとの差分を pshufb の表引きで求めて加算する。
+  デコードは範囲の比較で文字を値に変換し、1つでも base64 の文字でなければブロックを処理せずに返す。
+  値は pmaddubsw と pmaddwd で 24 ビットずつに詰める。
+ */
+
+__attribute__((target("ssse3")))
+inline __m128i base64_encode_block_ssse3(__m128i in, __m128i shift_lut) noexcept
+{
+    in = _mm_shuffle_epi8(in, _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10));
+    __m128i t0 = _mm_mulhi_epu16(_mm_and_si128(in, _mm_set1_epi32(0x0FC0FC00)), _mm_set1_epi32(0x04000040));
+    __m128i t1 = _mm_mullo_epi16(_mm_and_si128(in, _mm_set1_epi32(0x003F03F0)), _mm_set1_epi32(0x01000010));
+    __m128i idx = _mm_or_si128(t0, t1);
+
+    // 0..25 => 13, 26..51 => 0, 52..61 => 1..10, 62 => 11, 63 => 12
+    __m128i res = _mm_subs_epu8(idx, _mm_set1_epi8(51));
+    res = _mm_or_si128(res, _mm_and_si128(_mm_cmpgt_epi8(_mm_set1_epi8(26), idx), _mm_set1_epi8(13)));
+    return _mm_add_epi8(_mm_shuffle_epi8(shift_lut, res), idx);
+}
+
+__attribute__((target("ssse3")))
+inline __m128i base64_shift_lut_ssse3(base64_table const & t) noexcept
+{
+    return _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                         '0' - 52, '0' - 52, '0' - 52, static_cast<char>(t.c62 - 62), static_cast<char>(t.c63 - 63), 'A', 0, 0);
+}
+
+__attribute__((target("ssse3")))
+inline std::size_t base64_encode_ssse3(base64_table const & t, unsigned char const * in, std::size_t groups, char * out) noexcept
+{
+    // 16 バイトを読み込んで 12 バイトを使うので、最後の 4 バイトは読み込まずに残す
+    __m128i const lut = base64_shift_lut_ssse3(t);
+    std::size_t done = 0;
+    for(; (groups - done) * 3 >= 16; done += 4, in += 12, out += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<__m128i const *>(in));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out), base64_encode_block_ssse3(v, lut));
+    }
+    return done;
+}
+
+__attribute__((target("ssse3")))
+inline std::size_t base64_decode_ssse3(base64_table const & t, char const * in, std::size_t n, unsigned char * out) noexcept
+{
+    // 16 文字を 12 バイトに変換するが、書き込みは 16 バイト単位で行う
+    std::size_t done = 0;
+    for(; n - done >= 16; done += 16, in += 16, out += 12) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<__m128i const *>(in));
+        __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(x, _mm_set1_epi8('A' - 1)), _mm_cmpgt_epi8(_mm_set1_epi8('Z' + 1), x));
+        __m128i lower = _mm_and_si128(_mm_cmpgt_epi8(x, _mm_set1_epi8('a' - 1)), _mm_cmpgt_epi8(_mm_set1_epi8('z' + 1), x));
+        __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(x, _mm_set1_epi8('0' - 1)), _mm_cmpgt_epi8(_mm_set1_epi8('9' + 1), x));
+        __m128i c62 = _mm_cmpeq_epi8(x, _mm_set1_epi8(t.c62));
+        __m128i c63 = _mm_cmpeq_epi8(x, _mm_set1_epi8(t.c63));
+        __m128i valid = _mm_or_si128(_mm_or_si128(upper, lower), _mm_or_si128(_mm_or_si128(digit, c62), c63));
+        if (_mm_movemask_epi8(valid) != 0xFFFF)
+            break;
+
+        __m128i shift = _mm_or_si128(
+            _mm_or_si128(_mm_and_si128(upper, _mm_set1_epi8(-'A')), _mm_and_si128(lower, _mm_set1_epi8(26 - 'a'))),
+            _mm_or_si128(_mm_and_si128(digit, _mm_set1_epi8(52 - '0')),
+                         _mm_or_si128(_mm_and_si128(c62, _mm_set1_epi8(static_cast<char>(62 - t.c62))),
+                                      _mm_and_si128(c63, _mm_set1_epi8(static_cast<char>(63 - t.c63))))));
+        x = _mm_add_epi8(x, shift);
+        x = _mm_maddubs_epi16(x, _mm_set1_epi32(0x01400140));
+        x = _mm_madd_epi16(x, _mm_set1_epi32(0x00011000));
+        x = _mm_shuffle_epi8(x, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out), x);
+    }
+    return done;
+}
+
+__attribute__((target("avx2")))
+inline std::size_t base64_encode_avx2(base64_table const & t, unsigned char const * in, std::size_t groups, char * out) noexcept
+{
+    __m128i const lut128 = base64_shift_lut_ssse3(t);
+    __m256i const lut = _mm256_broadcastsi128_si256(lut128);
+    __m256i const shuffle = _mm256_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10,
+                                             1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+    std::size_t done = 0;
+    // 2つのレーンに 12 バイトずつ読み込むので、in + 12 から 16 バイトが読めなければならない
+    for(; (groups - done) * 3 >= 28; done += 8, in += 24, out += 32) {
+        __m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<__m128i const *>(in))),
+                                            _mm_loadu_si128(reinterpret_cast<__m128i const *>(in + 12)), 1);
+        v = _mm256_shuffle_epi8(v, shuffle);
+        __m256i t0 = _mm256_mulhi_epu16(_mm256_and_si256(v, _mm256_set1_epi32(0x0FC0FC00)), _mm256_set1_epi32(0x04000040));
+        __m256i t1 = _mm256_mullo_epi16(_mm256_and_si256(v, _mm256_set1_epi32(0x003F03F0)), _mm256_set1_epi32(0x01000010));
+        __m256i idx = _mm256_or_si256(t0, t1);
+        __m256i res = _mm256_subs_epu8(idx, _mm256_set1_epi8(51));
+        res = _mm256_or_si256(res, _mm256_and_si256(_mm256_cmpgt_epi8(_mm256_set1_epi8(26), idx), _mm256_set1_epi8(13)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out), _mm256_add_epi8(_mm256_shuffle_epi8(lut, res), idx));
+    }
+    return done + base64_encode_ssse3(t, in, groups - done, out);
+}
+
+__attribute__((target("avx2")))
+inline std::size_t base64_decode_avx2(base64_table const & t, char const * in, std::size_t n, unsigned char * out) noexcept
+{
+    std::size_t done = 0;
+    for(; n - done >= 32; done += 32, in += 32, out += 24) {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(in));
+        __m256i upper = _mm256_and_si256(_mm256_cmpgt_epi8(x, _mm256_set1_epi8('A' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('Z' + 1), x));
+        __m256i lower = _mm256_and_si256(_mm256_cmpgt_epi8(x, _mm256_set1_epi8('a' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), x));
+        __m256i digit = _mm256_and_si256(_mm256_cmpgt_epi8(x, _mm256_set1_epi8('0' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), x));
+        __m256i c62 = _mm256_cmpeq_epi8(x, _mm256_set1_epi8(t.c62));
+        __m256i c63 = _mm256_cmpeq_epi8(x, _mm256_set1_epi8(t.c63));
+        __m256i valid = _mm256_or_si256(_mm256_or_si256(upper, lower), _mm256_or_si256(_mm256_or_si256(digit, c62), c63));
+        if (_mm256_movemask_epi8(valid) != -1)
+            break;
+
+        __m256i shift = _mm256_or_si256(
+            _mm256_or_si256(_mm256_and_si256(upper, _mm256_set1_epi8(-'A')), _mm256_and_si256(lower, _mm256_set1_epi8(26 - 'a'))),
+            _mm256_or_si256(_mm256_and_si256(digit, _mm256_set1_epi8(52 - '0')),
+                            _mm256_or_si256(_mm256_and_si256(c62, _mm256_set1_epi8(static_cast<char>(62 - t.c62))),
+                                            _mm256_and_si256(c63, _mm256_set1_epi8(static_cast<char>(63 - t.c63))))));
+        x = _mm256_add_epi8(x, shift);
+        x = _mm256_maddubs_epi16(x, _mm256_set1_epi32(0x01400140));
+        x = _mm256_madd_epi16(x, _mm256_set1_epi32(0x00011000));
+        x = _mm256_shuffle_epi8(x, _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+                                                    2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+        x = _mm256_permutevar8x32_epi32(x, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out), x);
+    }
+    return done + base64_decode_ssse3(t, in, n - done, out);
+}
+
+#endif  // ACQUA_IOSTREAMS_BASE64_X86
+
+
+inline std::size_t base64_encode_none(base64_table const &, unsigned char const *, std::size_t, char *) noexcept
+{
+    return 0;
+}
+
+inline std::size_t base64_decode_none(base64_table const &, char const *, std::size_t, unsigned char *) noexcept
+{
+    return 0;
+}
+
+
+/*!
+  実行中の CPU で使えるブロック変換の関数.
+  初めて使うときに CPU の機能を調べて、AVX2、SSSE3、表引きのみ、の順に選ぶ
+ */
+struct base64_codec
+{
+    using encode_type = std::size_t (*)(base64_table const &, unsigned char const *, std::size_t, char *);
+    using decode_type = std::size_t (*)(base64_table const &, char const *, std::size_t, unsigned char *);
+
+    encode_type encode;
+    decode_type decode;
+    char const * name;
+
+    static base64_codec const & instance() noexcept
+    {
+        static base64_codec const codec = select();
+        return codec;
+    }
+
+    static base64_codec select() noexcept
+    {
+#if defined(ACQUA_IOSTREAMS_BASE64_X86)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+            return { &base64_encode_avx2, &base64_decode_avx2, "avx2" };
+        if (__builtin_cpu_supports("ssse3"))
+            return { &base64_encode_ssse3, &base64_decode_ssse3, "ssse3" };
+#endif
+        return { &base64_encode_none, &base64_decode_none, "scalar" };
+    }
+};
+
+
+/*!
+  3バイトずつ groups 個を変換する. out には groups * 4 文字を書き込む
+ */
+inline void base64_encode_groups(base64_table const & t, unsigned char const * in, std::size_t groups, char * out) noexcept
+{
+    std::size_t done = base64_codec::instance().encode(t, in, groups, out);
+    base64_encode_scalar(t, in + done * 3, groups - done, out + done * 4);
+}
+
+/*!
+  改行などを含まない先頭のブロックをまとめて変換して、消費した文字数 (16 の倍数) を返す.
+  out には、消費した文字数の 3/4 に加えて 32 バイトの余裕がなければならない
+ */
+inline std::size_t base64_decode_blocks(base64_table const & t, char const * in, std::size_t n, unsigned char * out) noexcept
+{
+    return base64_codec::instance().decode(t, in, n, out);
+}
+
+} } }
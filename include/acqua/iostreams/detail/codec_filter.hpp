@@ -0,0 +1,146 @@
+/*!
+  acqua library
+
+  Copyright (c) 2016 Haruhiko Uchida
+  The software is released under the MIT license.
+  http://opensource.org/licenses/mit-license.php
+ */
+
+#pragma once
+
+#include <acqua/iostreams/detail/filter_buffer.hpp>
+#include <boost/iostreams/operations.hpp>
+#include <boost/iostreams/categories.hpp>
+#include <algorithm>
+#include <cstring>
+#include <memory>
+
+namespace acqua { namespace iostreams { namespace detail {
+
+/*!
+  圧縮や伸長のライブラリのストリーム API や、改行の変換のようなブロック単位の変換をフィルタにする.
+
+  Codec は次の関数を持つ。エラーは boost::system::system_error を投げる
+  - run(s, n, out, finish) : s から n バイトを変換して out に追記する。finish が true のときは入力の終わりを処理する
+  - reset() : 次のフレームのために状態を戻す
+
+  Codec はライブラリのコンテキストを持つことがあるのでムーブだけできればよい。フィルタは boost::iostreams にコピーされるので、shared_ptr で共有する。
+  input_filter と output_filter の両方を指定できるが、１つのインスタンスに対してどちらか片方しか使用してはいけない
+ */
+template <typename Codec>
+class codec_filter
+{
+    static std::size_t const block_size = 64 * 1024;
+
+public:
+    struct category : boost::iostreams::multichar_dual_use_filter_tag, boost::iostreams::closable_tag {};
+    using char_type = char;
+    using codec_type = Codec;
+
+public:
+    explicit codec_filter(Codec && codec)
+        : impl_(std::make_shared<impl>(std::move(codec)))
+    {
+    }
+
+    template <typename Source>
+    std::streamsize read(Source & src, char * s, std::streamsize n)
+    {
+        auto & im = *impl_;
+        im.reading_ = true;
+        if (!im.in_)
+            im.in_.reset(new char[block_size]);
+        while(im.out_.empty()) {
+            if (im.eof_)
+                return -1;
+
+            std::streamsize res = boost::iostreams::read(src, im.in_.get(), static_cast<std::streamsize>(block_size));
+            if (res < 0) {
+                im.codec_.run(nullptr, 0, im.out_, true);
+                im.eof_ = true;
+            } else if (res == 0) {
+                return 0;
+            } else {
+                im.codec_.run(im.in_.get(), static_cast<std::size_t>(res), im.out_, false);
+            }
+        }
+        return im.out_.take(s, n);
+    }
+
+    /*!
+      boost::iostreams は既定では 128 バイトずつ書き込むので、block_size まで溜めてから変換する.
+      溜まっていなければ、大きな書き込みはそのまま変換する
+     */
+    template <typename Sink>
+    std::streamsize write(Sink & sink, char const * s, std::streamsize n)
+    {
+        auto & im = *impl_;
+        if (!im.out_.flush(sink))
+            return 0;
+        if (!im.in_)
+            im.in_.reset(new char[block_size]);
+
+        std::streamsize done = 0;
+        while(done < n) {
+            std::size_t rest = static_cast<std::size_t>(n - done);
+            if (im.in_size_ == 0 && rest >= block_size) {
+                im.codec_.run(s + done, block_size, im.out_, false);
+                done += static_cast<std::streamsize>(block_size);
+            } else {
+                std::size_t len = std::min(rest, block_size - im.in_size_);
+                std::memcpy(im.in_.get() + im.in_size_, s + done, len);
+                im.in_size_ += len;
+                done += static_cast<std::streamsize>(len);
+                if (im.in_size_ < block_size)
+                    break;
+                im.codec_.run(im.in_.get(), im.in_size_, im.out_, false);
+                im.in_size_ = 0;
+            }
+            if (!im.out_.flush(sink))
+                break;
+        }
+        return done;
+    }
+
+    template <typename Device>
+    void close(Device & dev, std::ios_base::openmode which)
+    {
+        auto & im = *impl_;
+        if (which == std::ios_base::out && !im.reading_) {
+            im.codec_.run(im.in_.get(), im.in_size_, im.out_, true);
+            im.out_.flush(dev);
+        }
+        if ((which == std::ios_base::in) == im.reading_) {
+            im.codec_.reset();
+            im.out_.clear();
+            im.in_size_ = 0;
+            im.eof_ = false;
+            im.reading_ = false;
+        }
+    }
+
+    Codec & codec() noexcept
+    {
+        return impl_->codec_;
+    }
+
+private:
+    struct impl
+    {
+        explicit impl(Codec && codec)
+            : codec_(std::move(codec))
+        {
+        }
+
+        Codec codec_;
+        filter_buffer out_;
+        std::unique_ptr<char[]> in_;
+        std::size_t in_size_ = 0;
+        bool eof_ = false;
+        bool reading_ = false;
+    };
+
+    std::shared_ptr<impl> impl_;
+};
+
+} } }
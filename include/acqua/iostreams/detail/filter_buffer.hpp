@@ -0,0 +1,103 @@
+/*!
+  acqua library
+
+  Copyright (c) 2016 Haruhiko Uchida
+  The software is released under the MIT license.
+  http://opensource.org/licenses/mit-license.php
+ */
+
+#pragma once
+
+#include <boost/iostreams/operations.hpp>
+#include <algorithm>
+#include <cstring>
+#include <ios>
+#include <vector>
+
+namespace acqua { namespace iostreams { namespace detail {
+
+/*!
+  multichar フィルタの変換結果を溜めるバッファ.
+
+  フィルタはブロック単位で変換した結果をここに追記し、
+  入力フィルタとしては read() の呼び出し元へ、出力フィルタとしては sink へ少しずつ渡す。
+ */
+class filter_buffer
+{
+public:
+    //! まだ渡していない文字数を返す.
+    std::size_t size() const noexcept
+    {
+        return data_.size() - pos_;
+    }
+
+    bool empty() const noexcept
+    {
+        return pos_ == data_.size();
+    }
+
+    //! 末尾に n 文字分の領域を確保して、その先頭を返す. 書き込んだ後に commit() で実際の文字数を確定する
+    char * prepare(std::size_t n)
+    {
+        std::size_t used = data_.size();
+        data_.resize(used + n);
+        return data_.data() + used;
+    }
+
+    void commit(char const * end) noexcept
+    {
+        data_.resize(static_cast<std::size_t>(end - data_.data()));
+    }
+
+    void push_back(char ch)
+    {
+        data_.push_back(ch);
+    }
+
+    void append(char const * s, std::size_t n)
+    {
+        data_.insert(data_.end(), s, s + n);
+    }
+
+    //! 最大 n 文字を s にコピーして、コピーした文字数を返す.
+    std::streamsize take(char * s, std::streamsize n) noexcept
+    {
+        std::size_t len = std::min(size(), static_cast<std::size_t>(n));
+        std::memcpy(s, data_.data() + pos_, len);
+        consume(len);
+        return static_cast<std::streamsize>(len);
+    }
+
+    //! すべてを sink に書き出す. sink がすべてを受け取らなければ false を返す
+    template <typename Sink>
+    bool flush(Sink & sink)
+    {
+        while(!empty()) {
+            std::streamsize res = boost::iostreams::write(sink, data_.data() + pos_, static_cast<std::streamsize>(size()));
+            if (res <= 0)
+                return false;
+            consume(static_cast<std::size_t>(res));
+        }
+        return true;
+    }
+
+    void clear() noexcept
+    {
+        data_.clear();
+        pos_ = 0;
+    }
+
+private:
+    void consume(std::size_t n) noexcept
+    {
+        pos_ += n;
+        if (pos_ == data_.size())
+            clear();
+    }
+
+private:
+    std::vector<char> data_;
+    std::size_t pos_ = 0;
+};
+
+} } }
@@ -0,0 +1,390 @@
+/*!
+  acqua library
+
+  Copyright (c) 2016 Haruhiko Uchida
+  The software is released under the MIT license.
+  http://opensource.org/licenses/mit-license.php
+ */
+
+#pragma once
+
+#include <acqua/iostreams/detail/json_number.hpp>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace acqua { namespace iostreams { namespace detail {
+
+//! 64 ビットの仮数と 2 の指数で表した浮動小数点数
+struct json_diy_fp
+{
+    std::uint64_t f;
+    int e;
+
+    json_diy_fp operator-(json_diy_fp const & rhs) const noexcept
+    {
+        return json_diy_fp{ f - rhs.f, e };
+    }
+
+    //! 128 ビットの積を四捨五入して上位 64 ビットにする
+    json_diy_fp operator*(json_diy_fp const & rhs) const noexcept
+    {
+        __extension__ using uint128_type = unsigned __int128;
+        uint128_type p = static_cast<uint128_type>(f) * rhs.f;
+        std::uint64_t h = static_cast<std::uint64_t>(p >> 64) + (static_cast<std::uint64_t>(p) >> 63);
+        return json_diy_fp{ h, e + rhs.e + 64 };
+    }
+
+    json_diy_fp normalize() const noexcept
+    {
+        int s = __builtin_clzll(f);
+        return json_diy_fp{ f << s, e - s };
+    }
+};
+
+
+/*!
+  10^k (k = -348 .. 340, 8 ごと) を 64 ビットの仮数に丸めた値.
+  f * 2^e が 10^k に最も近い
+ */
+struct json_cached_power
+{
+    std::uint64_t f;
+    int e;
+    int k;
+
+    static json_cached_power const * table() noexcept
+    {
+        static constexpr json_cached_power tbl[] = {
+            { 0xfa8fd5a0081c0288u, -1220, -348 },
+            { 0xbaaee17fa23ebf76u, -1193, -340 },
+            { 0x8b16fb203055ac76u, -1166, -332 },
+            { 0xcf42894a5dce35eau, -1140, -324 },
+            { 0x9a6bb0aa55653b2du, -1113, -316 },
+            { 0xe61acf033d1a45dfu, -1087, -308 },
+            { 0xab70fe17c79ac6cau, -1060, -300 },
+            { 0xff77b1fcbebcdc4fu, -1034, -292 },
+            { 0xbe5691ef416bd60cu, -1007, -284 },
+            { 0x8dd01fad907ffc3cu,  -980, -276 },
+            { 0xd3515c2831559a83u,  -954, -268 },
+            { 0x9d71ac8fada6c9b5u,  -927, -260 },
+            { 0xea9c227723ee8bcbu,  -901, -252 },
+            { 0xaecc49914078536du,  -874, -244 },
+            { 0x823c12795db6ce57u,  -847, -236 },
+            { 0xc21094364dfb5637u,  -821, -228 },
+            { 0x9096ea6f3848984fu,  -794, -220 },
+            { 0xd77485cb25823ac7u,  -768, -212 },
+            { 0xa086cfcd97bf97f4u,  -741, -204 },
+            { 0xef340a98172aace5u,  -715, -196 },
+            { 0xb23867fb2a35b28eu,  -688, -188 },
+            { 0x84c8d4dfd2c63f3bu,  -661, -180 },
+            { 0xc5dd44271ad3cdbau,  -635, -172 },
+            { 0x936b9fcebb25c996u,  -608, -164 },
+            { 0xdbac6c247d62a584u,  -582, -156 },
+            { 0xa3ab66580d5fdaf6u,  -555, -148 },
+            { 0xf3e2f893dec3f126u,  -529, -140 },
+            { 0xb5b5ada8aaff80b8u,  -502, -132 },
+            { 0x87625f056c7c4a8bu,  -475, -124 },
+            { 0xc9bcff6034c13053u,  -449, -116 },
+            { 0x964e858c91ba2655u,  -422, -108 },
+            { 0xdff9772470297ebdu,  -396, -100 },
+            { 0xa6dfbd9fb8e5b88fu,  -369,  -92 },
+            { 0xf8a95fcf88747d94u,  -343,  -84 },
+            { 0xb94470938fa89bcfu,  -316,  -76 },
+            { 0x8a08f0f8bf0f156bu,  -289,  -68 },
+            { 0xcdb02555653131b6u,  -263,  -60 },
+            { 0x993fe2c6d07b7facu,  -236,  -52 },
+            { 0xe45c10c42a2b3b06u,  -210,  -44 },
+            { 0xaa242499697392d3u,  -183,  -36 },
+            { 0xfd87b5f28300ca0eu,  -157,  -28 },
+            { 0xbce5086492111aebu,  -130,  -20 },
+            { 0x8cbccc096f5088ccu,  -103,  -12 },
+            { 0xd1b71758e219652cu,   -77,   -4 },
+            { 0x9c40000000000000u,   -50,    4 },
+            { 0xe8d4a51000000000u,   -24,   12 },
+            { 0xad78ebc5ac620000u,     3,   20 },
+            { 0x813f3978f8940984u,    30,   28 },
+            { 0xc097ce7bc90715b3u,    56,   36 },
+            { 0x8f7e32ce7bea5c70u,    83,   44 },
+            { 0xd5d238a4abe98068u,   109,   52 },
+            { 0x9f4f2726179a2245u,   136,   60 },
+            { 0xed63a231d4c4fb27u,   162,   68 },
+            { 0xb0de65388cc8ada8u,   189,   76 },
+            { 0x83c7088e1aab65dbu,   216,   84 },
+            { 0xc45d1df942711d9au,   242,   92 },
+            { 0x924d692ca61be758u,   269,  100 },
+            { 0xda01ee641a708deau,   295,  108 },
+            { 0xa26da3999aef774au,   322,  116 },
+            { 0xf209787bb47d6b85u,   348,  124 },
+            { 0xb454e4a179dd1877u,   375,  132 },
+            { 0x865b86925b9bc5c2u,   402,  140 },
+            { 0xc83553c5c8965d3du,   428,  148 },
+            { 0x952ab45cfa97a0b3u,   455,  156 },
+            { 0xde469fbd99a05fe3u,   481,  164 },
+            { 0xa59bc234db398c25u,   508,  172 },
+            { 0xf6c69a72a3989f5cu,   534,  180 },
+            { 0xb7dcbf5354e9beceu,   561,  188 },
+            { 0x88fcf317f22241e2u,   588,  196 },
+            { 0xcc20ce9bd35c78a5u,   614,  204 },
+            { 0x98165af37b2153dfu,   641,  212 },
+            { 0xe2a0b5dc971f303au,   667,  220 },
+            { 0xa8d9d1535ce3b396u,   694,  228 },
+            { 0xfb9b7cd9a4a7443cu,   720,  236 },
+            { 0xbb764c4ca7a44410u,   747,  244 },
+            { 0x8bab8eefb6409c1au,   774,  252 },
+            { 0xd01fef10a657842cu,   800,  260 },
+            { 0x9b10a4e5e9913129u,   827,  268 },
+            { 0xe7109bfba19c0c9du,   853,  276 },
+            { 0xac2820d9623bf429u,   880,  284 },
+            { 0x80444b5e7aa7cf85u,   907,  292 },
+            { 0xbf21e44003acdd2du,   933,  300 },
+            { 0x8e679c2f5e44ff8fu,   960,  308 },
+            { 0xd433179d9c8cb841u,   986,  316 },
+            { 0x9e19db92b4e31ba9u,  1013,  324 },
+            { 0xeb96bf6ebadf77d9u,  1039,  332 },
+            { 0xaf87023b9bf0ee6bu,  1066,  340 },
+        };
+        return tbl;
+    }
+
+    //! v の指数と足して [alpha, gamma] に入る 10 の累乗を選ぶ
+    static json_cached_power const & lookup(int alpha, int gamma, int e) noexcept
+    {
+        int const min_e = alpha - e - 64;
+        int const max_e = gamma - e - 64;
+        int const k = static_cast<int>(std::ceil((min_e + 63) * 0.30102999566398114));
+        int index = (348 + k - 1) / 8 + 1;
+        auto const * tbl = table();
+        while(tbl[index].e < min_e)
+            ++index;
+        while(tbl[index].e > max_e)
+            --index;
+        return tbl[index];
+    }
+};
+
+
+/*!
+  double を最も短い 10 進数に変換する (Grisu3).
+
+  digits に有効桁を書き込み、v = digits * 10^exponent となる exponent と桁数を求める。
+  境界の誤差のために最短の桁が決まらないとき (0.5% ほど) は false を返す
+ */
+class json_grisu
+{
+    static int const alpha = -60;
+    static int const gamma = -32;
+
+public:
+    static bool shortest(double v, char * digits, int & length, int & exponent) noexcept
+    {
+        std::uint64_t bits;
+        std::memcpy(&bits, &v, sizeof(bits));
+        std::uint64_t const hidden = std::uint64_t(1) << 52;
+        int const biased = static_cast<int>((bits >> 52) & 0x7FF);
+        json_diy_fp fp = { bits & (hidden - 1), 1 - 1075 };
+        if (biased != 0) {
+            fp.f |= hidden;
+            fp.e = biased - 1075;
+        }
+
+        // v の前後の double との中点
+        json_diy_fp plus = json_diy_fp{ (fp.f << 1) + 1, fp.e - 1 }.normalize();
+        json_diy_fp minus = (fp.f == hidden && biased > 1)
+            ? json_diy_fp{ (fp.f << 2) - 1, fp.e - 2 }
+            : json_diy_fp{ (fp.f << 1) - 1, fp.e - 1 };
+        minus.f <<= minus.e - plus.e;
+        minus.e = plus.e;
+        json_diy_fp w = fp.normalize();
+
+        json_cached_power const & c = json_cached_power::lookup(alpha, gamma, w.e);
+        json_diy_fp const ten_mk = { c.f, c.e };
+        int kappa;
+        length = 0;
+        if (!digit_gen(minus * ten_mk, w * ten_mk, plus * ten_mk, digits, length, kappa))
+            return false;
+        exponent = kappa - c.k;
+        return true;
+    }
+
+private:
+    static bool digit_gen(json_diy_fp low, json_diy_fp w, json_diy_fp high, char * buffer, int & length, int & kappa) noexcept
+    {
+        static std::uint32_t const powers[] = {
+            1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000
+        };
+
+        std::uint64_t unit = 1;
+        json_diy_fp const too_low = { low.f - unit, low.e };
+        json_diy_fp const too_high = { high.f + unit, high.e };
+        json_diy_fp unsafe_interval = too_high - too_low;
+        json_diy_fp const one = { std::uint64_t(1) << -w.e, w.e };
+        std::uint32_t integrals = static_cast<std::uint32_t>(too_high.f >> -one.e);
+        std::uint64_t fractionals = too_high.f & (one.f - 1);
+
+        int i = 9;
+        while(i >= 0 && powers[i] > integrals)
+            --i;
+        kappa = i + 1;
+        std::uint32_t divisor = (i >= 0) ? powers[i] : 0;
+
+        while(kappa > 0) {
+            buffer[length++] = static_cast<char>('0' + integrals / divisor);
+            integrals %= divisor;
+            --kappa;
+            std::uint64_t rest = (static_cast<std::uint64_t>(integrals) << -one.e) + fractionals;
+            if (rest < unsafe_interval.f)
+                return round_weed(buffer, length, (too_high - w).f, unsafe_interval.f, rest, static_cast<std::uint64_t>(divisor) << -one.e, unit);
+            divisor /= 10;
+        }
+
+        for(;;) {
+            fractionals *= 10;
+            unit *= 10;
+            unsafe_interval.f *= 10;
+            buffer[length++] = static_cast<char>('0' + (fractionals >> -one.e));
+            fractionals &= one.f - 1;
+            --kappa;
+            if (fractionals < unsafe_interval.f)
+                return round_weed(buffer, length, (too_high - w).f * unit, unsafe_interval.f, fractionals, one.f, unit);
+        }
+    }
+
+    //! 最後の桁を v に近づけ、安全な範囲に入ったかを確かめる
+    static bool round_weed(char * buffer, int length, std::uint64_t distance_too_high_w, std::uint64_t unsafe_interval,
+                           std::uint64_t rest, std::uint64_t ten_kappa, std::uint64_t unit) noexcept
+    {
+        std::uint64_t const small_distance = distance_too_high_w - unit;
+        std::uint64_t const big_distance = distance_too_high_w + unit;
+        while(rest < small_distance && unsafe_interval - rest >= ten_kappa &&
+              (rest + ten_kappa < small_distance || small_distance - rest >= rest + ten_kappa - small_distance)) {
+            --buffer[length - 1];
+            rest += ten_kappa;
+        }
+        if (rest < big_distance && unsafe_interval - rest >= ten_kappa &&
+            (rest + ten_kappa < big_distance || big_distance - rest > rest + ten_kappa - big_distance))
+            return false;
+        return 2 * unit <= rest && rest <= unsafe_interval - 4 * unit;
+    }
+};
+
+
+/*!
+  Grisu3 で決まらなかったときに、printf で桁数を増やしながら戻せる桁を探す.
+  小数点の文字はロケールで変わるので、数字と指数だけを取り出して json_parse_number で確かめる
+ */
+inline void json_shortest_fallback(double v, char * digits, int & length, int & exponent)
+{
+    for(int precision = 15; precision <= 17; ++precision) {
+        char buf[40];
+        std::snprintf(buf, sizeof(buf), "%.*e", precision - 1, v);
+        length = 0;
+        char const * p = buf;
+        for(; *p != 'e'; ++p) {
+            if (*p >= '0' && *p <= '9')
+                digits[length++] = *p;
+        }
+        exponent = std::atoi(p + 1) - (length - 1);
+        while(length > 1 && digits[length - 1] == '0') {
+            --length;
+            ++exponent;
+        }
+
+        char text[40];
+        int n = std::snprintf(text, sizeof(text), "%.*se%d", length, digits, exponent);
+        json_number num;
+        json_parse_number(text, text + n, num);
+        if (num.real == (v < 0 ? -v : v))
+            return;
+    }
+}
+
+
+/*!
+  整数を 10 進数にして、書き込んだ文字数を返す. buf は 20 文字以上
+ */
+inline int json_format_integer(std::uint64_t val, char * buf) noexcept
+{
+    char tmp[20];
+    int n = 0;
+    do {
+        tmp[n++] = static_cast<char>('0' + val % 10);
+        val /= 10;
+    } while(val != 0);
+    for(int i = 0; i < n; ++i)
+        buf[i] = tmp[n - 1 - i];
+    return n;
+}
+
+
+/*!
+  double を、読み戻すと同じ値になる最も短い JSON の数値にして、書き込んだ文字数を返す. buf は 32 文字以上.
+
+  Python の repr と同じく、10 進の指数が -4 以上 16 未満であれば小数点の形にし、整数にも ".0" を付けて整数と区別する。
+  それ以外は "1.5e+20" のような指数の形にする。JSON で表せない無限大と NaN は null にする
+ */
+inline int json_format_double(double v, char * buf)
+{
+    if (v != v || v - v != 0) {
+        std::memcpy(buf, "null", 4);
+        return 4;
+    }
+
+    char * out = buf;
+    if (std::signbit(v)) {
+        *out++ = '-';
+        v = -v;
+    }
+    if (v == 0) {
+        std::memcpy(out, "0.0", 3);
+        return static_cast<int>(out - buf) + 3;
+    }
+
+    char digits[20];
+    int length, exponent;
+    if (!json_grisu::shortest(v, digits, length, exponent))
+        json_shortest_fallback(v, digits, length, exponent);
+
+    // 0.d1d2...dk * 10^point
+    int const point = length + exponent;
+    int const x = point - 1;
+    if (x >= -4 && x < 16) {
+        if (point <= 0) {
+            *out++ = '0';
+            *out++ = '.';
+            for(int i = point; i < 0; ++i)
+                *out++ = '0';
+            std::memcpy(out, digits, static_cast<std::size_t>(length));
+            out += length;
+        } else if (point >= length) {
+            std::memcpy(out, digits, static_cast<std::size_t>(length));
+            out += length;
+            for(int i = length; i < point; ++i)
+                *out++ = '0';
+            *out++ = '.';
+            *out++ = '0';
+        } else {
+            std::memcpy(out, digits, static_cast<std::size_t>(point));
+            out += point;
+            *out++ = '.';
+            std::memcpy(out, digits + point, static_cast<std::size_t>(length - point));
+            out += length - point;
+        }
+    } else {
+        *out++ = digits[0];
+        if (length > 1) {
+            *out++ = '.';
+            std::memcpy(out, digits + 1, static_cast<std::size_t>(length - 1));
+            out += length - 1;
+        }
+        *out++ = 'e';
+        *out++ = (x < 0) ? '-' : '+';
+        out += json_format_integer(static_cast<std::uint64_t>(x < 0 ? -x : x), out);
+    }
+    return static_cast<int>(out - buf);
+}
+
+} } }
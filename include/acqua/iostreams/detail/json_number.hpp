@@ -0,0 +1,309 @@
+/*!
+  acqua library
+
+  Copyright (c) 2016 Haruhiko Uchida
+  The software is released under the MIT license.
+  http://opensource.org/licenses/mit-license.php
+ */
+
+#pragma once
+
+#include <acqua/iostreams/detail/json_power5_table.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <string>
+
+extern "C" {
+#include <locale.h>
+#include <stdlib.h>
+}
+
+namespace acqua { namespace iostreams { namespace detail {
+
+/*!
+  JSON の数値を変換した結果.
+
+  小数点も指数もない整数は、long に収まれば integer、unsigned long に収まれば unsigned_integer になる。
+  どちらにも収まらない整数は big になり、テキストをそのまま渡せるようにする。big と real は real に最も近い double が入る
+ */
+struct json_number
+{
+    enum class kind : unsigned char { integer, unsigned_integer, real, big };
+
+    kind type;
+    long integer;
+    unsigned long unsigned_integer;
+    double real;
+};
+
+
+/*!
+  10 進数の仮数と指数を double に変換する (Eisel-Lemire のアルゴリズム).
+
+  仮数を 5^q の上位 128 ビットと掛けて、丸めに必要なビットが決まれば正しく丸めた値になる。
+  決まらないときは power2 を -1 にして返すので、呼び出し側で strtod に任せる
+ */
+class json_decimal_to_binary
+{
+    __extension__ using uint128_type = unsigned __int128;
+
+public:
+    static int const mantissa_bits = 52;
+    static int const min_exponent = -1023;
+    static int const infinite_power = 0x7FF;
+    static int const smallest_power = -342;
+    static int const largest_power = 308;
+
+    struct result
+    {
+        std::uint64_t mantissa;
+        int power2;
+
+        bool operator==(result const & rhs) const noexcept
+        {
+            return mantissa == rhs.mantissa && power2 == rhs.power2;
+        }
+    };
+
+    static result compute(std::int64_t q, std::uint64_t w) noexcept
+    {
+        if (w == 0 || q < smallest_power)
+            return result{ 0, 0 };
+        if (q > largest_power)
+            return result{ 0, infinite_power };
+
+        int const lz = __builtin_clzll(w);
+        w <<= lz;
+
+        // 仮数の 52 ビットと丸めの 3 ビットが決まるまで、下位の 64 ビットも掛ける
+        std::uint64_t const * pow5 = json_power5_table() + 2 * (q - smallest_power);
+        uint128_type first = static_cast<uint128_type>(w) * pow5[0];
+        std::uint64_t high = static_cast<std::uint64_t>(first >> 64);
+        std::uint64_t low = static_cast<std::uint64_t>(first);
+        std::uint64_t const precision_mask = ~std::uint64_t(0) >> (mantissa_bits + 3);
+        if ((high & precision_mask) == precision_mask) {
+            uint128_type second = static_cast<uint128_type>(w) * pow5[1];
+            std::uint64_t second_high = static_cast<std::uint64_t>(second >> 64);
+            low += second_high;
+            if (second_high > low)
+                ++high;
+        }
+        if (low == ~std::uint64_t(0) && (q < -27 || q > 55))
+            return result{ 0, -1 };
+
+        int const upperbit = static_cast<int>(high >> 63);
+        int const shift = upperbit + 64 - mantissa_bits - 3;
+        result res;
+        res.mantissa = high >> shift;
+        res.power2 = static_cast<int>(power(static_cast<int>(q)) + upperbit - lz - min_exponent);
+
+        // 非正規化数
+        if (res.power2 <= 0) {
+            if (-res.power2 + 1 >= 64)
+                return result{ 0, 0 };
+            res.mantissa >>= -res.power2 + 1;
+            res.mantissa += (res.mantissa & 1);
+            res.mantissa >>= 1;
+            res.power2 = (res.mantissa < (std::uint64_t(1) << mantissa_bits)) ? 0 : 1;
+            return res;
+        }
+
+        // ちょうど中間のときは偶数に丸める
+        if (low <= 1 && q >= -4 && q <= 23 && (res.mantissa & 3) == 1) {
+            if ((res.mantissa << shift) == high)
+                res.mantissa &= ~std::uint64_t(1);
+        }
+        res.mantissa += (res.mantissa & 1);
+        res.mantissa >>= 1;
+        if (res.mantissa >= (std::uint64_t(2) << mantissa_bits)) {
+            res.mantissa = std::uint64_t(1) << mantissa_bits;
+            ++res.power2;
+        }
+        res.mantissa &= ~(std::uint64_t(1) << mantissa_bits);
+        if (res.power2 >= infinite_power)
+            return result{ 0, infinite_power };
+        return res;
+    }
+
+    static double to_double(result const & res, bool minus) noexcept
+    {
+        std::uint64_t bits = res.mantissa | (static_cast<std::uint64_t>(res.power2) << mantissa_bits);
+        if (minus)
+            bits |= std::uint64_t(1) << 63;
+        double val;
+        std::memcpy(&val, &bits, sizeof(val));
+        return val;
+    }
+
+private:
+    //! floor(log2(10^q)) + 63
+    static int power(int q) noexcept
+    {
+        return (((152170 + 65536) * q) >> 16) + 63;
+    }
+};
+
+
+//! 正しく丸められなかったときに、C ロケールの strtod で変換する
+template <typename CharT>
+inline double json_strtod(CharT const * beg, CharT const * end)
+{
+    static ::locale_t const c_locale = ::newlocale(LC_ALL_MASK, "C", static_cast<::locale_t>(0));
+
+    // strtod は char の NUL 終端の文字列しか受け付けないので写す
+    std::size_t const len = static_cast<std::size_t>(end - beg);
+    std::string str(len, '\0');
+    for(std::size_t i = 0; i < len; ++i)
+        str[i] = static_cast<char>(beg[i]);
+    return ::strtod_l(str.c_str(), nullptr, c_locale);
+}
+
+
+/*!
+  [beg, end) の数値を num に変換する. 数値の文法に合わなければ false を返す.
+
+  仮数が 2^53 以下で指数が ±22 以内であれば double の演算だけで正確に求まる (Clinger の方法)。
+  それ以外は json_decimal_to_binary で求め、決まらないときだけ strtod に任せる。
+  以前の json_parser と同じく、先頭の '+' と整数部の先頭の 0 も受け付ける
+ */
+template <typename CharT>
+inline bool json_parse_number(CharT const * beg, CharT const * end, json_number & num)
+{
+    auto is_digit = [](CharT ch) { return ch >= '0' && ch <= '9'; };
+    auto digit = [](CharT ch) { return static_cast<std::uint64_t>(ch - '0'); };
+
+    CharT const * it = beg;
+    bool minus = false;
+    if (it != end && (*it == '-' || *it == '+'))
+        minus = (*it++ == '-');
+
+    // 20 桁以上では桁あふれするが、そのときは後で数え直す
+    std::uint64_t mantissa = 0;
+    CharT const * const int_beg = it;
+    for(; it != end && is_digit(*it); ++it)
+        mantissa = mantissa * 10 + digit(*it);
+    CharT const * const int_end = it;
+    if (int_beg == int_end)
+        return false;
+
+    CharT const * frac_beg = it;
+    CharT const * frac_end = it;
+    if (it != end && *it == '.') {
+        frac_beg = ++it;
+        for(; it != end && is_digit(*it); ++it)
+            mantissa = mantissa * 10 + digit(*it);
+        frac_end = it;
+        if (frac_beg == frac_end)
+            return false;
+    }
+
+    std::int64_t exponent = 0;
+    bool has_exponent = false;
+    if (it != end && (*it == 'e' || *it == 'E')) {
+        has_exponent = true;
+        bool exp_minus = false;
+        if (++it != end && (*it == '+' || *it == '-'))
+            exp_minus = (*it++ == '-');
+        CharT const * exp_beg = it;
+        for(; it != end && is_digit(*it); ++it) {
+            if (exponent < 0x10000)
+                exponent = exponent * 10 + static_cast<std::int64_t>(digit(*it));
+        }
+        if (it == exp_beg)
+            return false;
+        if (exp_minus)
+            exponent = -exponent;
+    }
+    if (it != end)
+        return false;
+
+    // 先頭の 0 を除いた有効桁の数
+    CharT const * sig = int_beg;
+    while(sig != int_end && *sig == '0')
+        ++sig;
+    std::size_t int_digits = static_cast<std::size_t>(int_end - sig);
+    std::size_t frac_digits = static_cast<std::size_t>(frac_end - frac_beg);
+    std::size_t sig_digits = int_digits + frac_digits;
+    if (int_digits == 0) {
+        CharT const * p = frac_beg;
+        while(p != frac_end && *p == '0')
+            ++p;
+        sig_digits = static_cast<std::size_t>(frac_end - p);
+    }
+
+    bool is_integer = (frac_beg == frac_end && !has_exponent);
+    if (is_integer) {
+        bool overflow = false;
+        if (sig_digits > 19) {
+            mantissa = 0;
+            for(CharT const * p = sig; p != int_end && !overflow; ++p)
+                overflow = __builtin_mul_overflow(mantissa, std::uint64_t(10), &mantissa) || __builtin_add_overflow(mantissa, digit(*p), &mantissa);
+        }
+        if (!overflow) {
+            std::uint64_t const max = static_cast<std::uint64_t>(std::numeric_limits<long>::max());
+            if (mantissa <= max) {
+                num.type = json_number::kind::integer;
+                num.integer = minus ? -static_cast<long>(mantissa) : static_cast<long>(mantissa);
+                return true;
+            }
+            if (minus && mantissa == max + 1) {
+                num.type = json_number::kind::integer;
+                num.integer = std::numeric_limits<long>::min();
+                return true;
+            }
+            if (!minus && mantissa <= std::numeric_limits<unsigned long>::max()) {
+                num.type = json_number::kind::unsigned_integer;
+                num.unsigned_integer = static_cast<unsigned long>(mantissa);
+                return true;
+            }
+        }
+    }
+
+    // 有効桁が 19 桁を超えるときは、先頭の 19 桁で求めて、1 を足した値と同じになれば正しい
+    std::int64_t q = exponent - static_cast<std::int64_t>(frac_digits);
+    bool truncated = false;
+    if (sig_digits > 19) {
+        truncated = true;
+        mantissa = 0;
+        std::size_t count = 0;
+        CharT const * p = sig;
+        for(; p != int_end && count < 19; ++p, ++count)
+            mantissa = mantissa * 10 + digit(*p);
+        if (count < 19) {
+            p = frac_beg;
+            if (int_digits == 0) {
+                while(*p == '0')
+                    ++p;
+            }
+            for(; count < 19; ++p, ++count)
+                mantissa = mantissa * 10 + digit(*p);
+            q = exponent - static_cast<std::int64_t>(p - frac_beg);
+        } else {
+            q = exponent + static_cast<std::int64_t>(int_end - p);
+        }
+    }
+
+    num.type = is_integer ? json_number::kind::big : json_number::kind::real;
+    if (!truncated && q >= -22 && q <= 22 && mantissa <= (std::uint64_t(1) << 53)) {
+        static double const powers[] = {
+            1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+            1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+        };
+        double val = static_cast<double>(mantissa);
+        val = (q < 0) ? val / powers[-q] : val * powers[q];
+        num.real = minus ? -val : val;
+        return true;
+    }
+
+    auto res = json_decimal_to_binary::compute(q, mantissa);
+    if (res.power2 >= 0 && (!truncated || res == json_decimal_to_binary::compute(q, mantissa + 1)))
+        num.real = json_decimal_to_binary::to_double(res, minus);
+    else
+        num.real = json_strtod(beg, end);
+    return true;
+}
+
+} } }
@@ -0,0 +1,132 @@
+/*!
+  acqua library
+
+  Copyright (c) 2016 Haruhiko Uchida
+  The software is released under the MIT license.
+  http://opensource.org/licenses/mit-license.php
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <type_traits>
+
+#if defined(__SSE2__) && !defined(ACQUA_IOSTREAMS_JSON_NO_SIMD)
+# define ACQUA_IOSTREAMS_JSON_SSE2 1
+# include <emmintrin.h>
+#endif
+
+namespace acqua { namespace iostreams { namespace detail {
+
+/*!
+  JSON の文字の分類表.
+
+  plain は、文字列の中でそのまま使える文字 ('"' と '\\' と制御文字以外) であれば true になる。
+  number は数値に含まれる文字、hex は 16 進数の文字の値で、16 進数の文字でなければ 16 になる
+ */
+struct json_table
+{
+    bool plain[256];
+    bool number[256];
+    unsigned char hex[256];
+
+    constexpr json_table()
+        : plain(), number(), hex()
+    {
+        for(int i = 0; i < 256; ++i) {
+            plain[i] = (i >= 32 && i != '"' && i != '\\');
+            hex[i] = 16;
+        }
+        for(int i = 0; i < 10; ++i) {
+            number['0' + i] = true;
+            hex['0' + i] = static_cast<unsigned char>(i);
+        }
+        for(int i = 0; i < 6; ++i)
+            hex['A' + i] = hex['a' + i] = static_cast<unsigned char>(10 + i);
+        number['+'] = number['-'] = number['.'] = number['e'] = number['E'] = true;
+    }
+
+    static json_table const & instance() noexcept
+    {
+        static constexpr json_table tbl;
+        return tbl;
+    }
+
+    template <typename CharT>
+    static std::size_t index(CharT ch) noexcept
+    {
+        return static_cast<std::size_t>(static_cast<typename std::make_unsigned<CharT>::type>(ch));
+    }
+};
+
+
+/*!
+  [beg, end) の先頭から、文字列の中でそのまま使える文字が続く範囲の終端を返す.
+  SSE2 が使えれば 16 文字ずつ比較する
+ */
+inline char const * json_scan_string(char const * beg, char const * end) noexcept
+{
+#if defined(ACQUA_IOSTREAMS_JSON_SSE2)
+    for(; end - beg >= 16; beg += 16) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<__m128i const *>(beg));
+        // 符号なしの最大値が 31 のままであれば制御文字
+        __m128i ctrl = _mm_cmpeq_epi8(_mm_max_epu8(x, _mm_set1_epi8(31)), _mm_set1_epi8(31));
+        __m128i stop = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8('"')), _mm_cmpeq_epi8(x, _mm_set1_epi8('\\'))), ctrl);
+        unsigned int mask = static_cast<unsigned int>(_mm_movemask_epi8(stop));
+        if (mask != 0)
+            return beg + __builtin_ctz(mask);
+    }
+#endif
+    auto const & tbl = json_table::instance();
+    while(beg != end && tbl.plain[static_cast<unsigned char>(*beg)])
+        ++beg;
+    return beg;
+}
+
+template <typename CharT>
+inline CharT const * json_scan_string(CharT const * beg, CharT const * end) noexcept
+{
+    auto const & tbl = json_table::instance();
+    for(; beg != end; ++beg) {
+        std::size_t i = json_table::index(*beg);
+        if (i < 256 && !tbl.plain[i])
+            break;
+    }
+    return beg;
+}
+
+
+//! [beg, end) の先頭から、数値に含まれる文字が続く範囲の終端を返す
+template <typename CharT>
+inline CharT const * json_scan_number(CharT const * beg, CharT const * end) noexcept
+{
+    auto const & tbl = json_table::instance();
+    for(; beg != end; ++beg) {
+        std::size_t i = json_table::index(*beg);
+        if (i >= 256 || !tbl.number[i])
+            break;
+    }
+    return beg;
+}
+
+
+//! [beg, end) の先頭から、英字が続く範囲の終端を返す
+template <typename CharT>
+inline CharT const * json_scan_alpha(CharT const * beg, CharT const * end) noexcept
+{
+    while(beg != end && ((*beg >= 'a' && *beg <= 'z') || (*beg >= 'A' && *beg <= 'Z')))
+        ++beg;
+    return beg;
+}
+
+
+//! [beg, end) の先頭から、空白が続く範囲の終端を返す
+template <typename CharT>
+inline CharT const * json_skip_space(CharT const * beg, CharT const * end) noexcept
+{
+    while(beg != end && (*beg == ' ' || *beg == '\n' || *beg == '\r' || *beg == '\t'))
+        ++beg;
+    return beg;
+}
+
+} } }
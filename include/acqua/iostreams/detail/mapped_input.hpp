@@ -0,0 +1,80 @@
+/*!
+  acqua library
+
+  Copyright (c) 2016 Haruhiko Uchida
+  The software is released under the MIT license.
+  http://opensource.org/licenses/mit-license.php
+ */
+
+#pragma once
+
+extern "C" {
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+}
+
+#include <boost/noncopyable.hpp>
+#include <boost/system/system_error.hpp>
+#include <cerrno>
+#include <cstddef>
+#include <string>
+
+namespace acqua { namespace iostreams { namespace detail {
+
+/*!
+  読み込み専用でメモリにマップしたファイル.
+  先頭から順に読むことをカーネルに伝えて、先読みを増やす
+ */
+class mapped_input
+    : private boost::noncopyable
+{
+public:
+    explicit mapped_input(std::string const & path)
+    {
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            throw boost::system::system_error(errno, boost::system::generic_category(), path);
+        struct ::stat st;
+        if (::fstat(fd, &st) != 0) {
+            int err = errno;
+            ::close(fd);
+            throw boost::system::system_error(err, boost::system::generic_category(), path);
+        }
+        size_ = static_cast<std::size_t>(st.st_size);
+        if (size_ > 0) {
+            void * ptr = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (ptr == MAP_FAILED) {
+                int err = errno;
+                ::close(fd);
+                throw boost::system::system_error(err, boost::system::generic_category(), path);
+            }
+            ::madvise(ptr, size_, MADV_SEQUENTIAL);
+            data_ = static_cast<char const *>(ptr);
+        }
+        ::close(fd);
+    }
+
+    ~mapped_input()
+    {
+        if (data_)
+            ::munmap(const_cast<char *>(data_), size_);
+    }
+
+    char const * data() const noexcept
+    {
+        return data_;
+    }
+
+    std::size_t size() const noexcept
+    {
+        return size_;
+    }
+
+private:
+    char const * data_ = nullptr;
+    std::size_t size_ = 0;
+};
+
+} } }
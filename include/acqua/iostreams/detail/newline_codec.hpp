@@ -0,0 +1,183 @@
+/*!
+  acqua library
+
+  Copyright (c) 2016 Haruhiko Uchida
+  The software is released under the MIT license.
+  http://opensource.org/licenses/mit-license.php
+ */
+
+#pragma once
+
+#include <acqua/iostreams/newline_category.hpp>
+#include <acqua/iostreams/detail/filter_buffer.hpp>
+#include <acqua/iostreams/detail/newline_scan.hpp>
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+#include <string>
+
+namespace acqua { namespace iostreams { namespace detail {
+
+/*!
+  改行コード (CR, LF, CRLF) を nl にそろえる codec_filter の Codec.
+  改行までの文字の並びはまとめて写す。CRLF が run() の区切りをまたいでも 1 つの改行にする
+ */
+class newline_codec
+{
+public:
+    explicit newline_codec(newline nl)
+        : nl_(newline_chars(nl)), nl_size_(std::char_traits<char>::length(nl_)) {}
+
+    void run(char const * s, std::size_t n, filter_buffer & out, bool)
+    {
+        char const * end = s + n;
+        while(s != end) {
+            if (cr_) {
+                cr_ = false;
+                if (*s == '\n') {
+                    ++s;
+                    continue;
+                }
+            }
+            char const * q = newline_scan(s, end);
+            out.append(s, static_cast<std::size_t>(q - s));
+            if (q == end)
+                break;
+            out.append(nl_, nl_size_);
+            cr_ = (*q == '\r');
+            s = q + 1;
+        }
+    }
+
+    void reset() noexcept
+    {
+        cr_ = false;
+    }
+
+private:
+    char const * nl_;
+    std::size_t nl_size_;
+    bool cr_ = false;
+};
+
+
+/*!
+  7bit の format=flowed のエンコードを行う codec_filter の Codec.
+  1行が size 文字に達すると、空白と改行コード nl によるソフト改行を挟む。入力の LF は nl にし、CR は取り除く
+ */
+class ascii_encode_codec
+{
+public:
+    ascii_encode_codec(newline nl, std::size_t size)
+        : nl_(newline_chars(nl)), nl_size_(std::char_traits<char>::length(nl_))
+        , max_(nl == newline::none ? std::numeric_limits<std::size_t>::max() : std::max<std::size_t>(size, 1)) {}
+
+    void run(char const * s, std::size_t n, filter_buffer & out, bool)
+    {
+        char const * end = s + n;
+        while(s != end) {
+            char const * q = newline_scan(s, end);
+            literal(s, static_cast<std::size_t>(q - s), out);
+            if (q == end)
+                break;
+            if (*q == '\n') {
+                out.append(nl_, nl_size_);
+                col_ = 0;
+            }
+            s = q + 1;
+        }
+    }
+
+    void reset() noexcept
+    {
+        col_ = 0;
+    }
+
+private:
+    void literal(char const * s, std::size_t n, filter_buffer & out)
+    {
+        while(n > 0) {
+            if (col_ >= max_) {
+                out.push_back(' ');
+                out.append(nl_, nl_size_);
+                col_ = 0;
+            }
+            std::size_t len = std::min(n, max_ - col_);
+            out.append(s, len);
+            col_ += len;
+            s += len;
+            n -= len;
+        }
+    }
+
+private:
+    char const * nl_;
+    std::size_t nl_size_;
+    std::size_t max_;
+    std::size_t col_ = 0;
+};
+
+
+/*!
+  7bit の format=flowed のデコードを行う codec_filter の Codec.
+  空白かタブに続く改行はソフト改行として、空白ごと取り除く。それ以外の改行 (CR, LF, CRLF) は LF にする。
+  行末の空白は、次の文字を見るまで保留する
+ */
+class ascii_decode_codec
+{
+public:
+    void run(char const * s, std::size_t n, filter_buffer & out, bool finish)
+    {
+        char const * end = s + n;
+        while(s != end) {
+            if (cr_) {
+                cr_ = false;
+                if (*s == '\n') {
+                    ++s;
+                    continue;
+                }
+            }
+
+            char const * q = newline_scan(s, end);
+            if (q == s) {
+                if (prior_)
+                    prior_ = 0;
+                else
+                    out.push_back('\n');
+                cr_ = (*s == '\r');
+                ++s;
+                continue;
+            }
+
+            if (prior_) {
+                out.push_back(prior_);
+                prior_ = 0;
+            }
+            char last = q[-1];
+            if (last == ' ' || last == '\t') {
+                out.append(s, static_cast<std::size_t>(q - 1 - s));
+                prior_ = last;
+            } else {
+                out.append(s, static_cast<std::size_t>(q - s));
+            }
+            s = q;
+        }
+
+        if (finish && prior_) {
+            out.push_back(prior_);
+            prior_ = 0;
+        }
+    }
+
+    void reset() noexcept
+    {
+        prior_ = 0;
+        cr_ = false;
+    }
+
+private:
+    char prior_ = 0;
+    bool cr_ = false;
+};
+
+} } }
@@ -0,0 +1,58 @@
+/*!
+  acqua library
+
+  Copyright (c) 2016 Haruhiko Uchida
+  The software is released under the MIT license.
+  http://opensource.org/licenses/mit-license.php
+ */
+
+#pragma once
+
+#include <acqua/iostreams/newline_category.hpp>
+#include <cstddef>
+
+#if defined(__SSE2__) && !defined(ACQUA_IOSTREAMS_NEWLINE_NO_SIMD)
+# define ACQUA_IOSTREAMS_NEWLINE_SSE2 1
+# include <emmintrin.h>
+#endif
+
+namespace acqua { namespace iostreams { namespace detail {
+
+/*!
+  [beg, end) の先頭から、CR と LF のどちらかが最初に現れる位置を返す. なければ end を返す.
+  SSE2 が使えれば 16 文字ずつ比較する
+ */
+inline char const * newline_scan(char const * beg, char const * end) noexcept
+{
+#if defined(ACQUA_IOSTREAMS_NEWLINE_SSE2)
+    for(; end - beg >= 16; beg += 16) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<__m128i const *>(beg));
+        __m128i nl = _mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8('\r')), _mm_cmpeq_epi8(x, _mm_set1_epi8('\n')));
+        unsigned int mask = static_cast<unsigned int>(_mm_movemask_epi8(nl));
+        if (mask != 0)
+            return beg + __builtin_ctz(mask);
+    }
+#endif
+    while(beg != end && *beg != '\r' && *beg != '\n')
+        ++beg;
+    return beg;
+}
+
+
+//! 改行コードの文字列. newline::none は空文字列
+inline char const * newline_chars(newline nl) noexcept
+{
+    switch(nl) {
+        case newline::cr:
+            return "\r";
+        case newline::ln:
+            return "\n";
+        case newline::crln:
+            return "\r\n";
+        case newline::none:
+            break;
+    }
+    return "";
+}
+
+} } }
@@ -0,0 +1,81 @@
+/*!
+  acqua library
+
+  Copyright (c) 2016 Haruhiko Uchida
+  The software is released under the MIT license.
+  http://opensource.org/licenses/mit-license.php
+ */
+
+#pragma once
+
+#include <cstddef>
+
+#if defined(__SSE2__) && !defined(ACQUA_IOSTREAMS_QPRINT_NO_SIMD)
+# define ACQUA_IOSTREAMS_QPRINT_SSE2 1
+# include <emmintrin.h>
+#endif
+
+namespace acqua { namespace iostreams { namespace detail {
+
+/*!
+  quoted-printable の変換表.
+
+  plain は、そのまま書き出せる文字 (33..126 のうち '=' 以外、空白とタブ) であれば true になる。
+  hex は 16 進数の文字の値で、16 進数の文字でなければ 16 になる。小文字も受け付ける
+ */
+struct qprint_table
+{
+    bool plain[256];
+    unsigned char hex[256];
+    char digits[16];
+
+    constexpr qprint_table()
+        : plain(), hex(), digits()
+    {
+        for(int i = 0; i < 256; ++i) {
+            plain[i] = (32 <= i && i <= 126 && i != '=') || i == '\t';
+            hex[i] = 16;
+        }
+        for(int i = 0; i < 10; ++i) {
+            hex['0' + i] = static_cast<unsigned char>(i);
+            digits[i] = static_cast<char>('0' + i);
+        }
+        for(int i = 0; i < 6; ++i) {
+            hex['A' + i] = hex['a' + i] = static_cast<unsigned char>(10 + i);
+            digits[10 + i] = static_cast<char>('A' + i);
+        }
+    }
+
+    static qprint_table const & instance() noexcept
+    {
+        static constexpr qprint_table tbl;
+        return tbl;
+    }
+};
+
+
+/*!
+  [beg, end) の先頭から、そのまま書き出せる文字が続く範囲の終端を返す.
+  SSE2 が使えれば 16 文字ずつ比較する
+ */
+inline char const * qprint_scan_plain(char const * beg, char const * end) noexcept
+{
+#if defined(ACQUA_IOSTREAMS_QPRINT_SSE2)
+    for(; end - beg >= 16; beg += 16) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<__m128i const *>(beg));
+        // 符号付きで比較するので、128 以上の文字も 32 未満になる
+        __m128i printable = _mm_andnot_si128(_mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8('=')), _mm_cmpeq_epi8(x, _mm_set1_epi8(127))),
+                                             _mm_cmpgt_epi8(x, _mm_set1_epi8(31)));
+        __m128i plain = _mm_or_si128(printable, _mm_cmpeq_epi8(x, _mm_set1_epi8('\t')));
+        unsigned int mask = static_cast<unsigned int>(_mm_movemask_epi8(plain)) ^ 0xFFFFu;
+        if (mask != 0)
+            return beg + __builtin_ctz(mask);
+    }
+#endif
+    auto const & tbl = qprint_table::instance();
+    while(beg != end && tbl.plain[static_cast<unsigned char>(*beg)])
+        ++beg;
+    return beg;
+}
+
+} } }
@@ -0,0 +1,116 @@
+/*!
+  acqua library
+
+  Copyright (c) 2016 Haruhiko Uchida
+  The software is released under the MIT license.
+  http://opensource.org/licenses/mit-license.php
+ */
+
+#pragma once
+
+#include <boost/noncopyable.hpp>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace acqua { namespace iostreams { namespace detail {
+
+/*!
+  処理を分担するスレッドプール.
+  スレッドは生成時に起動して、破棄されるまで使い回す
+ */
+class worker_pool
+    : private boost::noncopyable
+{
+public:
+    //! threads は呼び出し元のスレッドを含めた数. threads - 1 個のスレッドを起動する
+    explicit worker_pool(std::size_t threads)
+    {
+        for(std::size_t i = 1; i < threads; ++i)
+            workers_.emplace_back([this] { run(); });
+    }
+
+    ~worker_pool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        cond_.notify_all();
+        for(auto & th : workers_)
+            th.join();
+    }
+
+    //! 呼び出し元のスレッドを含めた数を返す
+    std::size_t size() const noexcept
+    {
+        return workers_.size() + 1;
+    }
+
+    /*!
+      f(0) ... f(n - 1) を分担して実行し、すべて終わるまで待つ.
+      f(0) は呼び出し元のスレッドで実行する。f は例外を投げてはならない
+     */
+    template <typename F>
+    void parallel_for(std::size_t n, F f)
+    {
+        if (n == 0)
+            return;
+
+        std::mutex done_mutex;
+        std::condition_variable done_cond;
+        std::size_t remain = n - 1;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for(std::size_t i = 1; i < n; ++i) {
+                tasks_.emplace_back([&, i] {
+                    f(i);
+                    std::lock_guard<std::mutex> done_lock(done_mutex);
+                    if (--remain == 0)
+                        done_cond.notify_one();
+                });
+            }
+        }
+        cond_.notify_all();
+
+        f(0);
+
+        // 空いていれば呼び出し元のスレッドも残りを手伝う
+        while(auto task = pop(false))
+            task();
+
+        std::unique_lock<std::mutex> lock(done_mutex);
+        done_cond.wait(lock, [&] { return remain == 0; });
+    }
+
+private:
+    std::function<void()> pop(bool wait)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (wait)
+            cond_.wait(lock, [this] { return stop_ || !tasks_.empty(); });
+        if (tasks_.empty())
+            return nullptr;
+        auto task = std::move(tasks_.front());
+        tasks_.pop_front();
+        return task;
+    }
+
+    void run()
+    {
+        while(auto task = pop(true))
+            task();
+    }
+
+private:
+    std::vector<std::thread> workers_;
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    std::deque<std::function<void()>> tasks_;
+    bool stop_ = false;
+};
+
+} } }
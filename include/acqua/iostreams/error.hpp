@@ -20,7 +20,7 @@ enum cryptographic_errors {
 
 inline boost::system::error_category const & get_cryptographic_category();
 
-boost::system::error_code make_error_code(cryptographic_errors e)
+inline boost::system::error_code make_error_code(cryptographic_errors e)
 {
     return boost::system::error_code(static_cast<int>(e), get_cryptographic_category());
 }
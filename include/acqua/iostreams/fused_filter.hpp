@@ -0,0 +1,217 @@
+#pragma once
+
+/*!
+  acqua library
+
+  Copyright (c) 2016 Haruhiko Uchida
+  The software is released under the MIT license.
+  http://opensource.org/licenses/mit-license.php
+ */
+
+#include <boost/iostreams/operations.hpp>
+#include <boost/iostreams/categories.hpp>
+#include <boost/iostreams/device/null.hpp>
+#include <tuple>
+#include <utility>
+
+namespace acqua { namespace iostreams {
+
+//! Taps にフィルタの呼び出し側のデータ (出力フィルタでは書き込まれたデータ、入力フィルタでは読み出したデータ) を渡す
+struct tap_caller_side {};
+
+//! Taps にデバイス側のデータ (出力フィルタではシンクに書き出すデータ、入力フィルタではソースから読み込んだデータ) を渡す
+struct tap_device_side {};
+
+
+/*!
+  1つのフィルタと、データを覗くだけのフィルタ (transferred_counter やハッシュのフィルタ) をまとめたフィルタ.
+
+  Side が tap_caller_side であれば、Taps には呼び出し側のデータをそのまま渡す。
+  zstd_compressor と md5_filter と transferred_counter を fuse() でまとめると、圧縮前のデータを数えてハッシュを計算しながら圧縮する。
+  出力のチェインで伸長するときは、呼び出し側のデータは圧縮されたままなので、fuse_device() で tap_device_side にして伸長後のデータを渡す。
+  それぞれをチェインに並べるのと同じ結果になるが、リンクごとのバッファを経由せずに同じデータを一度に処理する。
+
+  Taps の出力は捨てるので、データを変えないフィルタでなければならない
+ */
+template <typename Side, typename Filter, typename... Taps>
+class basic_fused_filter
+{
+public:
+    struct category : boost::iostreams::multichar_dual_use_filter_tag, boost::iostreams::closable_tag {};
+    using char_type = char;
+
+public:
+    explicit basic_fused_filter(Filter filter, Taps... taps)
+        : filter_(std::move(filter))
+        , taps_(std::move(taps)...)
+    {
+    }
+
+    template <typename Source>
+    std::streamsize read(Source & src, char * s, std::streamsize n)
+    {
+        return read(src, s, n, Side());
+    }
+
+    template <typename Sink>
+    std::streamsize write(Sink & sink, char const * s, std::streamsize n)
+    {
+        return write(sink, s, n, Side());
+    }
+
+    template <typename Device>
+    void close(Device & dev, std::ios_base::openmode which)
+    {
+        close(dev, which, Side());
+        close_taps(which, std::index_sequence_for<Taps...>());
+    }
+
+private:
+    //! ソースから読み込んだデータを Taps に渡すデバイス
+    template <typename Source>
+    class tap_source
+    {
+    public:
+        using char_type = char;
+        struct category : boost::iostreams::source_tag {};
+
+        tap_source(Source & src, basic_fused_filter & self)
+            : src_(src), self_(self) {}
+
+        std::streamsize read(char * s, std::streamsize n)
+        {
+            n = boost::iostreams::read(src_, s, n);
+            if (n > 0)
+                self_.observe(s, n, std::index_sequence_for<Taps...>());
+            return n;
+        }
+
+    private:
+        Source & src_;
+        basic_fused_filter & self_;
+    };
+
+    //! シンクに書き出したデータを Taps に渡すデバイス
+    template <typename Sink>
+    class tap_sink
+    {
+    public:
+        using char_type = char;
+        struct category : boost::iostreams::sink_tag, boost::iostreams::flushable_tag {};
+
+        tap_sink(Sink & sink, basic_fused_filter & self)
+            : sink_(sink), self_(self) {}
+
+        std::streamsize write(char const * s, std::streamsize n)
+        {
+            n = boost::iostreams::write(sink_, s, n);
+            if (n > 0)
+                self_.observe(s, n, std::index_sequence_for<Taps...>());
+            return n;
+        }
+
+        bool flush()
+        {
+            return boost::iostreams::flush(sink_);
+        }
+
+    private:
+        Sink & sink_;
+        basic_fused_filter & self_;
+    };
+
+    template <typename Source>
+    std::streamsize read(Source & src, char * s, std::streamsize n, tap_caller_side)
+    {
+        n = boost::iostreams::read(filter_, src, s, n);
+        if (n > 0)
+            observe(s, n, std::index_sequence_for<Taps...>());
+        return n;
+    }
+
+    template <typename Source>
+    std::streamsize read(Source & src, char * s, std::streamsize n, tap_device_side)
+    {
+        tap_source<Source> tap(src, *this);
+        return boost::iostreams::read(filter_, tap, s, n);
+    }
+
+    template <typename Sink>
+    std::streamsize write(Sink & sink, char const * s, std::streamsize n, tap_caller_side)
+    {
+        n = boost::iostreams::write(filter_, sink, s, n);
+        if (n > 0)
+            observe(s, n, std::index_sequence_for<Taps...>());
+        return n;
+    }
+
+    template <typename Sink>
+    std::streamsize write(Sink & sink, char const * s, std::streamsize n, tap_device_side)
+    {
+        tap_sink<Sink> tap(sink, *this);
+        return boost::iostreams::write(filter_, tap, s, n);
+    }
+
+    template <typename Device>
+    void close(Device & dev, std::ios_base::openmode which, tap_caller_side)
+    {
+        boost::iostreams::close(filter_, dev, which);
+    }
+
+    //! 出力フィルタが close で書き出す残りのデータも Taps に渡す
+    template <typename Device>
+    void close(Device & dev, std::ios_base::openmode which, tap_device_side)
+    {
+        close_device(dev, which, typename boost::iostreams::category_of<Device>::type());
+    }
+
+    template <typename Device>
+    void close_device(Device & dev, std::ios_base::openmode which, boost::iostreams::output)
+    {
+        tap_sink<Device> tap(dev, *this);
+        boost::iostreams::close(filter_, tap, which);
+    }
+
+    template <typename Device>
+    void close_device(Device & dev, std::ios_base::openmode which, boost::iostreams::any_tag)
+    {
+        boost::iostreams::close(filter_, dev, which);
+    }
+
+    template <std::size_t... I>
+    void observe(char const * s, std::streamsize n, std::index_sequence<I...>)
+    {
+        boost::iostreams::null_sink null;
+        int dummy[] = { 0, (boost::iostreams::write(std::get<I>(taps_), null, s, n), 0)... };
+        (void)dummy;
+    }
+
+    template <std::size_t... I>
+    void close_taps(std::ios_base::openmode which, std::index_sequence<I...>)
+    {
+        boost::iostreams::null_sink null;
+        int dummy[] = { 0, (boost::iostreams::close(std::get<I>(taps_), null, which), 0)... };
+        (void)dummy;
+    }
+
+private:
+    Filter filter_;
+    std::tuple<Taps...> taps_;
+};
+
+
+//! filter と、呼び出し側のデータを覗く taps をまとめたフィルタを作る.
+template <typename Filter, typename... Taps>
+inline basic_fused_filter<tap_caller_side, Filter, Taps...> fuse(Filter filter, Taps... taps)
+{
+    return basic_fused_filter<tap_caller_side, Filter, Taps...>(std::move(filter), std::move(taps)...);
+}
+
+//! filter と、デバイス側のデータを覗く taps をまとめたフィルタを作る. 出力のチェインで伸長しながらハッシュを計算するときに使う
+template <typename Filter, typename... Taps>
+inline basic_fused_filter<tap_device_side, Filter, Taps...> fuse_device(Filter filter, Taps... taps)
+{
+    return basic_fused_filter<tap_device_side, Filter, Taps...>(std::move(filter), std::move(taps)...);
+}
+
+} }
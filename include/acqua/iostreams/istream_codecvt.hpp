@@ -9,59 +9,94 @@
 #pragma once
 
 #include <acqua/utility/string_cast.hpp>
+#include <acqua/utility/detail/utf_transcode.hpp>
 #include <boost/iostreams/categories.hpp>
 #include <boost/locale/encoding_utf.hpp>
 #include <boost/locale/encoding.hpp>
 #include <iostream>
 #include <memory>
+#include <algorithm>
 #include <array>
 #include <type_traits>
 #include <cstring>
 
 namespace acqua { namespace iostreams {
 
+/*!
+  sbuf から CharT をまとめて読み込み、Char に変換して返すアダプター.
+  ASCII の続く範囲はまとめて写す。s に収まらなかった文字の残りは、次の read() で返す
+ */
 template <typename Char, typename CharT, typename Traits, typename Enabler = void>
 class basic_istream_codecvt
 {
     using streambuf_type = std::basic_streambuf<CharT, Traits>;
-    using utf_traits_type =  boost::locale::utf::utf_traits<CharT>;
+
+    struct buffer
+    {
+        std::array<CharT, 4096> in;
+        std::size_t beg = 0;
+        std::size_t end = 0;
+        std::array<Char, 4> out;
+        std::size_t out_beg = 0;
+        std::size_t out_end = 0;
+    };
 
 public:
     using char_type = Char;
     using category = boost::iostreams::source_tag;
 
     explicit basic_istream_codecvt(streambuf_type * sbuf)
-        : sbuf_(sbuf) {}
+        : sbuf_(sbuf), buf_(std::make_shared<buffer>()) {}
 
     std::streamsize read(char_type * s, std::streamsize n)
     {
-        namespace utf = boost::locale::utf;
-
-        int ch;
-        std::streamsize i = 0;
-        while(i < n && (ch = static_cast<int>(sbuf_->sbumpc())) != EOF) {
-            std::array<CharT, utf_traits_type::max_width> tmp;
-            auto it = tmp.begin();
-            for(int width = utf_traits_type::trail_length( *it++ = static_cast<CharT>(ch) ); width > 0; --width) {
-                if ((ch = static_cast<int>(sbuf_->sbumpc())) == EOF)
-                    return i;
-                *it++ = static_cast<CharT>(ch);
+        namespace utf = acqua::utility::detail;
+
+        buffer & buf = *buf_;
+        char_type * out = s;
+        char_type * const out_end = s + n;
+        while(out != out_end && buf.out_beg != buf.out_end)
+            *out++ = buf.out[buf.out_beg++];
+
+        while(out != out_end) {
+            CharT const * in = buf.in.data() + buf.beg;
+            CharT const * in_end = buf.in.data() + buf.end;
+            auto res = utf::utf_transcode(in, in_end, out, out_end);
+            buf.beg = static_cast<std::size_t>(res.in - buf.in.data());
+            out = res.out;
+            if (out == out_end)
+                break;
+
+            // 次の文字が s に収まらなければ、いったん out に変換して入る分だけ写す
+            auto rest = utf::utf_transcode(res.in, in_end, buf.out.data(), buf.out.data() + buf.out.size());
+            buf.beg = static_cast<std::size_t>(rest.in - buf.in.data());
+            if (rest.out != buf.out.data()) {
+                buf.out_beg = 0;
+                buf.out_end = static_cast<std::size_t>(rest.out - buf.out.data());
+                while(out != out_end && buf.out_beg != buf.out_end)
+                    *out++ = buf.out[buf.out_beg++];
+                continue;
             }
 
-            it = tmp.begin();
-            utf::code_point cp = utf::utf_traits<CharT>::template decode<decltype(it)>(it, tmp.end());
-            if (cp != utf::illegal && cp != utf::incomplete) {
-                char_type * t = utf::utf_traits<char_type>::template encode<char_type *>(cp, s);
-                i += (t - s);
-                s = t;
+            // 途中で終わっている文字を先頭に移して、続きを読み込む。最後まで途中のままの文字は捨てる
+            std::size_t tail = buf.end - buf.beg;
+            std::copy(buf.in.data() + buf.beg, buf.in.data() + buf.end, buf.in.data());
+            buf.beg = 0;
+            buf.end = tail;
+            std::streamsize len = sbuf_->sgetn(buf.in.data() + tail, static_cast<std::streamsize>(buf.in.size() - tail));
+            if (len <= 0) {
+                buf.end = 0;
+                break;
             }
+            buf.end += static_cast<std::size_t>(len);
         }
 
-        return (i > 0) ? i : EOF;
+        return (out != s) ? (out - s) : EOF;
     }
 
 private:
     streambuf_type * sbuf_;
+    std::shared_ptr<buffer> buf_;
 };
 
 
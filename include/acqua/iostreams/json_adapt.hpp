@@ -12,7 +12,11 @@
 
 namespace acqua { namespace iostreams {
 
-template <typename T>
+/*!
+  JSON と T を変換する方法.
+  Enable は、構造体などの型の集まりを enable_if で特殊化するために使う
+ */
+template <typename T, typename Enable = void>
 struct json_adapt;
 
 template <typename CharT>
@@ -24,7 +28,10 @@ struct json_adapt< std::basic_string<CharT> >
 
     json_adapt(value_type & val) : val_(val) {}
 
-    void data(value_type & val) { val_ = val; }
+    void data(value_type const & val) { val_ = val; }
+
+    template <typename Handler>
+    static void serialize(value_type const & val, Handler & handler) { handler.string(val); }
 
 private:
     value_type & val_;
@@ -10,6 +10,7 @@
 
 #include <acqua/iostreams/json_adapt.hpp>
 #include <boost/property_tree/ptree.hpp>
+#include <utility>
 
 namespace acqua { namespace iostreams {
 
@@ -38,6 +39,11 @@ public:
         value_.data() = std::to_string(val);
     }
 
+    void data(unsigned long val) const
+    {
+        value_.data() = std::to_string(val);
+    }
+
     void data(double const & val) const
     {
         value_.data() = std::to_string(val);
@@ -48,6 +54,11 @@ public:
         value_.data() = val;
     }
 
+    void data(Key && val) const
+    {
+        value_.data() = std::move(val);
+    }
+
     value_type & add_child(int) const
     {
         return value_.push_back(typename value_type::value_type())->second;
@@ -58,6 +69,36 @@ public:
         return value_.push_back(typename value_type::value_type(key, value_type()))->second;
     }
 
+    value_type & add_child(Key && key) const
+    {
+        return value_.push_back(typename value_type::value_type(std::move(key), value_type()))->second;
+    }
+
+    /*!
+      json を handler に書き出す.
+      ptree は値の型を持たないので、boost::property_tree::write_json と同じく値はすべて文字列にし、
+      子のキーがすべて空であれば配列にする
+     */
+    template <typename Handler>
+    static void serialize(value_type const & json, Handler & handler)
+    {
+        if (json.empty()) {
+            handler.string(json.data());
+        } else if (json.count(Key()) == json.size()) {
+            handler.start_array();
+            for(auto const & child : json)
+                serialize(child.second, handler);
+            handler.end_array();
+        } else {
+            handler.start_object();
+            for(auto const & child : json) {
+                handler.key(child.first);
+                serialize(child.second, handler);
+            }
+            handler.end_object();
+        }
+    }
+
 private:
     value_type & value_;
 };
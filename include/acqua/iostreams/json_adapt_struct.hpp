@@ -0,0 +1,614 @@
+#pragma once
+
+/*!
+  acqua library
+
+  Copyright (c) 2016 Haruhiko Uchida
+  The software is released under the MIT license.
+  http://opensource.org/licenses/mit-license.php
+ */
+
+#include <acqua/iostreams/json_adapt.hpp>
+#include <boost/exception/exception.hpp>
+#include <boost/throw_exception.hpp>
+#include <boost/fusion/include/adapt_struct.hpp>
+#include <boost/fusion/include/at_c.hpp>
+#include <boost/fusion/include/tag_of.hpp>
+#include <boost/optional.hpp>
+#include <boost/utility/string_view.hpp>
+#include <cstddef>
+#include <limits>
+#include <map>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace acqua { namespace iostreams {
+
+namespace json {
+
+//! JSON の値の型が、格納先の型に合わない
+struct type_error : virtual std::exception, virtual boost::exception {};
+
+
+//! BOOST_FUSION_ADAPT_STRUCT で宣言した構造体であれば true
+template <typename T>
+struct is_adapted_struct
+    : std::is_same<typename boost::fusion::traits::tag_of<T>::type, boost::fusion::struct_tag> {};
+
+
+template <typename CharT>
+struct bind_ops;
+
+//! 値を格納する先. object を ops の関数で操作する
+template <typename CharT>
+struct bind_target
+{
+    void * object;
+    bind_ops<CharT> const * ops;
+};
+
+
+/*!
+  格納先の型ごとの関数の表.
+  構造体のメンバーの型はコンパイル時に決まるが、JSON の入れ子は実行時にしかわからないので、関数ポインタでたどる
+ */
+template <typename CharT>
+struct bind_ops
+{
+    using view_type = boost::basic_string_view<CharT>;
+
+    void (*null)(void *);
+    void (*boolean)(void *, bool);
+    void (*integer)(void *, long);
+    void (*unsigned_integer)(void *, unsigned long);
+    void (*real)(void *, double);
+    void (*string)(void *, view_type);
+    void (*start_object)(void *);
+    bool (*member)(void *, view_type, bind_target<CharT> &, std::size_t &);
+    void (*start_array)(void *);
+    bind_target<CharT> (*element)(void *);
+};
+
+
+/*!
+  型ごとの格納と書き出しの実装.
+  binder_base を継承して、受け付ける値の関数だけを定義する。定義しない関数は type_error を投げる
+ */
+template <typename T, typename CharT, typename Enable = void>
+struct binder;
+
+template <typename T, typename CharT>
+bind_ops<CharT> const * bind_ops_of();
+
+
+template <typename CharT>
+struct binder_base
+{
+    using view_type = boost::basic_string_view<CharT>;
+
+    static void null(void *) { BOOST_THROW_EXCEPTION( type_error() ); }
+    static void boolean(void *, bool) { BOOST_THROW_EXCEPTION( type_error() ); }
+    static void integer(void *, long) { BOOST_THROW_EXCEPTION( type_error() ); }
+    static void unsigned_integer(void *, unsigned long) { BOOST_THROW_EXCEPTION( type_error() ); }
+    static void real(void *, double) { BOOST_THROW_EXCEPTION( type_error() ); }
+    static void string(void *, view_type) { BOOST_THROW_EXCEPTION( type_error() ); }
+    static void start_object(void *) { BOOST_THROW_EXCEPTION( type_error() ); }
+    static bool member(void *, view_type, bind_target<CharT> &, std::size_t &) { BOOST_THROW_EXCEPTION( type_error() ); }
+    static void start_array(void *) { BOOST_THROW_EXCEPTION( type_error() ); }
+    static bind_target<CharT> element(void *) { BOOST_THROW_EXCEPTION( type_error() ); }
+};
+
+
+template <typename CharT>
+struct binder<bool, CharT>
+    : binder_base<CharT>
+{
+    static void boolean(void * p, bool val)
+    {
+        *static_cast<bool *>(p) = val;
+    }
+
+    template <typename Handler>
+    static void serialize(bool val, Handler & handler)
+    {
+        handler.boolean(val);
+    }
+};
+
+
+//! 整数. 範囲を超える値と、小数部のある数値は type_error にする
+template <typename T, typename CharT>
+struct binder<T, CharT, typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value>::type>
+    : binder_base<CharT>
+{
+    using limits = std::numeric_limits<T>;
+
+    static void integer(void * p, long val)
+    {
+        if (!in_range(val, std::is_signed<T>()))
+            BOOST_THROW_EXCEPTION( type_error() );
+        *static_cast<T *>(p) = static_cast<T>(val);
+    }
+
+    static void unsigned_integer(void * p, unsigned long val)
+    {
+        if (val > static_cast<typename std::make_unsigned<T>::type>(limits::max()))
+            BOOST_THROW_EXCEPTION( type_error() );
+        *static_cast<T *>(p) = static_cast<T>(val);
+    }
+
+    static void real(void * p, double val)
+    {
+        // max + 1 は 2 の累乗なので double で正確に表せる
+        double const upper = static_cast<double>(limits::max() / 2 + 1) * 2;
+        if (!(val >= static_cast<double>(limits::min()) && val < upper) || static_cast<double>(static_cast<T>(val)) != val)
+            BOOST_THROW_EXCEPTION( type_error() );
+        *static_cast<T *>(p) = static_cast<T>(val);
+    }
+
+    template <typename Handler>
+    static void serialize(T val, Handler & handler)
+    {
+        serialize(val, handler, std::is_signed<T>());
+    }
+
+private:
+    static bool in_range(long val, std::true_type) noexcept
+    {
+        return val >= static_cast<long>(limits::min()) && val <= static_cast<long>(limits::max());
+    }
+
+    static bool in_range(long val, std::false_type) noexcept
+    {
+        return val >= 0 && static_cast<unsigned long>(val) <= static_cast<unsigned long>(limits::max());
+    }
+
+    template <typename Handler>
+    static void serialize(T val, Handler & handler, std::true_type)
+    {
+        handler.number(static_cast<long>(val));
+    }
+
+    template <typename Handler>
+    static void serialize(T val, Handler & handler, std::false_type)
+    {
+        handler.number(static_cast<unsigned long>(val));
+    }
+};
+
+
+template <typename T, typename CharT>
+struct binder<T, CharT, typename std::enable_if<std::is_floating_point<T>::value>::type>
+    : binder_base<CharT>
+{
+    static void integer(void * p, long val)
+    {
+        *static_cast<T *>(p) = static_cast<T>(val);
+    }
+
+    static void unsigned_integer(void * p, unsigned long val)
+    {
+        *static_cast<T *>(p) = static_cast<T>(val);
+    }
+
+    static void real(void * p, double val)
+    {
+        *static_cast<T *>(p) = static_cast<T>(val);
+    }
+
+    template <typename Handler>
+    static void serialize(T val, Handler & handler)
+    {
+        handler.number(static_cast<double>(val));
+    }
+};
+
+
+//! 文字列. 以前の容量を使い回す
+template <typename Traits, typename Alloc, typename CharT>
+struct binder<std::basic_string<CharT, Traits, Alloc>, CharT>
+    : binder_base<CharT>
+{
+    using value_type = std::basic_string<CharT, Traits, Alloc>;
+    using view_type = boost::basic_string_view<CharT>;
+
+    static void string(void * p, view_type str)
+    {
+        static_cast<value_type *>(p)->assign(str.data(), str.size());
+    }
+
+    template <typename Handler>
+    static void serialize(value_type const & val, Handler & handler)
+    {
+        handler.string(view_type(val.data(), val.size()));
+    }
+};
+
+
+//! null であれば空にし、それ以外は値を作ってから T として格納する
+template <typename T, typename CharT>
+struct binder<boost::optional<T>, CharT>
+    : binder_base<CharT>
+{
+    using value_type = boost::optional<T>;
+    using view_type = boost::basic_string_view<CharT>;
+    using inner = binder<T, CharT>;
+
+    static void null(void * p)
+    {
+        static_cast<value_type *>(p)->reset();
+    }
+
+    static void boolean(void * p, bool val) { inner::boolean(get(p), val); }
+    static void integer(void * p, long val) { inner::integer(get(p), val); }
+    static void unsigned_integer(void * p, unsigned long val) { inner::unsigned_integer(get(p), val); }
+    static void real(void * p, double val) { inner::real(get(p), val); }
+    static void string(void * p, view_type str) { inner::string(get(p), str); }
+    static void start_object(void * p) { inner::start_object(get(p)); }
+    static bool member(void * p, view_type key, bind_target<CharT> & child, std::size_t & hint) { return inner::member(get(p), key, child, hint); }
+    static void start_array(void * p) { inner::start_array(get(p)); }
+    static bind_target<CharT> element(void * p) { return inner::element(get(p)); }
+
+    template <typename Handler>
+    static void serialize(value_type const & val, Handler & handler)
+    {
+        if (val)
+            inner::serialize(*val, handler);
+        else
+            handler.null();
+    }
+
+private:
+    static void * get(void * p)
+    {
+        auto & opt = *static_cast<value_type *>(p);
+        if (!opt)
+            opt = T();
+        return &*opt;
+    }
+};
+
+
+//! 配列. 要素は最後に追加したものにだけ格納するので、ポインタは次の要素まで有効であればよい
+template <typename T, typename Alloc, typename CharT>
+struct binder<std::vector<T, Alloc>, CharT>
+    : binder_base<CharT>
+{
+    using value_type = std::vector<T, Alloc>;
+
+    static void start_array(void * p)
+    {
+        static_cast<value_type *>(p)->clear();
+    }
+
+    static bind_target<CharT> element(void * p)
+    {
+        auto & vec = *static_cast<value_type *>(p);
+        vec.emplace_back();
+        return bind_target<CharT>{ &vec.back(), bind_ops_of<T, CharT>() };
+    }
+
+    template <typename Handler>
+    static void serialize(value_type const & val, Handler & handler)
+    {
+        handler.start_array();
+        for(auto const & e : val)
+            binder<T, CharT>::serialize(e, handler);
+        handler.end_array();
+    }
+};
+
+
+//! キーが決まっていないオブジェクト
+template <typename T, typename Traits, typename Alloc, typename Compare, typename MapAlloc, typename CharT>
+struct binder<std::map<std::basic_string<CharT, Traits, Alloc>, T, Compare, MapAlloc>, CharT>
+    : binder_base<CharT>
+{
+    using value_type = std::map<std::basic_string<CharT, Traits, Alloc>, T, Compare, MapAlloc>;
+    using view_type = boost::basic_string_view<CharT>;
+
+    static void start_object(void * p)
+    {
+        static_cast<value_type *>(p)->clear();
+    }
+
+    static bool member(void * p, view_type key, bind_target<CharT> & child, std::size_t &)
+    {
+        auto & val = (*static_cast<value_type *>(p))[typename value_type::key_type(key.data(), key.size())];
+        child = bind_target<CharT>{ &val, bind_ops_of<T, CharT>() };
+        return true;
+    }
+
+    template <typename Handler>
+    static void serialize(value_type const & val, Handler & handler)
+    {
+        handler.start_object();
+        for(auto const & e : val) {
+            handler.key(view_type(e.first.data(), e.first.size()));
+            binder<T, CharT>::serialize(e.second, handler);
+        }
+        handler.end_object();
+    }
+};
+
+
+/*!
+  BOOST_FUSION_ADAPT_STRUCT で宣言した構造体.
+
+  メンバーの名前をキーにする。JSON にないメンバーはそのままにし、構造体にないキーの値は読み飛ばす。
+  キーはたいてい宣言の順に並んでいるので、前のキーの次のメンバーから比べる
+ */
+template <typename T, typename CharT>
+struct binder<T, CharT, typename std::enable_if<is_adapted_struct<T>::value>::type>
+    : binder_base<CharT>
+{
+    using view_type = boost::basic_string_view<CharT>;
+    static std::size_t const size = boost::fusion::extension::struct_size<T>::value;
+
+    struct field
+    {
+        std::basic_string<CharT> name;
+        bind_target<CharT> (*get)(void *);
+    };
+
+    static void start_object(void *)
+    {
+    }
+
+    static bool member(void * p, view_type key, bind_target<CharT> & child, std::size_t & hint)
+    {
+        field const * tbl = fields();
+        for(std::size_t n = 0; n < size; ++n, ++hint) {
+            if (hint >= size)
+                hint = 0;
+            if (key == tbl[hint].name) {
+                child = tbl[hint].get(p);
+                ++hint;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    template <typename Handler>
+    static void serialize(T const & val, Handler & handler)
+    {
+        handler.start_object();
+        serialize_members(val, handler, std::make_index_sequence<size>());
+        handler.end_object();
+    }
+
+private:
+    template <std::size_t I>
+    using member_type = typename std::decay<decltype(boost::fusion::at_c<I>(std::declval<T &>()))>::type;
+
+    template <std::size_t I>
+    static bind_target<CharT> get(void * p)
+    {
+        return bind_target<CharT>{ &boost::fusion::at_c<I>(*static_cast<T *>(p)), bind_ops_of<member_type<I>, CharT>() };
+    }
+
+    template <std::size_t I>
+    static std::basic_string<CharT> name()
+    {
+        char const * s = boost::fusion::extension::struct_member_name<T, I>::call();
+        return std::basic_string<CharT>(s, s + std::char_traits<char>::length(s));
+    }
+
+    template <std::size_t... I>
+    static field const * make_fields(std::index_sequence<I...>)
+    {
+        static field const tbl[] = { field{ name<I>(), &get<I> }... };
+        return tbl;
+    }
+
+    static field const * fields()
+    {
+        static field const * tbl = make_fields(std::make_index_sequence<size>());
+        return tbl;
+    }
+
+    template <typename Handler, std::size_t... I>
+    static void serialize_members(T const & val, Handler & handler, std::index_sequence<I...>)
+    {
+        field const * tbl = fields();
+        int dummy[] = { 0, (handler.key(view_type(tbl[I].name)), binder<member_type<I>, CharT>::serialize(boost::fusion::at_c<I>(val), handler), 0)... };
+        (void)dummy;
+    }
+};
+
+
+template <typename T, typename CharT>
+inline bind_ops<CharT> const * bind_ops_of()
+{
+    using b = binder<T, CharT>;
+    static bind_ops<CharT> const ops = {
+        &b::null, &b::boolean, &b::integer, &b::unsigned_integer, &b::real, &b::string,
+        &b::start_object, &b::member, &b::start_array, &b::element
+    };
+    return &ops;
+}
+
+
+/*!
+  basic_tokenizer の呼び出しを、型の決まった値に直接格納するハンドラ.
+  構造体にないキーの値は、入れ子も含めて数えるだけで読み飛ばす
+ */
+template <typename T, typename CharT = char>
+class bind_handler
+{
+    struct frame
+    {
+        bind_target<CharT> target;
+        bool array;
+        std::size_t hint;
+    };
+
+public:
+    using view_type = boost::basic_string_view<CharT>;
+
+public:
+    explicit bind_handler(T & value)
+        : root_{ &value, bind_ops_of<T, CharT>() }
+    {
+    }
+
+    void null()
+    {
+        if (!skip())
+            next().ops->null(target_.object);
+    }
+
+    void boolean(bool val)
+    {
+        if (!skip())
+            next().ops->boolean(target_.object, val);
+    }
+
+    void number(long val)
+    {
+        if (!skip())
+            next().ops->integer(target_.object, val);
+    }
+
+    void number(unsigned long val)
+    {
+        if (!skip())
+            next().ops->unsigned_integer(target_.object, val);
+    }
+
+    void number(double val)
+    {
+        if (!skip())
+            next().ops->real(target_.object, val);
+    }
+
+    void string(view_type str)
+    {
+        if (!skip())
+            next().ops->string(target_.object, str);
+    }
+
+    void key(view_type str)
+    {
+        if (skip_depth_ > 0)
+            return;
+        frame & top = stack_.back();
+        if (!top.target.ops->member(top.target.object, str, target_, top.hint))
+            skip_next_ = true;
+    }
+
+    void start_object()
+    {
+        if (enter_skip())
+            return;
+        next().ops->start_object(target_.object);
+        stack_.push_back(frame{ target_, false, 0 });
+    }
+
+    void end_object()
+    {
+        leave();
+    }
+
+    void start_array()
+    {
+        if (enter_skip())
+            return;
+        next().ops->start_array(target_.object);
+        stack_.push_back(frame{ target_, true, 0 });
+    }
+
+    void end_array()
+    {
+        leave();
+    }
+
+private:
+    //! 次の値を格納する先を target_ にする. オブジェクトでは key() で決まっている
+    bind_target<CharT> const & next()
+    {
+        if (stack_.empty())
+            target_ = root_;
+        else if (stack_.back().array)
+            target_ = stack_.back().target.ops->element(stack_.back().target.object);
+        return target_;
+    }
+
+    bool skip() noexcept
+    {
+        if (skip_depth_ > 0)
+            return true;
+        if (skip_next_) {
+            skip_next_ = false;
+            return true;
+        }
+        return false;
+    }
+
+    bool enter_skip() noexcept
+    {
+        if (skip_depth_ > 0 || skip_next_) {
+            skip_next_ = false;
+            ++skip_depth_;
+            return true;
+        }
+        return false;
+    }
+
+    void leave() noexcept
+    {
+        if (skip_depth_ > 0)
+            --skip_depth_;
+        else
+            stack_.pop_back();
+    }
+
+private:
+    bind_target<CharT> root_;
+    bind_target<CharT> target_ = {};
+    std::vector<frame> stack_;
+    int skip_depth_ = 0;
+    bool skip_next_ = false;
+};
+
+}  // json
+
+
+/*!
+  BOOST_FUSION_ADAPT_STRUCT で宣言した構造体.
+  json_parser は ptree を経由せずにメンバーに直接格納し、json_writer はメンバーの型のまま書き出す
+ */
+template <typename T>
+struct json_adapt<T, typename std::enable_if<json::is_adapted_struct<T>::value>::type>
+{
+    using value_type = T;
+    using char_type = char;
+    using handler_type = json::bind_handler<T, char>;
+
+    template <typename Handler>
+    static void serialize(value_type const & val, Handler & handler)
+    {
+        json::binder<T, char>::serialize(val, handler);
+    }
+};
+
+
+//! 構造体などの配列
+template <typename T, typename Alloc>
+struct json_adapt< std::vector<T, Alloc> >
+{
+    using value_type = std::vector<T, Alloc>;
+    using char_type = char;
+    using handler_type = json::bind_handler<value_type, char>;
+
+    template <typename Handler>
+    static void serialize(value_type const & val, Handler & handler)
+    {
+        json::binder<value_type, char>::serialize(val, handler);
+    }
+};
+
+} }
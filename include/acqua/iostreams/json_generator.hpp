@@ -0,0 +1,226 @@
+#pragma once
+
+/*!
+  acqua library
+
+  Copyright (c) 2016 Haruhiko Uchida
+  The software is released under the MIT license.
+  http://opensource.org/licenses/mit-license.php
+ */
+
+#include <acqua/iostreams/detail/json_scan.hpp>
+#include <acqua/iostreams/detail/json_dtoa.hpp>
+#include <boost/utility/string_view.hpp>
+#include <string>
+#include <type_traits>
+
+namespace acqua { namespace iostreams { namespace json {
+
+/*!
+  SAX 形式の呼び出しから JSON のテキストを作る.
+
+  関数は basic_tokenizer のハンドラと同じなので、basic_tokenizer に渡すと JSON を整形し直せる。
+  テキストは out に追記する。indent が 0 であれば空白を入れず、1 以上であればその数の空白で字下げする。
+  呼び出しの順が JSON の構造に合っているかは確かめない
+ */
+template <typename CharT = char>
+class basic_generator
+{
+public:
+    using char_type = CharT;
+    using string_type = std::basic_string<CharT>;
+    using view_type = boost::basic_string_view<CharT>;
+
+public:
+    explicit basic_generator(string_type & out, int indent = 0)
+        : out_(out), indent_(indent)
+    {
+    }
+
+    void null()
+    {
+        separate();
+        append("null", 4);
+    }
+
+    void boolean(bool flag)
+    {
+        separate();
+        if (flag)
+            append("true", 4);
+        else
+            append("false", 5);
+    }
+
+    void number(long val)
+    {
+        separate();
+        char buf[24];
+        char * p = buf;
+        std::uint64_t abs = static_cast<std::uint64_t>(val);
+        if (val < 0) {
+            *p++ = '-';
+            abs = ~abs + 1;
+        }
+        p += detail::json_format_integer(abs, p);
+        append(buf, p - buf);
+    }
+
+    void number(unsigned long val)
+    {
+        separate();
+        char buf[24];
+        append(buf, detail::json_format_integer(val, buf));
+    }
+
+    void number(double val)
+    {
+        separate();
+        char buf[32];
+        append(buf, detail::json_format_double(val, buf));
+    }
+
+    //! 64 ビットに収まらない整数などを、テキストのまま書き込む
+    void big_number(view_type text)
+    {
+        separate();
+        out_.append(text.data(), text.size());
+    }
+
+    void string(view_type str)
+    {
+        separate();
+        quote(str);
+    }
+
+    void key(view_type str)
+    {
+        separate();
+        quote(str);
+        out_ += CharT(':');
+        if (indent_ > 0)
+            out_ += CharT(' ');
+        after_key_ = true;
+    }
+
+    void start_object()
+    {
+        open('{');
+    }
+
+    void end_object()
+    {
+        close('}');
+    }
+
+    void start_array()
+    {
+        open('[');
+    }
+
+    void end_array()
+    {
+        close(']');
+    }
+
+private:
+    //! 値の前の ',' と改行を書き込む
+    void separate()
+    {
+        if (after_key_) {
+            after_key_ = false;
+        } else if (depth_ > 0) {
+            if (!first_)
+                out_ += CharT(',');
+            newline(depth_);
+        }
+        first_ = false;
+    }
+
+    void open(char ch)
+    {
+        separate();
+        out_ += CharT(ch);
+        ++depth_;
+        first_ = true;
+    }
+
+    void close(char ch)
+    {
+        --depth_;
+        if (!first_)
+            newline(depth_);
+        out_ += CharT(ch);
+        first_ = false;
+    }
+
+    void newline(int depth)
+    {
+        if (indent_ > 0) {
+            out_ += CharT('\n');
+            out_.append(static_cast<std::size_t>(depth * indent_), CharT(' '));
+        }
+    }
+
+    //! エスケープしなくてよい文字の並びはまとめて写す
+    void quote(view_type str)
+    {
+        static char const hex[] = "0123456789abcdef";
+
+        out_ += CharT('"');
+        CharT const * p = str.data();
+        CharT const * end = p + str.size();
+        for(;;) {
+            CharT const * q = detail::json_scan_string(p, end);
+            out_.append(p, static_cast<std::size_t>(q - p));
+            if (q == end)
+                break;
+            switch(*q) {
+                case '"':  append("\\\"", 2); break;
+                case '\\': append("\\\\", 2); break;
+                case '\b': append("\\b", 2); break;
+                case '\f': append("\\f", 2); break;
+                case '\n': append("\\n", 2); break;
+                case '\r': append("\\r", 2); break;
+                case '\t': append("\\t", 2); break;
+                default: {
+                    std::size_t ch = detail::json_table::index(*q);
+                    char buf[6] = { '\\', 'u', '0', '0', hex[(ch >> 4) & 0xF], hex[ch & 0xF] };
+                    append(buf, 6);
+                    break;
+                }
+            }
+            p = q + 1;
+        }
+        out_ += CharT('"');
+    }
+
+    //! ASCII の文字列を追記する. 範囲を渡す append は一時的な文字列を作るので、char はそのまま写す
+    template <typename Size>
+    void append(char const * s, Size n)
+    {
+        append(s, static_cast<std::size_t>(n), std::is_same<CharT, char>());
+    }
+
+    void append(char const * s, std::size_t n, std::true_type)
+    {
+        out_.append(s, n);
+    }
+
+    void append(char const * s, std::size_t n, std::false_type)
+    {
+        for(std::size_t i = 0; i < n; ++i)
+            out_ += CharT(s[i]);
+    }
+
+private:
+    string_type & out_;
+    int indent_;
+    int depth_ = 0;
+    bool first_ = true;
+    bool after_key_ = false;
+};
+
+using generator = basic_generator<char>;
+
+} } }
@@ -0,0 +1,86 @@
+#pragma once
+
+/*!
+  acqua library
+
+  Copyright (c) 2016 Haruhiko Uchida
+  The software is released under the MIT license.
+  http://opensource.org/licenses/mit-license.php
+ */
+
+#include <acqua/iostreams/json_adapt.hpp>
+#include <boost/iostreams/categories.hpp>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+
+namespace acqua { namespace iostreams {
+
+/*!
+  改行で区切った JSON (JSON Lines, NDJSON) を、レコードごとに Json にして callback に渡すシンク.
+
+  json_parser は 1 つの値で終わるが、json_lines_parser は値が終わるたびに callback を呼び、Json を作り直して次の値を続ける。
+  トークナイザとハンドラのバッファは使い回すので、レコードごとのメモリの確保は Json の分だけになる。
+  改行のない最後のレコードは close() で完了する
+ */
+template <
+    typename Json,
+    typename Adapt = json_adapt<Json>,
+    typename CharT = typename Adapt::char_type
+    >
+class json_lines_parser
+{
+    struct impl;
+
+public:
+    using char_type = CharT;
+    struct category : boost::iostreams::sink_tag, boost::iostreams::closable_tag {};
+    using callback_type = std::function<void(Json &)>;
+
+public:
+    explicit json_lines_parser(callback_type callback);
+
+    std::streamsize write(char_type const * s, std::streamsize n);
+
+    void close();
+
+    //! callback に渡したレコードの数
+    std::size_t count() const noexcept;
+
+private:
+    std::shared_ptr<impl> impl_;
+};
+
+
+//! parse_json_lines() の設定
+struct json_lines_options
+{
+    //! 呼び出し元を含めたスレッドの数. 0 であれば CPU の数
+    std::size_t threads = 0;
+
+    //! 1 つのスレッドが一度に解析するバイト数の目安. 境界は次の改行まで延ばす
+    std::size_t chunk_size = 1 << 20;
+
+    //! true であれば、入力の順に呼び出し元のスレッドから f を呼ぶ。false であれば f は複数のスレッドから同時に呼ばれる
+    bool ordered = true;
+};
+
+
+/*!
+  メモリ上の JSON Lines を、改行の位置で分けて複数のスレッドで解析する.
+
+  ordered のときは、スレッドの数の分だけ解析したレコードを溜めてから順に f に渡すので、溜まるのは chunk_size * threads 程度に収まる。
+  解析に失敗すると、それより前のレコードを渡してから例外を投げ直す
+ */
+template <typename Json, typename Adapt = json_adapt<Json>, typename F>
+void parse_json_lines(char const * s, std::size_t n, F f, json_lines_options const & opts = json_lines_options());
+
+
+//! ファイルをメモリにマップして parse_json_lines() で解析する. 開けなければ boost::system::system_error を投げる
+template <typename Json, typename Adapt = json_adapt<Json>, typename F>
+void parse_json_lines_file(std::string const & path, F f, json_lines_options const & opts = json_lines_options());
+
+} }
+
+#include <acqua/iostreams/json_lines_parser.ipp>
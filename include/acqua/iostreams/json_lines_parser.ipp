@@ -0,0 +1,176 @@
+#pragma once
+
+/*!
+  acqua library
+
+  Copyright (c) 2016 Haruhiko Uchida
+  The software is released under the MIT license.
+  http://opensource.org/licenses/mit-license.php
+ */
+
+#include <acqua/iostreams/json_lines_parser.hpp>
+#include <acqua/iostreams/json_parser.hpp>
+#include <acqua/iostreams/json_tokenizer.hpp>
+#include <acqua/iostreams/detail/mapped_input.hpp>
+#include <acqua/iostreams/detail/worker_pool.hpp>
+#include <algorithm>
+#include <cstring>
+#include <exception>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace acqua { namespace iostreams {
+
+template <typename Json, typename Adapt, typename CharT>
+struct json_lines_parser<Json, Adapt, CharT>::impl
+{
+    using handler_type = typename json::parser_handler<Json, Adapt, CharT>::type;
+
+    explicit impl(callback_type && callback)
+        : callback_(std::move(callback)), handler_(value_), tokenizer_(handler_) {}
+
+    std::streamsize write(char_type const * s, std::streamsize n)
+    {
+        std::size_t const len = static_cast<std::size_t>(n);
+        std::size_t pos = 0;
+        while(pos < len) {
+            pos += tokenizer_.write(s + pos, len - pos);
+            if (tokenizer_.done())
+                complete();
+        }
+        return n;
+    }
+
+    void close()
+    {
+        if (!tokenizer_.empty()) {
+            tokenizer_.finish();
+            complete();
+        }
+    }
+
+    //! ハンドラは value_ を指したままなので、value_ を空にしてトークナイザだけ戻す
+    void complete()
+    {
+        ++count_;
+        callback_(value_);
+        value_ = Json();
+        tokenizer_.reset();
+    }
+
+    callback_type callback_;
+    Json value_;
+    handler_type handler_;
+    json::basic_tokenizer<handler_type, CharT> tokenizer_;
+    std::size_t count_ = 0;
+};
+
+
+template <typename Json, typename Adapt, typename CharT>
+inline json_lines_parser<Json, Adapt, CharT>::json_lines_parser(callback_type callback)
+    : impl_(new impl(std::move(callback))) {}
+
+
+template <typename Json, typename Adapt, typename CharT>
+inline std::streamsize json_lines_parser<Json, Adapt, CharT>::write(char_type const * s, std::streamsize n)
+{
+    return impl_->write(s, n);
+}
+
+
+template <typename Json, typename Adapt, typename CharT>
+inline void json_lines_parser<Json, Adapt, CharT>::close()
+{
+    impl_->close();
+}
+
+
+template <typename Json, typename Adapt, typename CharT>
+inline std::size_t json_lines_parser<Json, Adapt, CharT>::count() const noexcept
+{
+    return impl_->count_;
+}
+
+
+namespace detail {
+
+//! p から size バイト先の、次の行の先頭を返す
+inline char const * json_lines_boundary(char const * p, char const * end, std::size_t size) noexcept
+{
+    if (static_cast<std::size_t>(end - p) <= size)
+        return end;
+    void const * nl = std::memchr(p + size, '\n', static_cast<std::size_t>(end - p) - size);
+    return nl ? static_cast<char const *>(nl) + 1 : end;
+}
+
+}  // detail
+
+
+template <typename Json, typename Adapt, typename F>
+inline void parse_json_lines(char const * s, std::size_t n, F f, json_lines_options const & opts)
+{
+    static_assert(std::is_same<typename Adapt::char_type, char>::value, "parse_json_lines reads bytes");
+
+    std::size_t threads = opts.threads;
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    std::size_t const chunk_size = std::max<std::size_t>(opts.chunk_size, 1);
+
+    auto parse = [](char const * beg, char const * end, std::function<void(Json &)> callback) {
+        json_lines_parser<Json, Adapt, char> parser(std::move(callback));
+        parser.write(beg, end - beg);
+        parser.close();
+    };
+
+    char const * p = s;
+    char const * const end = s + n;
+    if (threads == 1) {
+        parse(p, end, [&f](Json & json) { f(json); });
+        return;
+    }
+
+    // 一度に解析する分をスレッドの数に分け、終わるたびに順に渡す
+    detail::worker_pool pool(threads);
+    std::vector<std::pair<char const *, char const *> > chunks;
+    std::vector<std::vector<Json> > results(pool.size());
+    std::vector<std::exception_ptr> errors(pool.size());
+    while(p != end) {
+        chunks.clear();
+        for(std::size_t i = 0; i < pool.size() && p != end; ++i) {
+            char const * q = detail::json_lines_boundary(p, end, chunk_size);
+            chunks.emplace_back(p, q);
+            p = q;
+        }
+
+        pool.parallel_for(chunks.size(), [&](std::size_t i) {
+            try {
+                if (opts.ordered)
+                    parse(chunks[i].first, chunks[i].second, [&results, i](Json & json) { results[i].push_back(std::move(json)); });
+                else
+                    parse(chunks[i].first, chunks[i].second, [&f](Json & json) { f(json); });
+            } catch(...) {
+                errors[i] = std::current_exception();
+            }
+        });
+
+        for(std::size_t i = 0; i < chunks.size(); ++i) {
+            for(auto & json : results[i])
+                f(json);
+            results[i].clear();
+            if (errors[i])
+                std::rethrow_exception(errors[i]);
+        }
+    }
+}
+
+
+template <typename Json, typename Adapt, typename F>
+inline void parse_json_lines_file(std::string const & path, F f, json_lines_options const & opts)
+{
+    detail::mapped_input input(path);
+    parse_json_lines<Json, Adapt>(input.data(), input.size(), std::move(f), opts);
+}
+
+} }
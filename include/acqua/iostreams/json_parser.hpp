@@ -14,6 +14,10 @@
 
 namespace acqua { namespace iostreams {
 
+/*!
+  JSON を解析して Json に格納するシンク.
+  トップレベルの数値やリテラルは区切りの文字がないので、close() で完了する
+ */
 template <
     typename Json,
     typename Adapt = json_adapt<Json>,
@@ -25,13 +29,16 @@ class json_parser
 
 public:
     using char_type = CharT;
-    using category = boost::iostreams::sink_tag;
+    struct category : boost::iostreams::sink_tag, boost::iostreams::closable_tag {};
 
 public:
     json_parser(Json & json);
 
     std::streamsize write(char_type const * s, std::streamsize n);
 
+    //! 入力の終わりを伝える. 値が途中であれば json::syntax_error を投げる
+    void close();
+
     explicit operator bool() const noexcept;
 
 private:
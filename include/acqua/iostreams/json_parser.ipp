@@ -9,486 +9,167 @@
  */
 
 #include <acqua/iostreams/json_parser.hpp>
-#include <boost/locale/encoding_utf.hpp>
-#include <boost/variant.hpp>
-#include <boost/exception/exception.hpp>
+#include <acqua/iostreams/json_tokenizer.hpp>
+#include <cstdio>
+#include <vector>
 
 namespace acqua { namespace iostreams {
 
 namespace json {
 
-enum class literal { l_null, l_true, l_false };
-enum class sign { plus, minus };
-
-struct syntax_error : virtual std::exception, virtual boost::exception {};
-
-class any_parser
-{
-public:
-    template <typename CharT, typename Impl>
-    bool operator()(CharT const & ch, Impl & impl)
-    {
-        switch(ch) {
-            case '\0':
-                return true;
-            case ' ': case '\t': case '\r': case '\n':
-                return true;
-            case 'n': case 'N':
-                impl.new_literal(literal::l_null);
-                return true;
-            case 't': case 'T':
-                impl.new_literal(literal::l_true);
-                return true;
-            case 'f': case 'F':
-                impl.new_literal(literal::l_false);
-                return true;
-            case '"':
-                impl.new_string();
-                return true;
-            case '[':
-                impl.new_array();
-                return true;
-            case '{':
-                impl.new_object();
-                return true;
-            case '-': case '+':
-            case '0' ... '9':
-                impl.new_number(ch);
-                return true;
-        }
-        BOOST_THROW_EXCEPTION( syntax_error() );
-    }
-};
-
-
-class literal_parser
+/*!
+  basic_tokenizer の呼び出しを Adapt の add_child() と data() に変換するハンドラ.
+  開いている配列とオブジェクトの Json をスタックに積み、オブジェクトではキーを受け取った時点で子を作る
+ */
+template <typename Json, typename Adapt, typename CharT>
+class adapt_handler
 {
-private:
-    literal l_;
-    char const * lit_;
+    using string_type = std::basic_string<CharT>;
+    using view_type = boost::basic_string_view<CharT>;
 
-    static char const * c_str(literal l)
+    //! index が負であればオブジェクト
+    struct frame
     {
-        switch(l) {
-            case literal::l_null:  return "null";
-            case literal::l_true:  return "true";
-            case literal::l_false: return "false";
-            default:               return "";
-        }
-    }
+        Json * json;
+        int index;
+    };
 
 public:
-    literal_parser(literal l)
-        : l_(l), lit_(c_str(l)) {}
+    explicit adapt_handler(Json & json)
+        : root_(json) {}
 
-    template <typename CharT, typename Impl>
-    bool operator()(CharT const & ch, Impl & impl)
+    void null()
     {
-        if (*++lit_ == '\0') {
-            switch(l_) {
-                case literal::l_null:
-                    impl.complete(nullptr);
-                    break;
-                case literal::l_true:
-                    impl.complete(true);
-                    break;
-                case literal::l_false:
-                    impl.complete(false);
-                    break;
-            }
-            return false;
-        } else if (std::tolower(ch, std::locale::classic()) == *lit_) {
-            return true;
-        }
-        BOOST_THROW_EXCEPTION( syntax_error() );
-        return true;
+        Adapt(next()).data(nullptr);
     }
-};
-
-
-class number_parser
-{
-    enum class n_type { decimal, fraction, exp, exponent } n_ = n_type::decimal;
-    long decimal_;
-    int fraction_;
-    int exponent_;
-    sign sign_;
 
-public:
-    number_parser(int decimal, enum sign sign)
-        : decimal_(decimal), fraction_(1), exponent_(0), sign_(sign) {}
-
-    template <typename CharT, typename Impl>
-    bool operator()(CharT const & ch, Impl & impl)
+    void boolean(bool flag)
     {
-        switch(n_) {
-            case n_type::decimal:
-                if (ch == 'e' || ch == 'E') {
-                    if (sign_ == sign::minus) decimal_ *= -1;
-                    n_ = n_type::exp;
-                    return true;
-                }
-                if (ch == '.') {
-                    n_ = n_type::fraction;
-                    return true;
-                }
-                if (std::isdigit(ch)) {
-                    decimal_ = decimal_ * 10 + (ch - '0');
-                    return true;
-                }
-
-                if (sign_ == sign::minus) decimal_ *= -1;
-                impl.complete(decimal_);
-                return false;
-            case n_type::fraction:
-                if (ch == 'e' || ch == 'E') {
-                    if (sign_ == sign::minus) decimal_ *= -1;
-                    n_ = n_type::exp;
-                    return true;
-                }
-                if (std::isdigit(ch)) {
-                    decimal_ = decimal_ * 10 + ch - '0';
-                    fraction_ *= 10;
-                    return true;
-                }
-
-                if (sign_ == sign::minus) decimal_ *= -1;
-                impl.complete(static_cast<double>(decimal_) / static_cast<double>(fraction_));
-                return false;
-            case n_type::exp:
-                switch(ch) {
-                    case '1' ... '9':
-                        exponent_ = ch - '0';
-                        //return false;
-                    case '+': case '0':
-                        n_ = n_type::exponent;
-                        sign_ = sign::plus;
-                        return true;
-                    case '-':
-                        n_ = n_type::exponent;
-                        sign_ = sign::minus;
-                        return true;
-                }
-                break;
-            case n_type::exponent:
-                if (std::isdigit(ch)) {
-                    exponent_ = exponent_ * 10 + (ch - '0');
-                    return true;
-                }
-                if (sign_ == sign::minus) exponent_ *= -1;
-                impl.complete(static_cast<double>(decimal_) * std::pow(10, exponent_) / static_cast<double>(fraction_));
-                return false;
-        }
-
-        BOOST_THROW_EXCEPTION( syntax_error() );
+        Adapt(next()).data(flag);
     }
-};
 
-
-template <typename String>
-class string_parser
-{
-public:
-    template <typename CharT, typename Impl>
-    bool operator()(CharT const & ch, Impl & impl)
+    void number(long val)
     {
-        if (escape_) {
-            if (hex_[0] == 0) {
-                switch(ch) {
-                    case '"':
-                        str_ += '"';
-                        break;
-                    case '\\':
-                        str_ += '\\';
-                        break;
-                    case '/':
-                        str_ += '/';
-                        break;
-                    case 'b':
-                        str_ += '\b';
-                        break;
-                    case 'f':
-                        str_ += '\f';
-                        break;
-                    case 'n':
-                        str_ += '\n';
-                        break;
-                    case 'r':
-                        str_ += '\r';
-                        break;
-                    case 't':
-                        str_ += '\t';
-                        break;
-                    case 'u': case 'U':
-                        hex_[0] = ch;
-                        hex_[1] = 0;
-                        return true;
-                    default:
-                        BOOST_THROW_EXCEPTION( syntax_error() );
-                }
-                escape_ = false;
-                return true;
-            } else if (hex_[1] == 0) {
-                if (std::isxdigit(ch)) {
-                    hex_[1] = ch;
-                    hex_[2] = 0;
-                    return true;
-                }
-            } else if (hex_[2] == 0) {
-                if (std::isxdigit(ch)) {
-                    hex_[2] = ch;
-                    hex_[3] = 0;
-                    return true;
-                }
-            } else if (hex_[3] == 0) {
-                if (std::isxdigit(ch)) {
-                    hex_[3] = ch;
-                    hex_[4] = 0;
-                    return true;
-                }
-            } else if (hex_[4] == 0) {
-                if (std::isxdigit(ch)) {
-                    hex_[4] = ch;
-                    hex_[5] = 0;
-                    escape_ = false;
-                    unescape(static_cast<char16_t>(std::strtol(hex_ + 1, nullptr, 16)), str_);
-                    return true;
-                }
-            }
-        } else if (ch == '"') {
-            impl.complete(std::move(str_));
-            return true;
-        } else if (ch == '\\') {
-            escape_ = true;
-            hex_[0] = 0;
-            return true;
-        } else if (std::isprint(ch, std::locale::classic())) {
-            str_ += ch;
-            return true;
-        }
-
-        BOOST_THROW_EXCEPTION(syntax_error());
+        Adapt(next()).data(val);
     }
 
-private:
-    static void unescape(char16_t ch, std::basic_string<char16_t> & s)
+    void number(unsigned long val)
     {
-        s += ch;
+        data_unsigned(Adapt(next()), val, 0);
     }
 
-    template <typename Ch>
-    static void unescape(char16_t ch, std::basic_string<Ch> & s)
+    void number(double val)
     {
-        namespace utf = boost::locale::utf;
-
-        char16_t * it = &ch;
-        utf::code_point cp = utf::utf_traits<char16_t>::decode(it, it + 1);
-        if (cp != utf::illegal && cp != utf::incomplete)
-            utf::utf_traits<Ch>::encode(cp, std::back_inserter(s));
+        Adapt(next()).data(val);
     }
 
-private:
-    bool escape_ = false;
-    char hex_[6];
-
-protected:
-    String str_ = {};
-};
-
-
-template <typename Impl>
-class array_parser
-{
-    std::unique_ptr<Impl> data_ = {};
-    int index_ = 0;
-
-public:
-    template <typename CharT>
-    bool operator()(CharT const & ch, Impl & impl)
+    void string(view_type str)
     {
-        if (data_ && data_->in_progress) {
-            return data_->parse_1(ch);
-        } else if (ch == ']') {
-            impl.complete();
-            return true;
-        } else if (!data_) {
-            impl.new_child(index_++, data_);
-            return data_->parse_1(ch);
-        } else if (ch == ',') {
-            impl.new_child(index_++, data_);
-            return true;
-        }
-
-        if (ch == ' ' || ch == '\t' || ch == '\r' || ch == '\n')
-            return true;
-
-        BOOST_THROW_EXCEPTION(syntax_error());
+        Adapt(next()).data(string_type(str.data(), str.size()));
     }
-};
-
 
-template <typename Impl, typename String>
-class object_parser
-{
-    struct string_impl : string_parser<String>
-    {
-        explicit string_impl(Impl & parent) : parent_(parent) {}
-        template <typename T>
-        void complete(T &&) { in_progress = false; }
-        Impl & parent_;
-        bool in_progress = true;
-        using string_parser<String>::str_;
-    };
-    std::unique_ptr<string_impl> key_ = {};
-    std::unique_ptr<Impl> val_ = {};
-    bool first_ = true;
-
-public:
-    template <typename CharT>
-    bool operator()(CharT const & ch, Impl & impl)
+    void key(view_type str)
     {
-        if (val_) {
-            if (val_->in_progress)
-                return val_->parse_1(ch);
-            if (ch == '}') {
-                impl.complete();
-                return true;
-            }
-            if (ch == ',') {
-                key_.release();
-                val_.release();
-                return true;
-            }
-        } else if (!key_) {
-            if (first_ && ch == '}') {
-                impl.complete();
-                return true;
-            }
-            if (ch == '"') {
-                first_ = false;
-                key_.reset(new string_impl(impl));
-                return true;
-            }
-        } else if (key_->in_progress) {
-            return (*key_)(ch, *key_);
-        } else if (ch == ':') {
-            impl.new_child(std::move(key_->str_), val_);
-            return true;
-        }
-        if (ch == ' ' || ch == '\t' || ch == '\r' || ch == '\n')
-            return true;
-        BOOST_THROW_EXCEPTION( syntax_error() );
+        child_ = &Adapt(*stack_.back().json).add_child(string_type(str.data(), str.size()));
     }
-};
-
-template <typename Json, typename Adapt, typename CharT>
-struct parser_impl
-    : private Adapt
-    , public boost::variant<
-        any_parser, literal_parser, number_parser,
-        string_parser<std::basic_string<CharT> >,
-        array_parser<parser_impl<Json, Adapt, CharT> >,
-        object_parser<parser_impl<Json, Adapt, CharT>, std::basic_string<CharT> >
-    >
-{
-    using any = any_parser;
-    using lit = literal_parser;
-    using num = number_parser;
-    using str = string_parser<std::basic_string<CharT> >;
-    using arr = array_parser<parser_impl >;
-    using obj = object_parser<parser_impl, std::basic_string<CharT> >;
-    using base_type = boost::variant<any, lit, num, str, arr, obj>;
-
-    struct visitor : boost::static_visitor<bool>
-    {
-        CharT const & ch_;
-        parser_impl & impl_;
-
-        explicit visitor(CharT const & ch, parser_impl & impl)
-            : ch_(ch), impl_(impl) {}
-
-        template <typename Parser>
-        bool operator()(Parser & parser) const { return parser(ch_, impl_); }
-    };
-
-    parser_impl(Json & json)
-        : Adapt(json) {}
 
-    bool parse_1(CharT const & ch)
+    void start_object()
     {
-        return boost::apply_visitor(visitor(ch, *this), *this);
+        Json & json = next();
+        stack_.push_back(frame{ &json, -1 });
     }
 
-    void new_literal(literal l)
+    void end_object()
     {
-        *static_cast<base_type *>(this) = lit(l);
+        stack_.pop_back();
     }
 
-    void new_number(char ch)
+    void start_array()
     {
-        *static_cast<base_type *>(this)
-            = (ch == '-') ? num(0, sign::minus)
-            : (ch == '+') ? num(0, sign::plus)
-            :               num(ch - '0', sign::plus);
+        Json & json = next();
+        stack_.push_back(frame{ &json, 0 });
     }
 
-    void new_string()
+    void end_array()
     {
-        *static_cast<base_type *>(this) = str();
+        stack_.pop_back();
     }
 
-    void new_array()
+private:
+    //! Adapt が unsigned long を受け取れなければ double にする
+    template <typename A>
+    static auto data_unsigned(A && adapt, unsigned long val, int) -> decltype(adapt.data(val), void())
     {
-        *static_cast<base_type *>(this) = arr();
+        adapt.data(val);
     }
 
-    void new_object()
+    template <typename A>
+    static void data_unsigned(A && adapt, unsigned long val, long)
     {
-        *static_cast<base_type *>(this) = obj();
+        adapt.data(static_cast<double>(val));
     }
 
-    template <typename T>
-    void new_child(T && t, std::unique_ptr<parser_impl> & impl)
+    //! 次の値を格納する Json
+    Json & next()
     {
-        impl.reset(new parser_impl(static_cast<Adapt *>(this)->add_child(std::forward<T>(t))));
+        if (stack_.empty())
+            return root_;
+        frame & top = stack_.back();
+        if (top.index >= 0)
+            return Adapt(*top.json).add_child(top.index++);
+        return *child_;
     }
 
-    void complete()
-    {
-        *static_cast<base_type *>(this) = any();
-        in_progress = false;
-    }
+private:
+    Json & root_;
+    std::vector<frame> stack_;
+    Json * child_ = nullptr;
+};
 
-    template <typename T>
-    void complete(T && t)
-    {
-        static_cast<Adapt *>(this)->data(std::forward<T>(t));
-        complete();
-    }
 
-    bool in_progress = true;
+template <typename T>
+struct always_void { using type = void; };
+
+//! Adapt が handler_type を持っていればそれを、なければ adapt_handler を使う
+template <typename Json, typename Adapt, typename CharT, typename Enable = void>
+struct parser_handler
+{
+    using type = adapt_handler<Json, Adapt, CharT>;
+};
+
+template <typename Json, typename Adapt, typename CharT>
+struct parser_handler<Json, Adapt, CharT, typename always_void<typename Adapt::handler_type>::type>
+{
+    using type = typename Adapt::handler_type;
 };
 
 }  // json
 
 template <typename Json, typename Adapt, typename CharT>
 struct json_parser<Json, Adapt, CharT>::impl
-    : json::parser_impl<Json, Adapt, CharT>
+    : json::parser_handler<Json, Adapt, CharT>::type
 {
+    using handler_type = typename json::parser_handler<Json, Adapt, CharT>::type;
+
     impl(Json & json)
-        : json::parser_impl<Json, Adapt, CharT>(json) {}
+        : handler_type(json), tokenizer_(*this) {}
 
     std::streamsize write(char_type const * s, std::streamsize n)
     {
-        if (!this->in_progress)
+        bool done = tokenizer_.done();
+        std::size_t res = tokenizer_.write(s, static_cast<std::size_t>(n));
+        if (done && res == 0 && n > 0)
             return EOF;
+        return static_cast<std::streamsize>(res);
+    }
 
-        std::streamsize i;
-        for(i = 0; this->in_progress && i < n; ++i, ++s) {
-            while(this->in_progress && !this->parse_1(*s));
-        }
-        return i;
+    void close()
+    {
+        if (!tokenizer_.empty())
+            tokenizer_.finish();
     }
+
+    json::basic_tokenizer<handler_type, CharT> tokenizer_;
 };
 
 
@@ -504,10 +185,17 @@ inline std::streamsize json_parser<Json, Adapt, CharT>::write(char_type const *
 }
 
 
+template <typename Json, typename Adapt, typename CharT>
+inline void json_parser<Json, Adapt, CharT>::close()
+{
+    impl_->close();
+}
+
+
 template <typename Json, typename Adapt, typename CharT>
 inline json_parser<Json, Adapt, CharT>::operator bool() const noexcept
 {
-    return impl_->in_progress;
+    return !impl_->tokenizer_.done();
 }
 
 } }
@@ -0,0 +1,482 @@
+#pragma once
+
+/*!
+  acqua library
+
+  Copyright (c) 2016 Haruhiko Uchida
+  The software is released under the MIT license.
+  http://opensource.org/licenses/mit-license.php
+ */
+
+#include <acqua/iostreams/detail/json_scan.hpp>
+#include <acqua/iostreams/detail/json_number.hpp>
+#include <boost/locale/encoding_utf.hpp>
+#include <boost/assert.hpp>
+#include <boost/exception/exception.hpp>
+#include <boost/throw_exception.hpp>
+#include <boost/utility/string_view.hpp>
+#include <string>
+#include <vector>
+
+namespace acqua { namespace iostreams { namespace json {
+
+struct syntax_error : virtual std::exception, virtual boost::exception {};
+
+
+/*!
+  SAX 形式のハンドラの既定の実装. 何もしない.
+
+  basic_tokenizer に渡すハンドラは、これを継承して必要な関数だけを定義してもよい。
+  string と key に渡す文字列は、次の呼び出しまでしか有効でない。
+
+  ハンドラが number(unsigned long) を持っていれば、long に収まらない正の整数をそれで受け取る。
+  big_number(view_type) を持っていれば、64 ビットに収まらない整数をテキストのまま受け取る。
+  どちらも持っていなければ、最も近い double を number(double) で受け取る
+ */
+template <typename CharT>
+struct basic_sax_handler
+{
+    using view_type = boost::basic_string_view<CharT>;
+
+    void null() {}
+    void boolean(bool) {}
+    void number(long) {}
+    void number(double) {}
+    void string(view_type) {}
+    void key(view_type) {}
+    void start_object() {}
+    void end_object() {}
+    void start_array() {}
+    void end_array() {}
+};
+
+using sax_handler = basic_sax_handler<char>;
+
+
+/*!
+  JSON を字句解析して、値ごとに Handler の関数を呼び出す.
+
+  write() に分けて渡された入力を続けて解析する。入れ子は再帰せずにスタックで数えるので、値ごとのメモリの確保はない。
+  エスケープがなく write() の区切りをまたがない文字列は、入力をそのまま指す view_type で渡す。
+  それ以外の文字列と区切りをまたぐ数値やリテラルは、内部のバッファに集めてから渡す。
+  以前の json_parser と同じく、リテラルの大文字と数値の先頭の '+' も受け付ける。
+  文法の誤りは syntax_error を投げる
+ */
+template <typename Handler, typename CharT = char>
+class basic_tokenizer
+{
+    enum class state : unsigned char { value, first_value, first_key, key, colon, next, string, number, literal, done };
+
+public:
+    using char_type = CharT;
+    using string_type = std::basic_string<CharT>;
+    using view_type = boost::basic_string_view<CharT>;
+
+public:
+    explicit basic_tokenizer(Handler & handler)
+        : handler_(handler)
+    {
+    }
+
+    /*!
+      s から n 文字を解析して、使った文字数を返す.
+      トップレベルの値が終わると、続く空白までを使って止まる
+     */
+    std::size_t write(CharT const * s, std::size_t n)
+    {
+        CharT const * p = s;
+        CharT const * end = s + n;
+        while(p != end) {
+            switch(state_) {
+                case state::string:
+                    p = resume_string(p, end);
+                    continue;
+                case state::number:
+                    p = resume_token(p, end, detail::json_scan_number(p, end), &basic_tokenizer::emit_number);
+                    continue;
+                case state::literal:
+                    p = resume_token(p, end, detail::json_scan_alpha(p, end), &basic_tokenizer::emit_literal);
+                    continue;
+                default:
+                    break;
+            }
+
+            p = detail::json_skip_space(p, end);
+            if (p == end || state_ == state::done)
+                break;
+
+            CharT ch = *p;
+            switch(state_) {
+                case state::first_value:
+                    if (ch == ']') {
+                        ++p;
+                        close();
+                        break;
+                    }
+                    // fall through
+                case state::value:
+                    p = parse_value(p, end);
+                    break;
+                case state::first_key:
+                    if (ch == '}') {
+                        ++p;
+                        close();
+                        break;
+                    }
+                    // fall through
+                case state::key:
+                    if (ch != '"')
+                        BOOST_THROW_EXCEPTION( syntax_error() );
+                    key_ = true;
+                    p = parse_string(p + 1, end);
+                    break;
+                case state::colon:
+                    if (ch != ':')
+                        BOOST_THROW_EXCEPTION( syntax_error() );
+                    ++p;
+                    state_ = state::value;
+                    break;
+                case state::next:
+                    ++p;
+                    if (ch == ',') {
+                        state_ = (stack_.back() == '[') ? state::value : state::key;
+                    } else if (ch == (stack_.back() == '[' ? ']' : '}')) {
+                        close();
+                    } else {
+                        BOOST_THROW_EXCEPTION( syntax_error() );
+                    }
+                    break;
+                default:
+                    break;
+            }
+        }
+        return static_cast<std::size_t>(p - s);
+    }
+
+    /*!
+      入力の終わりを伝える.
+      トップレベルの数値は区切りの文字がないので、ここで完了する。値が途中であれば syntax_error を投げる
+     */
+    void finish()
+    {
+        if (state_ == state::number)
+            emit_number(buf_.data(), buf_.data() + buf_.size());
+        else if (state_ == state::literal)
+            emit_literal(buf_.data(), buf_.data() + buf_.size());
+        if (state_ != state::done)
+            BOOST_THROW_EXCEPTION( syntax_error() );
+    }
+
+    //! トップレベルの値が終わっていれば true
+    bool done() const noexcept
+    {
+        return state_ == state::done;
+    }
+
+    //! トップレベルの値をまだ読み始めていなければ true
+    bool empty() const noexcept
+    {
+        return state_ == state::value && stack_.empty();
+    }
+
+    //! 次の値のために状態を戻す. バッファは確保したまま使い回す
+    void reset() noexcept
+    {
+        state_ = state::value;
+        stack_.clear();
+        buf_.clear();
+        esc_.clear();
+    }
+
+private:
+    CharT const * parse_value(CharT const * p, CharT const * end)
+    {
+        switch(*p) {
+            case '"':
+                key_ = false;
+                return parse_string(p + 1, end);
+            case '{':
+                stack_.push_back('{');
+                handler_.start_object();
+                state_ = state::first_key;
+                return p + 1;
+            case '[':
+                stack_.push_back('[');
+                handler_.start_array();
+                state_ = state::first_value;
+                return p + 1;
+            case '-': case '+':
+            case '0': case '1': case '2': case '3': case '4':
+            case '5': case '6': case '7': case '8': case '9':
+                return parse_token(p, end, detail::json_scan_number(p, end), state::number, &basic_tokenizer::emit_number);
+            case 'n': case 'N':
+            case 't': case 'T':
+            case 'f': case 'F':
+                return parse_token(p, end, detail::json_scan_alpha(p, end), state::literal, &basic_tokenizer::emit_literal);
+        }
+        BOOST_THROW_EXCEPTION( syntax_error() );
+    }
+
+    //! p は開きの '"' の次を指す
+    CharT const * parse_string(CharT const * p, CharT const * end)
+    {
+        CharT const * q = detail::json_scan_string(p, end);
+        if (q != end && *q == '"') {
+            emit_string(view_type(p, static_cast<std::size_t>(q - p)));
+            return q + 1;
+        }
+        buf_.assign(p, q);
+        state_ = state::string;
+        return resume_string(q, end);
+    }
+
+    //! buf_ に文字列を集めながら、閉じの '"' を探す
+    CharT const * resume_string(CharT const * p, CharT const * end)
+    {
+        if (!esc_.empty()) {
+            p = resume_escape(p, end);
+            if (!esc_.empty())
+                return p;
+        }
+        for(;;) {
+            CharT const * q = detail::json_scan_string(p, end);
+            buf_.append(p, q);
+            p = q;
+            if (p == end)
+                return p;
+            if (*p == '"') {
+                emit_string(view_type(buf_.data(), buf_.size()));
+                return p + 1;
+            }
+            if (*p != '\\')
+                BOOST_THROW_EXCEPTION( syntax_error() );
+
+            std::size_t len = unescape(p, end, buf_);
+            if (len == 0) {
+                esc_.assign(p, end);
+                return end;
+            }
+            p += len;
+        }
+    }
+
+    //! write() の区切りをまたいだエスケープを、esc_ に足りるまで集めてから変換する
+    CharT const * resume_escape(CharT const * p, CharT const * end)
+    {
+        std::size_t const old = esc_.size();
+        std::size_t const len = std::min(static_cast<std::size_t>(end - p), max_escape - old);
+        esc_.append(p, p + len);
+        std::size_t used = unescape(esc_.data(), esc_.data() + esc_.size(), buf_);
+        if (used == 0)
+            return p + len;
+        if (used >= old) {
+            esc_.clear();
+            return p + (used - old);
+        }
+
+        // 対にならない上位サロゲートの後ろの "\\u" など、前の入力の残りは新しい入力を使わずに処理し直す.
+        // 残りはエスケープの途中なので、文字列の終わりを含まずに esc_ に戻る
+        string_type rest(esc_, used, old - used);
+        esc_.clear();
+        CharT const * q = resume_string(rest.data(), rest.data() + rest.size());
+        BOOST_ASSERT(q == rest.data() + rest.size());
+        (void)q;
+        return p;
+    }
+
+    template <typename Emit>
+    CharT const * parse_token(CharT const * p, CharT const * end, CharT const * q, state st, Emit emit)
+    {
+        if (q == end) {
+            buf_.assign(p, q);
+            state_ = st;
+            return end;
+        }
+        (this->*emit)(p, q);
+        return q;
+    }
+
+    template <typename Emit>
+    CharT const * resume_token(CharT const *p, CharT const * end, CharT const * q, Emit emit)
+    {
+        buf_.append(p, q);
+        if (q != end)
+            (this->*emit)(buf_.data(), buf_.data() + buf_.size());
+        return q;
+    }
+
+    void emit_string(view_type str)
+    {
+        if (key_) {
+            handler_.key(str);
+            state_ = state::colon;
+        } else {
+            handler_.string(str);
+            complete();
+        }
+    }
+
+    /*!
+      数値を変換して渡す.
+      number(unsigned long) と big_number(view_type) はハンドラが呼び出せるときだけ使い、そうでなければ number(double) に渡す
+     */
+    void emit_number(CharT const * beg, CharT const * end)
+    {
+        detail::json_number num;
+        if (!detail::json_parse_number(beg, end, num))
+            BOOST_THROW_EXCEPTION( syntax_error() );
+        switch(num.type) {
+            case detail::json_number::kind::integer:
+                handler_.number(num.integer);
+                break;
+            case detail::json_number::kind::unsigned_integer:
+                number_unsigned(handler_, num.unsigned_integer, 0);
+                break;
+            case detail::json_number::kind::real:
+                handler_.number(num.real);
+                break;
+            case detail::json_number::kind::big:
+                big_number(handler_, view_type(beg, static_cast<std::size_t>(end - beg)), num.real, 0);
+                break;
+        }
+        complete();
+    }
+
+    template <typename H>
+    static auto number_unsigned(H & handler, unsigned long val, int) -> decltype(handler.number(val), void())
+    {
+        handler.number(val);
+    }
+
+    template <typename H>
+    static void number_unsigned(H & handler, unsigned long val, long)
+    {
+        handler.number(static_cast<double>(val));
+    }
+
+    template <typename H>
+    static auto big_number(H & handler, view_type text, double, int) -> decltype(handler.big_number(text), void())
+    {
+        handler.big_number(text);
+    }
+
+    template <typename H>
+    static void big_number(H & handler, view_type, double val, long)
+    {
+        handler.number(val);
+    }
+
+    //! null, true, false を大文字と小文字を区別せずに比べる
+    void emit_literal(CharT const * beg, CharT const * end)
+    {
+        std::size_t const len = static_cast<std::size_t>(end - beg);
+        if (equals(beg, len, "null")) {
+            handler_.null();
+        } else if (equals(beg, len, "true")) {
+            handler_.boolean(true);
+        } else if (equals(beg, len, "false")) {
+            handler_.boolean(false);
+        } else {
+            BOOST_THROW_EXCEPTION( syntax_error() );
+        }
+        complete();
+    }
+
+    static bool equals(CharT const * s, std::size_t len, char const * lit) noexcept
+    {
+        std::size_t i = 0;
+        for(; i < len && lit[i] != '\0'; ++i) {
+            if ((s[i] | 0x20) != lit[i])
+                return false;
+        }
+        return i == len && lit[i] == '\0';
+    }
+
+    /*!
+      s が指す '\\' から始まるエスケープを変換して out に追加し、使った文字数を返す.
+      文字が足りなければ 0 を返す。サロゲートペアは 1 つのコードポイントにし、対になっていないサロゲートは U+FFFD にする
+     */
+    static std::size_t unescape(CharT const * s, CharT const * e, string_type & out)
+    {
+        std::size_t const n = static_cast<std::size_t>(e - s);
+        if (n < 2)
+            return 0;
+        switch(s[1]) {
+            case '"': case '\\': case '/':
+                out += s[1];
+                return 2;
+            case 'b': out += CharT('\b'); return 2;
+            case 'f': out += CharT('\f'); return 2;
+            case 'n': out += CharT('\n'); return 2;
+            case 'r': out += CharT('\r'); return 2;
+            case 't': out += CharT('\t'); return 2;
+            case 'u': case 'U':
+                break;
+            default:
+                BOOST_THROW_EXCEPTION( syntax_error() );
+        }
+
+        if (n < 6)
+            return 0;
+        char32_t cp = hex4(s + 2);
+        std::size_t used = 6;
+        if (cp >= 0xD800 && cp < 0xDC00) {
+            if (n < 8 && !(n == 7 && s[6] != '\\'))
+                return 0;
+            if (n >= 8 && s[6] == '\\' && (s[7] == 'u' || s[7] == 'U')) {
+                if (n < 12)
+                    return 0;
+                char32_t lo = hex4(s + 8);
+                if (lo >= 0xDC00 && lo < 0xE000) {
+                    cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+                    used = 12;
+                }
+            }
+        }
+        if (cp >= 0xD800 && cp < 0xE000)
+            cp = 0xFFFD;
+        boost::locale::utf::utf_traits<CharT>::encode(static_cast<boost::locale::utf::code_point>(cp), std::back_inserter(out));
+        return used;
+    }
+
+    static char32_t hex4(CharT const * s)
+    {
+        auto const & tbl = detail::json_table::instance();
+        char32_t cp = 0;
+        for(int i = 0; i < 4; ++i) {
+            std::size_t c = detail::json_table::index(s[i]);
+            if (c >= 256 || tbl.hex[c] >= 16)
+                BOOST_THROW_EXCEPTION( syntax_error() );
+            cp = (cp << 4) | tbl.hex[c];
+        }
+        return cp;
+    }
+
+    void close()
+    {
+        if (stack_.back() == '[')
+            handler_.end_array();
+        else
+            handler_.end_object();
+        stack_.pop_back();
+        complete();
+    }
+
+    void complete() noexcept
+    {
+        state_ = stack_.empty() ? state::done : state::next;
+    }
+
+private:
+    //! サロゲートペアの "\\uXXXX\\uXXXX" の長さ
+    static std::size_t const max_escape = 12;
+
+    Handler & handler_;
+    state state_ = state::value;
+    bool key_ = false;
+    std::vector<char> stack_;
+    string_type buf_;
+    string_type esc_;
+};
+
+} } }
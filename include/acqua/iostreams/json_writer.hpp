@@ -0,0 +1,70 @@
+#pragma once
+
+/*!
+  acqua library
+
+  Copyright (c) 2016 Haruhiko Uchida
+  The software is released under the MIT license.
+  http://opensource.org/licenses/mit-license.php
+ */
+
+#include <acqua/iostreams/json_adapt.hpp>
+#include <boost/exception/exception.hpp>
+#include <boost/iostreams/categories.hpp>
+#include <exception>
+#include <memory>
+
+namespace acqua { namespace iostreams {
+
+namespace json {
+
+//! json_writer で、入れ子が max_depth を超えたときに read から投げる
+struct depth_error : virtual std::exception, virtual boost::exception {};
+
+}  // json
+
+/*!
+  Json を JSON のテキストとして読み出すソース. json_parser の逆.
+
+  Adapt::serialize(json, generator) で json::basic_generator に書き出したテキストを、read で順に返す。
+  serialize() はコルーチンで実行し、read で求められた分だけ書き出すたびに止めるので、大きな Json でもテキスト全体を保持しない。
+  indent が 0 であれば空白を入れず、1 以上であればその数の空白で字下げする
+
+  serialize() はコルーチンの固定の大きさのスタックで再帰するので、
+  入れ子が max_depth を超えると、スタックを溢れさせる前に json::depth_error を投げる。
+
+  参照で受け取った json は、最後の read まで生存していること。一時オブジェクトは受け付けないので、
+  寿命を管理できなければ shared_ptr で渡す
+ */
+template <
+    typename Json,
+    typename Adapt = json_adapt<Json>,
+    typename CharT = typename Adapt::char_type
+    >
+class json_writer
+{
+    struct impl;
+
+public:
+    using char_type = CharT;
+    using category = boost::iostreams::source_tag;
+
+    //! 入れ子の深さの上限. 1段あたりのスタックの消費が 2KiB までなら、コルーチンのスタックに収まる
+    static constexpr int max_depth = 512;
+
+public:
+    explicit json_writer(Json const & json, int indent = 0);
+
+    explicit json_writer(std::shared_ptr<Json const> json, int indent = 0);
+
+    json_writer(Json && json, int indent = 0) = delete;
+
+    std::streamsize read(char_type * s, std::streamsize n);
+
+private:
+    std::shared_ptr<impl> impl_;
+};
+
+} }
+
+#include <acqua/iostreams/json_writer.ipp>
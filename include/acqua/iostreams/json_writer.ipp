@@ -0,0 +1,149 @@
+#pragma once
+
+/*!
+  acqua library
+
+  Copyright (c) 2016 Haruhiko Uchida
+  The software is released under the MIT license.
+  http://opensource.org/licenses/mit-license.php
+ */
+
+#include <acqua/iostreams/json_writer.hpp>
+#include <acqua/iostreams/json_generator.hpp>
+#include <boost/coroutine/asymmetric_coroutine.hpp>
+#include <boost/throw_exception.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <string>
+
+namespace acqua { namespace iostreams {
+
+namespace json {
+
+/*!
+  basic_generator に書き出し、out が limit 文字を超えるたびに呼び出し元に戻るハンドラ.
+  json_writer のコルーチンの中で Adapt::serialize() に渡す。入れ子が max_depth を超えたら depth_error を投げる
+ */
+template <typename CharT, typename Sink>
+class chunked_generator
+    : public basic_generator<CharT>
+{
+    using base_type = basic_generator<CharT>;
+
+public:
+    using string_type = typename base_type::string_type;
+    using view_type = typename base_type::view_type;
+
+public:
+    chunked_generator(string_type & out, int indent, std::size_t const & limit, Sink & sink, int max_depth)
+        : base_type(out, indent), out_(out), limit_(limit), sink_(sink), max_depth_(max_depth)
+    {
+    }
+
+    void null() { base_type::null(); yield(); }
+    void boolean(bool flag) { base_type::boolean(flag); yield(); }
+    void number(long val) { base_type::number(val); yield(); }
+    void number(unsigned long val) { base_type::number(val); yield(); }
+    void number(double val) { base_type::number(val); yield(); }
+    void big_number(view_type text) { base_type::big_number(text); yield(); }
+    void string(view_type str) { base_type::string(str); yield(); }
+    void key(view_type str) { base_type::key(str); yield(); }
+    void start_object() { enter(); base_type::start_object(); yield(); }
+    void end_object() { --depth_; base_type::end_object(); yield(); }
+    void start_array() { enter(); base_type::start_array(); yield(); }
+    void end_array() { --depth_; base_type::end_array(); yield(); }
+
+private:
+    void enter()
+    {
+        if (++depth_ > max_depth_)
+            BOOST_THROW_EXCEPTION( depth_error() );
+    }
+
+    void yield()
+    {
+        if (out_.size() >= limit_)
+            sink_();
+    }
+
+private:
+    string_type & out_;
+    std::size_t const & limit_;
+    Sink & sink_;
+    int const max_depth_;
+    int depth_ = 0;
+};
+
+}  // json
+
+
+template <typename Json, typename Adapt, typename CharT>
+struct json_writer<Json, Adapt, CharT>::impl
+{
+    using coroutine_type = boost::coroutines::asymmetric_coroutine<void>;
+
+    //! Adapt::serialize() は再帰するので、max_depth 段の入れ子が収まるようにスタックを大きめにとる. 触れたページだけが確保される
+    static constexpr std::size_t stack_size = 1024 * 1024;
+
+    impl(Json const & json, int indent)
+        : json_(json), indent_(indent) {}
+
+    impl(std::shared_ptr<Json const> json, int indent)
+        : owner_(std::move(json)), json_(*owner_), indent_(indent) {}
+
+    /*!
+      Adapt::serialize() をコルーチンで実行し、n 文字以上たまるたびに止めて返す.
+      バッファは n と 1 つの値の長さまでしか大きくならない
+     */
+    std::streamsize read(char_type * s, std::streamsize n)
+    {
+        if (pos_ == buffer_.size()) {
+            buffer_.clear();
+            pos_ = 0;
+            limit_ = static_cast<std::size_t>(n);
+            if (!started_) {
+                started_ = true;
+                source_ = typename coroutine_type::pull_type([this](typename coroutine_type::push_type & sink) {
+                        json::chunked_generator<CharT, typename coroutine_type::push_type> gen(buffer_, indent_, limit_, sink, max_depth);
+                        Adapt::serialize(json_, gen);
+                    }, boost::coroutines::attributes(stack_size));
+            } else if (source_) {
+                source_();
+            }
+            if (buffer_.empty())
+                return EOF;
+        }
+        std::size_t len = std::min(static_cast<std::size_t>(n), buffer_.size() - pos_);
+        std::copy_n(buffer_.data() + pos_, len, s);
+        pos_ += len;
+        return static_cast<std::streamsize>(len);
+    }
+
+    std::shared_ptr<Json const> owner_;
+    Json const & json_;
+    int indent_;
+    std::basic_string<CharT> buffer_;
+    std::size_t pos_ = 0;
+    std::size_t limit_ = 0;
+    bool started_ = false;
+    typename coroutine_type::pull_type source_;
+};
+
+
+template <typename Json, typename Adapt, typename CharT>
+inline json_writer<Json, Adapt, CharT>::json_writer(Json const & json, int indent)
+    : impl_(new impl(json, indent)) {}
+
+
+template <typename Json, typename Adapt, typename CharT>
+inline json_writer<Json, Adapt, CharT>::json_writer(std::shared_ptr<Json const> json, int indent)
+    : impl_(new impl(std::move(json), indent)) {}
+
+
+template <typename Json, typename Adapt, typename CharT>
+inline std::streamsize json_writer<Json, Adapt, CharT>::read(char_type * s, std::streamsize n)
+{
+    return impl_->read(s, n);
+}
+
+} }
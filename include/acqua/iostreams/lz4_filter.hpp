@@ -0,0 +1,244 @@
+#pragma once
+
+/*!
+  acqua library
+
+  Copyright (c) 2016 Haruhiko Uchida
+  The software is released under the MIT license.
+  http://opensource.org/licenses/mit-license.php
+
+  liblz4 (-llz4) が必要
+ */
+
+#include <acqua/iostreams/detail/codec_filter.hpp>
+#include <boost/system/system_error.hpp>
+#include <boost/system/error_code.hpp>
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <string>
+
+extern "C" {
+#include <lz4frame.h>
+}
+
+namespace acqua { namespace iostreams {
+
+namespace error {
+
+/*!
+  liblz4 のフレーム API のエラー.
+  値は LZ4F_errorCodes で、関数の戻り値 (size_t)-値 で表されたものを戻している
+ */
+class lz4_category
+    : public boost::system::error_category
+{
+public:
+    char const * name() const noexcept override
+    {
+        return "iostreams.lz4";
+    }
+
+    std::string message(int ev) const override
+    {
+        return ::LZ4F_getErrorName(static_cast<std::size_t>(-static_cast<std::ptrdiff_t>(ev)));
+    }
+};
+
+inline boost::system::error_category const & get_lz4_category()
+{
+    static lz4_category instance;
+    return instance;
+}
+
+}  // error
+
+
+namespace detail {
+
+//! LZ4F_ERROR_frameSize_wrong. 列挙型は静的リンクのときしか宣言されない
+static int const lz4_frame_size_wrong = 14;
+
+inline std::size_t lz4_check(std::size_t ret, char const * what)
+{
+    if (::LZ4F_isError(ret))
+        throw boost::system::system_error(static_cast<int>(-static_cast<std::ptrdiff_t>(ret)), error::get_lz4_category(), what);
+    return ret;
+}
+
+}  // detail
+
+
+/*!
+  lz4 の圧縮パラメータ.
+  level が 3 以上であれば LZ4 HC で圧縮する。block_size は 64, 256, 1024, 4096 KiB のいずれか
+ */
+struct lz4_params
+{
+    lz4_params(int level_ = 0, std::size_t block_size_ = 64 * 1024, bool checksum_ = false)
+        : level(level_), block_size(block_size_), checksum(checksum_)
+    {
+    }
+
+    int level;
+    std::size_t block_size;
+    bool checksum;
+};
+
+
+namespace detail {
+
+class lz4_compress_codec
+{
+public:
+    explicit lz4_compress_codec(lz4_params const & params)
+        : prefs_()
+    {
+        ::LZ4F_cctx * ctx = nullptr;
+        lz4_check(::LZ4F_createCompressionContext(&ctx, LZ4F_VERSION), "lz4_compressor");
+        ctx_.reset(ctx);
+
+        if (params.block_size <= 64 * 1024)
+            prefs_.frameInfo.blockSizeID = LZ4F_max64KB;
+        else if (params.block_size <= 256 * 1024)
+            prefs_.frameInfo.blockSizeID = LZ4F_max256KB;
+        else if (params.block_size <= 1024 * 1024)
+            prefs_.frameInfo.blockSizeID = LZ4F_max1MB;
+        else
+            prefs_.frameInfo.blockSizeID = LZ4F_max4MB;
+        prefs_.frameInfo.blockMode = LZ4F_blockLinked;
+        prefs_.frameInfo.contentChecksumFlag = params.checksum ? LZ4F_contentChecksumEnabled : LZ4F_noContentChecksum;
+        prefs_.compressionLevel = params.level;
+    }
+
+    void run(char const * s, std::size_t n, filter_buffer & out, bool finish)
+    {
+        if (!started_) {
+            char * p = out.prepare(LZ4F_HEADER_SIZE_MAX);
+            out.commit(p + lz4_check(::LZ4F_compressBegin(ctx_.get(), p, LZ4F_HEADER_SIZE_MAX, &prefs_), "lz4_compressor"));
+            started_ = true;
+        }
+
+        // compressBound は入力の大きさに比例するので、区切って出力先を確保する
+        std::size_t const step = 64 * 1024;
+        for(std::size_t done = 0; done < n; ) {
+            std::size_t len = std::min(n - done, step);
+            std::size_t cap = ::LZ4F_compressBound(len, &prefs_);
+            char * p = out.prepare(cap);
+            out.commit(p + lz4_check(::LZ4F_compressUpdate(ctx_.get(), p, cap, s + done, len, nullptr), "lz4_compressor"));
+            done += len;
+        }
+
+        if (finish) {
+            std::size_t cap = ::LZ4F_compressBound(0, &prefs_);
+            char * p = out.prepare(cap);
+            out.commit(p + lz4_check(::LZ4F_compressEnd(ctx_.get(), p, cap, nullptr), "lz4_compressor"));
+            started_ = false;
+        }
+    }
+
+    void reset() noexcept
+    {
+        // 次の run() で新しいフレームを始める
+        started_ = false;
+    }
+
+private:
+    struct deleter
+    {
+        void operator()(::LZ4F_cctx * ctx) const noexcept
+        {
+            ::LZ4F_freeCompressionContext(ctx);
+        }
+    };
+
+private:
+    std::unique_ptr<::LZ4F_cctx, deleter> ctx_;
+    ::LZ4F_preferences_t prefs_;
+    bool started_ = false;
+};
+
+
+class lz4_decompress_codec
+{
+    static std::size_t const out_size = 64 * 1024;
+
+public:
+    lz4_decompress_codec()
+        : out_(new char[out_size])
+    {
+        ::LZ4F_dctx * ctx = nullptr;
+        lz4_check(::LZ4F_createDecompressionContext(&ctx, LZ4F_VERSION), "lz4_decompressor");
+        ctx_.reset(ctx);
+    }
+
+    void run(char const * s, std::size_t n, filter_buffer & out, bool finish)
+    {
+        std::size_t done = 0;
+        for(;;) {
+            std::size_t dst_size = out_size;
+            std::size_t src_size = n - done;
+            std::size_t ret = lz4_check(::LZ4F_decompress(ctx_.get(), out_.get(), &dst_size, s + done, &src_size, nullptr), "lz4_decompressor");
+            out.append(out_.get(), dst_size);
+            done += src_size;
+            // 何も進まなかったときは、次のフレームを待っているだけなので変えない
+            if (src_size > 0 || dst_size > 0)
+                complete_ = (ret == 0);
+            if (done == n && dst_size < out_size)
+                break;
+        }
+        if (finish && !complete_)
+            throw boost::system::system_error(lz4_frame_size_wrong, error::get_lz4_category(), "lz4_decompressor");
+    }
+
+    void reset() noexcept
+    {
+        ::LZ4F_resetDecompressionContext(ctx_.get());
+        complete_ = true;
+    }
+
+private:
+    struct deleter
+    {
+        void operator()(::LZ4F_dctx * ctx) const noexcept
+        {
+            ::LZ4F_freeDecompressionContext(ctx);
+        }
+    };
+
+private:
+    std::unique_ptr<::LZ4F_dctx, deleter> ctx_;
+    std::unique_ptr<char[]> out_;
+    bool complete_ = true;
+};
+
+}  // detail
+
+
+/*!
+  lz4 フレーム形式の圧縮フィルタ.
+  zstd より圧縮率は低いが、圧縮と伸長がとても速い
+ */
+class lz4_compressor
+    : public detail::codec_filter<detail::lz4_compress_codec>
+{
+public:
+    explicit lz4_compressor(lz4_params const & params = lz4_params())
+        : codec_filter(detail::lz4_compress_codec(params))
+    {
+    }
+};
+
+
+//! lz4 フレーム形式の伸長フィルタ.
+class lz4_decompressor
+    : public detail::codec_filter<detail::lz4_decompress_codec>
+{
+public:
+    lz4_decompressor()
+        : codec_filter(detail::lz4_decompress_codec())
+    {
+    }
+};
+
+} }
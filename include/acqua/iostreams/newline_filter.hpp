@@ -0,0 +1,34 @@
+/*!
+  acqua library
+
+  Copyright (c) 2016 Haruhiko Uchida
+  The software is released under the MIT license.
+  http://opensource.org/licenses/mit-license.php
+ */
+
+#pragma once
+
+#include <acqua/iostreams/newline_category.hpp>
+#include <acqua/iostreams/detail/codec_filter.hpp>
+#include <acqua/iostreams/detail/newline_codec.hpp>
+
+namespace acqua { namespace iostreams {
+
+/*!
+  改行コード (CR, LF, CRLF) を nl にそろえるフィルタ.
+
+  newline::crln を指定すると SMTP の DATA に書き込む本文に、newline::ln を指定すると受け取った本文を LF だけにできる。
+  newline::none は改行を取り除く。
+  input_filter と output_filter の両方を指定できるが、１つのインスタンスに対してどちらか片方しか使用してはいけない
+ */
+class newline_filter
+    : public detail::codec_filter<detail::newline_codec>
+{
+public:
+    explicit newline_filter(newline nl = newline::ln)
+        : codec_filter(detail::newline_codec(nl))
+    {
+    }
+};
+
+} }
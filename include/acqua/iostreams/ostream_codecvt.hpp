@@ -8,36 +8,87 @@
 
 #pragma once
 
+#include <acqua/utility/detail/utf_transcode.hpp>
 #include <boost/locale/encoding.hpp>
 #include <boost/locale/encoding_utf.hpp>
 #include <boost/iostreams/categories.hpp>
 #include <iostream>
 #include <algorithm>
+#include <array>
 #include <memory>
 
 namespace acqua { namespace iostreams {
 
+/*!
+  Char を CharT に変換しながら sbuf に書き込むアダプター.
+  ブロックごとに変換してまとめて書き込む。write() の区切りで途中になった文字は、次の write() の先頭に足す
+ */
 template <typename Char, typename CharT, typename Traits, typename Enabler = void>
 class basic_ostream_codecvt
 {
     using streambuf_type = std::basic_streambuf<CharT, Traits>;
 
+    struct tail
+    {
+        std::array<Char, 4> data;
+        std::size_t size = 0;
+    };
+
 public:
     using char_type = Char;
     using category = boost::iostreams::sink_tag;
 
     explicit basic_ostream_codecvt(streambuf_type * sbuf)
-        : sbuf_(sbuf) {}
+        : sbuf_(sbuf), tail_(std::make_shared<tail>()) {}
 
-    std::streamsize write(char_type const * s, std::streamsize n) const
+    std::streamsize write(char_type const * s, std::streamsize n)
     {
-        auto str = boost::locale::conv::utf_to_utf<CharT>(s, s + n);
-        sbuf_->sputn(str.c_str(), static_cast<std::streamsize>(str.size()));
+        namespace utf = acqua::utility::detail;
+
+        std::array<CharT, 1024> out;
+        char_type const * in = s;
+        char_type const * const in_end = s + n;
+
+        if (tail_->size > 0) {
+            // 1 文字は 4 つ以内なので、8 つあれば必ず決まる
+            std::array<char_type, 8> tmp;
+            std::size_t const len = std::min<std::size_t>(static_cast<std::size_t>(n), tmp.size() - tail_->size);
+            std::copy_n(tail_->data.data(), tail_->size, tmp.data());
+            std::copy_n(s, len, tmp.data() + tail_->size);
+            auto res = utf::utf_transcode(tmp.data(), tmp.data() + tail_->size + len, out.data(), out.data() + out.size());
+            flush(out.data(), res.out);
+            std::size_t const used = static_cast<std::size_t>(res.in - tmp.data());
+            if (used < tail_->size) {
+                std::copy(tmp.data() + used, tmp.data() + tail_->size + len, tail_->data.data());
+                tail_->size = tail_->size + len - used;
+                return n;
+            }
+            in += used - tail_->size;
+            tail_->size = 0;
+        }
+
+        while(in != in_end) {
+            auto res = utf::utf_transcode(in, in_end, out.data(), out.data() + out.size());
+            flush(out.data(), res.out);
+            if (res.in == in && res.out == out.data()) {
+                tail_->size = static_cast<std::size_t>(std::copy(in, in_end, tail_->data.data()) - tail_->data.data());
+                break;
+            }
+            in = res.in;
+        }
         return n;
     }
 
+private:
+    void flush(CharT const * beg, CharT const * end)
+    {
+        if (beg != end)
+            sbuf_->sputn(beg, end - beg);
+    }
+
 private:
     streambuf_type * sbuf_;
+    std::shared_ptr<tail> tail_;
 };
 
 
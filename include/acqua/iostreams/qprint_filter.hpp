@@ -9,153 +9,330 @@
 #pragma once
 
 #include <acqua/iostreams/newline_category.hpp>
+#include <acqua/iostreams/detail/filter_buffer.hpp>
+#include <acqua/iostreams/detail/qprint_codec.hpp>
 #include <boost/iostreams/categories.hpp>
 #include <boost/iostreams/operations.hpp>
-#include <boost/scope_exit.hpp>
+#include <algorithm>
+#include <cstring>
+#include <limits>
 
 namespace acqua { namespace iostreams {
 
+/*!
+  quoted-printable のエンコーダ.
+
+  そのまま書き出せる文字の並びは、まとめて1回でコピーする。エスケープと改行だけを1文字ずつ処理する。
+  1行が size 文字を超えるときは、'=' と改行コードによるソフト改行を挟む。
+  入力の改行 (LF) はそのまま書き出して行の文字数を数え直し、CR は取り除く。改行の直前の空白とタブはエスケープする。
+  input_filter と output_filter の両方を指定できるが、１つのインスタンスに対してどちらか片方しか使用してはいけない
+ */
 class qprint_encoder
-    : public detail::newline_base< qprint_encoder >
 {
 private:
-    using base_type = qprint_encoder::base_type;
+    static std::size_t const block_size = 4 * 1024;
 
 public:
-    struct category : boost::iostreams::output_filter_tag, boost::iostreams::closable_tag {};
+    struct category : boost::iostreams::multichar_dual_use_filter_tag, boost::iostreams::closable_tag {};
     using char_type = char;
 
     explicit qprint_encoder(newline nl = newline::none, std::size_t size = std::numeric_limits<std::size_t>::max())
-        : base_type(nl, size) {}
+        : nl_(nl), max_(nl == newline::none ? std::numeric_limits<std::size_t>::max() : size) {}
 
-    template <typename Sink>
-    bool put(Sink & sink, char ch)
+    template <typename Source>
+    std::streamsize read(Source & src, char * s, std::streamsize n)
     {
-        if (prior_) {
-            BOOST_SCOPE_EXIT_ALL(this) { prior_ = 0; };
-            if (!((ch == '\r' || ch == '\n') ? escape(sink, prior_) : base_type::put(sink, prior_)))
-                return false;
-        }
+        reading_ = true;
+        while(out_.empty()) {
+            if (eof_)
+                return -1;
 
-        if (ch == '\r') {
-            return true;
-        } else if (ch == '\n') {
-            return boost::iostreams::put(sink, ch);
-        } else if (ch == ' ' || ch == '\t') {
-            prior_ = ch;
-            return true;
-        } else if (ch == '=' || ch < 33 || 126 < ch) {
-            return escape(sink, ch);
-        } else {
-            return base_type::put(sink, ch);
+            char buf[block_size];
+            std::streamsize res = boost::iostreams::read(src, buf, block_size);
+            if (res < 0) {
+                finish();
+                eof_ = true;
+            } else if (res == 0) {
+                return 0;
+            } else {
+                encode(buf, static_cast<std::size_t>(res));
+            }
         }
+        return out_.take(s, n);
     }
 
     template <typename Sink>
-    void close(Sink & sink)
+    std::streamsize write(Sink & sink, char const * s, std::streamsize n)
     {
-        if (prior_) {
-            boost::iostreams::put(sink, prior_);
-            prior_ = 0;
+        if (!out_.flush(sink))
+            return 0;
+
+        std::streamsize done = 0;
+        while(done < n) {
+            std::size_t len = std::min(static_cast<std::size_t>(n - done), std::size_t(block_size));
+            encode(s + done, len);
+            done += static_cast<std::streamsize>(len);
+            if (!out_.flush(sink))
+                break;
         }
+        return done;
     }
 
-    // overrided by base_type
-    template <typename Sink>
-    bool line_break(Sink & sink)
+    template <typename Device>
+    void close(Device & dev, std::ios_base::openmode which)
     {
-        return boost::iostreams::put(sink, '=')
-            && base_type::line_break(sink);
+        if (which == std::ios_base::out && !reading_) {
+            finish();
+            out_.flush(dev);
+        }
+        if ((which == std::ios_base::in) == reading_) {
+            out_.clear();
+            col_ = 0;
+            prior_ = 0;
+            eof_ = false;
+            reading_ = false;
+        }
     }
 
 private:
-    template <typename Sink>
-    bool escape(Sink & sink, char hex)
+    void encode(char const * s, std::size_t n)
+    {
+        char const * end = s + n;
+        while(s != end) {
+            if (prior_) {
+                // 保留していた空白は、改行の直前であればエスケープする
+                char ws = prior_;
+                prior_ = 0;
+                if (*s == '\r' || *s == '\n')
+                    escape(ws);
+                else
+                    literal(&ws, 1);
+            }
+
+            char const * run = detail::qprint_scan_plain(s, end);
+            if (run != s) {
+                // 末尾の空白は、次の文字を見るまで保留する
+                char last = *(run - 1);
+                if (last == ' ' || last == '\t') {
+                    literal(s, static_cast<std::size_t>(run - 1 - s));
+                    prior_ = last;
+                } else {
+                    literal(s, static_cast<std::size_t>(run - s));
+                }
+                s = run;
+                continue;
+            }
+
+            char ch = *s++;
+            if (ch == '\r')
+                continue;
+            else if (ch == '\n')
+                hard_break();
+            else
+                escape(ch);
+        }
+    }
+
+    void literal(char const * s, std::size_t n)
+    {
+        while(n > 0) {
+            if (col_ >= max_)
+                soft_break();
+            std::size_t len = std::min(n, max_ - col_);
+            out_.append(s, len);
+            col_ += len;
+            s += len;
+            n -= len;
+        }
+    }
+
+    void escape(char ch)
     {
-        char upper = (static_cast<unsigned char>(hex) >> 4) & 0xf;
-        char lower = (static_cast<unsigned char>(hex) >> 0) & 0xf;
-        return base_type::put(sink, '=')
-            && base_type::put_nobreak(sink, static_cast<char>((upper < 10) ? upper + '0' : upper + 'A' - 10))
-            && base_type::put_nobreak(sink, static_cast<char>((lower < 10) ? lower + '0' : lower + 'A' - 10));
+        if (col_ >= max_)
+            soft_break();
+        auto const & tbl = detail::qprint_table::instance();
+        char buf[3] = { '=', tbl.digits[(static_cast<unsigned char>(ch) >> 4) & 0xF], tbl.digits[static_cast<unsigned char>(ch) & 0xF] };
+        out_.append(buf, 3);
+        col_ += 3;
+    }
+
+    void hard_break()
+    {
+        out_.push_back('\n');
+        col_ = 0;
+    }
+
+    void soft_break()
+    {
+        out_.push_back('=');
+        col_ = 0;
+        switch(nl_) {
+            case newline::none:
+                break;
+            case newline::ln:
+                out_.push_back('\n');
+                break;
+            case newline::cr:
+                out_.push_back('\r');
+                break;
+            case newline::crln:
+                out_.append("\r\n", 2);
+                break;
+        }
+    }
+
+    void finish()
+    {
+        if (prior_) {
+            out_.push_back(prior_);
+            prior_ = 0;
+        }
     }
 
 private:
+    newline nl_;
+    std::size_t max_;
+    std::size_t col_ = 0;
     char prior_ = 0;
+    bool eof_ = false;
+    bool reading_ = false;
+    detail::filter_buffer out_;
 };
 
 
 /*!
   quoted-printable のデコーダ.
+
+  '=' までの文字の並びは、まとめて1回でコピーする。
+  '=' に続く改行 (CR, LF, CRLF) はソフト改行として取り除き、16 進数2桁は1バイトに戻す。
+  16 進数でないエスケープは、そのまま出力する。
   input_filter と output_filter の両方を指定できるが、１つのインスタンスに対してどちらか片方しか使用してはいけない
 */
 class qprint_decoder
 {
+private:
+    static std::size_t const block_size = 4 * 1024;
+
+    enum class state { normal, escape, soft_cr, hex };
+
 public:
     using char_type = char;
-    using category = boost::iostreams::dual_use_filter_tag;
+    struct category : boost::iostreams::multichar_dual_use_filter_tag, boost::iostreams::closable_tag {};
 
     template <typename Source>
-    int get(Source & src) const
+    std::streamsize read(Source & src, char * s, std::streamsize n)
     {
-        int ch = boost::iostreams::get(src);
-        if (ch == '=') {
-            ch = boost::iostreams::get(src);
-            if (ch == EOF || ch == boost::iostreams::WOULD_BLOCK)
-                return ch;
-            if (ch == '\r' || ch == '\n') {
-                if ((ch = boost::iostreams::get(src)) == '\n')
-                    ch = boost::iostreams::get(src);
+        reading_ = true;
+        while(out_.empty()) {
+            if (eof_)
+                return -1;
+
+            char buf[block_size];
+            std::streamsize res = boost::iostreams::read(src, buf, block_size);
+            if (res < 0) {
+                finish();
+                eof_ = true;
+            } else if (res == 0) {
+                return 0;
             } else {
-                int prior = ch;
-                ch = boost::iostreams::get(src);
-                if (ch == EOF || ch == boost::iostreams::WOULD_BLOCK)
-                    return ch;
-                ch = unescape(prior, ch);
+                decode(buf, static_cast<std::size_t>(res));
             }
         }
-        return ch;
+        return out_.take(s, n);
     }
 
     template <typename Sink>
-    bool put(Sink & sink, char ch)
+    std::streamsize write(Sink & sink, char const * s, std::streamsize n)
     {
-        if (tmp[1]) {
-            int hex = unescape(tmp[1], ch);
-            tmp[0] = tmp[1] = 0;
-            return hex < 0 ? false : boost::iostreams::put(sink, static_cast<char>(hex));
-        }
+        if (!out_.flush(sink))
+            return 0;
 
-        if (tmp[0]) {
-            tmp[1] = ch;
-            return true;
+        std::streamsize done = 0;
+        while(done < n) {
+            std::size_t len = std::min(static_cast<std::size_t>(n - done), std::size_t(block_size));
+            decode(s + done, len);
+            done += static_cast<std::streamsize>(len);
+            if (!out_.flush(sink))
+                break;
         }
+        return done;
+    }
 
-        if (ch == '=') {
-            tmp[0] = '=';
-            return true;
+    template <typename Device>
+    void close(Device & dev, std::ios_base::openmode which)
+    {
+        if (which == std::ios_base::out && !reading_) {
+            finish();
+            out_.flush(dev);
+        }
+        if ((which == std::ios_base::in) == reading_) {
+            out_.clear();
+            state_ = state::normal;
+            eof_ = false;
+            reading_ = false;
         }
-
-        return boost::iostreams::put(sink, ch);
     }
 
 private:
-    int unescape(int upper, int lower) const
+    void decode(char const * s, std::size_t n)
     {
-        int hex = 0;
-        if      ('0' <= upper && upper <= '9') hex = upper - '0';
-        else if ('a' <= upper && upper <= 'f') hex = upper - 'a';
-        else if ('A' <= upper && upper <= 'F') hex = upper - 'A';
-        else    return -1;
-        hex <<= 4;
-        if      ('0' <= lower && lower <= '9') hex += lower - '0';
-        else if ('a' <= lower && lower <= 'a') hex += lower - 'a';
-        else if ('A' <= lower && lower <= 'A') hex += lower - 'A';
-        else    return -1;
-        return hex;
+        auto const & tbl = detail::qprint_table::instance();
+        char const * end = s + n;
+        while(s != end) {
+            switch(state_) {
+                case state::normal: {
+                    auto const * eq = static_cast<char const *>(std::memchr(s, '=', static_cast<std::size_t>(end - s)));
+                    if (eq == nullptr) {
+                        out_.append(s, static_cast<std::size_t>(end - s));
+                        return;
+                    }
+                    out_.append(s, static_cast<std::size_t>(eq - s));
+                    s = eq + 1;
+                    state_ = state::escape;
+                    break;
+                }
+                case state::escape:
+                    hex_ = *s++;
+                    state_ = (hex_ == '\n') ? state::normal : (hex_ == '\r') ? state::soft_cr : state::hex;
+                    break;
+                case state::soft_cr:
+                    if (*s == '\n')
+                        ++s;
+                    state_ = state::normal;
+                    break;
+                case state::hex: {
+                    unsigned int upper = tbl.hex[static_cast<unsigned char>(hex_)];
+                    unsigned int lower = tbl.hex[static_cast<unsigned char>(*s)];
+                    if (upper < 16 && lower < 16) {
+                        out_.push_back(static_cast<char>(upper << 4 | lower));
+                        ++s;
+                    } else {
+                        // 不正なエスケープはそのまま出力して、*s は通常の文字として処理し直す
+                        out_.push_back('=');
+                        out_.push_back(hex_);
+                    }
+                    state_ = state::normal;
+                    break;
+                }
+            }
+        }
+    }
+
+    void finish()
+    {
+        if (state_ == state::hex) {
+            out_.push_back('=');
+            out_.push_back(hex_);
+        }
+        state_ = state::normal;
     }
 
 private:
-    char tmp[2] = { 0, 0 };
+    state state_ = state::normal;
+    char hex_ = 0;
+    bool eof_ = false;
+    bool reading_ = false;
+    detail::filter_buffer out_;
 };
 
 } }
@@ -0,0 +1,313 @@
+#pragma once
+
+/*!
+  acqua library
+
+  Copyright (c) 2016 Haruhiko Uchida
+  The software is released under the MIT license.
+  http://opensource.org/licenses/mit-license.php
+
+  libzstd (-lzstd) が必要
+ */
+
+#include <acqua/iostreams/detail/codec_filter.hpp>
+#include <boost/system/system_error.hpp>
+#include <boost/system/error_code.hpp>
+#include <memory>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include <zstd.h>
+#include <zstd_errors.h>
+#include <zdict.h>
+}
+
+namespace acqua { namespace iostreams {
+
+namespace error {
+
+//! libzstd のエラー. 値は ZSTD_ErrorCode
+class zstd_category
+    : public boost::system::error_category
+{
+public:
+    char const * name() const noexcept override
+    {
+        return "iostreams.zstd";
+    }
+
+    std::string message(int ev) const override
+    {
+        return ::ZSTD_getErrorString(static_cast<::ZSTD_ErrorCode>(ev));
+    }
+};
+
+inline boost::system::error_category const & get_zstd_category()
+{
+    static zstd_category instance;
+    return instance;
+}
+
+}  // error
+
+
+namespace detail {
+
+//! libzstd の関数の戻り値がエラーであれば例外を投げる
+inline std::size_t zstd_check(std::size_t ret, char const * what)
+{
+    if (::ZSTD_isError(ret))
+        throw boost::system::system_error(static_cast<int>(::ZSTD_getErrorCode(ret)), error::get_zstd_category(), what);
+    return ret;
+}
+
+}  // detail
+
+
+/*!
+  zstd の辞書.
+
+  小さなメッセージは単体ではほとんど圧縮できないので、似たメッセージから学習した辞書を圧縮と伸長の両方に渡す。
+  辞書の内容から圧縮用と伸長用のコンテキストを一度だけ作り、コピーしたものの間で共有する
+ */
+class zstd_dictionary
+{
+public:
+    //! 辞書の内容から作る. 圧縮には level を使う
+    zstd_dictionary(void const * data, std::size_t size, int level = ZSTD_CLEVEL_DEFAULT)
+        : impl_(std::make_shared<impl>())
+    {
+        impl_->content_.assign(static_cast<char const *>(data), size);
+        impl_->cdict_ = ::ZSTD_createCDict(impl_->content_.data(), size, level);
+        impl_->ddict_ = ::ZSTD_createDDict(impl_->content_.data(), size);
+        if (impl_->cdict_ == nullptr || impl_->ddict_ == nullptr)
+            throw boost::system::system_error(ZSTD_error_dictionaryCreation_failed, error::get_zstd_category(), "zstd_dictionary");
+    }
+
+    explicit zstd_dictionary(std::string const & content, int level = ZSTD_CLEVEL_DEFAULT)
+        : zstd_dictionary(content.data(), content.size(), level)
+    {
+    }
+
+    /*!
+      サンプルのメッセージから辞書を学習する.
+      capacity は辞書の最大サイズで、サンプルの合計はその 100 倍程度あるとよい
+     */
+    template <typename Range>
+    static zstd_dictionary train(Range const & samples, std::size_t capacity = 112640, int level = ZSTD_CLEVEL_DEFAULT)
+    {
+        std::string buffer;
+        std::vector<std::size_t> sizes;
+        for(auto const & sample : samples) {
+            buffer.append(sample.data(), sample.size());
+            sizes.push_back(sample.size());
+        }
+
+        std::string dict(capacity, '\0');
+        std::size_t ret = ::ZDICT_trainFromBuffer(&dict[0], dict.size(), buffer.data(), sizes.data(), static_cast<unsigned>(sizes.size()));
+        detail::zstd_check(ret, "zstd_dictionary::train");
+        dict.resize(ret);
+        return zstd_dictionary(dict, level);
+    }
+
+    std::string const & content() const noexcept
+    {
+        return impl_->content_;
+    }
+
+    ::ZSTD_CDict const * cdict() const noexcept
+    {
+        return impl_->cdict_;
+    }
+
+    ::ZSTD_DDict const * ddict() const noexcept
+    {
+        return impl_->ddict_;
+    }
+
+private:
+    struct impl
+    {
+        ~impl()
+        {
+            ::ZSTD_freeCDict(cdict_);
+            ::ZSTD_freeDDict(ddict_);
+        }
+
+        std::string content_;
+        ::ZSTD_CDict * cdict_ = nullptr;
+        ::ZSTD_DDict * ddict_ = nullptr;
+    };
+
+    std::shared_ptr<impl> impl_;
+};
+
+
+/*!
+  zstd の圧縮パラメータ.
+  workers が 1 以上であれば、その数のスレッドで圧縮する。辞書を指定した場合は辞書の圧縮レベルを使う
+ */
+struct zstd_params
+{
+    zstd_params(int level_ = ZSTD_CLEVEL_DEFAULT, int workers_ = 0, bool checksum_ = false)
+        : level(level_), workers(workers_), checksum(checksum_)
+    {
+    }
+
+    int level;
+    int workers;
+    bool checksum;
+    std::shared_ptr<zstd_dictionary const> dictionary;
+};
+
+
+namespace detail {
+
+class zstd_compress_codec
+{
+public:
+    explicit zstd_compress_codec(zstd_params const & params)
+        : ctx_(::ZSTD_createCCtx())
+        , out_(new char[::ZSTD_CStreamOutSize()])
+        , params_(params)
+    {
+        if (!ctx_)
+            throw std::bad_alloc();
+        configure();
+    }
+
+    void run(char const * s, std::size_t n, filter_buffer & out, bool finish)
+    {
+        ::ZSTD_inBuffer in = { s, n, 0 };
+        for(;;) {
+            ::ZSTD_outBuffer ob = { out_.get(), ::ZSTD_CStreamOutSize(), 0 };
+            std::size_t ret = zstd_check(::ZSTD_compressStream2(ctx_.get(), &ob, &in, finish ? ZSTD_e_end : ZSTD_e_continue), "zstd_compressor");
+            out.append(out_.get(), ob.pos);
+            if (finish ? (ret == 0) : (in.pos == in.size))
+                break;
+        }
+    }
+
+    void reset()
+    {
+        ::ZSTD_CCtx_reset(ctx_.get(), ZSTD_reset_session_only);
+    }
+
+private:
+    void configure()
+    {
+        auto * ctx = ctx_.get();
+        zstd_check(::ZSTD_CCtx_setParameter(ctx, ZSTD_c_compressionLevel, params_.level), "zstd_compressor");
+        zstd_check(::ZSTD_CCtx_setParameter(ctx, ZSTD_c_checksumFlag, params_.checksum ? 1 : 0), "zstd_compressor");
+        if (params_.workers > 0)
+            zstd_check(::ZSTD_CCtx_setParameter(ctx, ZSTD_c_nbWorkers, params_.workers), "zstd_compressor");
+        if (params_.dictionary)
+            zstd_check(::ZSTD_CCtx_refCDict(ctx, params_.dictionary->cdict()), "zstd_compressor");
+    }
+
+    struct deleter
+    {
+        void operator()(::ZSTD_CCtx * ctx) const noexcept
+        {
+            ::ZSTD_freeCCtx(ctx);
+        }
+    };
+
+private:
+    std::unique_ptr<::ZSTD_CCtx, deleter> ctx_;
+    std::unique_ptr<char[]> out_;
+    zstd_params params_;
+};
+
+
+class zstd_decompress_codec
+{
+public:
+    explicit zstd_decompress_codec(std::shared_ptr<zstd_dictionary const> dictionary)
+        : ctx_(::ZSTD_createDCtx())
+        , out_(new char[::ZSTD_DStreamOutSize()])
+        , dictionary_(std::move(dictionary))
+    {
+        if (!ctx_)
+            throw std::bad_alloc();
+        if (dictionary_)
+            zstd_check(::ZSTD_DCtx_refDDict(ctx_.get(), dictionary_->ddict()), "zstd_decompressor");
+    }
+
+    void run(char const * s, std::size_t n, filter_buffer & out, bool finish)
+    {
+        ::ZSTD_inBuffer in = { s, n, 0 };
+        std::size_t const size = ::ZSTD_DStreamOutSize();
+        for(;;) {
+            ::ZSTD_outBuffer ob = { out_.get(), size, 0 };
+            std::size_t pos = in.pos;
+            std::size_t ret = zstd_check(::ZSTD_decompressStream(ctx_.get(), &ob, &in), "zstd_decompressor");
+            out.append(out_.get(), ob.pos);
+            // 何も進まなかったときは、次のフレームを待っているだけなので変えない
+            if (in.pos > pos || ob.pos > 0)
+                complete_ = (ret == 0);
+            // フレームの終わりでは入力が残っていても戻る。
+            // 入力を使い切っても内部のバッファに残っていることがあるので、終わりでは出力がなくなるまで繰り返す
+            if (ob.pos < size && in.pos == in.size && (!finish || complete_ || ob.pos == 0))
+                break;
+        }
+        if (finish && !complete_)
+            throw boost::system::system_error(ZSTD_error_srcSize_wrong, error::get_zstd_category(), "zstd_decompressor");
+    }
+
+    void reset()
+    {
+        ::ZSTD_DCtx_reset(ctx_.get(), ZSTD_reset_session_only);
+        complete_ = true;
+    }
+
+private:
+    struct deleter
+    {
+        void operator()(::ZSTD_DCtx * ctx) const noexcept
+        {
+            ::ZSTD_freeDCtx(ctx);
+        }
+    };
+
+private:
+    std::unique_ptr<::ZSTD_DCtx, deleter> ctx_;
+    std::unique_ptr<char[]> out_;
+    std::shared_ptr<zstd_dictionary const> dictionary_;
+    bool complete_ = true;
+};
+
+}  // detail
+
+
+/*!
+  zstd の圧縮フィルタ.
+  close されるとフレームを閉じる。boost::iostreams::zlib_compressor などと同じように使える
+ */
+class zstd_compressor
+    : public detail::codec_filter<detail::zstd_compress_codec>
+{
+public:
+    explicit zstd_compressor(zstd_params const & params = zstd_params())
+        : codec_filter(detail::zstd_compress_codec(params))
+    {
+    }
+};
+
+
+/*!
+  zstd の伸長フィルタ.
+  連続した複数のフレームも伸長する。途中でフレームが終わっていると、close で例外を投げる
+ */
+class zstd_decompressor
+    : public detail::codec_filter<detail::zstd_decompress_codec>
+{
+public:
+    explicit zstd_decompressor(std::shared_ptr<zstd_dictionary const> dictionary = nullptr)
+        : codec_filter(detail::zstd_decompress_codec(std::move(dictionary)))
+    {
+    }
+};
+
+} }
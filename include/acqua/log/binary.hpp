@@ -0,0 +1,261 @@
+#pragma once
+
+extern "C" {
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+}
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <boost/noncopyable.hpp>
+#include <boost/system/system_error.hpp>
+#include <acqua/log/severity.hpp>
+#include <acqua/log/detail/binary_record.hpp>
+
+namespace acqua { namespace log { namespace binary {
+
+/*!
+  バイナリログの呼び出し元の情報.
+  BLOG マクロが呼び出し元ごとに static に持ち、初めて実行されたときに番号を割り振って登録する
+ */
+struct site
+{
+    severity_type level;
+    char const * format;
+    char const * func;
+    char const * file;
+    unsigned int line;
+};
+
+/*!
+  バイナリログを書き込むメモリマップトファイル.
+
+  書き込み位置をアトミックに進めて領域を確保するので、複数のスレッドからロックなしで書き込める。
+  容量を使い切った後のレコードは捨てて数える。
+ */
+class mapped_file
+    : private boost::noncopyable
+{
+public:
+    mapped_file(std::string const & path, std::size_t capacity)
+        : capacity_(detail::binary_align(capacity))
+    {
+        fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd_ < 0)
+            throw boost::system::system_error(errno, boost::system::generic_category(), "binary log: " + path);
+        void * ptr;
+        if (::ftruncate(fd_, static_cast<off_t>(capacity_)) != 0 ||
+            (ptr = ::mmap(nullptr, capacity_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0)) == MAP_FAILED) {
+            int err = errno;
+            ::close(fd_);
+            throw boost::system::system_error(err, boost::system::generic_category(), "binary log: " + path);
+        }
+        data_ = static_cast<char *>(ptr);
+        std::memcpy(data_, detail::binary_magic, sizeof(detail::binary_magic));
+        pos_.store(sizeof(detail::binary_magic));
+    }
+
+    //! 使用した大きさに切り詰めて閉じる.
+    ~mapped_file()
+    {
+        std::size_t used = std::min(pos_.load(), capacity_);
+        ::munmap(data_, capacity_);
+        if (::ftruncate(fd_, static_cast<off_t>(used)) != 0) {
+            // 切り詰めに失敗しても、残りは size が 0 の領域として読み飛ばされる
+        }
+        ::close(fd_);
+    }
+
+    //! size バイトの領域を確保する. 容量が足りなければ nullptr を返す
+    char * reserve(std::size_t size) noexcept
+    {
+        std::size_t pos = pos_.fetch_add(size, std::memory_order_relaxed);
+        if (pos + size > capacity_) {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        return data_ + pos;
+    }
+
+    //! reserve() した領域の書き込みを完了する. size を最後に書くので、読み込み側は size が 0 でなければ完全なレコードとみなせる
+    static void commit(char * record, std::uint32_t size) noexcept
+    {
+        __atomic_store_n(reinterpret_cast<std::uint32_t *>(record), size, __ATOMIC_RELEASE);
+    }
+
+    std::size_t size() const noexcept
+    {
+        return std::min(pos_.load(std::memory_order_relaxed), capacity_);
+    }
+
+    std::size_t dropped() const noexcept
+    {
+        return dropped_.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::size_t const capacity_;
+    int fd_;
+    char * data_;
+    std::atomic<std::size_t> pos_{0};
+    std::atomic<std::size_t> dropped_{0};
+};
+
+} } }
+
+namespace acqua { namespace log { namespace detail {
+
+struct binary_state
+{
+    std::atomic<binary::mapped_file *> file{nullptr};
+    std::atomic<severity_type> level{trace};
+    std::vector<binary::site const *> sites;
+    std::mutex mutex;
+
+    static binary_state & instance()
+    {
+        static binary_state s;
+        return s;
+    }
+
+    ~binary_state()
+    {
+        delete file.load();
+    }
+};
+
+inline std::uint32_t binary_thread_id() noexcept
+{
+    static thread_local std::uint32_t tid = static_cast<std::uint32_t>(::syscall(SYS_gettid));
+    return tid;
+}
+
+inline std::uint64_t binary_now() noexcept
+{
+    return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count());
+}
+
+template <typename... Args>
+inline void binary_write_record(binary::mapped_file & file, std::uint32_t id, Args const &... args) noexcept
+{
+    std::size_t size = binary_align(sizeof(binary_header) + binary_args_size(args...));
+    char * record = file.reserve(size);
+    if (record == nullptr)
+        return;
+
+    binary_header hdr{0, id, binary_now(), binary_thread_id(), 0};
+    char * out = record;
+    binary_put(out, hdr);
+    binary_put_args(out, args...);
+    binary::mapped_file::commit(record, static_cast<std::uint32_t>(size));
+}
+
+inline void binary_write_site(binary::mapped_file & file, std::uint32_t id, binary::site const & s) noexcept
+{
+    binary_write_record(file, 0, id, static_cast<std::uint32_t>(s.level), s.line, s.format, s.file, s.func);
+}
+
+} } }
+
+namespace acqua { namespace log { namespace binary {
+
+/*!
+  path にバイナリログのファイルを作成して、以後の BLOG の出力先にする.
+  ログを出力中のスレッドと並行して呼び出さないこと
+ */
+inline void open(std::string const & path, std::size_t capacity = 64 * 1024 * 1024)
+{
+    auto & st = detail::binary_state::instance();
+    std::lock_guard<std::mutex> lock(st.mutex);
+
+    std::unique_ptr<mapped_file> file(new mapped_file(path, capacity));
+    for(std::size_t i = 0; i < st.sites.size(); ++i)
+        detail::binary_write_site(*file, static_cast<std::uint32_t>(i + 1), *st.sites[i]);
+    delete st.file.exchange(file.release());
+}
+
+//! ファイルを閉じる. ログを出力中のスレッドと並行して呼び出さないこと
+inline void close()
+{
+    auto & st = detail::binary_state::instance();
+    std::lock_guard<std::mutex> lock(st.mutex);
+    delete st.file.exchange(nullptr);
+}
+
+//! 容量が足りずに捨てたレコードの数を返す.
+inline std::size_t dropped() noexcept
+{
+    auto * file = detail::binary_state::instance().file.load(std::memory_order_acquire);
+    return file ? file->dropped() : 0;
+}
+
+inline void set_level(severity_type level) noexcept
+{
+    detail::binary_state::instance().level.store(level, std::memory_order_relaxed);
+}
+
+inline bool enabled(severity_type level) noexcept
+{
+    return level >= detail::binary_state::instance().level.load(std::memory_order_relaxed);
+}
+
+//! 呼び出し元を登録して、番号を返す. 開いているファイルには定義のレコードを書き込む
+inline std::uint32_t register_site(site const & s)
+{
+    auto & st = detail::binary_state::instance();
+    std::lock_guard<std::mutex> lock(st.mutex);
+
+    st.sites.push_back(&s);
+    auto id = static_cast<std::uint32_t>(st.sites.size());
+    if (auto * file = st.file.load())
+        detail::binary_write_site(*file, id, s);
+    return id;
+}
+
+/*!
+  ログのレコードを書き込む.
+  引数は整形せずに、型タグと値だけをコピーする。ファイルが開かれていなければ何もしない
+ */
+template <typename... Args>
+inline void write(std::uint32_t id, char const *, Args const &... args) noexcept
+{
+    if (auto * file = detail::binary_state::instance().file.load(std::memory_order_acquire))
+        detail::binary_write_record(*file, id, args...);
+}
+
+} } }
+
+
+#define ACQUA_BLOG_DETAIL_FIRST(fmt, ...) fmt
+
+/*!
+  バイナリログを出力する. BLOG(info, "recv {} bytes from {}", size, addr);
+
+  書式の {} は、デコード時に引数で順に置き換える。
+  呼び出し元の情報は初回だけ登録し、以後はレコードに番号と引数だけを書き込む
+ */
+#define ACQUA_BLOG(level, ...)                                          \
+    do {                                                                \
+        if (static_cast<int>(acqua::log::level) >= ACQUA_LOG_MIN_SEVERITY && \
+            acqua::log::binary::enabled(acqua::log::level)) {           \
+            static acqua::log::binary::site const acqua_blog_site_ = {  \
+                acqua::log::level, ACQUA_BLOG_DETAIL_FIRST(__VA_ARGS__, 0), __PRETTY_FUNCTION__, __FILE__, __LINE__ \
+            };                                                          \
+            static std::uint32_t const acqua_blog_id_ = acqua::log::binary::register_site(acqua_blog_site_); \
+            acqua::log::binary::write(acqua_blog_id_, __VA_ARGS__);     \
+        }                                                               \
+    } while(false)
+
+#ifndef ACQUA_LOG_MIN_SEVERITY
+#define ACQUA_LOG_MIN_SEVERITY 0
+#endif
+
+#ifndef BLOG
+#define BLOG(level, ...) ACQUA_BLOG(level, __VA_ARGS__)
+#endif
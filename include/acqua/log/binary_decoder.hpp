@@ -0,0 +1,244 @@
+#pragma once
+
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <boost/system/system_error.hpp>
+#include <acqua/log/severity.hpp>
+#include <acqua/log/detail/binary_record.hpp>
+#include <acqua/log/detail/formatter.hpp>
+
+namespace acqua { namespace log { namespace binary {
+
+/*!
+  BLOG で書き出したバイナリログを読み込んで、テキストに整形するクラス.
+
+  整形には logger::set_format() と同じ書式 (%F %T.%u [%L] - %v など) を使う。
+  %v は、呼び出し元の書式の {} を引数で順に置き換えたものになる。
+ */
+class decoder
+{
+public:
+    struct site_info
+    {
+        severity_type level;
+        unsigned int line;
+        std::string format;
+        std::string file;
+        std::string func;
+    };
+
+    //! 1つのログレコード. formatter の Derived として使う
+    struct record
+        : acqua::log::detail::formatter<record, boost::posix_time::ptime>
+    {
+        severity_type level = trace;
+        char const * func = "";
+        char const * file = "";
+        unsigned int line = 0;
+        std::uint32_t tid = 0;
+        std::uint64_t time = 0;
+        std::string text;
+
+        boost::posix_time::ptime now() const
+        {
+            std::time_t sec = static_cast<std::time_t>(time / 1000000000);
+            std::tm tm;
+            ::localtime_r(&sec, &tm);
+            return boost::posix_time::ptime_from_tm(tm) + boost::posix_time::microseconds(static_cast<long>(time / 1000 % 1000000));
+        }
+
+        std::string const & message() const noexcept
+        {
+            return text;
+        }
+
+        template <typename Out>
+        void replace_thread_id(Out & out) const
+        {
+            out << tid;
+        }
+    };
+
+    //! path を読み込む. ファイルが開けないか、バイナリログでなければ例外を投げる
+    explicit decoder(std::string const & path)
+    {
+        std::ifstream ifs(path, std::ios::binary);
+        if (!ifs)
+            throw boost::system::system_error(errno, boost::system::generic_category(), "binary decoder: " + path);
+        data_.assign(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+        if (data_.size() < sizeof(detail::binary_magic) ||
+            std::memcmp(data_.data(), detail::binary_magic, sizeof(detail::binary_magic)) != 0)
+            throw boost::system::system_error(make_error_code(boost::system::errc::illegal_byte_sequence), "binary decoder: " + path);
+    }
+
+    /*!
+      ログレコードを順に f(record &) に渡して、レコード数を返す.
+      呼び出し元の定義のレコードは、読み込んだ時点で登録する
+     */
+    template <typename F>
+    std::size_t for_each(F f)
+    {
+        std::size_t count = 0;
+        std::size_t pos = sizeof(detail::binary_magic);
+        record rec;
+        std::vector<std::string> args;
+        bool skipped = false;
+
+        while(pos + sizeof(detail::binary_header) <= data_.size()) {
+            detail::binary_header hdr;
+            std::memcpy(&hdr, data_.data() + pos, sizeof(hdr));
+            if (!valid(hdr, pos, skipped)) {
+                // 確保したまま書き込まれなかったレコード (size が 0) や壊れたレコードは、
+                // 8 バイトずつ進めて、次の正しいヘッダまで読み飛ばす
+                pos += 8;
+                skipped = true;
+                continue;
+            }
+            skipped = false;
+
+            char const * beg = data_.data() + pos + sizeof(hdr);
+            char const * end = data_.data() + pos + hdr.size;
+            pos += hdr.size;
+            decode_args(beg, end, args);
+
+            if (hdr.id == 0) {
+                define_site(args);
+                continue;
+            }
+
+            rec.tid = hdr.tid;
+            rec.time = hdr.time;
+            if (hdr.id <= sites_.size() && sites_[hdr.id - 1]) {
+                auto const & site = *sites_[hdr.id - 1];
+                rec.level = site.level;
+                rec.func = site.func.c_str();
+                rec.file = site.file.c_str();
+                rec.line = site.line;
+                rec.text = render(site.format, args);
+            } else {
+                rec.level = trace;
+                rec.func = rec.file = "";
+                rec.line = 0;
+                rec.text = "<unknown site " + std::to_string(hdr.id) + ">";
+            }
+            f(rec);
+            ++count;
+        }
+        return count;
+    }
+
+    //! すべてのログレコードを fmt で整形して、1行ずつ os に書き出す.
+    std::size_t write(std::ostream & os, std::string const & fmt)
+    {
+        acqua::log::detail::compiled_format<char> compiled(fmt);
+        return for_each([&os, &compiled](record & rec) {
+                rec.format(os, compiled);
+                os << '\n';
+            });
+    }
+
+    //! 読み込んだ呼び出し元の定義. 番号は 1 から始まる
+    site_info const * site(std::uint32_t id) const noexcept
+    {
+        return (id > 0 && id <= sites_.size()) ? sites_[id - 1].get() : nullptr;
+    }
+
+private:
+    //! pos のヘッダがレコードとして読めるか. 読み飛ばした直後は、引数を誤認しないように番号も確かめる
+    bool valid(detail::binary_header const & hdr, std::size_t pos, bool skipped) const noexcept
+    {
+        if (hdr.size < sizeof(hdr) || hdr.size % 8 != 0 || hdr.size > data_.size() - pos || hdr.reserved != 0)
+            return false;
+        return !skipped || hdr.id <= sites_.size();
+    }
+
+    template <typename T>
+    static T get(char const *& beg, char const * end)
+    {
+        T value = T();
+        if (end - beg >= static_cast<std::ptrdiff_t>(sizeof(T)))
+            std::memcpy(&value, beg, sizeof(T));
+        beg += sizeof(T);
+        return value;
+    }
+
+    //! 引数を文字列に変換して args に格納する
+    static void decode_args(char const * beg, char const * end, std::vector<std::string> & args)
+    {
+        args.clear();
+        while(beg < end) {
+            switch(static_cast<detail::binary_arg>(*beg++)) {
+                case detail::binary_arg::int64:
+                    args.push_back(std::to_string(get<std::int64_t>(beg, end)));
+                    break;
+                case detail::binary_arg::uint64:
+                    args.push_back(std::to_string(get<std::uint64_t>(beg, end)));
+                    break;
+                case detail::binary_arg::float64: {
+                    std::ostringstream oss;
+                    oss << get<double>(beg, end);
+                    args.push_back(oss.str());
+                    break;
+                }
+                case detail::binary_arg::boolean:
+                    args.push_back(get<std::uint8_t>(beg, end) ? "true" : "false");
+                    break;
+                case detail::binary_arg::character:
+                    args.push_back(std::string(1, get<char>(beg, end)));
+                    break;
+                case detail::binary_arg::string: {
+                    auto len = get<std::uint32_t>(beg, end);
+                    if (end - beg < static_cast<std::ptrdiff_t>(len))
+                        return;
+                    args.emplace_back(beg, len);
+                    beg += len;
+                    break;
+                }
+                case detail::binary_arg::pointer: {
+                    char buf[32];
+                    std::snprintf(buf, sizeof(buf), "0x%llx", static_cast<unsigned long long>(get<std::uint64_t>(beg, end)));
+                    args.push_back(buf);
+                    break;
+                }
+                default:
+                    // 残りは 8 バイト境界までの詰め物
+                    return;
+            }
+        }
+    }
+
+    void define_site(std::vector<std::string> const & args)
+    {
+        if (args.size() < 6)
+            return;
+        std::size_t id = std::stoul(args[0]);
+        if (id == 0)
+            return;
+        if (sites_.size() < id)
+            sites_.resize(id);
+        sites_[id - 1].reset(new site_info{static_cast<severity_type>(std::stoul(args[1])), static_cast<unsigned int>(std::stoul(args[2])), args[3], args[4], args[5]});
+    }
+
+    static std::string render(std::string const & fmt, std::vector<std::string> const & args)
+    {
+        std::string str;
+        std::size_t i = 0, beg = 0, end;
+        while((end = fmt.find("{}", beg)) != std::string::npos && i < args.size()) {
+            str.append(fmt, beg, end - beg);
+            str.append(args[i++]);
+            beg = end + 2;
+        }
+        str.append(fmt, beg, std::string::npos);
+        return str;
+    }
+
+private:
+    std::vector<char> data_;
+    std::vector< std::unique_ptr<site_info> > sites_;
+};
+
+} } }
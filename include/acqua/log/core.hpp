@@ -1,19 +1,24 @@
 #pragma once
 
 #include <mutex>
+#include <atomic>
+#include <chrono>
 #include <memory>
 #include <typeinfo>
 #include <typeindex>
 #include <unordered_map>
 #include <boost/serialization/singleton.hpp>
-#include <boost/iostreams/stream_buffer.hpp>
-#include <boost/iostreams/device/back_inserter.hpp>
 #include <acqua/log/severity.hpp>
+#include <acqua/log/overflow_policy.hpp>
+#include <acqua/log/detail/async_writer.hpp>
 #include <acqua/log/detail/line_logger.hpp>
+#include <acqua/log/detail/rate_limiter.hpp>
+#include <acqua/log/detail/sink_registry.hpp>
 #include <acqua/log/detail/logging_buffer.hpp>
 #include <acqua/log/detail/loggable_buffer.hpp>
 #include <acqua/log/sinks/logger_sink.hpp>
 #include <acqua/log/sinks/console_sink.hpp>
+#include <acqua/log/sinks/file_sink.hpp>
 
 namespace acqua { namespace log {
 
@@ -31,10 +36,19 @@ class core
 
     core()
         : default_logger_(new logger())
-        , cout_sink_(std::cout)
-        , cerr_sink_(std::cerr)
+        , cout_sink_(std::cout, stdout)
+        , cerr_sink_(std::cerr, stderr)
     {
         default_logger_->push(cout_sink_);
+        cache<default_tag>().store(default_logger_.get(), std::memory_order_release);
+    }
+
+    ~core()
+    {
+        // 非同期モードの書き出しスレッドが cout_sink_ を参照しているので、先に止める
+        loggers_.clear();
+        cache<default_tag>().store(nullptr, std::memory_order_release);
+        default_logger_.reset();
     }
 
 public:
@@ -54,31 +68,38 @@ public:
         using char_type = core::char_type;
         using mutex_type = core::mutex_type;
         using string_type = std::basic_string<char_type>;
+        using sink_type = sinks::logger_sink<char_type, mutex_type>;
 
-        // template <typename Sink>
-        // void push(Sink const & sink)
-        // {
-        //     // TODO: スレッドセーフでない
-        //     sinks_.emplace_back(new Sink(sink));
-        // }
+        ~logger()
+        {
+            set_sync();
+        }
 
-        void push(sinks::console_sink<char_type, mutex_type> & sink)
+        /*!
+          シンクを追加する. 任意のスレッドから、ログの出力と並行して呼び出せる.
+          登録済みのシンクであれば何もしない。シンクの write() の中から呼び出すと std::logic_error を投げる
+         */
+        void push(std::shared_ptr<sink_type> sink)
         {
-            auto it = std::find(sinks_.begin(), sinks_.end(), &sink);
-            if (it == sinks_.end())
-                sinks_.emplace_back(&sink);
+            sinks_.push(std::move(sink));
         }
 
+        //! 所有権を持たずにシンクを追加する. sink はロガーより長く生存しなければならない
+        void push(sink_type & sink)
+        {
+            sinks_.push(std::shared_ptr<sink_type>(&sink, [](sink_type *) {}));
+        }
+
+        //! 最後に追加したシンクを取り除く.
         void pop()
         {
-            auto core_ = &singleton::get_mutable_instance();
+            sinks_.pop();
+        }
 
-            if (!sinks_.empty()) {
-                auto * sink = sinks_.back();
-                sinks_.pop_back();
-                if (sink != &core_->cout_sink_ || sink != &core_->cerr_sink_)
-                    delete sink;
-            }
+        //! sink を取り除く. 取り除いたシンクに書き込み中のスレッドがあれば、それが終わるまで待つ
+        bool remove(sink_type const & sink)
+        {
+            return sinks_.remove(sink);
         }
 
         template <typename Tag>
@@ -89,43 +110,113 @@ public:
 
         logging_line_logger make_line_logger(severity_type level, char const * func, char const * file, unsigned int line)
         {
-            return logging_line_logger(*this, new detail::logging_buffer<char_type>(level, func, file, line));
+            auto * buf = detail::buffer_pool< detail::logging_buffer<char_type> >::acquire();
+            buf->reset(level, func, file, line);
+            return logging_line_logger(*this, buf);
         }
 
         loggable_line_logger make_line_logger(severity_type level, char const * func, char const * file, unsigned int line, std::type_info const & type)
         {
-            return loggable_line_logger(*this, new detail::loggable_buffer<char_type>(level, func, file, line, type));
+            auto * buf = detail::buffer_pool< detail::loggable_buffer<char_type> >::acquire();
+            buf->reset(level, func, file, line, type);
+            return loggable_line_logger(*this, buf);
         }
 
         template <typename Buffer>
-        void write(std::unique_ptr<Buffer> && buf) const
+        void write(Buffer & buf) const
         {
-            string_type dest;
-            dest.reserve(1024);
+            // 整形先はバッファごとに使い回すので、容量が足りていればヒープの確保は起きない
+            auto & out = buf.output;
+            out.reset();
+            buf.format(out, format_);
+
+            if (async_) {
+                // 空いたセルの文字列と入れ替わるので、容量は書き出しスレッドとの間で循環する
+                async_->push(out.str());
+                return;
+            }
 
-            boost::iostreams::stream_buffer< boost::iostreams::back_insert_device<string_type> > strbuf(dest);
-            std::basic_ostream<char_type> os(&strbuf);
-            buf->format(os, format_);
-            os.flush();
+            auto const & str = out.str();
+            sinks_.for_each([&str](sink_type const & sink) {
+                    sink.write(str.c_str(), str.size());
+                });
+        }
 
-            for(auto const & sink : sinks_) {
-               sink->write(dest.c_str(), dest.size());
-            }
+        /*!
+          非同期モードに切り替える.
+
+          以後の行は呼び出し元のスレッドで整形した後、capacity 行のリングバッファに積まれ、
+          専用のスレッドがまとめてシンクに書き出す。ログを出力中のスレッドと並行して呼び出さないこと
+         */
+        void set_async(std::size_t capacity = 8192, overflow_policy policy = overflow_policy::block)
+        {
+            set_sync();
+            async_.reset(new detail::async_writer<char_type>([this](struct ::iovec const * iov, std::size_t count) {
+                        sinks_.for_each([iov, count](sink_type const & sink) {
+                                sink.write(iov, count);
+                            });
+                    }, capacity, policy));
         }
 
+        //! キューに残った行を書き出してから、同期モードに戻す.
+        void set_sync()
+        {
+            async_.reset();
+        }
+
+        bool is_async() const noexcept
+        {
+            return static_cast<bool>(async_);
+        }
+
+        //! 非同期モードであればキューに積まれた行が書き出されるまで待ち、シンクのバッファを書き出す.
+        void flush()
+        {
+            if (async_)
+                async_->flush();
+            sinks_.for_each([](sink_type const & sink) {
+                    sink.flush();
+                });
+        }
+
+        //! 非同期モードで、キューが満杯のために捨てた行数を返す.
+        std::size_t dropped() const noexcept
+        {
+            return async_ ? async_->dropped() : 0;
+        }
+
+        //! level 未満のログを出力しないようにする.
+        void set_level(severity_type level) noexcept
+        {
+            level_.store(level, std::memory_order_relaxed);
+        }
+
+        severity_type get_level() const noexcept
+        {
+            return level_.load(std::memory_order_relaxed);
+        }
+
+        bool enabled(severity_type level) const noexcept
+        {
+            return level >= level_.load(std::memory_order_relaxed);
+        }
+
+        //! 書式を解析して保持する. ログを出力中のスレッドと並行して呼び出さないこと
         void set_format(string_type const & format)
         {
-            format_ = format;
+            format_.compile(format);
         }
 
         string_type const & get_format() const
         {
-            return format_;
+            return format_.str();
         }
 
     private:
-        string_type format_ = "%F %T.%U [%L] - %v";
-        std::vector<sinks::logger_sink<char_type, mutex_type> *> sinks_;
+        std::atomic<severity_type> level_{trace};
+        detail::compiled_format<char_type> format_{"%F %T.%U [%L] - %v"};
+        detail::sink_registry<sink_type> sinks_;
+        std::unique_ptr<detail::async_writer<char_type> > async_;
     };
 
     template <typename Tag>
@@ -139,6 +230,19 @@ public:
         return get<default_tag>();
     }
 
+    /*!
+      Tag のロガーが level のログを出力するかを返す.
+
+      ロガーをロックせずに参照するため、LOG マクロから整形の前に呼び出される。
+      remove() や alias() はログを出力中のスレッドと並行して呼び出さないこと
+     */
+    template <typename Tag>
+    static bool enabled(severity_type level) noexcept
+    {
+        logger const * ptr = cache<Tag>().load(std::memory_order_acquire);
+        return ptr == nullptr || ptr->enabled(level);
+    }
+
     template <typename Tag>
     static bool remove()
     {
@@ -155,15 +259,45 @@ public:
         singleton::get_mutable_instance().name_ = name;
     }
 
+    /*!
+      LOG_EVERY_N などで捨てた行数を書き出す間隔を設定する. デフォルトは1秒.
+      0 にすると定期的には書き出さないので、report_suppressed() を呼び出すこと
+     */
+    static void suppressed_interval(std::chrono::nanoseconds interval)
+    {
+        detail::suppressed_reporter::instance().interval(interval);
+    }
+
+    static std::chrono::nanoseconds suppressed_interval()
+    {
+        return detail::suppressed_reporter::instance().interval();
+    }
+
+    //! LOG_EVERY_N などの呼び出し元ごとに、前回から捨てた行数があれば "(N suppressed)" の行を書き出す
+    static void report_suppressed()
+    {
+        detail::suppressed_reporter::instance().report();
+    }
+
 private:
+    //! Tag に対応するロガーのポインタ. 定数初期化されるので、参照にガード変数のチェックを伴わない
+    template <typename Tag>
+    static std::atomic<logger *> & cache() noexcept
+    {
+        static std::atomic<logger *> ptr{nullptr};
+        return ptr;
+    }
+
     template <typename Tag>
     std::shared_ptr<logger> find_or_construct(Tag const *)
     {
         std::lock_guard<decltype(mutex_)> lock(mutex_);
 
         auto it = loggers_.find(std::type_index(typeid(Tag)));
-        if (it == loggers_.end())
+        if (it == loggers_.end()) {
             it = loggers_.emplace_hint(it, std::type_index(typeid(Tag)), std::shared_ptr<logger>(new logger()));
+            cache<Tag>().store(it->second.get(), std::memory_order_release);
+        }
         return it->second;
     }
 
@@ -180,6 +314,7 @@ private:
         auto it = loggers_.find(std::type_index(typeid(Tag)));
         if (it == loggers_.end())
             return false;
+        cache<Tag>().store(nullptr, std::memory_order_release);
         loggers_.erase(it);
         return true;
     }
@@ -199,12 +334,14 @@ private:
             it->second = that;
         else
             loggers_.emplace_hint(it, std::type_index(typeid(Tag)), that);
+        cache<Tag>().store(that.get(), std::memory_order_release);
     }
 
     void alias(default_tag *, std::shared_ptr<logger> that)
     {
         if (default_logger_ != that)
             default_logger_ = that;
+        cache<default_tag>().store(that.get(), std::memory_order_release);
     }
 
 private:
@@ -219,43 +356,119 @@ private:
 } }
 
 
+/*!
+  ACQUA_LOG_MIN_SEVERITY 未満のログは、コンパイル時に取り除かれる.
+  リリースビルドで -DACQUA_LOG_MIN_SEVERITY=2 とすれば、trace と debug の文が消える
+ */
+#ifndef ACQUA_LOG_MIN_SEVERITY
+#define ACQUA_LOG_MIN_SEVERITY 0
+#endif
+
+/*!
+  出力しないレベルでは、line_logger を作らず、<< の右辺も評価しない.
+  実行時の判定は、ロガーのレベルをアトミックに読み込んで比較するだけである
+ */
+#define ACQUA_LOG_DETAIL_LOGGING(level, func)                           \
+    (static_cast<int>(acqua::log::level) < ACQUA_LOG_MIN_SEVERITY ||    \
+     !detail_logging_enabled(acqua::log::koenig_lookup_tag(), acqua::log::level)) \
+    ? (void)0                                                           \
+    : acqua::log::detail::voidify() & detail_logging(acqua::log::koenig_lookup_tag(), acqua::log::level, func, __FILE__, __LINE__)
+
 #ifndef ACQUA_LOG_trace
-#define ACQUA_LOG_trace    detail_logging(acqua::log::koenig_lookup_tag(), acqua::log::trace, __func__, __FILE__, __LINE__)
+#define ACQUA_LOG_trace    ACQUA_LOG_DETAIL_LOGGING(trace, __func__)
 #endif
 
 #ifndef ACQUA_LOG_debug
-#define ACQUA_LOG_debug    detail_logging(acqua::log::koenig_lookup_tag(), acqua::log::debug, __PRETTY_FUNCTION__, __FILE__, __LINE__)
+#define ACQUA_LOG_debug    ACQUA_LOG_DETAIL_LOGGING(debug, __PRETTY_FUNCTION__)
 #endif
 
 #ifndef ACQUA_LOG_info
-#define ACQUA_LOG_info     detail_logging(acqua::log::koenig_lookup_tag(), acqua::log::info, __PRETTY_FUNCTION__, __FILE__, __LINE__)
+#define ACQUA_LOG_info     ACQUA_LOG_DETAIL_LOGGING(info, __PRETTY_FUNCTION__)
 #endif
 
 #ifndef ACQUA_LOG_notice
-#define ACQUA_LOG_notice   detail_logging(acqua::log::koenig_lookup_tag(), acqua::log::notice, __PRETTY_FUNCTION__, __FILE__, __LINE__)
+#define ACQUA_LOG_notice   ACQUA_LOG_DETAIL_LOGGING(notice, __PRETTY_FUNCTION__)
 #endif
 
 #ifndef ACQUA_LOG_warning
-#define ACQUA_LOG_warning  detail_logging(acqua::log::koenig_lookup_tag(), acqua::log::warning, __PRETTY_FUNCTION__, __FILE__, __LINE__)
+#define ACQUA_LOG_warning  ACQUA_LOG_DETAIL_LOGGING(warning, __PRETTY_FUNCTION__)
 #endif
 
 #ifndef ACQUA_LOG_error
-#define ACQUA_LOG_error    detail__logging(acqua::log::koenig_lookup_tag(), acqua::log::error, __PRETTY_FUNCTION__, __FILE__, __LINE__)
+#define ACQUA_LOG_error    ACQUA_LOG_DETAIL_LOGGING(error, __PRETTY_FUNCTION__)
 #endif
 
 #ifndef ACQUA_LOG_critical
-#define ACQUA_LOG_critical detail__logging(acqua::log::koenig_lookup_tag(), acqua::log::critical, __PRETTY_FUNCTION__, __FILE__, __LINE__)
+#define ACQUA_LOG_critical ACQUA_LOG_DETAIL_LOGGING(critical, __PRETTY_FUNCTION__)
 #endif
 
 #ifndef ACQUA_LOG_alert
-#define ACQUA_LOG_alert    detail_logging(acqua::log::koenig_lookup_tag(), acqua::log::alert, __PRETTY_FUNCTION__, __FILE__, __LINE__)
+#define ACQUA_LOG_alert    ACQUA_LOG_DETAIL_LOGGING(alert, __PRETTY_FUNCTION__)
 #endif
 
 #ifndef ACQUA_LOG_emerg
-#define ACQUA_LOG_emerg    detail_logging(acqua::log::koenig_lookup_tag(), acqua::log::emerg, __PRETTY_FUNCTION__, __FILE__, __LINE__)
+#define ACQUA_LOG_emerg    ACQUA_LOG_DETAIL_LOGGING(emerg, __PRETTY_FUNCTION__)
 #endif
 
 
 #ifndef LOG
 #define LOG(level) ACQUA_LOG_ ## level
 #endif
+
+
+/*!
+  間引きに用いる時計. テストなどで時刻を差し替える場合は、インクルードの前に定義する.
+  Clock::now() の time_since_epoch() を時刻として用いる
+ */
+#ifndef ACQUA_LOG_LIMITER_CLOCK
+#define ACQUA_LOG_LIMITER_CLOCK std::chrono::steady_clock
+#endif
+
+/*!
+  呼び出し元ごとに間引いてログを出力する.
+
+  間引きの状態は呼び出し元ごとに static に持ち、初めて評価されたときに引数で初期化する。
+  捨てた行は << の右辺も評価しない。捨てた行数は、次に出力する行の先頭に書き出す。
+  次の行が出力されないまま core::suppressed_interval() が経つと、捨てた行数だけの行を書き出す
+ */
+#define ACQUA_LOG_DETAIL_LIMITED(level, limiter, ...)                  \
+    (static_cast<int>(acqua::log::level) < ACQUA_LOG_MIN_SEVERITY ||    \
+     !detail_logging_enabled(acqua::log::koenig_lookup_tag(), acqua::log::level) || \
+     ![&](char const * acqua_log_func_) -> acqua::log::detail::limiter_site<limiter> & { \
+         static acqua::log::detail::limiter_site<limiter> acqua_log_site_( \
+             acqua_log_func_,                                           \
+             [](char const * func, std::uint64_t count) {               \
+                 if (detail_logging_enabled(acqua::log::koenig_lookup_tag(), acqua::log::level)) \
+                     detail_logging(acqua::log::koenig_lookup_tag(), acqua::log::level, func, __FILE__, __LINE__) \
+                         << '(' << count << " suppressed)";             \
+             },                                                         \
+             __VA_ARGS__);                                              \
+         return acqua_log_site_;                                        \
+     }(__PRETTY_FUNCTION__).admit())                                    \
+    ? (void)0                                                           \
+    : acqua::log::detail::voidify() & detail_logging(acqua::log::koenig_lookup_tag(), acqua::log::level, __PRETTY_FUNCTION__, __FILE__, __LINE__) \
+    << acqua::log::detail::suppressed_note()
+
+//! n 回に1回だけ出力する. LOG_EVERY_N(warning, 100) << ...
+#define ACQUA_LOG_EVERY_N(level, n)                                     \
+    ACQUA_LOG_DETAIL_LIMITED(level, acqua::log::detail::every_n_limiter, n)
+
+//! interval ごとに最初の n 行だけを出力する. LOG_FIRST_N(warning, 10, std::chrono::seconds(1)) << ...
+#define ACQUA_LOG_FIRST_N(level, n, interval)                           \
+    ACQUA_LOG_DETAIL_LIMITED(level, acqua::log::detail::first_n_limiter<ACQUA_LOG_LIMITER_CLOCK>, n, interval)
+
+//! 1秒あたり rate 行、最大 burst 行まで続けて出力する. LOG_RATE(warning, 10, 20) << ...
+#define ACQUA_LOG_RATE(level, rate, burst)                              \
+    ACQUA_LOG_DETAIL_LIMITED(level, acqua::log::detail::token_bucket_limiter<ACQUA_LOG_LIMITER_CLOCK>, rate, burst)
+
+#ifndef LOG_EVERY_N
+#define LOG_EVERY_N(level, n) ACQUA_LOG_EVERY_N(level, n)
+#endif
+
+#ifndef LOG_FIRST_N
+#define LOG_FIRST_N(level, n, interval) ACQUA_LOG_FIRST_N(level, n, interval)
+#endif
+
+#ifndef LOG_RATE
+#define LOG_RATE(level, rate, burst) ACQUA_LOG_RATE(level, rate, burst)
+#endif
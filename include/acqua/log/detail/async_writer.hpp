@@ -0,0 +1,184 @@
+#pragma once
+
+extern "C" {
+#include <sys/uio.h>
+}
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <functional>
+#include <condition_variable>
+#include <boost/noncopyable.hpp>
+#include <acqua/log/overflow_policy.hpp>
+#include <acqua/log/detail/mpsc_ring.hpp>
+
+namespace acqua { namespace log { namespace detail {
+
+/*!
+  整形済みのログ行をリングバッファに積み、専用のスレッドからまとめてシンクに書き出すクラス.
+
+  書き出しスレッドは、キューに溜まった行を最大 max_batch 行ずつ取り出し、
+  iovec の配列として一度に consumer に渡す。
+  書き出しスレッドの waiting_ と push() 側のキューの確認は、互いに seq_cst のフェンスを挟んで読み書きするので、
+  起床の通知を取りこぼさない。overflow_policy::block で満杯のときは、空きができるまで条件変数で待つ。
+ */
+template <typename CharT>
+class async_writer
+    : private boost::noncopyable
+{
+public:
+    using string_type = std::basic_string<CharT>;
+    using consumer_type = std::function<void(struct ::iovec const *, std::size_t)>;
+
+    static const std::size_t max_batch = 256;
+
+    async_writer(consumer_type consumer, std::size_t capacity, overflow_policy policy)
+        : consumer_(std::move(consumer))
+        , ring_(capacity)
+        , policy_(policy)
+        , thread_(&async_writer::run, this)
+    {
+    }
+
+    //! キューに残っている行を書き出してから、スレッドを停止する.
+    ~async_writer()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_.store(true);
+            cond_.notify_one();
+        }
+        thread_.join();
+    }
+
+    //! 行をキューに積む. 成功すると line には空いたセルの文字列が入る
+    void push(string_type & line)
+    {
+        switch(policy_) {
+            case overflow_policy::block:
+                if (!ring_.try_push(line))
+                    wait_push(line);
+                break;
+            case overflow_policy::drop:
+                if (!ring_.try_push(line)) {
+                    dropped_.fetch_add(1, std::memory_order_relaxed);
+                    return;
+                }
+                break;
+            case overflow_policy::drop_oldest:
+                while(!ring_.try_push(line)) {
+                    string_type oldest;
+                    if (ring_.try_pop(oldest))
+                        dropped_.fetch_add(1, std::memory_order_relaxed);
+                }
+                break;
+        }
+        // キューへの書き込みと waiting_ の読み込みを入れ替えない. 書き出しスレッドの run() と対になる
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (waiting_.load(std::memory_order_relaxed))
+            wakeup();
+    }
+
+    //! キューに積まれた行が書き出されるまで待つ. 書き出しスレッドがキューを空にしたときに条件変数で起こされる
+    void flush()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        ++flushers_;
+        cond_.notify_one();
+        while(!ring_.empty() || busy_.load())
+            drained_.wait(lock);
+        --flushers_;
+    }
+
+    //! overflow_policy により捨てた行数を返す.
+    std::size_t dropped() const noexcept
+    {
+        return dropped_.load(std::memory_order_relaxed);
+    }
+
+private:
+    void wakeup()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        cond_.notify_one();
+    }
+
+    //! 満杯のキューに空きができるまで待ってから積む
+    void wait_push(string_type & line)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        blocked_.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        while(!ring_.try_push(line)) {
+            cond_.notify_one();
+            space_.wait(lock);
+        }
+        blocked_.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    void run()
+    {
+        std::vector<string_type> batch(max_batch);
+        std::vector<struct ::iovec> iov(max_batch);
+
+        while(true) {
+            busy_.store(true);
+            std::size_t n = 0;
+            while(n < max_batch && ring_.try_pop(batch[n]))
+                ++n;
+            if (n > 0) {
+                for(std::size_t i = 0; i < n; ++i) {
+                    iov[i].iov_base = const_cast<CharT *>(batch[i].data());
+                    iov[i].iov_len = batch[i].size() * sizeof(CharT);
+                }
+                // 取り出して空いた分を、満杯で待っている push() に知らせる. wait_push() と対になる
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                if (blocked_.load(std::memory_order_relaxed) > 0) {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    space_.notify_all();
+                }
+
+                try {
+                    consumer_(iov.data(), n);
+                } catch(...) {}
+                for(std::size_t i = 0; i < n; ++i)
+                    batch[i].clear();
+            }
+            busy_.store(false);
+            if (n > 0)
+                continue;
+
+            std::unique_lock<std::mutex> lock(mutex_);
+            if (flushers_ > 0)
+                drained_.notify_all();
+            if (stop_.load())
+                break;
+            waiting_.store(true, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            while(ring_.empty() && !stop_.load())
+                cond_.wait(lock);
+            waiting_.store(false, std::memory_order_relaxed);
+        }
+    }
+
+private:
+    consumer_type consumer_;
+    mpsc_ring<string_type> ring_;
+    overflow_policy const policy_;
+    std::atomic<std::size_t> dropped_{0};
+    std::atomic<bool> busy_{false};
+    std::atomic<bool> waiting_{false};
+    std::atomic<std::size_t> blocked_{0};
+    std::atomic<bool> stop_{false};
+    std::mutex mutex_;
+    std::condition_variable cond_;  // 書き出しスレッドを起こす
+    std::condition_variable space_;  // 満杯で待っている push() を起こす
+    std::condition_variable drained_;  // キューが空になるのを flush() で待っているスレッドを起こす
+    std::size_t flushers_ = 0;  // flush() で待っているスレッドの数. mutex_ で保護する
+    std::thread thread_;
+};
+
+} } }
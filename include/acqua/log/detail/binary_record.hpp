@@ -0,0 +1,213 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <boost/utility/string_view.hpp>
+
+namespace acqua { namespace log { namespace detail {
+
+/*!
+  バイナリログのファイル形式.
+
+  ファイルの先頭に binary_magic を置き、その後にレコードを 8 バイト境界で並べる。
+  各レコードは binary_header で始まり、size は header を含むレコード全体の大きさである。
+  size が 0 のレコードは、確保したまま書き込まれなかったもので、読み込み側は次のレコードまで読み飛ばす。
+
+  id が 0 のレコードは呼び出し元の定義で、id (u32), level (u32), line (u32) の後に
+  format, file, func の文字列が続く。id が 1 以上のレコードはログで、引数が続く。
+  引数は binary_arg の型タグの後に値が続き、文字列は長さ (u32) と中身になる。
+ */
+static char const binary_magic[8] = { 'A', 'C', 'Q', 'L', 'O', 'G', '0', '1' };
+
+struct binary_header
+{
+    std::uint32_t size;
+    std::uint32_t id;
+    std::uint64_t time;  //!< エポックからのナノ秒
+    std::uint32_t tid;
+    std::uint32_t reserved;
+};
+
+static_assert(sizeof(binary_header) == 24, "");
+
+enum class binary_arg : std::uint8_t {
+    int64 = 1,
+    uint64,
+    float64,
+    boolean,
+    character,
+    string,
+    pointer,
+};
+
+constexpr std::size_t binary_align(std::size_t size) noexcept
+{
+    return (size + 7) & ~static_cast<std::size_t>(7);
+}
+
+inline void binary_put(char *& out, void const * data, std::size_t size) noexcept
+{
+    std::memcpy(out, data, size);
+    out += size;
+}
+
+template <typename T>
+inline void binary_put(char *& out, T const & value) noexcept
+{
+    binary_put(out, &value, sizeof(value));
+}
+
+//! nullptr は空文字列として扱う
+inline std::size_t binary_strlen(char const * str) noexcept
+{
+    return str ? std::strlen(str) : 0;
+}
+
+inline void binary_put_string(char *& out, char const * str, std::size_t len) noexcept
+{
+    std::uint32_t size = static_cast<std::uint32_t>(len);
+    binary_put(out, size);
+    if (len)
+        binary_put(out, str, len);
+}
+
+/*!
+  引数の大きさの計算と書き込み.
+  整数は 64 ビットに広げ、文字列は長さと中身をコピーする
+ */
+template <typename T, typename Enabler = void>
+struct binary_encoder;
+
+template <typename T>
+struct binary_encoder<T, typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value && !std::is_same<T, char>::value>::type>
+{
+    static std::size_t size(T) noexcept { return 1 + 8; }
+    static void put(char *& out, T value) noexcept
+    {
+        binary_put(out, binary_arg::int64);
+        binary_put(out, static_cast<std::int64_t>(value));
+    }
+};
+
+template <typename T>
+struct binary_encoder<T, typename std::enable_if<std::is_integral<T>::value && std::is_unsigned<T>::value && !std::is_same<T, bool>::value>::type>
+{
+    static std::size_t size(T) noexcept { return 1 + 8; }
+    static void put(char *& out, T value) noexcept
+    {
+        binary_put(out, binary_arg::uint64);
+        binary_put(out, static_cast<std::uint64_t>(value));
+    }
+};
+
+template <typename T>
+struct binary_encoder<T, typename std::enable_if<std::is_floating_point<T>::value>::type>
+{
+    static std::size_t size(T) noexcept { return 1 + 8; }
+    static void put(char *& out, T value) noexcept
+    {
+        binary_put(out, binary_arg::float64);
+        binary_put(out, static_cast<double>(value));
+    }
+};
+
+template <>
+struct binary_encoder<bool>
+{
+    static std::size_t size(bool) noexcept { return 1 + 1; }
+    static void put(char *& out, bool value) noexcept
+    {
+        binary_put(out, binary_arg::boolean);
+        binary_put(out, static_cast<std::uint8_t>(value));
+    }
+};
+
+template <>
+struct binary_encoder<char>
+{
+    static std::size_t size(char) noexcept { return 1 + 1; }
+    static void put(char *& out, char value) noexcept
+    {
+        binary_put(out, binary_arg::character);
+        binary_put(out, value);
+    }
+};
+
+template <>
+struct binary_encoder<char const *>
+{
+    static std::size_t size(char const * str) noexcept { return 1 + 4 + binary_strlen(str); }
+    static void put(char *& out, char const * str) noexcept
+    {
+        binary_put(out, binary_arg::string);
+        binary_put_string(out, str, binary_strlen(str));
+    }
+};
+
+template <>
+struct binary_encoder<char *>
+    : binary_encoder<char const *>
+{
+};
+
+template <>
+struct binary_encoder<std::string>
+{
+    static std::size_t size(std::string const & str) noexcept { return 1 + 4 + str.size(); }
+    static void put(char *& out, std::string const & str) noexcept
+    {
+        binary_put(out, binary_arg::string);
+        binary_put_string(out, str.data(), str.size());
+    }
+};
+
+template <>
+struct binary_encoder<boost::string_view>
+{
+    static std::size_t size(boost::string_view str) noexcept { return 1 + 4 + str.size(); }
+    static void put(char *& out, boost::string_view str) noexcept
+    {
+        binary_put(out, binary_arg::string);
+        binary_put_string(out, str.data(), str.size());
+    }
+};
+
+template <typename T>
+struct binary_encoder<T *, typename std::enable_if<!std::is_same<typename std::remove_cv<T>::type, char>::value>::type>
+{
+    static std::size_t size(T *) noexcept { return 1 + 8; }
+    static void put(char *& out, T * ptr) noexcept
+    {
+        binary_put(out, binary_arg::pointer);
+        binary_put(out, static_cast<std::uint64_t>(reinterpret_cast<std::uintptr_t>(ptr)));
+    }
+};
+
+template <typename T>
+using binary_encoder_t = binary_encoder<typename std::decay<T>::type>;
+
+inline std::size_t binary_args_size() noexcept
+{
+    return 0;
+}
+
+template <typename T, typename... Args>
+inline std::size_t binary_args_size(T const & t, Args const &... args) noexcept
+{
+    return binary_encoder_t<T>::size(t) + binary_args_size(args...);
+}
+
+inline void binary_put_args(char *&) noexcept
+{
+}
+
+template <typename T, typename... Args>
+inline void binary_put_args(char *& out, T const & t, Args const &... args) noexcept
+{
+    binary_encoder_t<T>::put(out, t);
+    binary_put_args(out, args...);
+}
+
+} } }
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+namespace acqua { namespace log { namespace detail {
+
+/*!
+  ログバッファのスレッドごとのプール.
+
+  LOG の << の中でさらに LOG を呼び出しても良いように、入れ子の深さごとに1つのバッファを持つ。
+  バッファはスレッドの終了まで解放しないので、2行目以降はヒープの確保が起きない。
+ */
+template <typename Buffer>
+class buffer_pool
+{
+public:
+    static Buffer * acquire()
+    {
+        auto & pool = instance();
+        if (pool.depth_ == pool.buffers_.size())
+            pool.buffers_.emplace_back(new Buffer());
+        return pool.buffers_[pool.depth_++].get();
+    }
+
+    static void release(Buffer *) noexcept
+    {
+        --instance().depth_;
+    }
+
+private:
+    static buffer_pool & instance()
+    {
+        static thread_local buffer_pool pool;
+        return pool;
+    }
+
+private:
+    std::vector<std::unique_ptr<Buffer> > buffers_;
+    std::size_t depth_ = 0;
+};
+
+} } }
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include <cctype>
+#include <cstddef>
+
+namespace acqua { namespace log { namespace detail {
+
+/*!
+  ログの書式文字列を解析済みのフィールドの列に変換したもの.
+
+  logger::set_format() で一度だけ解析し、行ごとの整形ではフィールドを順に出力するだけにする。
+  先頭から秒単位でしか変化しないフィールドだけが続く範囲を prefix として記録しておき、
+  formatter は同じ秒の間、その範囲の出力をスレッドごとにキャッシュして再利用する。
+ */
+template <typename CharT>
+class compiled_format
+{
+public:
+    using string_type = std::basic_string<CharT>;
+
+    struct field
+    {
+        char code;          //!< 変換指定子. リテラルなら 0
+        bool left;          //!< '-' 指定
+        bool zero;          //!< '0' 指定
+        int width;          //!< 幅の指定. 指定なしなら 0
+        std::size_t pos;    //!< リテラルの text_ 上の位置
+        std::size_t len;    //!< リテラルの長さ
+    };
+
+    compiled_format()
+        : id_(next_id())
+    {
+    }
+
+    explicit compiled_format(string_type const & fmt)
+        : compiled_format()
+    {
+        compile(fmt);
+    }
+
+    void compile(string_type const & fmt)
+    {
+        text_ = fmt;
+        fields_.clear();
+        id_ = next_id();
+
+        std::size_t beg = 0, end;
+        while(beg < fmt.size()) {
+            if ((end = fmt.find('%', beg)) == string_type::npos)
+                end = fmt.size();
+            if (end > beg)
+                fields_.push_back(field{0, false, false, 0, beg, end - beg});
+            if (end++ >= fmt.size())
+                break;
+
+            field f{0, false, false, 0, 0, 0};
+            if (end < fmt.size() && fmt[end] == '-') {
+                f.left = true;
+                ++end;
+            }
+            if (end < fmt.size() && fmt[end] == '0') {
+                f.zero = true;
+                ++end;
+            }
+            while(end < fmt.size() && std::isdigit(static_cast<int>(fmt[end])))
+                f.width = f.width * 10 + static_cast<int>(fmt[end++] - '0');
+            if (end >= fmt.size())
+                break;
+            f.code = static_cast<char>(fmt[end++]);
+            fields_.push_back(f);
+            beg = end;
+        }
+
+        prefix_ = 0;
+        while(prefix_ < fields_.size() && is_second_field(fields_[prefix_].code))
+            ++prefix_;
+    }
+
+    string_type const & str() const noexcept
+    {
+        return text_;
+    }
+
+    std::vector<field> const & fields() const noexcept
+    {
+        return fields_;
+    }
+
+    //! 先頭から、秒単位でしか変化しないフィールドの数
+    std::size_t prefix() const noexcept
+    {
+        return prefix_;
+    }
+
+    //! compile() ごとに変わる識別子. スレッドごとのキャッシュの照合に使う
+    unsigned int id() const noexcept
+    {
+        return id_;
+    }
+
+    CharT const * literal(field const & f) const noexcept
+    {
+        return text_.data() + f.pos;
+    }
+
+private:
+    static unsigned int next_id() noexcept
+    {
+        static std::atomic<unsigned int> id{0};
+        return ++id;
+    }
+
+    static bool is_second_field(char code) noexcept
+    {
+        switch(code) {
+            case 0: case '%':
+            case 'A': case 'a': case 'B': case 'b': case 'C':
+            case 'd': case 'F': case 'H': case 'I': case 'j': case 'M': case 'm':
+            case 'S': case 'T': case 'W': case 'w': case 'Y': case 'y': case 'Z': case 'z':
+                return true;
+            default:
+                return false;
+        }
+    }
+
+private:
+    string_type text_;
+    std::vector<field> fields_;
+    std::size_t prefix_ = 0;
+    unsigned int id_;
+};
+
+} } }
@@ -1,12 +1,15 @@
 #pragma once
 
 #include <ctime>
+#include <chrono>
 #include <locale>
 #include <iomanip>
 #include "boost/date_time/time_zone_base.hpp"
 #include <boost/date_time/gregorian/gregorian.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/date_time/local_time/local_time.hpp>
+#include <acqua/log/detail/compiled_format.hpp>
+#include <acqua/log/detail/string_ostream.hpp>
 
 namespace acqua { namespace log { namespace detail {
 
@@ -24,177 +27,228 @@ class formatter<Derived, boost::posix_time::ptime>
     using zone = boost::local_time::time_zone_ptr;
 
 public:
+    /*!
+      現在のローカル時刻を返す.
+      localtime_r() は秒が変わったときだけ呼び出し、同じ秒の間はスレッドごとにキャッシュした値にマイクロ秒を足す
+     */
     static ptime now()
     {
-        return boost::posix_time::microsec_clock::local_time();
+        struct cache_type
+        {
+            std::time_t sec = -1;
+            ptime base;
+        };
+        static thread_local cache_type cache;
+
+        auto usec = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+        std::time_t sec = static_cast<std::time_t>(usec / 1000000);
+        if (sec != cache.sec) {
+            std::tm tm;
+            ::localtime_r(&sec, &tm);
+            cache.base = boost::posix_time::ptime_from_tm(tm);
+            cache.sec = sec;
+        }
+        return cache.base + boost::posix_time::microseconds(usec % 1000000);
     }
 
     static zone tz()
     {
         // TODO:
-        return zone(new boost::local_time::posix_time_zone("JST-9"));
+        static zone const z(new boost::local_time::posix_time_zone("JST-9"));
+        return z;
+    }
+
+    template <typename Out, typename CharT>
+    void format(Out & os, std::basic_string<CharT> const & fmt)
+    {
+        format(os, compiled_format<CharT>(fmt));
     }
 
-    template <typename Out, typename Fmt>
-    void format(Out & os, Fmt const & fmt)
+    /*!
+      解析済みの書式で整形する.
+      先頭の秒単位のフィールドは、同じ書式、同じ秒であれば前回の出力をそのまま書き込む
+     */
+    template <typename Out, typename CharT>
+    void format(Out & os, compiled_format<CharT> const & fmt)
     {
+        struct cache_type
+        {
+            unsigned int id = 0;
+            std::int64_t sec = -1;
+            string_ostream<CharT> text;
+        };
+        static thread_local cache_type cache;
+
         ptime now = static_cast<Derived *>(this)->now();
         date d = now.date();
         time t = now.time_of_day();
         zone z;
 
-        std::size_t end = 0, beg;
-        do {
-            beg = end;
-            if ((end = fmt.find('%', beg) + 1) == 0)
-                end = fmt.size() + 1;
-            os.write(fmt.c_str() + beg, end - beg - 1);
-
-            if (end < fmt.size() && fmt[end] == '-') {
-                os << std::left;
-                ++end;
-            }
-
-          CONTINUE:
-            if (end >= fmt.size())
-                break;
-            switch(fmt[end++]) {
-                case '0':
-                    os << std::setfill('0');
-                case '1' ... '9': {
-                    int w = fmt[end-1] - '0';
-                    while(std::isdigit(fmt[end]))
-                        w = w * 10 + fmt[end++] - '0';
-                    os << std::setw(w);
-                    goto CONTINUE;
-                }
-                case '%':
-                    os << '%';
-                    break;
-                case 'A':
-                    static_cast<Derived *>(this)->replace_weekday_name(os, d);
-                    break;
-                case 'a':
-                    static_cast<Derived *>(this)->replace_abbreviated_weekday_name(os, d);
-                    break;
-                case 'B':
-                    static_cast<Derived *>(this)->replace_month_name(os, d);
-                    break;
-                case 'b':
-                    static_cast<Derived *>(this)->replace_abbreviated_month_name(os, d);
-                    break;
-                case 'C':
-                    static_cast<Derived *>(this)->replace_century(os, d);
-                    break;
-                case 'c':
-                    static_cast<Derived *>(this)->replace_date_time(os, now);
-                    break;
-              //case 'D':
-                case 'd':
-                    static_cast<Derived *>(this)->replace_day(os, d);
-                    break;
-              //case 'E':
-              //case 'e':
-                case 'F':
-                    static_cast<Derived *>(this)->replace_simple_date_string(os, d);
-                    break;
-                case 'f':  // extends
-                    static_cast<Derived *>(this)->replace_logger_function(os);
-                    break;
-                case 'H':
-                    static_cast<Derived *>(this)->replace_24_hour_clock(os, t);
-                    break;
-              //case 'h':
-                case 'I':
-                    static_cast<Derived *>(this)->replace_12_hour_clock(os, t);
-                    break;
-                case 'i':   // extends
-                    static_cast<Derived *>(this)->replace_logger_info(os);
-                    break;
-              //case 'J':
-                case 'j':
-                    static_cast<Derived *>(this)->replace_day_of_year(os, d);
-                    break;
-             // case 'K':
-             // case 'k':
-                case 'L':  // extends
-                    static_cast<Derived *>(this)->replace_level_name(os);
-                    break;
-                case 'l':  // extends
-                    static_cast<Derived *>(this)->replace_logger_location(os);
-                    break;
-                case 'M':
-                    static_cast<Derived *>(this)->replace_minute(os, t);
-                    break;
-                case 'm':
-                    static_cast<Derived *>(this)->replace_month(os, d);
-                    break;
-             // case 'N':
-             // case 'n':
-             // case 'O':
-             // case 'o':
-                case 'P':
-                    //static_cast<Derived *>(this)->replace_am_pm_string(os, now);
-                    break;
-                case 'p':
-                    //static_cast<Derived *>(this)->replace_lower_am_pm_string(os, now);
-                    break;
-             // case 'Q':
-             // case 'q':
-             // case 'R':
-             // case 'r':
-                case 'S':
-                    static_cast<Derived *>(this)->replace_second(os, t);
-                    break;
-                case 's':
-                    //static_cast<Derived *>(this)->replace_unix_epoch(os, now);
-                    break;
-                case 'T':
-                    static_cast<Derived *>(this)->replace_simple_time_string(os, t);
-                    break;
-                case 't':  // extends
-                    static_cast<Derived *>(this)->replace_thread_id(os);
-                    break;
-                case 'U':  // extends
-                    static_cast<Derived *>(this)->replace_millisecond(os, t);
-                    break;
-                case 'u':  // extends
-                    static_cast<Derived *>(this)->replace_microsecond(os, t);
-                    break;
-              //case 'V':
-                case 'v':  // extends
-                    static_cast<Derived *>(this)->replace_logger_message(os);
-                    break;
-                case 'W':
-                    static_cast<Derived *>(this)->replace_week_of_year(os, d);
-                    break;
-                case 'w':
-                    static_cast<Derived *>(this)->replace_day_of_week(os, d);
-                    break;
-              //case 'X':
-              //case 'x':
-                case 'Y':
-                    static_cast<Derived *>(this)->replace_year(os, d);
-                    break;
-                case 'y':
-                    static_cast<Derived *>(this)->replace_year_without_century(os, d);
-                    break;
-                case 'Z':
-                    if (!z) z = static_cast<Derived *>(this)->tz();
-                    static_cast<Derived *>(this)->replace_time_zone_name(os, z);
-                    break;
-                case 'z':
-                    if (!z) z = static_cast<Derived *>(this)->tz();
-                    static_cast<Derived *>(this)->replace_base_utc_offset(os, z);
-                    break;
-                default:
-                    os << '%' << fmt[end];
-                    break;
+        auto const & fields = fmt.fields();
+        std::size_t i = 0;
+        if (fmt.prefix() > 0) {
+            std::int64_t sec = static_cast<std::int64_t>(d.day_number()) * 86400 + t.total_seconds();
+            if (cache.id != fmt.id() || cache.sec != sec) {
+                cache.text.reset();
+                for(; i < fmt.prefix(); ++i)
+                    format_field(cache.text, fmt, fields[i], now, d, t, z);
+                cache.id = fmt.id();
+                cache.sec = sec;
             }
-        } while(true);
+            os.write(cache.text.str().data(), static_cast<std::streamsize>(cache.text.str().size()));
+            i = fmt.prefix();
+        }
+        for(; i < fields.size(); ++i)
+            format_field(os, fmt, fields[i], now, d, t, z);
     }
 
 private:
+    template <typename Out, typename Field, typename CharT>
+    void format_field(Out & os, compiled_format<CharT> const & fmt, Field const & f, ptime const & now, date const & d, time const & t, zone & z)
+    {
+        if (f.code == 0) {
+            os.write(fmt.literal(f), static_cast<std::streamsize>(f.len));
+            return;
+        }
+
+        if (f.left)
+            os.setf(std::ios_base::left, std::ios_base::adjustfield);
+        if (f.zero)
+            os.fill(os.widen('0'));
+        if (f.width)
+            os.width(f.width);
+
+        switch(f.code) {
+            case '%':
+                os << '%';
+                break;
+            case 'A':
+                static_cast<Derived *>(this)->replace_weekday_name(os, d);
+                break;
+            case 'a':
+                static_cast<Derived *>(this)->replace_abbreviated_weekday_name(os, d);
+                break;
+            case 'B':
+                static_cast<Derived *>(this)->replace_month_name(os, d);
+                break;
+            case 'b':
+                static_cast<Derived *>(this)->replace_abbreviated_month_name(os, d);
+                break;
+            case 'C':
+                static_cast<Derived *>(this)->replace_century(os, d);
+                break;
+            case 'c':
+                static_cast<Derived *>(this)->replace_date_time(os, now);
+                break;
+          //case 'D':
+            case 'd':
+                static_cast<Derived *>(this)->replace_day(os, d);
+                break;
+          //case 'E':
+          //case 'e':
+            case 'F':
+                static_cast<Derived *>(this)->replace_simple_date_string(os, d);
+                break;
+            case 'f':  // extends
+                static_cast<Derived *>(this)->replace_logger_function(os);
+                break;
+            case 'H':
+                static_cast<Derived *>(this)->replace_24_hour_clock(os, t);
+                break;
+          //case 'h':
+            case 'I':
+                static_cast<Derived *>(this)->replace_12_hour_clock(os, t);
+                break;
+            case 'i':   // extends
+                static_cast<Derived *>(this)->replace_logger_info(os);
+                break;
+          //case 'J':
+            case 'j':
+                static_cast<Derived *>(this)->replace_day_of_year(os, d);
+                break;
+         // case 'K':
+         // case 'k':
+            case 'L':  // extends
+                static_cast<Derived *>(this)->replace_level_name(os);
+                break;
+            case 'l':  // extends
+                static_cast<Derived *>(this)->replace_logger_location(os);
+                break;
+            case 'M':
+                static_cast<Derived *>(this)->replace_minute(os, t);
+                break;
+            case 'm':
+                static_cast<Derived *>(this)->replace_month(os, d);
+                break;
+         // case 'N':
+         // case 'n':
+         // case 'O':
+         // case 'o':
+            case 'P':
+                //static_cast<Derived *>(this)->replace_am_pm_string(os, now);
+                break;
+            case 'p':
+                //static_cast<Derived *>(this)->replace_lower_am_pm_string(os, now);
+                break;
+         // case 'Q':
+         // case 'q':
+         // case 'R':
+         // case 'r':
+            case 'S':
+                static_cast<Derived *>(this)->replace_second(os, t);
+                break;
+            case 's':
+                //static_cast<Derived *>(this)->replace_unix_epoch(os, now);
+                break;
+            case 'T':
+                static_cast<Derived *>(this)->replace_simple_time_string(os, t);
+                break;
+            case 't':  // extends
+                static_cast<Derived *>(this)->replace_thread_id(os);
+                break;
+            case 'U':  // extends
+                static_cast<Derived *>(this)->replace_millisecond(os, t);
+                break;
+            case 'u':  // extends
+                static_cast<Derived *>(this)->replace_microsecond(os, t);
+                break;
+          //case 'V':
+            case 'v':  // extends
+                static_cast<Derived *>(this)->replace_logger_message(os);
+                break;
+            case 'W':
+                static_cast<Derived *>(this)->replace_week_of_year(os, d);
+                break;
+            case 'w':
+                static_cast<Derived *>(this)->replace_day_of_week(os, d);
+                break;
+          //case 'X':
+          //case 'x':
+            case 'Y':
+                static_cast<Derived *>(this)->replace_year(os, d);
+                break;
+            case 'y':
+                static_cast<Derived *>(this)->replace_year_without_century(os, d);
+                break;
+            case 'Z':
+                if (!z) z = static_cast<Derived *>(this)->tz();
+                static_cast<Derived *>(this)->replace_time_zone_name(os, z);
+                break;
+            case 'z':
+                if (!z) z = static_cast<Derived *>(this)->tz();
+                static_cast<Derived *>(this)->replace_base_utc_offset(os, z);
+                break;
+            default:
+                os << '%' << f.code;
+                break;
+        }
+
+        if (f.left)
+            os.unsetf(std::ios_base::adjustfield);
+        if (f.zero)
+            os.fill(os.widen(' '));
+    }
+
     static void replace_weekday_name(os & os, date const & now) { os << now.day_of_week().as_long_string(); }
     static void replace_weekday_name(wos & os, date const & now) { os << now.day_of_week().as_long_wstring(); }
     static void replace_abbreviated_weekday_name(os & os, date const & now) { os << now.day_of_week().as_short_string(); }
@@ -205,7 +259,18 @@ private:
     static void replace_abbreviated_month_name(wos & os, date const & now) { os << now.month().as_long_wstring(); }
     template <typename Out> static void replace_date_time(Out & os, ptime const & now) { os << now; }
     template <typename Out> static void replace_day(Out & os, date const & now) { os << now.day(); }
-    template <typename Out> static void replace_simple_date_string(Out & os, date const & now) { os << boost::gregorian::to_iso_extended_string(now); }
+    template <typename Out> static void replace_simple_date_string(Out & os, date const & now)
+    {
+        auto ymd = now.year_month_day();
+        typename Out::char_type str[11];
+        write_digits(str, 4, ymd.year);
+        str[4] = '-';
+        write_digits(str + 5, 2, ymd.month);
+        str[7] = '-';
+        write_digits(str + 8, 2, ymd.day);
+        str[10] = 0;
+        os << str;
+    }
     template <typename Out> static void replace_24_hour_clock(Out & os, time const & now) { os << now.hours(); }
     template <typename Out> static void replace_12_hour_clock(Out & os, time const & now) { os << (now.hours() % 12); }
     template <typename Out> static void replace_day_of_year(Out & os, date const & now) { os << now.day_of_year(); }
@@ -253,13 +318,37 @@ private:
         tz[5] = 0;
         os << tz;
     }
-    template <typename Out> static void replace_millisecond(Out & os, time const & now) { os << std::setfill('0') << std::setw(3) << now.total_milliseconds() % 1000; }
-    template <typename Out> static void replace_microsecond(Out & os, time const & now) { os << std::setfill('0') << std::setw(6) << now.total_microseconds() % 1000000; }
+    template <typename Out> static void replace_millisecond(Out & os, time const & now)
+    {
+        typename Out::char_type str[4];
+        write_digits(str, 3, static_cast<unsigned long>(now.total_milliseconds() % 1000));
+        str[3] = 0;
+        os << str;
+    }
+    template <typename Out> static void replace_microsecond(Out & os, time const & now)
+    {
+        typename Out::char_type str[7];
+        write_digits(str, 6, static_cast<unsigned long>(now.total_microseconds() % 1000000));
+        str[6] = 0;
+        os << str;
+    }
+    //! 0 埋めした n 桁の10進数を書き込む
+    template <typename Char> static void write_digits(Char * str, int n, unsigned long value)
+    {
+        while(n-- > 0) {
+            str[n] = static_cast<Char>('0' + value % 10);
+            value /= 10;
+        }
+    }
     template <typename Out> static void replace_century(Out & os, date const & now) { os << (now.year() / 100 + 1); }
 
     template <typename Out> void replace_level_name(Out & os) const { os << static_cast<Derived const *>(this)->level; }
     template <typename Out> void replace_abbreviated_level_name(Out & os) const { os << severity_symbol(static_cast<Derived const *>(this)->level); }
-    template <typename Out> void replace_logger_message(Out & os) { os << &static_cast<Derived *>(this)->buffer; }
+    template <typename Out> void replace_logger_message(Out & os)
+    {
+        auto const & msg = static_cast<Derived *>(this)->message();
+        os.write(msg.data(), static_cast<std::streamsize>(msg.size()));
+    }
     template <typename Out> void replace_thread_id(Out & os) { os << static_cast<Derived *>(this)->tid; }
     template <typename Out> void replace_logger_info(Out &) {}
     template <typename Out> void replace_logger_location(Out & os) const
@@ -3,12 +3,20 @@
 #include <utility>
 #include <memory>
 #include <type_traits>
+#include <acqua/log/detail/buffer_pool.hpp>
 
 namespace acqua { namespace log { namespace detail {
 
 //! マニピュレータタグ
 struct manip_tag {};
 
+//! LOG マクロの条件演算子で、両辺の型を void に揃える
+struct voidify
+{
+    template <typename T>
+    void operator&(T const &) const noexcept {}
+};
+
 template <typename Logger, typename Buffer>
 class line_logger
 {
@@ -19,14 +27,18 @@ public:
     line_logger(line_logger const &) = delete;
 
     line_logger(line_logger && rhs)
-        : logger_(rhs.logger_), buffer_(std::move(rhs.buffer_)) {}
+        : logger_(rhs.logger_), buffer_(rhs.buffer_)
+    {
+        rhs.buffer_ = nullptr;
+    }
 
     ~line_logger()
     {
         if (buffer_) {
             try {
-                logger_.write(std::move(buffer_));
+                logger_.write(*buffer_);
             } catch(...) {}
+            buffer_pool<Buffer>::release(buffer_);
         }
     }
 
@@ -39,7 +51,7 @@ public:
 
 private:
     Logger & logger_;
-    std::unique_ptr<Buffer> buffer_;
+    Buffer * buffer_;
 };
 
 
@@ -1,39 +1,57 @@
 #pragma once
 
-#include <sstream>
 #include <thread>
+#include <typeinfo>
 #include <boost/core/demangle.hpp>
 #include <acqua/log/severity.hpp>
 #include <acqua/log/detail/formatter.hpp>
+#include <acqua/log/detail/string_ostream.hpp>
 
 namespace acqua { namespace log { namespace detail {
 
 template <typename CharT>
 struct loggable_buffer
-    : std::basic_ostream<CharT>
+    : string_ostream<CharT>
     , formatter< loggable_buffer<CharT>, boost::posix_time::ptime>
 {
+    loggable_buffer() = default;
+
     explicit loggable_buffer(severity_type level, char const * func, char const * file, unsigned int line, std::type_info const & type)
-        : std::basic_ostream<CharT>(&buffer)
-        , level(level)
-        , func(func)
-        , file(file)
-        , line(line)
-        , type(type)
-        , tid(std::this_thread::get_id()) {}
-
-    std::basic_stringbuf<CharT> buffer;
-    severity_type level;
-    char const * func;
-    char const * file;
-    unsigned int line;
-    std::type_info const & type;
+    {
+        reset(level, func, file, line, type);
+    }
+
+    //! バッファを使い回すために、文字列の容量を残して初期化する
+    void reset(severity_type level, char const * func, char const * file, unsigned int line, std::type_info const & type)
+    {
+        string_ostream<CharT>::reset();
+        this->level = level;
+        this->func = func;
+        this->file = file;
+        this->line = line;
+        this->type = &type;
+        tid = std::this_thread::get_id();
+    }
+
+    std::basic_string<CharT> const & message() const noexcept
+    {
+        return this->str();
+    }
+
+    severity_type level = trace;
+    char const * func = "";
+    char const * file = "";
+    unsigned int line = 0;
+    std::type_info const * type = &typeid(void);
     std::thread::id tid;
 
+    //! 整形した1行の出力先
+    string_ostream<CharT> output;
+
     template <typename Out>
     void replace_logger_info(Out & os) const
     {
-        boost::core::scoped_demangled_name name(type.name());
+        boost::core::scoped_demangled_name name(type->name());
         std::copy_n(name.get(), std::strlen(name.get()), std::ostreambuf_iterator<typename Out::char_type>(os));
     }
 };
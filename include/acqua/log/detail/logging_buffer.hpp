@@ -1,28 +1,48 @@
 #pragma once
 
-#include <sstream>
 #include <thread>
 #include <acqua/log/severity.hpp>
 #include <acqua/log/detail/formatter.hpp>
+#include <acqua/log/detail/string_ostream.hpp>
 
 namespace acqua { namespace log { namespace detail {
 
 template <typename CharT>
 struct logging_buffer
-    : std::basic_ostream<CharT>
+    : string_ostream<CharT>
     , formatter< logging_buffer<CharT>, boost::posix_time::ptime>
 {
+    logging_buffer() = default;
+
     explicit logging_buffer(severity_type level, char const * func, char const * file, unsigned int line)
-        : std::basic_ostream<CharT>(&buffer)
-        , level(level), func(func), file(file), line(line)
-        , tid(std::this_thread::get_id()) {}
-
-    std::basic_stringbuf<CharT> buffer;
-    severity_type level;
-    char const * func;
-    char const * file;
-    unsigned int line;
+    {
+        reset(level, func, file, line);
+    }
+
+    //! バッファを使い回すために、文字列の容量を残して初期化する
+    void reset(severity_type level, char const * func, char const * file, unsigned int line)
+    {
+        string_ostream<CharT>::reset();
+        this->level = level;
+        this->func = func;
+        this->file = file;
+        this->line = line;
+        tid = std::this_thread::get_id();
+    }
+
+    std::basic_string<CharT> const & message() const noexcept
+    {
+        return this->str();
+    }
+
+    severity_type level = trace;
+    char const * func = "";
+    char const * file = "";
+    unsigned int line = 0;
     std::thread::id tid;
+
+    //! 整形した1行の出力先
+    string_ostream<CharT> output;
 };
 
 } } }
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <utility>
+#include <cstddef>
+#include <cstdint>
+#include <boost/noncopyable.hpp>
+
+namespace acqua { namespace log { namespace detail {
+
+/*!
+  固定長のロックフリーなリングバッファ.
+
+  各セルにシーケンス番号を持たせ、書き込み位置と読み込み位置を CAS で進める。
+  主に複数スレッドから push() し、書き込みスレッドが pop() する用途だが、
+  drop-oldest のために書き込み側から pop() しても壊れない。
+  要素は swap で出し入れするので、T は noexcept でスワップできなければならない。
+ */
+template <typename T>
+class mpsc_ring
+    : private boost::noncopyable
+{
+    struct cell
+    {
+        std::atomic<std::size_t> seq;
+        T data;
+    };
+
+public:
+    //! capacity は 2 のべき乗に切り上げる
+    explicit mpsc_ring(std::size_t capacity)
+        : mask_(round_up(capacity) - 1)
+        , cells_(new cell[mask_ + 1])
+    {
+        for(std::size_t i = 0; i <= mask_; ++i)
+            cells_[i].seq.store(i, std::memory_order_relaxed);
+    }
+
+    std::size_t capacity() const noexcept
+    {
+        return mask_ + 1;
+    }
+
+    //! 空きがあれば t と入れ替えて true を返す. 満杯なら何もせずに false を返す
+    bool try_push(T & t) noexcept
+    {
+        std::size_t pos = tail_.load(std::memory_order_relaxed);
+        cell * c;
+        while(true) {
+            c = &cells_[pos & mask_];
+            auto diff = static_cast<std::intptr_t>(c->seq.load(std::memory_order_acquire)) - static_cast<std::intptr_t>(pos);
+            if (diff == 0) {
+                if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = tail_.load(std::memory_order_relaxed);
+            }
+        }
+        using std::swap;
+        swap(c->data, t);
+        c->seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    //! 先頭の要素を t と入れ替えて true を返す. 空なら false を返す
+    bool try_pop(T & t) noexcept
+    {
+        std::size_t pos = head_.load(std::memory_order_relaxed);
+        cell * c;
+        while(true) {
+            c = &cells_[pos & mask_];
+            auto diff = static_cast<std::intptr_t>(c->seq.load(std::memory_order_acquire)) - static_cast<std::intptr_t>(pos + 1);
+            if (diff == 0) {
+                if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = head_.load(std::memory_order_relaxed);
+            }
+        }
+        using std::swap;
+        swap(c->data, t);
+        c->seq.store(pos + mask_ + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool empty() const noexcept
+    {
+        std::size_t pos = head_.load(std::memory_order_acquire);
+        return cells_[pos & mask_].seq.load(std::memory_order_acquire) != pos + 1;
+    }
+
+private:
+    static std::size_t round_up(std::size_t n) noexcept
+    {
+        std::size_t size = 2;
+        while(size < n)
+            size <<= 1;
+        return size;
+    }
+
+private:
+    std::size_t const mask_;
+    std::unique_ptr<cell[]> cells_;
+    std::atomic<std::size_t> tail_{0};
+    char padding_[64 - sizeof(std::atomic<std::size_t>)];  // 書き込み位置と読み込み位置を別のキャッシュラインに置く
+    std::atomic<std::size_t> head_{0};
+};
+
+} } }
@@ -0,0 +1,310 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <thread>
+#include <utility>
+#include <condition_variable>
+#include <boost/noncopyable.hpp>
+
+namespace acqua { namespace log { namespace detail {
+
+/*!
+  呼び出し元ごとの間引きの状態.
+
+  LOG_EVERY_N などのマクロが呼び出し元ごとに static に持つ。
+  admit() は出力してよければ true を返し、それまでに捨てた行数を suppressed_count() に残す。
+  捨てた行数は、次に出力する行の先頭に "(N suppressed) " として書き出す。
+  次の行が出力されないまま時間が経った場合は、suppressed_reporter が定期的に "(N suppressed)" の行を書き出す。
+ */
+inline std::uint64_t & suppressed_count() noexcept
+{
+    static thread_local std::uint64_t count = 0;
+    return count;
+}
+
+//! line_logger に流すと、直前の admit() までに捨てた行数を書き出す
+struct suppressed_note {};
+
+template <typename CharT, typename Traits>
+inline std::basic_ostream<CharT, Traits> & operator<<(std::basic_ostream<CharT, Traits> & os, suppressed_note)
+{
+    auto & count = suppressed_count();
+    if (count > 0) {
+        os << '(' << count << " suppressed) ";
+        count = 0;
+    }
+    return os;
+}
+
+//! Clock の現在時刻をナノ秒で返す
+template <typename Clock>
+inline std::int64_t clock_now() noexcept
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+}
+
+
+/*!
+  間引きの基底クラス. 捨てた行数を数え、suppressed_reporter に登録されて定期的に報告する.
+
+  登録したサイトはプログラムの終了まで破棄されないので、リストからは取り除かない
+ */
+class limiter_base
+    : private boost::noncopyable
+{
+    friend class suppressed_reporter;
+
+public:
+    //! 捨てた行数を、呼び出し元のロガーに書き出す関数
+    using report_type = void (*)(char const * func, std::uint64_t count);
+
+protected:
+    limiter_base() = default;
+
+    void suppress() noexcept
+    {
+        suppressed_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    //! 出力する行に、それまでに捨てた行数を渡す
+    void admitted() noexcept
+    {
+        suppressed_count() = suppressed_.exchange(0, std::memory_order_relaxed);
+    }
+
+    void attach(char const * func, report_type reporter) noexcept;
+
+private:
+    void report()
+    {
+        std::uint64_t count = suppressed_.exchange(0, std::memory_order_relaxed);
+        if (count > 0)
+            report_(func_, count);
+    }
+
+private:
+    std::atomic<std::uint64_t> suppressed_{0};
+    char const * func_ = "";
+    report_type report_ = nullptr;
+    limiter_base * next_ = nullptr;
+};
+
+
+/*!
+  捨てた行数を定期的に書き出すクラス.
+
+  最初のサイトが登録されたときに専用のスレッドを起動し、interval() ごとに report() を呼び出す。
+  interval() を 0 にするとスレッドは何もしないので、report() を明示的に呼び出すこと
+ */
+class suppressed_reporter
+    : private boost::noncopyable
+{
+public:
+    static suppressed_reporter & instance()
+    {
+        static suppressed_reporter reporter;
+        return reporter;
+    }
+
+    ~suppressed_reporter()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+            cond_.notify_one();
+        }
+        if (thread_.joinable())
+            thread_.join();
+    }
+
+    void attach(limiter_base & site)
+    {
+        limiter_base * head = head_.load(std::memory_order_relaxed);
+        do {
+            site.next_ = head;
+        } while(!head_.compare_exchange_weak(head, &site, std::memory_order_release, std::memory_order_relaxed));
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!thread_.joinable())
+            thread_ = std::thread(&suppressed_reporter::run, this);
+    }
+
+    //! 登録されたすべてのサイトについて、前回から捨てた行数があれば書き出す
+    void report()
+    {
+        for(limiter_base * site = head_.load(std::memory_order_acquire); site; site = site->next_)
+            site->report();
+    }
+
+    void interval(std::chrono::nanoseconds value)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        interval_ = value;
+        cond_.notify_one();
+    }
+
+    std::chrono::nanoseconds interval() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return interval_;
+    }
+
+private:
+    suppressed_reporter() = default;
+
+    void run()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while(!stop_) {
+            if (interval_.count() <= 0) {
+                cond_.wait(lock);
+            } else if (cond_.wait_for(lock, interval_) == std::cv_status::timeout) {
+                lock.unlock();
+                try {
+                    report();
+                } catch(...) {}
+                lock.lock();
+            }
+        }
+    }
+
+private:
+    std::atomic<limiter_base *> head_{nullptr};
+    std::chrono::nanoseconds interval_ = std::chrono::seconds(1);
+    bool stop_ = false;
+    mutable std::mutex mutex_;
+    std::condition_variable cond_;
+    std::thread thread_;
+};
+
+inline void limiter_base::attach(char const * func, report_type reporter) noexcept
+{
+    func_ = func;
+    report_ = reporter;
+    try {
+        suppressed_reporter::instance().attach(*this);
+    } catch(...) {}
+}
+
+
+/*!
+  呼び出し元ごとに static に持つ間引きの状態.
+  Limiter を引数で初期化し、捨てた行数を書き出す report とともに suppressed_reporter に登録する
+ */
+template <typename Limiter>
+class limiter_site
+    : public Limiter
+{
+public:
+    template <typename... Args>
+    limiter_site(char const * func, limiter_base::report_type reporter, Args &&... args)
+        : Limiter(std::forward<Args>(args)...)
+    {
+        this->attach(func, reporter);
+    }
+};
+
+
+//! n 回に1回だけ出力する.
+class every_n_limiter
+    : public limiter_base
+{
+public:
+    explicit every_n_limiter(std::uint64_t n) noexcept
+        : n_(n > 0 ? n : 1) {}
+
+    bool admit() noexcept
+    {
+        if (count_.fetch_add(1, std::memory_order_relaxed) % n_ != 0) {
+            suppress();
+            return false;
+        }
+        admitted();
+        return true;
+    }
+
+private:
+    std::uint64_t const n_;
+    std::atomic<std::uint64_t> count_{0};
+};
+
+
+//! interval ごとに、最初の n 行だけを出力する. 時刻は Clock から取得する
+template <typename Clock = std::chrono::steady_clock>
+class first_n_limiter
+    : public limiter_base
+{
+public:
+    template <typename Rep, typename Period>
+    first_n_limiter(std::uint64_t n, std::chrono::duration<Rep, Period> interval) noexcept
+        : n_(n)
+        , interval_(std::max<std::int64_t>(1, std::chrono::duration_cast<std::chrono::nanoseconds>(interval).count())) {}
+
+    bool admit() noexcept
+    {
+        std::int64_t window = clock_now<Clock>() / interval_;
+        std::int64_t current = window_.load(std::memory_order_relaxed);
+        if (window != current && window_.compare_exchange_strong(current, window, std::memory_order_relaxed))
+            count_.store(0, std::memory_order_relaxed);
+
+        if (count_.fetch_add(1, std::memory_order_relaxed) >= n_) {
+            suppress();
+            return false;
+        }
+        admitted();
+        return true;
+    }
+
+private:
+    std::uint64_t const n_;
+    std::int64_t const interval_;
+    std::atomic<std::int64_t> window_{-1};
+    std::atomic<std::uint64_t> count_{0};
+};
+
+
+/*!
+  トークンバケット. 1秒あたり rate 行、最大 burst 行まで続けて出力する. 時刻は Clock から取得する.
+
+  GCRA (Generic Cell Rate Algorithm) で、次の行が出力できる理論上の時刻だけを持つので、
+  1つのアトミック変数の compare-and-swap で判定できる。
+ */
+template <typename Clock = std::chrono::steady_clock>
+class token_bucket_limiter
+    : public limiter_base
+{
+public:
+    token_bucket_limiter(double rate, std::uint64_t burst) noexcept
+        : period_(static_cast<std::int64_t>(1e9 / (rate > 0 ? rate : 1e-9)))
+        , tolerance_(period_ * static_cast<std::int64_t>(burst > 0 ? burst - 1 : 0)) {}
+
+    bool admit() noexcept
+    {
+        std::int64_t now = clock_now<Clock>();
+        std::int64_t tat = tat_.load(std::memory_order_relaxed);
+        std::int64_t next;
+        do {
+            std::int64_t base = (tat > now) ? tat : now;
+            if (base - now > tolerance_) {
+                suppress();
+                return false;
+            }
+            next = base + period_;
+        } while(!tat_.compare_exchange_weak(tat, next, std::memory_order_relaxed));
+
+        admitted();
+        return true;
+    }
+
+private:
+    std::int64_t const period_;
+    std::int64_t const tolerance_;
+    std::atomic<std::int64_t> tat_{0};
+};
+
+} } }
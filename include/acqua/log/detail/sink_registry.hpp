@@ -0,0 +1,175 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include <boost/noncopyable.hpp>
+
+namespace acqua { namespace log { namespace detail {
+
+/*!
+  ロガーに登録されたシンクの一覧.
+
+  一覧は変更のたびにコピーして差し替える (copy-on-write)。
+  書き込み側は、現在の世代のカウンタを増やしてから一覧を読むだけなので、ロックを取らない。
+  変更側は、世代を進めてから古い世代のカウンタが 0 になるのを待ち、古い一覧を解放する。
+
+  シンクの write() の中から同じ一覧を変更すると、自分自身が抜けるのを待つことになるので、
+  変更する関数は std::logic_error を投げる。ローテートなどの処理はシンクの中で完結させること。
+ */
+template <typename Sink>
+class sink_registry
+    : private boost::noncopyable
+{
+public:
+    using list_type = std::vector< std::shared_ptr<Sink> >;
+
+    sink_registry()
+        : list_(new list_type())
+    {
+    }
+
+    ~sink_registry()
+    {
+        delete list_.load();
+    }
+
+    //! 登録されているすべてのシンクについて f を呼び出す. 任意のスレッドから呼び出せる
+    template <typename F>
+    void for_each(F f) const
+    {
+        reading_guard guard(*this);
+        for(auto const & sink : *list_.load())
+            f(*sink);
+    }
+
+    //! sink を末尾に追加する. 登録済みであれば false を返す
+    bool push(std::shared_ptr<Sink> sink)
+    {
+        return update([&sink](list_type & list) {
+                if (std::find(list.begin(), list.end(), sink) != list.end())
+                    return false;
+                list.push_back(std::move(sink));
+                return true;
+            });
+    }
+
+    //! 末尾のシンクを取り除く.
+    bool pop()
+    {
+        return update([](list_type & list) {
+                if (list.empty())
+                    return false;
+                list.pop_back();
+                return true;
+            });
+    }
+
+    //! sink を取り除く. 登録されていなければ false を返す
+    bool remove(Sink const & sink)
+    {
+        return update([&sink](list_type & list) {
+                auto it = std::find_if(list.begin(), list.end(), [&sink](std::shared_ptr<Sink> const & e) { return e.get() == &sink; });
+                if (it == list.end())
+                    return false;
+                list.erase(it);
+                return true;
+            });
+    }
+
+    std::size_t size() const
+    {
+        auto & readers = enter();
+        std::size_t size = list_.load()->size();
+        readers.fetch_sub(1);
+        return size;
+    }
+
+private:
+    //! このスレッドで for_each() 中の一覧. 入れ子になったものを、スタック上の要素でつなぐ
+    struct reading_frame
+    {
+        sink_registry const * registry_;
+        reading_frame * next_;
+    };
+
+    static reading_frame *& reading() noexcept
+    {
+        static thread_local reading_frame * top = nullptr;
+        return top;
+    }
+
+    class reading_guard
+        : private boost::noncopyable
+    {
+    public:
+        explicit reading_guard(sink_registry const & registry) noexcept
+            : readers_(registry.enter()), frame_{&registry, reading()}
+        {
+            reading() = &frame_;
+        }
+
+        ~reading_guard()
+        {
+            reading() = frame_.next_;
+            readers_.fetch_sub(1);
+        }
+
+    private:
+        std::atomic<std::size_t> & readers_;
+        reading_frame frame_;
+    };
+
+    bool is_reading() const noexcept
+    {
+        for(auto const * frame = reading(); frame; frame = frame->next_)
+            if (frame->registry_ == this)
+                return true;
+        return false;
+    }
+
+    std::atomic<std::size_t> & enter() const noexcept
+    {
+        while(true) {
+            unsigned int epoch = epoch_.load();
+            auto & readers = readers_[epoch & 1];
+            readers.fetch_add(1);
+            if (epoch_.load() == epoch)
+                return readers;
+            readers.fetch_sub(1);
+        }
+    }
+
+    template <typename Modify>
+    bool update(Modify modify)
+    {
+        if (is_reading())
+            throw std::logic_error("sink_registry: the sinks cannot be modified from a sink's write()");
+
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        std::unique_ptr<list_type> next(new list_type(*list_.load()));
+        if (!modify(*next))
+            return false;
+        std::unique_ptr<list_type> prev(list_.exchange(next.release()));
+
+        // 古い一覧を読んでいる可能性のある書き込み側が抜けるのを待つ
+        unsigned int epoch = epoch_.load();
+        epoch_.store(epoch + 1);
+        while(readers_[epoch & 1].load() != 0)
+            std::this_thread::yield();
+        return true;
+    }
+
+private:
+    std::atomic<list_type *> list_;
+    std::atomic<unsigned int> epoch_{0};
+    mutable std::atomic<std::size_t> readers_[2] = {{0}, {0}};
+    std::mutex mutex_;
+};
+
+} } }
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <string>
+#include <ostream>
+#include <streambuf>
+
+namespace acqua { namespace log { namespace detail {
+
+//! std::basic_string の末尾に直接追記する streambuf
+template <typename CharT>
+class string_streambuf
+    : public std::basic_streambuf<CharT>
+{
+    using base_type = std::basic_streambuf<CharT>;
+
+public:
+    using string_type = std::basic_string<CharT>;
+    using int_type = typename base_type::int_type;
+    using traits_type = typename base_type::traits_type;
+
+    explicit string_streambuf(string_type & str) noexcept
+        : str_(str) {}
+
+protected:
+    int_type overflow(int_type ch) override
+    {
+        if (!traits_type::eq_int_type(ch, traits_type::eof()))
+            str_.push_back(traits_type::to_char_type(ch));
+        return traits_type::not_eof(ch);
+    }
+
+    std::streamsize xsputn(CharT const * s, std::streamsize n) override
+    {
+        str_.append(s, static_cast<std::size_t>(n));
+        return n;
+    }
+
+private:
+    string_type & str_;
+};
+
+/*!
+  文字列を保持する出力ストリーム.
+
+  reset() は文字列の容量を残したまま内容と書式の状態だけを初期化するので、
+  同じオブジェクトを使い回せばヒープの確保が起きない。
+ */
+template <typename CharT>
+class string_ostream
+    : public std::basic_ostream<CharT>
+{
+public:
+    using string_type = std::basic_string<CharT>;
+
+    string_ostream()
+        : std::basic_ostream<CharT>(&buf_)
+        , buf_(str_) {}
+
+    string_ostream(string_ostream const &) = delete;
+    string_ostream & operator=(string_ostream const &) = delete;
+
+    string_type & str() noexcept
+    {
+        return str_;
+    }
+
+    string_type const & str() const noexcept
+    {
+        return str_;
+    }
+
+    void reset()
+    {
+        str_.clear();
+        this->clear();
+        this->flags(std::ios_base::skipws | std::ios_base::dec);
+        this->width(0);
+        this->precision(6);
+        this->fill(this->widen(' '));
+    }
+
+private:
+    string_type str_;
+    string_streambuf<CharT> buf_;
+};
+
+} } }
@@ -0,0 +1,72 @@
+#pragma once
+
+extern "C" {
+#include <limits.h>
+#include <unistd.h>
+#include <sys/uio.h>
+}
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+
+namespace acqua { namespace log { namespace detail {
+
+//! size バイトをすべて fd に書き込む. 書き込んだバイト数を written に加える
+inline bool write_all(int fd, char const * data, std::size_t size, std::size_t & written) noexcept
+{
+    while(size > 0) {
+        ssize_t res = ::write(fd, data, size);
+        if (res < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        written += static_cast<std::size_t>(res);
+        data += res;
+        size -= static_cast<std::size_t>(res);
+    }
+    return true;
+}
+
+/*!
+  iov の各行と改行を交互に並べて、IOV_MAX 個ずつ fd に writev(2) する.
+  途中までしか書き込めなかった残りは write(2) で書き出す。書き込んだバイト数を written に加える
+ */
+template <typename CharT>
+bool write_lines(int fd, struct ::iovec const * iov, std::size_t count, std::size_t & written) noexcept
+{
+    static CharT const nl = '\n';
+    struct ::iovec vec[IOV_MAX];
+    std::size_t const max_lines = IOV_MAX / 2;
+
+    for(std::size_t beg = 0; beg < count; beg += max_lines) {
+        std::size_t n = std::min(max_lines, count - beg);
+        for(std::size_t i = 0; i < n; ++i) {
+            vec[i * 2] = iov[beg + i];
+            vec[i * 2 + 1].iov_base = const_cast<CharT *>(&nl);
+            vec[i * 2 + 1].iov_len = sizeof(CharT);
+        }
+
+        ssize_t res;
+        while((res = ::writev(fd, vec, static_cast<int>(n * 2))) < 0 && errno == EINTR)
+            ;
+        if (res < 0)
+            return false;
+        written += static_cast<std::size_t>(res);
+
+        std::size_t done = static_cast<std::size_t>(res);
+        for(std::size_t i = 0; i < n * 2; ++i) {
+            if (done >= vec[i].iov_len) {
+                done -= vec[i].iov_len;
+                continue;
+            }
+            if (!write_all(fd, static_cast<char const *>(vec[i].iov_base) + done, vec[i].iov_len - done, written))
+                return false;
+            done = 0;
+        }
+    }
+    return true;
+}
+
+} } }
@@ -8,6 +8,11 @@ template <typename Derived, typename Tag = typename core::default_tag>
 class loggable
 {
 protected:
+    static bool detail_logging_enabled(koenig_lookup_tag, severity_type level) noexcept
+    {
+        return core::enabled<Tag>(level);
+    }
+
     static core::loggable_line_logger detail_logging(koenig_lookup_tag, severity_type level, char const * func, char const * file, unsigned int line)
     {
         return core::get<Tag>()->make_line_logger(level, func, file, line, typeid(Derived));
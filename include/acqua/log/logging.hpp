@@ -4,6 +4,11 @@
 
 namespace acqua { namespace log {
 
+inline bool detail_logging_enabled(koenig_lookup_tag, severity_type level) noexcept
+{
+    return core::enabled<core::default_tag>(level);
+}
+
 inline core::logging_line_logger detail_logging(koenig_lookup_tag, severity_type level, char const * func, char const * file, unsigned int line)
 {
     return core::get_default()->make_line_logger(level, func, file, line);
@@ -0,0 +1,12 @@
+#pragma once
+
+namespace acqua { namespace log {
+
+//! 非同期ログのキューが満杯になったときの動作
+enum class overflow_policy {
+    block,        //!< 空きができるまで待つ
+    drop,         //!< 新しい行を捨てて数える
+    drop_oldest,  //!< 最も古い行を捨てて数える
+};
+
+} }
@@ -1,5 +1,8 @@
 #pragma once
 
+#include <ostream>
+#include <algorithm>
+
 namespace acqua { namespace log {
 
 //! ログレベル
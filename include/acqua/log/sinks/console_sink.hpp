@@ -1,8 +1,11 @@
 #pragma once
 
+#include <cstdio>
 #include <iostream>
+#include <type_traits>
 #include <acqua/log/core.hpp>
 #include <acqua/log/sinks/logger_sink.hpp>
+#include <acqua/log/detail/write_lines.hpp>
 
 namespace acqua { namespace log {
 
@@ -10,6 +13,12 @@ class core;
 
 namespace sinks {
 
+/*!
+  標準出力や標準エラーに書き出すシンク.
+
+  非同期モードでまとめて渡された行は、ストリームを flush してから file の記述子に直接 writev(2) する。
+  ストリームの rdbuf() が差し替えられている場合や、CharT が char でない場合は、ストリームに書き込む
+ */
 template <typename CharT, typename Mutex>
 class console_sink
     : public logger_sink<CharT, Mutex>
@@ -17,8 +26,8 @@ class console_sink
     friend core;
 
 private:
-    console_sink(std::basic_ostream<CharT> & os)
-        : os_(os) {}
+    console_sink(std::basic_ostream<CharT> & os, std::FILE * file = nullptr)
+        : os_(os), rdbuf_(os.rdbuf()), file_(file) {}
 
     virtual void write(CharT const * str, std::size_t size) const override
     {
@@ -26,8 +35,34 @@ private:
         os_ << std::endl;
     }
 
+    virtual void write(struct ::iovec const * iov, std::size_t count) const override
+    {
+        if (std::is_same<CharT, char>::value && file_ && os_.rdbuf() == rdbuf_) {
+            // ストリームと stdio に残っている内容を先に出してから、まとめて書き込む
+            os_.flush();
+            std::fflush(file_);
+            std::size_t written = 0;
+            detail::write_lines<CharT>(::fileno(file_), iov, count, written);
+            return;
+        }
+
+        // 1行ずつ flush せず、まとめて書いてから一度だけ flush する
+        for(std::size_t i = 0; i < count; ++i) {
+            os_.write(static_cast<CharT const *>(iov[i].iov_base), static_cast<std::streamsize>(iov[i].iov_len / sizeof(CharT)));
+            os_.put(os_.widen('\n'));
+        }
+        os_.flush();
+    }
+
+    virtual void flush() const override
+    {
+        os_.flush();
+    }
+
 private:
     std::basic_ostream<CharT> & os_;
+    std::basic_streambuf<CharT> * const rdbuf_;
+    std::FILE * const file_;
 };
 
 } } }
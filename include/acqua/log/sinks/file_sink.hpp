@@ -0,0 +1,367 @@
+#pragma once
+
+extern "C" {
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+}
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <ctime>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <condition_variable>
+#include <boost/system/system_error.hpp>
+#include <acqua/log/sinks/logger_sink.hpp>
+#include <acqua/log/detail/write_lines.hpp>
+
+namespace acqua { namespace log { namespace sinks {
+
+/*!
+  ファイルに書き出すシンク.
+
+  行は buffer_size バイトのバッファに溜めてから、まとめて write(2) する。
+  書き出しとローテートは、シンクごとに１つ持つスレッドで行う。
+  ログを出力するスレッドは、ロックを取ってバッファに追記し、必要ならスレッドを起こすだけで、write(2) や改名を待たない。
+  スレッドは、バッファが溢れたとき、flush_interval が経過したとき、ローテートが必要になったときに、
+  バッファを入れ替えてからロックを外して書き出す。
+  書き出しが追いつかずに、バッファが buffer_size の４倍 (最低 1MiB) を超えたときだけは、空くまで待つ。
+  flush() と rotate() は、呼び出したスレッドで書き出す。
+  use_writev(true) とすると、非同期モードでまとめて渡された行をバッファを経由せず、呼び出したスレッドで writev(2) する。
+  ファイルは O_APPEND で開くので、複数のプロセスから同じファイルに追記しても行が混ざらない。
+
+  rotate_size を超えたとき、または rotate_interval の倍数の時刻を過ぎたときに、
+  ファイルを "path.YYYYmmdd-HHMMSS" に改名して新しいファイルを開く。
+  大きさは書き出した後に判定するので、ファイルは１回に書き出した分だけ rotate_size を超えることがある。
+  改名や新しいファイルを開くことに失敗した場合は、rotate_retry の間はローテートを試みずに今のファイルに書き続ける。
+ */
+template <typename CharT, typename Mutex>
+class file_sink
+    : public logger_sink<CharT, Mutex>
+{
+    using clock_type = std::chrono::system_clock;
+    using lock_type = std::unique_lock<Mutex>;
+
+public:
+    explicit file_sink(std::string const & path)
+        : path_(path)
+        , fd_(open_file(path))
+    {
+        struct ::stat st;
+        if (::fstat(fd_, &st) == 0)
+            size_ = static_cast<std::size_t>(st.st_size);
+        buffer_.reserve(buffer_size_);
+        flusher_ = std::thread(&file_sink::run_flusher, this);
+    }
+
+    file_sink(file_sink const &) = delete;
+    file_sink & operator=(file_sink const &) = delete;
+
+    ~file_sink()
+    {
+        {
+            lock_type lock(this->mutex_);
+            stop_ = true;
+        }
+        flush_cond_.notify_one();
+        flusher_.join();
+        drain(false, nullptr, 0);
+        ::close(fd_);
+    }
+
+    std::string const & path() const noexcept
+    {
+        return path_;
+    }
+
+    //! size バイトを超えたらローテートする. 0 なら大きさではローテートしない
+    void rotate_size(std::size_t size)
+    {
+        lock_type lock(this->mutex_);
+        rotate_size_ = size;
+    }
+
+    //! interval の倍数の時刻を過ぎたらローテートする. 0 なら時刻ではローテートしない
+    void rotate_interval(std::chrono::seconds interval)
+    {
+        lock_type lock(this->mutex_);
+        rotate_interval_ = interval;
+        next_rotate_ = next_boundary(clock_type::now());
+    }
+
+    //! ローテートしたファイルを最大 n 個まで残す. 0 なら削除しない
+    void max_files(std::size_t n)
+    {
+        lock_type lock(this->mutex_);
+        max_files_ = n;
+    }
+
+    void buffer_size(std::size_t size)
+    {
+        lock_type lock(this->mutex_);
+        buffer_size_ = size;
+        buffer_.reserve(size);
+        if (buffer_.size() >= buffer_size_)
+            wake();
+    }
+
+    void flush_interval(std::chrono::milliseconds interval)
+    {
+        {
+            lock_type lock(this->mutex_);
+            flush_interval_ = interval;
+        }
+        flush_cond_.notify_one();
+    }
+
+    //! ローテートに失敗したときに、次に試みるまでの時間
+    void rotate_retry(std::chrono::milliseconds interval)
+    {
+        lock_type lock(this->mutex_);
+        rotate_retry_ = interval;
+    }
+
+    void use_writev(bool enable)
+    {
+        lock_type lock(this->mutex_);
+        writev_ = enable;
+    }
+
+    //! バッファを書き出してから、直ちにローテートする.
+    void rotate()
+    {
+        drain(true, nullptr, 0);
+    }
+
+    virtual void write(CharT const * str, std::size_t size) const override
+    {
+        lock_type lock(this->mutex_);
+        wait_space(lock);
+        append(str, size);
+        written();
+    }
+
+    virtual void write(struct ::iovec const * iov, std::size_t count) const override
+    {
+        {
+            lock_type lock(this->mutex_);
+            if (!writev_) {
+                wait_space(lock);
+                for(std::size_t i = 0; i < count; ++i)
+                    append(static_cast<CharT const *>(iov[i].iov_base), iov[i].iov_len / sizeof(CharT));
+                written();
+                return;
+            }
+        }
+        drain(false, iov, count);
+    }
+
+    virtual void flush() const override
+    {
+        drain(false, nullptr, 0);
+    }
+
+private:
+    static int open_file(std::string const & path)
+    {
+        int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (fd < 0)
+            throw boost::system::system_error(errno, boost::system::generic_category(), "file_sink: " + path);
+        return fd;
+    }
+
+    void append(CharT const * str, std::size_t size) const
+    {
+        auto const * ptr = reinterpret_cast<char const *>(str);
+        buffer_.insert(buffer_.end(), ptr, ptr + size * sizeof(CharT));
+        append_newline();
+    }
+
+    void append_newline() const
+    {
+        CharT nl = '\n';
+        auto const * ptr = reinterpret_cast<char const *>(&nl);
+        buffer_.insert(buffer_.end(), ptr, ptr + sizeof(CharT));
+    }
+
+    //! 書き出しスレッドを起こす. mutex_ を取って呼び出す
+    void wake() const
+    {
+        if (!wake_) {
+            wake_ = true;
+            flush_cond_.notify_one();
+        }
+    }
+
+    //! 書き出しが追いつかずにバッファが溜まりすぎたら、書き出しスレッドが入れ替えるまで待つ
+    void wait_space(lock_type & lock) const
+    {
+        std::size_t const limit = std::max<std::size_t>(buffer_size_ * 4, 1024 * 1024);
+        while(buffer_.size() >= limit && !stop_) {
+            wake();
+            space_cond_.wait(lock);
+        }
+    }
+
+    //! 書き込みのたびに mutex_ を取って呼び出して、書き出しスレッドを起こすかどうかを判定する
+    void written() const
+    {
+        if (buffer_.size() >= buffer_size_ || flush_interval_.count() == 0 || rotation_due(clock_type::now()))
+            wake();
+    }
+
+    bool rotation_due(clock_type::time_point now) const
+    {
+        if (now < retry_rotate_)
+            return false;
+        return (rotate_size_ > 0 && size_ + buffer_.size() >= rotate_size_) ||
+            (rotate_interval_.count() > 0 && now >= next_rotate_);
+    }
+
+    //! 起こされたとき、または flush_interval ごとにバッファを書き出す
+    void run_flusher()
+    {
+        lock_type lock(this->mutex_);
+        while(!stop_) {
+            if (!wake_) {
+                if (flush_interval_.count() > 0)
+                    flush_cond_.wait_for(lock, flush_interval_);
+                else
+                    flush_cond_.wait(lock);  // 0 なら書き込みのたびに起こされる
+            }
+            if (stop_)
+                break;
+            wake_ = false;
+            lock.unlock();
+            drain(false, nullptr, 0);
+            lock.lock();
+        }
+    }
+
+    /*!
+      バッファを入れ替えて書き出し、iov があれば続けて writev(2) してから、必要ならローテートする.
+      mutex_ はバッファの入れ替えとローテートの判定にだけ取り、ファイルの操作は io_mutex_ だけを取って行う
+     */
+    void drain(bool force_rotate, struct ::iovec const * iov, std::size_t count) const
+    {
+        std::lock_guard<std::mutex> io_lock(io_mutex_);
+        {
+            lock_type lock(this->mutex_);
+            back_.swap(buffer_);
+        }
+        space_cond_.notify_all();
+
+        std::size_t done = 0;
+        if (!back_.empty()) {
+            // 書き込みに失敗しても、溜め続けないように捨てる
+            detail::write_all(fd_, back_.data(), back_.size(), done);
+            back_.clear();
+        }
+        if (iov)
+            detail::write_lines<CharT>(fd_, iov, count, done);
+        size_ += done;
+
+        auto now = clock_type::now();
+        std::size_t keep;
+        {
+            lock_type lock(this->mutex_);
+            // 空のファイルは、時刻が来てもローテートしない
+            if (!force_rotate && (size_ == 0 || !rotation_due(now)))
+                return;
+            if (rotate_interval_.count() > 0)
+                next_rotate_ = next_boundary(now);
+            // 失敗したときは、書き込みのたびに改名を試みないように間を空ける
+            retry_rotate_ = now + rotate_retry_;
+            keep = max_files_;
+        }
+
+        if (reopen(now, keep)) {
+            lock_type lock(this->mutex_);
+            retry_rotate_ = clock_type::time_point();
+        }
+    }
+
+    //! io_mutex_ を取って呼び出す
+    bool reopen(clock_type::time_point now, std::size_t keep) const
+    {
+        std::string rotated = rotated_name(now);
+        if (::rename(path_.c_str(), rotated.c_str()) != 0)
+            return false;
+        int fd = ::open(path_.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (fd < 0)
+            return false;  // 改名したファイルに書き続ける
+
+        ::close(fd_);
+        fd_ = fd;
+        size_ = 0;
+
+        rotated_.push_back(std::move(rotated));
+        while(keep > 0 && rotated_.size() > keep) {
+            ::unlink(rotated_.front().c_str());
+            rotated_.pop_front();
+        }
+        return true;
+    }
+
+    std::string rotated_name(clock_type::time_point now) const
+    {
+        std::time_t t = clock_type::to_time_t(now);
+        std::tm tm;
+        ::localtime_r(&t, &tm);
+        char stamp[32];
+        std::strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &tm);
+
+        std::string name = path_ + "." + stamp;
+        if (stamp == last_stamp_)
+            name += "." + std::to_string(++seq_);
+        else
+            seq_ = 0;
+        last_stamp_ = stamp;
+        return name;
+    }
+
+    clock_type::time_point next_boundary(clock_type::time_point now) const
+    {
+        auto sec = std::chrono::duration_cast<std::chrono::seconds>(now.time_since_epoch());
+        return clock_type::time_point((sec / rotate_interval_ + 1) * rotate_interval_);
+    }
+
+private:
+    std::string const path_;
+
+    // mutex_ で保護する
+    mutable std::vector<char> buffer_;
+    mutable clock_type::time_point next_rotate_;
+    mutable clock_type::time_point retry_rotate_;
+    std::size_t buffer_size_ = 64 * 1024;
+    std::size_t rotate_size_ = 0;
+    std::size_t max_files_ = 0;
+    std::chrono::seconds rotate_interval_{0};
+    std::chrono::milliseconds flush_interval_{1000};
+    std::chrono::milliseconds rotate_retry_{1000};
+    bool writev_ = false;
+    mutable bool wake_ = false;
+    bool stop_ = false;
+
+    // io_mutex_ で保護する. size_ はローテートの判定のために mutex_ からも読む
+    mutable std::mutex io_mutex_;
+    mutable int fd_;
+    mutable std::vector<char> back_;
+    mutable std::atomic<std::size_t> size_{0};
+    mutable std::deque<std::string> rotated_;
+    mutable std::string last_stamp_;
+    mutable std::size_t seq_ = 0;
+
+    mutable std::condition_variable_any flush_cond_;
+    mutable std::condition_variable_any space_cond_;
+    std::thread flusher_;
+};
+
+} } }
@@ -1,5 +1,9 @@
 #pragma once
 
+extern "C" {
+#include <sys/uio.h>
+}
+
 #include <vector>
 #include <memory>
 
@@ -16,8 +20,18 @@ public:
     virtual ~logger_sink() {}
     virtual void write(CharT const *, std::size_t) const = 0;
 
+    //! 非同期モードで、複数行をまとめて書き出す. 各要素が改行を含まない1行になる
+    virtual void write(struct ::iovec const * iov, std::size_t count) const
+    {
+        for(std::size_t i = 0; i < count; ++i)
+            write(static_cast<CharT const *>(iov[i].iov_base), iov[i].iov_len / sizeof(CharT));
+    }
+
+    //! バッファリングしている内容を書き出す.
+    virtual void flush() const {}
+
 protected:
-    Mutex mutex_;
+    mutable Mutex mutex_;
 };
 
 } } }
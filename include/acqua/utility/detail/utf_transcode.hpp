@@ -0,0 +1,333 @@
+/*!
+  acqua library
+
+  Copyright (c) 2016 Haruhiko Uchida
+  The software is released under the MIT license.
+  http://opensource.org/licenses/mit-license.php
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+#if defined(__SSE2__) && !defined(ACQUA_UTILITY_UTF_NO_SIMD)
+# define ACQUA_UTILITY_UTF_SSE2 1
+# include <emmintrin.h>
+#endif
+
+namespace acqua { namespace utility { namespace detail {
+
+/*!
+  文字の型の大きさで決まる符号化. 1 バイトは UTF-8、2 バイトは UTF-16、4 バイトは UTF-32 とする.
+  wchar_t も大きさで決まるので、boost::locale::utf::utf_traits と同じになる
+ */
+template <typename CharT>
+using utf_unit = std::integral_constant<std::size_t, sizeof(CharT)>;
+
+using utf8_unit = std::integral_constant<std::size_t, 1>;
+using utf16_unit = std::integral_constant<std::size_t, 2>;
+using utf32_unit = std::integral_constant<std::size_t, 4>;
+
+//! utf_decode() の結果で、入力が足りない
+constexpr char32_t utf_incomplete = 0xFFFFFFFE;
+
+//! utf_decode() の結果で、不正な符号
+constexpr char32_t utf_illegal = 0xFFFFFFFF;
+
+
+/*!
+  p から 1 文字を読んで、p を進める.
+  文字の途中で end になれば p を進めずに utf_incomplete を返す。
+  冗長な符号、サロゲート、U+10FFFF を超える値は、読み飛ばして utf_illegal を返す
+ */
+template <typename CharT>
+inline char32_t utf_decode(CharT const *& p, CharT const * end, utf8_unit) noexcept
+{
+    std::uint32_t const c0 = static_cast<unsigned char>(*p);
+    if (c0 < 0x80) {
+        ++p;
+        return c0;
+    }
+
+    std::ptrdiff_t len;
+    std::uint32_t cp;
+    std::uint32_t min;
+    if (c0 < 0xC2) {
+        ++p;
+        return utf_illegal;
+    } else if (c0 < 0xE0) {
+        len = 2; cp = c0 & 0x1F; min = 0x80;
+    } else if (c0 < 0xF0) {
+        len = 3; cp = c0 & 0x0F; min = 0x800;
+    } else if (c0 < 0xF5) {
+        len = 4; cp = c0 & 0x07; min = 0x10000;
+    } else {
+        ++p;
+        return utf_illegal;
+    }
+
+    for(std::ptrdiff_t i = 1; i < len; ++i) {
+        if (i == end - p)
+            return utf_incomplete;
+        std::uint32_t const c = static_cast<unsigned char>(p[i]);
+        if ((c & 0xC0) != 0x80) {
+            p += i;
+            return utf_illegal;
+        }
+        cp = (cp << 6) | (c & 0x3F);
+    }
+    p += len;
+    if (cp < min || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF))
+        return utf_illegal;
+    return cp;
+}
+
+template <typename CharT>
+inline char32_t utf_decode(CharT const *& p, CharT const * end, utf16_unit) noexcept
+{
+    std::uint32_t const c0 = static_cast<std::uint16_t>(*p);
+    if (c0 < 0xD800 || c0 > 0xDFFF) {
+        ++p;
+        return c0;
+    }
+    if (c0 <= 0xDBFF) {
+        if (end - p < 2)
+            return utf_incomplete;
+        std::uint32_t const c1 = static_cast<std::uint16_t>(p[1]);
+        if (c1 >= 0xDC00 && c1 <= 0xDFFF) {
+            p += 2;
+            return 0x10000 + ((c0 - 0xD800) << 10) + (c1 - 0xDC00);
+        }
+    }
+    ++p;
+    return utf_illegal;
+}
+
+template <typename CharT>
+inline char32_t utf_decode(CharT const *& p, CharT const *, utf32_unit) noexcept
+{
+    std::uint32_t const cp = static_cast<std::uint32_t>(*p++);
+    if (cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF))
+        return utf_illegal;
+    return cp;
+}
+
+
+//! cp を符号化したときの長さ
+inline std::ptrdiff_t utf_width(char32_t cp, utf8_unit) noexcept
+{
+    return (cp < 0x80) ? 1 : (cp < 0x800) ? 2 : (cp < 0x10000) ? 3 : 4;
+}
+
+inline std::ptrdiff_t utf_width(char32_t cp, utf16_unit) noexcept
+{
+    return (cp < 0x10000) ? 1 : 2;
+}
+
+inline std::ptrdiff_t utf_width(char32_t, utf32_unit) noexcept
+{
+    return 1;
+}
+
+
+//! cp を out に書き込んで、書き込んだ後の位置を返す
+template <typename CharT>
+inline CharT * utf_encode(char32_t cp, CharT * out, utf8_unit) noexcept
+{
+    if (cp < 0x80) {
+        *out++ = static_cast<CharT>(cp);
+    } else if (cp < 0x800) {
+        *out++ = static_cast<CharT>(0xC0 | (cp >> 6));
+        *out++ = static_cast<CharT>(0x80 | (cp & 0x3F));
+    } else if (cp < 0x10000) {
+        *out++ = static_cast<CharT>(0xE0 | (cp >> 12));
+        *out++ = static_cast<CharT>(0x80 | ((cp >> 6) & 0x3F));
+        *out++ = static_cast<CharT>(0x80 | (cp & 0x3F));
+    } else {
+        *out++ = static_cast<CharT>(0xF0 | (cp >> 18));
+        *out++ = static_cast<CharT>(0x80 | ((cp >> 12) & 0x3F));
+        *out++ = static_cast<CharT>(0x80 | ((cp >> 6) & 0x3F));
+        *out++ = static_cast<CharT>(0x80 | (cp & 0x3F));
+    }
+    return out;
+}
+
+template <typename CharT>
+inline CharT * utf_encode(char32_t cp, CharT * out, utf16_unit) noexcept
+{
+    if (cp < 0x10000) {
+        *out++ = static_cast<CharT>(cp);
+    } else {
+        cp -= 0x10000;
+        *out++ = static_cast<CharT>(0xD800 | (cp >> 10));
+        *out++ = static_cast<CharT>(0xDC00 | (cp & 0x3FF));
+    }
+    return out;
+}
+
+template <typename CharT>
+inline CharT * utf_encode(char32_t cp, CharT * out, utf32_unit) noexcept
+{
+    *out++ = static_cast<CharT>(cp);
+    return out;
+}
+
+
+#if defined(ACQUA_UTILITY_UTF_SSE2)
+/*!
+  16 文字がすべて ASCII であれば To の幅に広げて (狭めて) out に書き込み、true を返す.
+  対応する組み合わせがなければ false を返して、1 文字ずつの変換に任せる
+ */
+template <typename From, typename To, typename FromUnit, typename ToUnit>
+inline bool utf_ascii_block(From const *, To *, FromUnit, ToUnit) noexcept
+{
+    return false;
+}
+
+template <typename From, typename To>
+inline bool utf_ascii_block(From const * in, To * out, utf8_unit, utf8_unit) noexcept
+{
+    __m128i x = _mm_loadu_si128(reinterpret_cast<__m128i const *>(in));
+    if (_mm_movemask_epi8(x) != 0)
+        return false;
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out), x);
+    return true;
+}
+
+template <typename From, typename To>
+inline bool utf_ascii_block(From const * in, To * out, utf8_unit, utf16_unit) noexcept
+{
+    __m128i x = _mm_loadu_si128(reinterpret_cast<__m128i const *>(in));
+    if (_mm_movemask_epi8(x) != 0)
+        return false;
+    __m128i zero = _mm_setzero_si128();
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out), _mm_unpacklo_epi8(x, zero));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 8), _mm_unpackhi_epi8(x, zero));
+    return true;
+}
+
+template <typename From, typename To>
+inline bool utf_ascii_block(From const * in, To * out, utf8_unit, utf32_unit) noexcept
+{
+    __m128i x = _mm_loadu_si128(reinterpret_cast<__m128i const *>(in));
+    if (_mm_movemask_epi8(x) != 0)
+        return false;
+    __m128i zero = _mm_setzero_si128();
+    __m128i lo = _mm_unpacklo_epi8(x, zero);
+    __m128i hi = _mm_unpackhi_epi8(x, zero);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out), _mm_unpacklo_epi16(lo, zero));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 4), _mm_unpackhi_epi16(lo, zero));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 8), _mm_unpacklo_epi16(hi, zero));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 12), _mm_unpackhi_epi16(hi, zero));
+    return true;
+}
+
+template <typename From, typename To>
+inline bool utf_ascii_block(From const * in, To * out, utf16_unit, utf8_unit) noexcept
+{
+    __m128i a = _mm_loadu_si128(reinterpret_cast<__m128i const *>(in));
+    __m128i b = _mm_loadu_si128(reinterpret_cast<__m128i const *>(in + 8));
+    __m128i high = _mm_and_si128(_mm_or_si128(a, b), _mm_set1_epi16(static_cast<short>(0xFF80)));
+    if (_mm_movemask_epi8(_mm_cmpeq_epi16(high, _mm_setzero_si128())) != 0xFFFF)
+        return false;
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out), _mm_packus_epi16(a, b));
+    return true;
+}
+
+template <typename From, typename To>
+inline bool utf_ascii_block(From const * in, To * out, utf32_unit, utf8_unit) noexcept
+{
+    __m128i a = _mm_loadu_si128(reinterpret_cast<__m128i const *>(in));
+    __m128i b = _mm_loadu_si128(reinterpret_cast<__m128i const *>(in + 4));
+    __m128i c = _mm_loadu_si128(reinterpret_cast<__m128i const *>(in + 8));
+    __m128i d = _mm_loadu_si128(reinterpret_cast<__m128i const *>(in + 12));
+    __m128i high = _mm_and_si128(_mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d)), _mm_set1_epi32(static_cast<int>(0xFFFFFF80)));
+    if (_mm_movemask_epi8(_mm_cmpeq_epi32(high, _mm_setzero_si128())) != 0xFFFF)
+        return false;
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out), _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d)));
+    return true;
+}
+#endif
+
+
+/*!
+  [in, in_end) の先頭から ASCII が続く分を、out_end を超えない範囲で写して、写した文字数を返す.
+  SSE2 が使えれば 16 文字ずつ調べる
+ */
+template <typename From, typename To>
+inline std::size_t utf_copy_ascii(From const * in, From const * in_end, To * out, To * out_end) noexcept
+{
+    std::size_t const n = static_cast<std::size_t>(std::min(in_end - in, out_end - out));
+    std::size_t i = 0;
+#if defined(ACQUA_UTILITY_UTF_SSE2)
+    for(; i + 16 <= n; i += 16) {
+        if (!utf_ascii_block(in + i, out + i, utf_unit<From>(), utf_unit<To>()))
+            break;
+    }
+#endif
+    for(; i < n; ++i) {
+        std::uint32_t const ch = static_cast<std::uint32_t>(static_cast<typename std::make_unsigned<From>::type>(in[i]));
+        if (ch >= 0x80)
+            break;
+        out[i] = static_cast<To>(ch);
+    }
+    return i;
+}
+
+
+template <typename From, typename To>
+struct utf_transcode_result
+{
+    From const * in;
+    To * out;
+};
+
+/*!
+  [in, in_end) を From の符号化から To の符号化に変換して、[out, out_end) に書き込む.
+
+  ASCII の続く範囲はまとめて写し、それ以外は 1 文字ずつ変換する。不正な符号は読み飛ばす。
+  入力の最後の文字が途中で終わっているか、出力に次の文字が収まらなければ、その文字の前で止まる。
+  止まった位置を返すので、呼び出し側で残りを次の入力の前に足すか、出力を空けてから続ける
+ */
+template <typename From, typename To>
+inline utf_transcode_result<From, To> utf_transcode(From const * in, From const * in_end, To * out, To * out_end) noexcept
+{
+    while(in != in_end) {
+        std::size_t const n = utf_copy_ascii(in, in_end, out, out_end);
+        in += n;
+        out += n;
+        if (in == in_end || out == out_end)
+            break;
+
+        // 次の ASCII までは 1 文字ずつ変換する
+        do {
+            From const * p = in;
+            char32_t const cp = utf_decode(p, in_end, utf_unit<From>());
+            if (cp == utf_incomplete)
+                return utf_transcode_result<From, To>{ in, out };
+            if (cp != utf_illegal) {
+                if (out_end - out < utf_width(cp, utf_unit<To>()))
+                    return utf_transcode_result<From, To>{ in, out };
+                out = utf_encode(cp, out, utf_unit<To>());
+            }
+            in = p;
+        } while(in != in_end && static_cast<std::uint32_t>(static_cast<typename std::make_unsigned<From>::type>(*in)) >= 0x80);
+    }
+    return utf_transcode_result<From, To>{ in, out };
+}
+
+
+//! From の n 文字を To に変換したときの、最大の文字数
+template <typename From, typename To>
+constexpr std::size_t utf_max_length(std::size_t n) noexcept
+{
+    return (sizeof(From) == 1) ? n
+        : (sizeof(To) == 1) ? n * (sizeof(From) == 2 ? 3 : 4)
+        : (sizeof(From) == 4 && sizeof(To) == 2) ? n * 2
+        : n;
+}
+
+} } }
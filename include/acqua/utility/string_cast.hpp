@@ -10,11 +10,29 @@
 
 #include <string>
 #include <iterator>
+#include <memory>
 #include <type_traits>
+#include <vector>
 #include <boost/locale.hpp>
+#include <acqua/utility/detail/utf_transcode.hpp>
 
 namespace acqua { namespace utility {
 
+//! 文字が連続して並んでいるイテレータ. ポインタと basic_string と vector のイテレータ
+template <typename It, typename T = typename std::remove_cv<typename std::iterator_traits<It>::value_type>::type>
+struct is_contiguous_iterator
+    : std::integral_constant<bool,
+                             std::is_pointer<It>::value ||
+                             std::is_same<It, typename std::basic_string<T>::iterator>::value ||
+                             std::is_same<It, typename std::basic_string<T>::const_iterator>::value ||
+                             std::is_same<It, typename std::vector<T>::iterator>::value ||
+                             std::is_same<It, typename std::vector<T>::const_iterator>::value> {};
+
+
+/*!
+  [beg, end) の文字列を、UTF-8 と UTF-16 と UTF-32 の間で変換する.
+  入力が連続していれば、ASCII をまとめて写すブロック単位の変換を使う
+ */
 template <typename It>
 class convert_string
 {
@@ -36,6 +54,46 @@ public:
 
     template <typename CharT, typename Iter, typename std::enable_if<!std::is_same<CharT, char_type>::value>::type * = nullptr>
     void convert(Iter ins) const
+    {
+        transcode<CharT>(ins, is_contiguous_iterator<It>());
+    }
+
+    //! 変換した文字列を str に追記する
+    template <typename CharT, typename Traits, typename Allocator>
+    void append_to(std::basic_string<CharT, Traits, Allocator> & str) const
+    {
+        append_to(str, std::integral_constant<bool, !std::is_same<CharT, char_type>::value && is_contiguous_iterator<It>::value>());
+    }
+
+    template <typename Ch, typename Tr>
+    friend std::basic_ostream<Ch, Tr> & operator<<(std::basic_ostream<Ch, Tr> & os, convert_string const & rhs)
+    {
+        rhs.convert<Ch>(std::ostreambuf_iterator<Ch>(os));
+        return os;
+    }
+
+private:
+    template <typename CharT, typename Iter>
+    void transcode(Iter ins, std::true_type) const
+    {
+        if (beg_ == end_)
+            return;
+
+        char_type const * in = std::addressof(*beg_);
+        char_type const * const in_end = in + (end_ - beg_);
+        CharT buf[256];
+        while(in != in_end) {
+            auto res = detail::utf_transcode(in, in_end, buf, buf + 256);
+            ins = std::copy(buf, res.out, ins);
+            // 最後の文字が途中で終わっていれば捨てる
+            if (res.in == in && res.out == buf)
+                break;
+            in = res.in;
+        }
+    }
+
+    template <typename CharT, typename Iter>
+    void transcode(Iter ins, std::false_type) const
     {
         boost::locale::utf::code_point cp;
 
@@ -47,11 +105,25 @@ public:
         }
     }
 
-    template <typename Ch, typename Tr>
-    friend std::basic_ostream<Ch, Tr> & operator<<(std::basic_ostream<Ch, Tr> & os, convert_string const & rhs)
+    //! 最大の長さを確保して直接書き込み、使わなかった分を切り詰める
+    template <typename CharT, typename Traits, typename Allocator>
+    void append_to(std::basic_string<CharT, Traits, Allocator> & str, std::true_type) const
     {
-        rhs.convert<Ch>(std::ostreambuf_iterator<Ch>(os));
-        return os;
+        if (beg_ == end_)
+            return;
+
+        std::size_t const n = static_cast<std::size_t>(end_ - beg_);
+        std::size_t const pos = str.size();
+        str.resize(pos + detail::utf_max_length<char_type, CharT>(n));
+        char_type const * in = std::addressof(*beg_);
+        auto res = detail::utf_transcode(in, in + n, &str[pos], &str[0] + str.size());
+        str.resize(static_cast<std::size_t>(res.out - &str[0]));
+    }
+
+    template <typename CharT, typename Traits, typename Allocator>
+    void append_to(std::basic_string<CharT, Traits, Allocator> & str, std::false_type) const
+    {
+        convert<CharT>(std::back_inserter(str));
     }
 
 private:
@@ -65,7 +137,7 @@ template <typename String, typename It, typename Allocator = typename String::al
 inline String string_cast(It beg, It end, Allocator alloc = Allocator())
 {
     String res(alloc);
-    utility::convert_string<It>(beg, end).template convert<typename String::value_type>(std::back_inserter(res));
+    utility::convert_string<It>(beg, end).append_to(res);
     return res;
 }
 
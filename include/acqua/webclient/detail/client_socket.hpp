@@ -30,6 +30,9 @@ class client_socket
 {
     using base_type = client_socket_base<Result>;
 
+    // ステータス行やヘッダーが、これ以上大きい場合はエラーにする
+    static const std::size_t max_header_size = 65536;
+
 public:
     using socket_type = Socket;
     using timer_type = Timer;
@@ -238,8 +241,8 @@ private:
     {
         if (!error) {
             std::ostream(&(base_type::temp_buffer())) << buffer1_;
-            boost::asio::async_read_until(
-                socket_, base_type::temp_buffer(), "\r\n",
+            acqua::asio::async_read_until(
+                socket_, base_type::temp_buffer(), "\r\n", max_header_size,
                 std::bind(
                     &client_socket::on_read_line,
                     this->shared_from_this(),
@@ -254,21 +257,21 @@ private:
         }
     }
 
-    void on_read_line(boost::system::error_code const & error, std::size_t size)
+    void on_read_line(boost::system::error_code const & error, boost::string_view line)
     {
         if (!error) {
-            char const * data = boost::asio::buffer_cast<char const *>(base_type::temp_buffer().data());
+            char const * data = line.data();
             namespace qi = boost::spirit::qi;
-            if (!qi::parse(data, data + base_type::temp_buffer().size(),
+            if (!qi::parse(data, data + line.size(),
                            qi::omit[ "HTTP/" >> qi::int_ >> '.' >> qi::int_ >> +qi::space] >> qi::int_, base_type::status_code())) {
                 // TODO: ちゃんとしたエラーカテゴリを定義する
                 on_error(boost::system::error_code(EINVAL, boost::system::generic_category()), "qi::parse request_line");
                 return;
             }
 
-            base_type::temp_buffer().consume(size);
-            boost::asio::async_read_until(
-                socket_, base_type::temp_buffer(), "\r\n\r\n",
+            base_type::temp_buffer().consume(line.size());
+            acqua::asio::async_read_until(
+                socket_, base_type::temp_buffer(), "\r\n\r\n", max_header_size,
                 std::bind(
                     &client_socket::on_read_header,
                     this->shared_from_this(),
@@ -280,12 +283,12 @@ private:
         }
     }
 
-    void on_read_header(boost::system::error_code const & error, std::size_t size)
+    void on_read_header(boost::system::error_code const & error, boost::string_view block)
     {
         if (!error) {
             auto & header = base_type::get_header();
-            auto beg = boost::asio::buffer_cast<char const *>(base_type::temp_buffer().data());
-            auto end = beg + size;
+            auto beg = block.data();
+            auto end = beg + block.size();
 
             namespace qi = boost::spirit::qi;
             if (!qi::parse(beg, end, (
@@ -296,7 +299,7 @@ private:
                 return;
             }
 
-            base_type::temp_buffer().consume(size);
+            base_type::temp_buffer().consume(block.size());
             auto it = header.find("Location");
             if (it != header.end()) {
                 on_move(it->second);
@@ -320,8 +323,8 @@ private:
 
             it = header.find("Transfer-Encoding");
             if (it != header.end() && boost::iequals(it->second, "chunked")) {
-                boost::asio::async_read_until(
-                    socket_, base_type::buffer_, "\r\n",
+                acqua::asio::async_read_until(
+                    socket_, base_type::buffer_, "\r\n", max_header_size,
                     std::bind(
                         &client_socket::on_read_chunked_size,
                         this->shared_from_this(),
@@ -331,7 +334,7 @@ private:
             } else {
                 it = header.find("Content-Length");
                 if (it != header.end()) {
-                    size = std::atol(it->second.c_str());
+                    std::size_t size = std::strtoul(it->second.c_str(), nullptr, 10);
 
                     boost::asio::async_read_until(
                         socket_, base_type::buffer_, size,
@@ -342,7 +345,6 @@ private:
                         )
                     );
                 } else {
-                    size = -1;
                     boost::asio::async_read(
                         socket_, base_type::buffer_,
                         std::bind(
@@ -369,15 +371,15 @@ private:
         }
     }
 
-    void on_read_chunked_size(boost::system::error_code const & error, std::size_t size)
+    void on_read_chunked_size(boost::system::error_code const & error, boost::string_view line)
     {
-        if (!error && size > 2) {
-            auto data = boost::asio::buffer_cast<char const *>(base_type::buffer_.data());
+        if (!error && line.size() > 2) {
+            auto data = line.data();
 
-            const_cast<char *>(data)[size-2] = '\0';
+            const_cast<char *>(data)[line.size()-2] = '\0';
             std::size_t chunk_size = std::strtol(data, nullptr, 16);
 
-            base_type::buffer_.consume(size);
+            base_type::buffer_.consume(line.size());
             if (chunk_size != 0) {
                 boost::asio::async_read_until(
                     socket_, base_type::buffer_, chunk_size+2,
@@ -400,8 +402,8 @@ private:
     {
         if (!error) {
             base_type::buffer_copy(size);
-            boost::asio::async_read_until(
-                socket_, base_type::buffer_, "\r\n",
+            acqua::asio::async_read_until(
+                socket_, base_type::buffer_, "\r\n", max_header_size,
                 std::bind(
                     &client_socket::on_read_chunked_size,
                     this->shared_from_this(),
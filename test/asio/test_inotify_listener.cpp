@@ -1,5 +1,13 @@
 #include <acqua/asio/inotify_listener.hpp>
 #include <boost/test/included/unit_test.hpp>
+#include <boost/asio/io_service.hpp>
+#include <fstream>
+
+extern "C" {
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+}
 
 BOOST_AUTO_TEST_SUITE(inotify_listener)
 
@@ -7,6 +15,31 @@ struct InotifyListener : acqua::asio::inotify_listener<InotifyListener>
 {
     explicit InotifyListener(boost::asio::io_service & io_service)
         : InotifyListener::base_type(io_service) {}
+
+    void on_create_path(boost::string_view name, boost::string_view in_name)
+    {
+        created.push_back(name.to_string() + '/' + in_name.to_string());
+    }
+
+    void on_modify(boost::string_view name)
+    {
+        modified.push_back(name.to_string());
+    }
+
+    void on_attribute(boost::string_view name)
+    {
+        attributes.push_back(name.to_string());
+    }
+
+    void on_open(boost::string_view name)
+    {
+        opened.push_back(name.to_string());
+    }
+
+    std::vector<std::string> created;
+    std::vector<std::string> modified;
+    std::vector<std::string> attributes;
+    std::vector<std::string> opened;
 };
 
 BOOST_AUTO_TEST_CASE(construct)
@@ -15,4 +48,170 @@ BOOST_AUTO_TEST_CASE(construct)
     InotifyListener inotify(io_service);
 }
 
+BOOST_AUTO_TEST_CASE(recursive)
+{
+    char tmpl[] = "/tmp/test_inotify_XXXXXX";
+    std::string root = ::mkdtemp(tmpl);
+
+    boost::asio::io_service io_service;
+    InotifyListener inotify(io_service);
+    inotify.start();
+    inotify.add_recursive(root);
+
+    ::mkdir((root + "/sub").c_str(), 0755);
+    io_service.poll();  // sub の作成を受け取り、監視に追加する
+    io_service.reset();
+    std::ofstream(root + "/sub/file") << "hello";
+    io_service.poll();
+    io_service.reset();
+
+    BOOST_TEST(inotify.created.size() == 2u);
+    BOOST_TEST((std::find(inotify.created.begin(), inotify.created.end(), root + "/sub/file") != inotify.created.end()));
+
+    ::unlink((root + "/sub/file").c_str());
+    ::rmdir((root + "/sub").c_str());
+    ::rmdir(root.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(coalesce)
+{
+    char tmpl[] = "/tmp/test_inotify_XXXXXX";
+    std::string root = ::mkdtemp(tmpl);
+    std::string a = root + "/a", b = root + "/b";
+    std::ofstream(a).close();
+    std::ofstream(b).close();
+
+    boost::asio::io_service io_service;
+    InotifyListener inotify(io_service);
+    inotify.coalesce(std::chrono::milliseconds(50));
+    inotify.start();
+    inotify.add(a);
+    inotify.add(b);
+
+    // 異なるファイルと異なるイベントを交互に発生させるので、カーネルではまとめられない
+    {
+        std::ofstream ofa(a), ofb(b);
+        for(int i = 0; i < 10; ++i) {
+            ofa << "hello" << std::flush;
+            ofb << "hello" << std::flush;
+            ::chmod(a.c_str(), (i % 2) ? 0644 : 0600);
+        }
+    }
+
+    boost::asio::steady_timer timer(io_service);
+    timer.expires_from_now(std::chrono::milliseconds(200));
+    timer.async_wait([&](boost::system::error_code const &) { inotify.close(); });
+    io_service.run();
+
+    BOOST_TEST(inotify.modified.size() == 2u);
+    BOOST_TEST((std::count(inotify.modified.begin(), inotify.modified.end(), a) == 1));
+    BOOST_TEST((std::count(inotify.modified.begin(), inotify.modified.end(), b) == 1));
+    BOOST_TEST(inotify.attributes.size() == 1u);
+    BOOST_TEST(inotify.attributes.front() == a);
+
+    ::unlink(a.c_str());
+    ::unlink(b.c_str());
+    ::rmdir(root.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(recursive_flags)
+{
+    char tmpl[] = "/tmp/test_inotify_XXXXXX";
+    std::string root = ::mkdtemp(tmpl);
+
+    // IN_MODIFY だけを指定すると、再帰監視のために加えた IN_CREATE は通知されない
+    boost::asio::io_service io_service;
+    InotifyListener inotify(io_service);
+    inotify.start();
+    boost::system::error_code ec;
+    inotify.add_recursive(root, IN_MODIFY, ec);
+    BOOST_REQUIRE(!ec);
+
+    ::mkdir((root + "/sub").c_str(), 0755);
+    io_service.poll();
+    io_service.reset();
+    std::ofstream(root + "/sub/file") << "hello";
+    io_service.poll();
+    io_service.reset();
+
+    BOOST_TEST(inotify.created.empty());
+    BOOST_TEST(inotify.opened.empty());
+    BOOST_TEST(inotify.modified.size() == 1u);
+    BOOST_TEST(inotify.modified.front() == root + "/sub");
+
+    ::unlink((root + "/sub/file").c_str());
+    ::rmdir((root + "/sub").c_str());
+    ::rmdir(root.c_str());
+}
+
+// std::string の引数をとるコールバックもそのまま呼び出せる
+struct StringListener : acqua::asio::inotify_listener<StringListener>
+{
+    explicit StringListener(boost::asio::io_service & io_service)
+        : StringListener::base_type(io_service) {}
+
+    void on_create_path(std::string const & name, std::string const & in_name)
+    {
+        created.push_back(name + '/' + in_name);
+    }
+
+    std::vector<std::string> created;
+};
+
+BOOST_AUTO_TEST_CASE(string_callback)
+{
+    char tmpl[] = "/tmp/test_inotify_XXXXXX";
+    std::string root = ::mkdtemp(tmpl);
+
+    boost::asio::io_service io_service;
+    StringListener inotify(io_service);
+    inotify.start();
+    inotify.add(root);
+    std::ofstream(root + "/file").close();
+    io_service.poll();
+
+    BOOST_TEST(inotify.created.size() == 1u);
+    BOOST_TEST(inotify.created.front() == root + "/file");
+
+    ::unlink((root + "/file").c_str());
+    ::rmdir(root.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(coalesce_many)
+{
+    // 異なるパスが大量に届いても、パスごとに１回ずつ通知する
+    char tmpl[] = "/tmp/test_inotify_XXXXXX";
+    std::string root = ::mkdtemp(tmpl);
+
+    boost::asio::io_service io_service;
+    InotifyListener inotify(io_service);
+    inotify.coalesce(std::chrono::milliseconds(200));
+    inotify.start();
+    boost::system::error_code ec;
+    inotify.add(root, IN_CREATE | IN_MODIFY, ec);
+    BOOST_REQUIRE(!ec);
+
+    int const count = 2000;
+    for(int i = 0; i < count; ++i) {
+        std::ofstream ofs(root + '/' + std::to_string(i));
+        ofs << "hello" << std::flush;
+        ofs << "world" << std::flush;
+    }
+
+    boost::asio::steady_timer timer(io_service);
+    timer.expires_from_now(std::chrono::milliseconds(500));
+    timer.async_wait([&](boost::system::error_code const &) { inotify.close(); });
+    io_service.run();
+
+    BOOST_TEST(inotify.created.size() == static_cast<std::size_t>(count));
+    std::sort(inotify.created.begin(), inotify.created.end());
+    BOOST_TEST((std::unique(inotify.created.begin(), inotify.created.end()) == inotify.created.end()));
+    // ２回の書き込みは、ファイルごとに１回の on_modify にまとまる
+    BOOST_TEST(inotify.modified.size() == static_cast<std::size_t>(count));
+
+    for(int i = 0; i < count; ++i)
+        ::unlink((root + '/' + std::to_string(i)).c_str());
+    ::rmdir(root.c_str());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -1,5 +1,6 @@
 #include <acqua/asio/netlink/netlink_listener.hpp>
 #include <boost/test/included/unit_test.hpp>
+#include <algorithm>
 
 BOOST_AUTO_TEST_SUITE(netlink_listener)
 
@@ -57,4 +58,55 @@ BOOST_AUTO_TEST_CASE(netlink_neighbor_v6)
     link.close(ec);
 }
 
+struct NetlinkDumpListener : acqua::asio::netlink::netlink_listener<NetlinkDumpListener>
+{
+    struct category : acqua::asio::netlink::link_tag, acqua::asio::netlink::ifaddr_tag {};
+    NetlinkDumpListener(boost::asio::io_service & io_service)
+        : NetlinkDumpListener::base_type(io_service) {}
+
+    void on_link(std::string const & ifname, acqua::network::linklayer_address const &, int, uint) { links.push_back(ifname); }
+    void on_ifaddr(acqua::network::internet4_address const & addr, std::string const &, uint, uint) { addrs_v4.push_back(addr); }
+    void on_ifaddr(acqua::network::internet6_address const &, std::string const &, uint, uint) {}
+    void on_dump_done() { done = true; close(); }
+    void on_error(boost::system::error_code const & error) { errors.push_back(error); }
+
+    std::vector<std::string> links;
+    std::vector<acqua::network::internet4_address> addrs_v4;
+    std::vector<boost::system::error_code> errors;
+    bool done = false;
+};
+
+namespace {
+
+// netlink ソケットを開けない環境では、テストをスキップする
+boost::test_tools::assertion_result can_open_netlink(boost::unit_test::test_unit_id)
+{
+    boost::asio::io_service io_service;
+    NetlinkDumpListener listener(io_service);
+    boost::system::error_code ec;
+    listener.start(ec);
+    boost::test_tools::assertion_result res(!ec);
+    res.message() << "netlink socket: " << ec.message();
+    return res;
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(netlink_dump, * boost::unit_test::precondition(can_open_netlink))
+{
+    boost::asio::io_service io_service;
+    NetlinkDumpListener listener(io_service);
+    boost::system::error_code ec;
+    listener.start(ec);
+    BOOST_REQUIRE(!ec);
+    listener.dump(ec);
+    BOOST_TEST(!ec);
+    io_service.run();
+    BOOST_TEST(listener.done);
+    // on_dump_done() で close() したあとは、読み込みを続けない
+    BOOST_TEST(listener.errors.empty());
+    BOOST_TEST((std::find(listener.links.begin(), listener.links.end(), "lo") != listener.links.end()));
+    BOOST_TEST((std::find(listener.addrs_v4.begin(), listener.addrs_v4.end(), acqua::network::internet4_address::loopback()) != listener.addrs_v4.end()));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,69 @@
+#include <acqua/asio/netlink/netlink_table.hpp>
+#include <boost/test/included/unit_test.hpp>
+#include <boost/asio/steady_timer.hpp>
+
+BOOST_AUTO_TEST_SUITE(netlink_table)
+
+namespace {
+
+// netlink ソケットを開けない環境では、テストをスキップする
+boost::test_tools::assertion_result can_open_netlink(boost::unit_test::test_unit_id)
+{
+    boost::asio::io_service io_service;
+    acqua::asio::netlink::netlink_table table(io_service);
+    boost::system::error_code ec;
+    table.start(ec);
+    boost::test_tools::assertion_result res(!ec);
+    res.message() << "netlink socket: " << ec.message();
+    return res;
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(initial)
+{
+    boost::asio::io_service io_service;
+    acqua::asio::netlink::netlink_table table(io_service);
+    auto empty = table.get();
+    BOOST_TEST(empty->links().empty());
+    BOOST_TEST(empty->owner(acqua::network::internet4_address::loopback()) == 0);
+    BOOST_TEST(empty->neighbor(acqua::network::internet4_address::loopback()) == nullptr);
+}
+
+BOOST_AUTO_TEST_CASE(snapshot, * boost::unit_test::precondition(can_open_netlink))
+{
+    boost::asio::io_service io_service;
+    acqua::asio::netlink::netlink_table table(io_service);
+    auto empty = table.get();
+    acqua::asio::netlink::netlink_table::reader reader(table);
+    BOOST_TEST(reader.get() == empty);
+
+    boost::system::error_code ec;
+    table.start(ec);
+    BOOST_REQUIRE(!ec);
+
+    boost::asio::steady_timer timer(io_service);
+    timer.expires_from_now(std::chrono::milliseconds(200));
+    timer.async_wait([&](boost::system::error_code const &) { table.close(); });
+    io_service.run();
+
+    auto snap = table.get();
+    BOOST_TEST(snap != empty);
+    BOOST_TEST(empty->version() == 0u);
+    BOOST_TEST(snap->version() > 0u);
+    BOOST_TEST(table.version() == snap->version());
+    int lo = snap->index("lo");
+    BOOST_TEST(lo != 0);
+    BOOST_TEST(snap->link(lo)->name_ == "lo");
+    BOOST_TEST(snap->owner(acqua::network::internet4_address::loopback()) == lo);
+    BOOST_TEST((snap->addresses_v4().count(std::make_pair(acqua::network::internet4_address::loopback(), lo)) == 1u));
+
+    // reader は公開された snapshot に追いつき、変わらなければ同じものを返す
+    BOOST_TEST(reader.get() == snap);
+    BOOST_TEST(reader->version() == snap->version());
+
+    // 古い snapshot は変更されない
+    BOOST_TEST(empty->links().empty());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -1,4 +1,9 @@
 #include <acqua/asio/raw.hpp>
+#include <acqua/asio/raw_tx_ring.hpp>
+#include <boost/asio/io_service.hpp>
+#include <acqua/network/ethernet_header.hpp>
+#include <acqua/network/ethernet_arp.hpp>
+#include <acqua/network/parse.hpp>
 #include <boost/test/included/unit_test.hpp>
 
 BOOST_AUTO_TEST_SUITE(raw)
@@ -14,4 +19,76 @@ BOOST_AUTO_TEST_CASE(basics)
     BOOST_TEST((ep.protocol() == acqua::asio::raw()));
 }
 
+namespace {
+
+// raw ソケットは CAP_NET_RAW がなければ開けないので、そのときはテストをスキップする
+boost::test_tools::assertion_result can_open_raw(boost::unit_test::test_unit_id)
+{
+    boost::system::error_code ec;
+    boost::asio::io_service io_service;
+    acqua::asio::raw::socket socket(io_service);
+    socket.open(acqua::asio::raw(), ec);
+    boost::test_tools::assertion_result res(!ec);
+    res.message() << "raw socket: " << ec.message();
+    return res;
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(tx_ring, * boost::unit_test::precondition(can_open_raw))
+{
+    namespace nw = acqua::network;
+
+    boost::system::error_code ec;
+    boost::asio::io_service io_service;
+    acqua::asio::raw::endpoint ep("lo", ec);
+    acqua::asio::raw::socket socket(io_service);
+    socket.open(acqua::asio::raw(), ec);
+    BOOST_REQUIRE(!ec);
+    socket.bind(ep, ec);
+
+    acqua::asio::raw_tx_ring ring(socket, 2048, 4);
+    ring.commit(0, ec);
+    BOOST_TEST((ec == boost::asio::error::bad_descriptor));
+    ring.open(ec);
+    BOOST_REQUIRE(!ec);
+    BOOST_TEST(ring.is_open());
+
+    // prepare() していなければ送信待ちにできない
+    ring.commit(0, ec);
+    BOOST_TEST((ec == boost::asio::error::invalid_argument));
+    BOOST_TEST(ring.pending() == 0u);
+    BOOST_TEST(ring.max_frame_length() >= 1500u);
+
+    std::size_t cnt = 0;
+    for(auto buf = ring.prepare(); boost::asio::buffer_size(buf) > 0; buf = ring.prepare()) {
+        auto * beg = boost::asio::buffer_cast<char *>(buf);
+        auto * end = beg + boost::asio::buffer_size(buf);
+        auto * eth = nw::parse<nw::ethernet_header>(beg, end);
+        BOOST_REQUIRE(eth);
+        eth->protocol(eth->arp);
+        auto * arp = reinterpret_cast<nw::ethernet_arp *>(eth + 1);
+        arp->hardware(arp->ethernet);
+        arp->protocol(arp->ip);
+        arp->operation(arp->arp_request);
+        ring.commit(sizeof(*eth) + sizeof(*arp));
+        ++cnt;
+    }
+    BOOST_TEST(cnt >= 4u);
+    BOOST_TEST(ring.pending() == cnt);
+    ring.flush(ec);
+    BOOST_TEST(!ec);
+    BOOST_TEST(ring.pending() == 0u);
+
+    // close() したあとは、もう一度 open() できる
+    BOOST_TEST(boost::asio::buffer_size(ring.prepare()) > 0u);
+    ring.commit(sizeof(nw::ethernet_header));
+    ring.close();
+    BOOST_TEST(!ring.is_open());
+    BOOST_TEST(ring.pending() == 0u);
+    ring.open(ec);
+    BOOST_TEST(!ec);
+    BOOST_TEST(ring.is_open());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
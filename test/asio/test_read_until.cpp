@@ -0,0 +1,220 @@
+#include <acqua/asio/read_until.hpp>
+#include <boost/test/included/unit_test.hpp>
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/write.hpp>
+#include <boost/asio/local/stream_protocol.hpp>
+#include <boost/asio/local/connect_pair.hpp>
+#include <boost/asio/strand.hpp>
+#if BOOST_VERSION >= 106600
+# include <boost/asio/bind_executor.hpp>
+#endif
+
+BOOST_AUTO_TEST_SUITE(read_until)
+
+using socket_type = boost::asio::local::stream_protocol::socket;
+
+BOOST_AUTO_TEST_CASE(search_delimiter)
+{
+    std::string str = "abc\r\ndef\r";
+    std::size_t offset = 0;
+    BOOST_TEST(acqua::asio::detail::search_delimiter(str.data(), 3, offset, "\r\n") == 0u);
+    BOOST_TEST(offset == 3u);
+    BOOST_TEST(acqua::asio::detail::search_delimiter(str.data(), 4, offset, "\r\n") == 0u);
+    BOOST_TEST(offset == 3u);  // 区切り文字の途中から再開する
+    BOOST_TEST(acqua::asio::detail::search_delimiter(str.data(), str.size(), offset, "\r\n") == 5u);
+
+    offset = 5;
+    BOOST_TEST(acqua::asio::detail::search_delimiter(str.data(), str.size(), offset, "\r\n") == 0u);
+    BOOST_TEST(offset == 8u);
+}
+
+BOOST_AUTO_TEST_CASE(sync_read)
+{
+    boost::asio::io_service io_service;
+    socket_type rd(io_service), wr(io_service);
+    boost::asio::local::connect_pair(rd, wr);
+
+    boost::asio::write(wr, boost::asio::buffer(std::string("HTTP/1.1 200 OK\r\nHost: example.com\r\n\r\nbody")));
+
+    boost::asio::streambuf buf;
+    auto line = acqua::asio::read_until(rd, buf, "\r\n");
+    BOOST_TEST(line == "HTTP/1.1 200 OK\r\n");
+    buf.consume(line.size());
+
+    auto header = acqua::asio::read_until(rd, buf, "\r\n\r\n");
+    BOOST_TEST(header == "Host: example.com\r\n\r\n");
+    buf.consume(header.size());
+    BOOST_TEST(buf.size() == 4u);
+
+    boost::asio::write(wr, boost::asio::buffer(std::string("xxxxxxxx")));
+    boost::system::error_code ec;
+    acqua::asio::read_until(rd, buf, "\r\n", 8, ec);
+    BOOST_TEST(ec == boost::asio::error::not_found);
+
+    acqua::asio::read_until(rd, buf, "", 1024, ec);
+    BOOST_TEST(ec == boost::asio::error::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(async_read)
+{
+    boost::asio::io_service io_service;
+    socket_type rd(io_service), wr(io_service);
+    boost::asio::local::connect_pair(rd, wr);
+
+    boost::asio::streambuf buf;
+    std::vector<std::string> lines;
+    std::function<void(boost::system::error_code const &, boost::string_view)> on_read;
+    on_read = [&](boost::system::error_code const & error, boost::string_view line) {
+        if (error) return;
+        lines.push_back(line.to_string());
+        buf.consume(line.size());
+        acqua::asio::async_read_until(rd, buf, "\r\n", 1024, on_read);
+    };
+    acqua::asio::async_read_until(rd, buf, "\r\n", 1024, on_read);
+
+    // 区切り文字が分割されて届いても見つけられる
+    for(auto const * s : { "first", " line\r", "\nsecond\r\nthird\r\n" }) {
+        boost::asio::write(wr, boost::asio::buffer(std::string(s)));
+        io_service.poll();
+        io_service.reset();
+    }
+    wr.close();
+    io_service.run();
+
+    BOOST_TEST(lines.size() == 3u);
+    BOOST_TEST(lines[0] == "first line\r\n");
+    BOOST_TEST(lines[1] == "second\r\n");
+    BOOST_TEST(lines[2] == "third\r\n");
+}
+
+namespace {
+
+// asio_handler_invoke フックを数えるハンドラー
+struct counting_handler
+{
+    int * invoked_;
+    boost::system::error_code * error_;
+    std::string * line_;
+
+    void operator()(boost::system::error_code const & error, boost::string_view line)
+    {
+        *error_ = error;
+        *line_ = line.to_string();
+    }
+
+    template <typename Function>
+    friend void asio_handler_invoke(Function & function, counting_handler * this_handler)
+    {
+        ++*this_handler->invoked_;
+        function();
+    }
+
+    template <typename Function>
+    friend void asio_handler_invoke(Function const & function, counting_handler * this_handler)
+    {
+        ++*this_handler->invoked_;
+        function();
+    }
+};
+
+}
+
+BOOST_AUTO_TEST_CASE(async_hooks)
+{
+    boost::asio::io_service io_service;
+    socket_type rd(io_service), wr(io_service);
+    boost::asio::local::connect_pair(rd, wr);
+
+    // 途中の読み込みの完了も、ハンドラーのフックを通して呼ばれる
+    boost::asio::streambuf buf;
+    int invoked = 0;
+    boost::system::error_code error;
+    std::string line;
+    acqua::asio::async_read_until(rd, buf, "\r\n", 1024, counting_handler{&invoked, &error, &line});
+    for(auto const * s : { "a", "b", "c\r\n" }) {
+        boost::asio::write(wr, boost::asio::buffer(std::string(s)));
+        io_service.poll();
+        io_service.reset();
+    }
+    BOOST_TEST(!error);
+    BOOST_TEST(line == "abc\r\n");
+    BOOST_TEST(invoked >= 3);
+
+#if BOOST_VERSION >= 106600
+    // strand に関連付けたハンドラーは、strand の中で呼ばれる
+    boost::asio::io_service::strand strand(io_service);
+    bool in_strand = false;
+    buf.consume(buf.size());
+    acqua::asio::async_read_until(rd, buf, "\n", 1024, boost::asio::bind_executor(strand, [&](boost::system::error_code const &, boost::string_view) {
+        in_strand = strand.running_in_this_thread();
+    }));
+    for(auto const * s : { "x", "y\n" }) {
+        boost::asio::write(wr, boost::asio::buffer(std::string(s)));
+        io_service.poll();
+        io_service.reset();
+    }
+    BOOST_TEST(in_strand);
+#endif
+}
+
+BOOST_AUTO_TEST_CASE(async_empty_delimiter)
+{
+    boost::asio::io_service io_service;
+    socket_type rd(io_service), wr(io_service);
+    boost::asio::local::connect_pair(rd, wr);
+
+    boost::asio::streambuf buf;
+    boost::system::error_code error;
+    bool called = false;
+    acqua::asio::async_read_until(rd, buf, "", 1024, [&](boost::system::error_code const & ec, boost::string_view) {
+        error = ec;
+        called = true;
+    });
+    BOOST_TEST(!called);  // 開始した関数の中では呼ばない
+    io_service.run();
+    BOOST_TEST(called);
+    BOOST_TEST(error == boost::asio::error::invalid_argument);
+}
+
+#if BOOST_VERSION >= 106600
+namespace {
+
+// async_read_some を呼ばれた回数を数えるストリーム. 読み込みは完了させない
+struct counting_stream
+{
+    using executor_type = boost::asio::io_service::executor_type;
+
+    executor_type get_executor() { return io_service_.get_executor(); }
+
+    template <typename MutableBuffers, typename Handler>
+    void async_read_some(MutableBuffers const &, Handler &&)
+    {
+        ++reads_;
+    }
+
+    boost::asio::io_service & io_service_;
+    int reads_;
+};
+
+}
+
+BOOST_AUTO_TEST_CASE(async_buffered)
+{
+    // 区切り文字がすでに受信済みであれば、読み込みをせずに非同期に完了する
+    boost::asio::io_service io_service;
+    counting_stream s{io_service, 0};
+    boost::asio::streambuf buf;
+    std::ostream(&buf) << "line\r\nrest";
+
+    std::string line;
+    acqua::asio::async_read_until(s, buf, "\r\n", 1024, [&](boost::system::error_code const &, boost::string_view res) {
+        line = res.to_string();
+    });
+    BOOST_TEST(line.empty());
+    io_service.run();
+    BOOST_TEST(line == "line\r\n");
+    BOOST_TEST(s.reads_ == 0);
+}
+#endif
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,81 @@
+#include <acqua/asio/smtp/client.hpp>
+#include <boost/test/included/unit_test.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/read_until.hpp>
+#include <boost/asio/streambuf.hpp>
+#include <boost/asio/write.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+#include <boost/iostreams/copy.hpp>
+#include <sstream>
+
+BOOST_AUTO_TEST_SUITE(smtp_client)
+
+namespace {
+
+namespace io = acqua::iostreams;
+
+std::string data_in(std::string const & str)
+{
+    std::istringstream iss(str);
+    boost::iostreams::filtering_istream in;
+    in.push(acqua::asio::smtp::detail::data_filter());
+    in.push(io::newline_filter(io::newline::crln));
+    in.push(iss);
+    std::ostringstream oss;
+    boost::iostreams::copy(in, oss);
+    return oss.str();
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(data_filter)
+{
+    // 改行を CRLF にそろえ、行頭の '.' を ".." にする
+    BOOST_TEST(data_in("a\n.b\r\n.\nc.\n") == "a\r\n..b\r\n..\r\nc.\r\n.\r\n");
+    BOOST_TEST(data_in(".") == "..\r\n.\r\n");
+    BOOST_TEST(data_in("a") == "a\r\n.\r\n");
+    BOOST_TEST(data_in("") == ".\r\n");
+
+    // 最後の "." だけの行は終端として扱う
+    BOOST_TEST(data_in("a\r\n.\r\n") == "a\r\n.\r\n");
+    BOOST_TEST(data_in("a\n.\n") == "a\r\n.\r\n");
+    BOOST_TEST(data_in(".\r\n.\r\n") == "..\r\n.\r\n");
+}
+
+BOOST_AUTO_TEST_CASE(data)
+{
+    boost::asio::io_service io_service;
+    boost::asio::ip::tcp::acceptor acceptor(io_service, boost::asio::ip::tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0));
+    std::string port = std::to_string(acceptor.local_endpoint().port());
+    std::string received;
+
+    boost::asio::spawn(io_service, [&](boost::asio::yield_context yield) {
+        boost::asio::ip::tcp::socket socket(io_service);
+        acceptor.async_accept(socket, yield);
+        boost::asio::async_write(socket, boost::asio::buffer("220 ready\r\n", 11), yield);
+
+        boost::asio::streambuf buf;
+        std::size_t size = boost::asio::async_read_until(socket, buf, "\r\n", yield);
+        BOOST_TEST(std::string(boost::asio::buffer_cast<char const *>(buf.data()), size) == "DATA\r\n");
+        buf.consume(size);
+        boost::asio::async_write(socket, boost::asio::buffer("354 go ahead\r\n", 14), yield);
+
+        size = boost::asio::async_read_until(socket, buf, "\r\n.\r\n", yield);
+        received.assign(boost::asio::buffer_cast<char const *>(buf.data()), size);
+        boost::asio::async_write(socket, boost::asio::buffer("250 ok\r\n", 8), yield);
+    });
+
+    uint res = 0;
+    boost::asio::spawn(io_service, [&](boost::asio::yield_context yield) {
+        acqua::asio::smtp::client smtp(io_service);
+        BOOST_TEST(smtp.connect(yield, "127.0.0.1", port) == 220u);
+        std::istringstream iss("Subject: test\n\n.hidden\nbody\n");
+        res = smtp.data(yield, iss);
+    });
+    io_service.run();
+
+    BOOST_TEST(res == 250u);
+    BOOST_TEST(received == "Subject: test\r\n\r\n..hidden\r\nbody\r\n.\r\n");
+}
+
+BOOST_AUTO_TEST_SUITE_END()
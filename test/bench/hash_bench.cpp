@@ -0,0 +1,127 @@
+/*!
+  crypto フィルタの変更前後を比べるベンチマーク.
+
+  usage: hash_bench [-n MESSAGES] [-l LENGTH]
+
+    -n  メッセージの数 (既定 200000)
+    -l  1 つのメッセージの長さ (既定 256). Webhook の署名くらいの小さなメッセージを想定する
+
+  before はメッセージごとに HMAC_CTX を作って HMAC_Init_ex で鍵を設定する、以前のフィルタと同じ手順。
+  hmac_sha256_filter はフィルタを作るたびに鍵の前処理をし、hmac_sha256_key は前処理済みの鍵を使い回す。
+  sha256 の before は以前のフィルタと同じ SHA256_Init などの低レベルの関数で計算する。
+ */
+// before の計算には OpenSSL 3 で非推奨になった関数を使う
+#define OPENSSL_SUPPRESS_DEPRECATED
+
+extern "C" {
+#include <unistd.h>
+#include <openssl/hmac.h>
+#include <openssl/sha.h>
+}
+
+#include <acqua/iostreams/crypto/hmac_filter.hpp>
+#include <acqua/iostreams/crypto/sha256_filter.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+#include <boost/iostreams/device/null.hpp>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+namespace {
+
+using clock_type = std::chrono::steady_clock;
+
+//! 計算を最適化で消されないように結果を書き込む
+unsigned char volatile sink_byte = 0;
+
+template <typename F>
+void measure(char const * name, std::size_t messages, std::size_t length, F f)
+{
+    unsigned char digest[32];
+    auto start = clock_type::now();
+    for(std::size_t i = 0; i < messages; ++i) {
+        f(digest);
+        sink_byte = static_cast<unsigned char>(sink_byte ^ digest[0]);
+    }
+    double sec = std::chrono::duration<double>(clock_type::now() - start).count();
+    std::cout << std::left << std::setw(24) << name << std::right << std::fixed
+              << std::setprecision(0) << std::setw(12) << (static_cast<double>(messages) / sec)
+              << std::setprecision(1) << std::setw(10) << (sec * 1e9 / static_cast<double>(messages))
+              << std::setw(10) << (static_cast<double>(messages * length) / sec / 1e6) << std::endl;
+}
+
+}
+
+int main(int argc, char ** argv)
+{
+    std::size_t messages = 200000;
+    std::size_t length = 256;
+
+    int opt;
+    while((opt = ::getopt(argc, argv, "n:l:")) != -1) {
+        switch(opt) {
+            case 'n': messages = std::max<std::size_t>(1, std::stoul(optarg)); break;
+            case 'l': length = std::stoul(optarg); break;
+            default:
+                std::cerr << "usage: " << argv[0] << " [-n MESSAGES] [-l LENGTH]" << std::endl;
+                return 1;
+        }
+    }
+
+    std::string const secret = "whsec_0123456789abcdef0123456789abcdef";
+    std::string const message(length, 'm');
+
+    std::cout << std::left << std::setw(24) << "case" << std::right
+              << std::setw(12) << "msgs/s" << std::setw(10) << "ns/msg" << std::setw(10) << "MB/s" << std::endl;
+
+    measure("hmac-sha256 before", messages, length, [&](unsigned char * digest) {
+        ::HMAC_CTX * ctx = ::HMAC_CTX_new();
+        unsigned int len = 32;
+        ::HMAC_Init_ex(ctx, secret.data(), static_cast<int>(secret.size()), ::EVP_sha256(), nullptr);
+        ::HMAC_Update(ctx, reinterpret_cast<unsigned char const *>(message.data()), message.size());
+        ::HMAC_Final(ctx, digest, &len);
+        ::HMAC_CTX_free(ctx);
+    });
+
+    measure("hmac_sha256_filter", messages, length, [&](unsigned char * digest) {
+        boost::iostreams::filtering_ostream out;
+        out.push(acqua::iostreams::hmac_sha256_filter(*reinterpret_cast<unsigned char (*)[32]>(digest), secret));
+        out.push(boost::iostreams::null_sink());
+        out.write(message.data(), static_cast<std::streamsize>(message.size()));
+    });
+
+    acqua::iostreams::hmac_sha256_key key(secret);
+    measure("hmac_sha256_key", messages, length, [&](unsigned char * digest) {
+        boost::iostreams::filtering_ostream out;
+        out.push(acqua::iostreams::hmac_sha256_filter(*reinterpret_cast<unsigned char (*)[32]>(digest), key));
+        out.push(boost::iostreams::null_sink());
+        out.write(message.data(), static_cast<std::streamsize>(message.size()));
+    });
+
+    measure("hmac_context + key", messages, length, [&](unsigned char * digest) {
+        acqua::iostreams::crypto::hmac_context<acqua::iostreams::crypto::hmac_sha256_engine> ctx;
+        boost::system::error_code ec;
+        ctx.init(key, ec);
+        ctx.update(message.data(), message.size(), ec);
+        ctx.finish(digest, 32, ec);
+    });
+
+    measure("sha256 before", messages, length, [&](unsigned char * digest) {
+        ::SHA256_CTX ctx;
+        ::SHA256_Init(&ctx);
+        ::SHA256_Update(&ctx, message.data(), message.size());
+        ::SHA256_Final(digest, &ctx);
+    });
+
+    measure("sha256_context", messages, length, [&](unsigned char * digest) {
+        acqua::iostreams::crypto::sha256_context ctx;
+        boost::system::error_code ec;
+        ctx.init(ec);
+        ctx.update(message.data(), message.size(), ec);
+        ctx.finish(digest, 32, ec);
+    });
+
+    return 0;
+}
@@ -0,0 +1,212 @@
+/*!
+  json_parser と SAX のトークナイザの速さを測るベンチマーク.
+
+  usage: json_bench [-n RECORDS] [-r ROUNDS] [-f PATH]
+
+    -n  test/iostreams/sample.json と同じ形のレコードの数 (既定 2000)
+    -r  繰り返す回数 (既定 20)
+    -f  レコードを作る代わりに読み込む JSON のファイル
+
+  ptree は boost::property_tree::read_json、json_parser は json_adapt<ptree> を通して ptree を作る。
+  struct は BOOST_FUSION_ADAPT_STRUCT で宣言した構造体の配列に直接格納する。
+  tokenizer は何もしないハンドラで字句解析だけを測る。
+  write_json と json_writer は ptree からテキストを作り、generator はトークナイザから直接つないで整形し直す。
+ */
+extern "C" {
+#include <unistd.h>
+}
+
+#include <acqua/iostreams/json_parser.hpp>
+#include <acqua/iostreams/json_adapt_boost_ptree.hpp>
+#include <acqua/iostreams/json_adapt_struct.hpp>
+#include <acqua/iostreams/json_tokenizer.hpp>
+#include <acqua/iostreams/json_generator.hpp>
+#include <acqua/iostreams/json_writer.hpp>
+#include <boost/iostreams/copy.hpp>
+#include <boost/iostreams/device/back_inserter.hpp>
+#include <boost/iostreams/stream.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <boost/property_tree/json_parser.hpp>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace bench {
+
+struct friend_type
+{
+    int id;
+    std::string name;
+};
+
+struct record
+{
+    std::string _id;
+    long index;
+    std::string guid;
+    bool isActive;
+    std::string balance;
+    int age;
+    std::string name;
+    std::string email;
+    std::string address;
+    std::string about;
+    double latitude;
+    double longitude;
+    std::vector<std::string> tags;
+    std::vector<friend_type> friends;
+};
+
+}
+
+BOOST_FUSION_ADAPT_STRUCT(bench::friend_type, id, name)
+BOOST_FUSION_ADAPT_STRUCT(bench::record, _id, index, guid, isActive, balance, age, name, email, address, about, latitude, longitude, tags, friends)
+
+namespace {
+
+using clock_type = std::chrono::steady_clock;
+
+//! 計算を最適化で消されないように結果を書き込む
+std::size_t volatile sink_value = 0;
+
+std::string make_document(std::size_t records)
+{
+    std::ostringstream oss;
+    oss << "[\n";
+    for(std::size_t i = 0; i < records; ++i) {
+        oss << (i == 0 ? "" : ",\n")
+            << "  {\n"
+            << "    \"_id\": \"553b587f3212c95c5d16" << std::setw(4) << std::setfill('0') << (i % 10000) << "\",\n"
+            << "    \"index\": " << i << ",\n"
+            << "    \"guid\": \"7a05ac31-f974-4777-b2fb-2352ffc70311\",\n"
+            << "    \"isActive\": " << (i % 2 ? "true" : "false") << ",\n"
+            << "    \"balance\": \"$2,558.37\",\n"
+            << "    \"age\": " << (20 + i % 50) << ",\n"
+            << "    \"name\": \"Mcgowan Barry\",\n"
+            << "    \"email\": \"mcgowanbarry@dancerity.com\",\n"
+            << "    \"address\": \"701 Baltic Street, Bridgetown, Wyoming, 6310\",\n"
+            << "    \"about\": \"Consectetur nulla non proident velit officia do elit officia.\\r\\n\",\n"
+            << "    \"latitude\": -28.880681,\n"
+            << "    \"longitude\": -172.850388,\n"
+            << "    \"tags\": [\"adipisicing\", \"occaecat\", \"esse\", \"enim\"],\n"
+            << "    \"friends\": [{\"id\": 0, \"name\": \"Le Flowers\"}, {\"id\": 1, \"name\": \"Shanna Bray\"}]\n"
+            << "  }";
+    }
+    oss << "\n]\n";
+    return oss.str();
+}
+
+struct count_handler : acqua::iostreams::json::sax_handler
+{
+    void string(view_type str) { count += str.size(); }
+    void key(view_type str) { count += str.size(); }
+    void number(long) { ++count; }
+    void number(double) { ++count; }
+
+    std::size_t count = 0;
+};
+
+template <typename F>
+void measure(char const * name, std::string const & doc, std::size_t rounds, F f)
+{
+    auto start = clock_type::now();
+    for(std::size_t i = 0; i < rounds; ++i)
+        sink_value = sink_value + f();
+    double sec = std::chrono::duration<double>(clock_type::now() - start).count();
+    std::cout << std::left << std::setw(16) << name << std::right << std::fixed
+              << std::setprecision(2) << std::setw(12) << (sec * 1e3 / static_cast<double>(rounds))
+              << std::setprecision(1) << std::setw(10) << (static_cast<double>(doc.size() * rounds) / sec / 1e6) << std::endl;
+}
+
+}
+
+int main(int argc, char ** argv)
+{
+    std::size_t records = 2000;
+    std::size_t rounds = 20;
+    std::string path;
+
+    int opt;
+    while((opt = ::getopt(argc, argv, "n:r:f:")) != -1) {
+        switch(opt) {
+            case 'n': records = std::stoul(optarg); break;
+            case 'r': rounds = std::max<std::size_t>(1, std::stoul(optarg)); break;
+            case 'f': path = optarg; break;
+            default:
+                std::cerr << "usage: " << argv[0] << " [-n RECORDS] [-r ROUNDS] [-f PATH]" << std::endl;
+                return 1;
+        }
+    }
+
+    std::string doc;
+    if (path.empty()) {
+        doc = make_document(records);
+    } else {
+        std::ifstream ifs(path);
+        doc.assign(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+    }
+
+    std::cout << std::left << std::setw(16) << "case" << std::right
+              << std::setw(12) << "ms/doc" << std::setw(10) << "MB/s" << std::endl;
+
+    measure("ptree", doc, rounds, [&]() {
+        boost::property_tree::ptree json;
+        std::istringstream iss(doc);
+        boost::property_tree::read_json(iss, json);
+        return json.size();
+    });
+
+    measure("json_parser", doc, rounds, [&]() {
+        boost::property_tree::ptree json;
+        acqua::iostreams::json_parser<boost::property_tree::ptree> parser(json);
+        parser.write(doc.data(), static_cast<std::streamsize>(doc.size()));
+        return json.size();
+    });
+
+    measure("struct", doc, rounds, [&]() {
+        std::vector<bench::record> parsed;
+        acqua::iostreams::json_parser<std::vector<bench::record> > parser(parsed);
+        parser.write(doc.data(), static_cast<std::streamsize>(doc.size()));
+        return parsed.size();
+    });
+
+    measure("tokenizer", doc, rounds, [&]() {
+        count_handler handler;
+        acqua::iostreams::json::basic_tokenizer<count_handler> tok(handler);
+        tok.write(doc.data(), doc.size());
+        return handler.count;
+    });
+
+    boost::property_tree::ptree tree;
+    do {
+        std::istringstream iss(doc);
+        boost::property_tree::read_json(iss, tree);
+    } while(false);
+
+    measure("write_json", doc, rounds, [&]() {
+        std::ostringstream oss;
+        boost::property_tree::write_json(oss, tree, false);
+        return oss.str().size();
+    });
+
+    measure("json_writer", doc, rounds, [&]() {
+        std::string out;
+        boost::iostreams::stream<acqua::iostreams::json_writer<boost::property_tree::ptree> > in(tree);
+        boost::iostreams::copy(in, boost::iostreams::back_inserter(out));
+        return out.size();
+    });
+
+    measure("generator", doc, rounds, [&]() {
+        std::string out;
+        acqua::iostreams::json::generator gen(out);
+        acqua::iostreams::json::basic_tokenizer<acqua::iostreams::json::generator> tok(gen);
+        tok.write(doc.data(), doc.size());
+        return out.size();
+    });
+
+    return 0;
+}
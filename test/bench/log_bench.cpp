@@ -0,0 +1,281 @@
+/*!
+  acqua::log のスループットとレイテンシを測るベンチマーク.
+
+  usage: log_bench [-n LINES] [-t THREADS] [-s SINKS] [-m MODES] [-o PATH]
+
+    -n  スレッドごとの行数 (既定 100000)
+    -t  最大スレッド数. 1, 2, 4, ... と倍にしながら測る (既定 hardware_concurrency)
+    -s  シンクをカンマ区切りで指定する. console, null, file (既定 すべて)
+    -m  モードをカンマ区切りで指定する. sync, async (既定 両方)
+    -o  file シンクの出力先 (既定 /tmp/acqua_log_bench.log)
+
+  console は既定のロガーの標準出力のシンクで、std::cout を /dev/null に付け替えて測る。
+  レイテンシは LOG 文1つの前後で steady_clock を読んだ差なので、時計の読み込みの分だけ大きく出る。
+  非同期モードの lines/s は、最後の行がシンクに書き出されるまでの時間で計算する。
+ */
+extern "C" {
+#include <unistd.h>
+}
+
+#include <acqua/log/logging.hpp>
+#include <acqua/log/loggable.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../log/counting_new.hpp"
+
+namespace {
+
+std::atomic<std::size_t> allocations{0};
+
+}
+
+void count_allocation() noexcept
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+}
+
+namespace {
+
+using clock_type = std::chrono::steady_clock;
+using logger_type = acqua::log::core::logger;
+using sink_type = logger_type::sink_type;
+
+std::size_t const ring_capacity = 8192;
+
+//! 何も書き出さないシンク. 整形とキューの費用だけを測る
+class null_sink
+    : public sink_type
+{
+public:
+    virtual void write(char const *, std::size_t) const override {}
+    virtual void write(struct ::iovec const *, std::size_t) const override {}
+};
+
+struct session
+    : acqua::log::loggable<session>
+{
+    explicit session(int id)
+        : id_(id) {}
+
+    void handle(std::size_t i)
+    {
+        LOG(notice) << "session " << id_ << " state " << states[i % 3] << " request " << i << " from " << this;
+    }
+
+    static char const * const states[3];
+    int id_;
+};
+
+char const * const session::states[3] = { "reading", "writing", "closing" };
+
+//! 実際のサーバのログに近い、文字列・整数・浮動小数点・ポインタの混ざった4種類の行を順に出力する
+inline void log_line(std::size_t i, session & s, std::string const & peer)
+{
+    switch(i % 4) {
+        case 0:
+            LOG(info) << "accepted connection from " << peer << ':' << (40000 + i % 20000);
+            break;
+        case 1:
+            LOG(debug) << "read " << (i * 37 % 65536) << " bytes in " << (static_cast<double>(i % 1000) / 7.0) << " ms";
+            break;
+        case 2:
+            s.handle(i);
+            break;
+        default:
+            LOG(warning) << "retry " << (i % 5) << '/' << 5 << " for " << peer << ": " << "Resource temporarily unavailable";
+            break;
+    }
+}
+
+struct result
+{
+    double lines_per_sec;
+    std::vector<std::uint32_t> latency;
+    double allocs_per_line;
+};
+
+result run(logger_type & logger, std::size_t threads, std::size_t lines)
+{
+    std::size_t const warmup = std::min<std::size_t>(lines, 1000);
+    std::vector< std::vector<std::uint32_t> > latency(threads);
+    for(auto & vec : latency)
+        vec.reserve(lines);
+
+    std::atomic<std::size_t> ready{0};
+    std::atomic<bool> go{false};
+    std::vector<std::thread> workers;
+    for(std::size_t t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t]() {
+                session s(static_cast<int>(t));
+                std::string peer = "192.0.2." + std::to_string(t + 1);
+
+                // スレッドごとのバッファを確保させてから測る
+                for(std::size_t i = 0; i < warmup; ++i)
+                    log_line(i, s, peer);
+
+                ++ready;
+                while(!go.load())
+                    std::this_thread::yield();
+
+                auto & vec = latency[t];
+                for(std::size_t i = 0; i < lines; ++i) {
+                    auto beg = clock_type::now();
+                    log_line(i, s, peer);
+                    auto end = clock_type::now();
+                    vec.push_back(static_cast<std::uint32_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - beg).count()));
+                }
+            });
+    }
+
+    while(ready.load() != threads)
+        std::this_thread::yield();
+    logger.flush();
+
+    std::size_t allocs = allocations.load();
+    auto beg = clock_type::now();
+    go = true;
+    for(auto & th : workers)
+        th.join();
+    logger.flush();
+    auto end = clock_type::now();
+    allocs = allocations.load() - allocs;
+
+    result res;
+    std::size_t total = threads * lines;
+    res.lines_per_sec = static_cast<double>(total) / std::chrono::duration<double>(end - beg).count();
+    res.allocs_per_line = static_cast<double>(allocs) / static_cast<double>(total);
+    res.latency.reserve(total);
+    for(auto const & vec : latency)
+        res.latency.insert(res.latency.end(), vec.begin(), vec.end());
+    std::sort(res.latency.begin(), res.latency.end());
+    return res;
+}
+
+std::uint32_t percentile(std::vector<std::uint32_t> const & sorted, double p)
+{
+    if (sorted.empty())
+        return 0;
+    std::size_t i = static_cast<std::size_t>(p / 100.0 * static_cast<double>(sorted.size() - 1));
+    return sorted[i];
+}
+
+std::vector<std::string> split(std::string const & str)
+{
+    std::vector<std::string> vec;
+    std::istringstream iss(str);
+    std::string item;
+    while(std::getline(iss, item, ','))
+        vec.push_back(item);
+    return vec;
+}
+
+bool contains(std::vector<std::string> const & vec, char const * str)
+{
+    return std::find(vec.begin(), vec.end(), str) != vec.end();
+}
+
+}
+
+int main(int argc, char ** argv)
+{
+    std::size_t lines = 100000;
+    std::size_t max_threads = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<std::string> sinks = { "console", "null", "file" };
+    std::vector<std::string> modes = { "sync", "async" };
+    std::string path = "/tmp/acqua_log_bench.log";
+
+    int opt;
+    while((opt = ::getopt(argc, argv, "n:t:s:m:o:")) != -1) {
+        switch(opt) {
+            case 'n': lines = std::max<std::size_t>(1, std::stoul(optarg)); break;
+            case 't': max_threads = std::max<std::size_t>(1, std::stoul(optarg)); break;
+            case 's': sinks = split(optarg); break;
+            case 'm': modes = split(optarg); break;
+            case 'o': path = optarg; break;
+            default:
+                std::cerr << "usage: " << argv[0] << " [-n LINES] [-t THREADS] [-s console,null,file] [-m sync,async] [-o PATH]" << std::endl;
+                return 1;
+        }
+    }
+
+    // 結果は元の標準出力に書き、std::cout は console シンクのために /dev/null に付け替える
+    std::ostream report(std::cout.rdbuf());
+    std::filebuf devnull;
+    devnull.open("/dev/null", std::ios::out);
+    std::cout.rdbuf(&devnull);
+
+    auto logger = acqua::log::core::get_default();
+    logger->set_format("%F %T.%U [%L] %t - %v");
+
+    report << std::left
+           << std::setw(8) << "sink" << std::setw(7) << "mode" << std::setw(8) << "threads"
+           << std::right
+           << std::setw(12) << "lines/s" << std::setw(9) << "p50" << std::setw(9) << "p90"
+           << std::setw(9) << "p99" << std::setw(9) << "p99.9" << std::setw(11) << "max(ns)"
+           << std::setw(13) << "allocs/line" << std::endl;
+
+    // 既定のシンクは取り除くと戻せないので、console を最初に測る
+    std::vector<char const *> order;
+    for(char const * name : { "console", "null", "file" })
+        if (contains(sinks, name))
+            order.push_back(name);
+
+    bool popped = false;
+    for(char const * name : order) {
+        std::shared_ptr<sink_type> sink;
+        if (std::string(name) != "console") {
+            if (!popped) {
+                logger->pop();
+                popped = true;
+            }
+            if (std::string(name) == "null")
+                sink = std::make_shared<null_sink>();
+            else
+                sink = std::make_shared< acqua::log::sinks::file_sink<char, std::mutex> >(path);
+            logger->push(sink);
+        }
+
+        for(auto const & mode : modes) {
+            if (mode == "async") {
+                // リングバッファのセルの文字列が容量を持つまで、一巡させてから測る
+                logger->set_async(ring_capacity);
+                run(*logger, 1, ring_capacity * 2);
+            }
+            for(std::size_t threads = 1; threads <= max_threads; threads *= 2) {
+                auto res = run(*logger, threads, lines);
+                report << std::left
+                       << std::setw(8) << name << std::setw(7) << mode << std::setw(8) << threads
+                       << std::right << std::fixed << std::setprecision(0)
+                       << std::setw(12) << res.lines_per_sec
+                       << std::setw(9) << percentile(res.latency, 50)
+                       << std::setw(9) << percentile(res.latency, 90)
+                       << std::setw(9) << percentile(res.latency, 99)
+                       << std::setw(9) << percentile(res.latency, 99.9)
+                       << std::setw(11) << res.latency.back()
+                       << std::setprecision(3) << std::setw(13) << res.allocs_per_line << std::endl;
+            }
+            logger->set_sync();
+        }
+
+        if (sink) {
+            logger->remove(*sink);
+            sink.reset();
+            if (std::string(name) == "file")
+                std::remove(path.c_str());
+        }
+    }
+
+    std::cout.rdbuf(report.rdbuf());
+    return 0;
+}
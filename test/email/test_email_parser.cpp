@@ -16,4 +16,22 @@ BOOST_AUTO_TEST_CASE(basics)
     email.dump(std::cout);
 }
 
+BOOST_AUTO_TEST_CASE(ascii_payload)
+{
+    // 本文は改行コードを除いた行ごとに ascii_decoder に渡すので、ascii_decoder が改行を LF にそろえても本文には影響しない
+    acqua::email::email email;
+    std::string src =
+        "Content-Type: text/plain; charset=us-ascii\r\n"
+        "\r\n"
+        "abc \r\n"
+        "def\tghi\r\n"
+        "jkl \r\n";
+    do {
+        boost::iostreams::filtering_ostream out;
+        out.push(acqua::email::email_parser(email));
+        out.write(src.data(), static_cast<std::streamsize>(src.size()));
+    } while(false);
+    BOOST_TEST(email->str() == "abc def\tghijkl ");
+}
+
 BOOST_AUTO_TEST_SUITE_END()
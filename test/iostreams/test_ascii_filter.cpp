@@ -137,4 +137,22 @@ BOOST_AUTO_TEST_CASE(multiline)
     } while(false);
 }
 
+BOOST_AUTO_TEST_CASE(decoder_newline)
+{
+    // ソフト改行は空白ごと取り除き、それ以外の改行は LF にする。区切りがどこにあっても同じになる
+    std::string src = "abc \r\ndef\r\nghi\t\nj k\rl  \n\r\nend ";
+    std::string expected = "abcdef\nghij k\nl \nend ";
+    for(std::size_t size = 1; size <= src.size(); ++size) {
+        std::ostringstream oss;
+        do {
+            boost::iostreams::filtering_ostream out;
+            out.push(acqua::iostreams::ascii_decoder());
+            out.push(oss);
+            for(std::size_t pos = 0; pos < src.size(); pos += size)
+                out.write(src.data() + pos, static_cast<std::streamsize>(std::min(size, src.size() - pos)));
+        } while(false);
+        BOOST_TEST(oss.str() == expected);
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
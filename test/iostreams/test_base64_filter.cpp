@@ -4,6 +4,8 @@
 #include <boost/iostreams/copy.hpp>
 #include <boost/algorithm/string/replace.hpp>
 #include <sstream>
+#include <random>
+#include <vector>
 
 BOOST_AUTO_TEST_SUITE(base64_filter)
 
@@ -244,4 +246,106 @@ BOOST_AUTO_TEST_CASE(convert_binary)
     BOOST_TEST(fo(io::base64_url_decoder(), encoded) == binary);
 }
 
+namespace {
+
+std::string random_binary(std::size_t size, unsigned int seed)
+{
+    std::mt19937 gen(seed);
+    std::string str(size, '\0');
+    for(auto & ch : str)
+        ch = static_cast<char>(gen());
+    return str;
+}
+
+//! 1文字ずつ変換した結果を、len 文字ごとに nl で改行する
+std::string reference_encode(std::string const & bin, std::string const & nl, std::size_t len)
+{
+    auto const & tbl = io::base64_traits::table();
+    std::string str;
+    for(std::size_t i = 0; i < bin.size(); i += 3) {
+        unsigned char b[3] = { 0, 0, 0 };
+        std::size_t n = std::min<std::size_t>(3, bin.size() - i);
+        for(std::size_t j = 0; j < n; ++j)
+            b[j] = static_cast<unsigned char>(bin[i + j]);
+        char group[4];
+        io::detail::base64_encode_scalar(tbl, b, 1, group);
+        for(std::size_t j = n + 1; j < 4; ++j)
+            group[j] = '=';
+        str.append(group, 4);
+    }
+    if (nl.empty())
+        return str;
+
+    std::string res;
+    for(std::size_t i = 0; i < str.size(); i += len)
+        res += str.substr(i, len) + nl;
+    return res;
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(convert_blocks)
+{
+    // SIMD のブロックの境界と、前回の残りを跨ぐ長さを試す
+    for(std::size_t size : { 0, 1, 2, 3, 11, 12, 13, 15, 16, 17, 27, 28, 29, 47, 48, 49, 57, 100, 1000, 3071, 3072, 3073, 10000, 100000 }) {
+        std::string bin = random_binary(size, static_cast<unsigned int>(size));
+
+        BOOST_TEST(fi(io::base64_encoder(), bin) == reference_encode(bin, "", 0));
+        BOOST_TEST(fo(io::base64_encoder(), bin) == reference_encode(bin, "", 0));
+        BOOST_TEST(fi(io::base64_encoder(io::newline::crln, 78), bin) == reference_encode(bin, "\r\n", 76));
+        BOOST_TEST(fo(io::base64_encoder(io::newline::ln, 65), bin) == reference_encode(bin, "\n", 64));
+
+        BOOST_TEST(fi(io::base64_decoder(), reference_encode(bin, "", 0)) == bin);
+        BOOST_TEST(fo(io::base64_decoder(), reference_encode(bin, "\r\n", 76)) == bin);
+        BOOST_TEST(fi(io::base64_decoder(), reference_encode(bin, "\n", 64)) == bin);
+
+        BOOST_TEST(fo(io::base64_url_decoder(), fi(io::base64_url_encoder(io::newline::ln, 76), bin)) == bin);
+        BOOST_TEST(fi(io::base64_url_decoder(), fo(io::base64_url_encoder(), bin)) == bin);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(decode_skips_garbage)
+{
+    std::string bin = random_binary(3000, 1);
+    std::string str = reference_encode(bin, "", 0);
+
+    // ブロックの途中に base64 以外の文字が入っていても読み飛ばす
+    std::string noisy;
+    for(std::size_t i = 0; i < str.size(); ++i) {
+        noisy += str[i];
+        if (i % 37 == 5) noisy += ' ';
+        if (i % 101 == 7) noisy += "\r\n";
+        if (i % 251 == 9) noisy += '\xff';
+    }
+    BOOST_TEST(fi(io::base64_decoder(), noisy) == bin);
+    BOOST_TEST(fo(io::base64_decoder(), noisy) == bin);
+}
+
+BOOST_AUTO_TEST_CASE(codec_matches_scalar)
+{
+    std::vector<io::detail::base64_codec> codecs = { io::detail::base64_codec::instance() };
+#if defined(ACQUA_IOSTREAMS_BASE64_X86)
+    if (__builtin_cpu_supports("ssse3"))
+        codecs.push_back({ &io::detail::base64_encode_ssse3, &io::detail::base64_decode_ssse3, "ssse3" });
+#endif
+
+    std::string bin = random_binary(3 * 1000, 2);
+    for(auto const & codec : codecs) {
+        BOOST_TEST_MESSAGE("base64 codec: " << codec.name);
+        for(auto const * tbl : { &io::base64_traits::table(), &io::base64_url_traits::table() }) {
+            std::string expected(4 * 1000, '\0');
+            io::detail::base64_encode_scalar(*tbl, reinterpret_cast<unsigned char const *>(bin.data()), 1000, &expected[0]);
+
+            std::string encoded(4 * 1000, '\0');
+            std::size_t done = codec.encode(*tbl, reinterpret_cast<unsigned char const *>(bin.data()), 1000, &encoded[0]);
+            BOOST_TEST(encoded.substr(0, done * 4) == expected.substr(0, done * 4));
+
+            std::string decoded(3 * 1000 + 32, '\0');
+            done = codec.decode(*tbl, expected.data(), expected.size(), reinterpret_cast<unsigned char *>(&decoded[0]));
+            BOOST_TEST(done % 16 == 0u);
+            BOOST_TEST(decoded.substr(0, done / 4 * 3) == bin.substr(0, done / 4 * 3));
+        }
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
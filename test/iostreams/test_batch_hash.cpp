@@ -0,0 +1,144 @@
+#include <acqua/iostreams/crypto/batch_hash.hpp>
+#include <acqua/iostreams/crypto/tree_hash.hpp>
+#include <boost/test/included/unit_test.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+#include <random>
+#include <string>
+#include <vector>
+
+BOOST_AUTO_TEST_SUITE(batch_hash)
+
+template <typename Context, std::size_t N>
+std::array<unsigned char, N> digest_of(std::string const & str)
+{
+    std::array<unsigned char, N> res;
+    boost::system::error_code ec;
+    Context ctx;
+    ctx.init(ec);
+    ctx.update(str.data(), str.size(), ec);
+    ctx.finish(res.data(), N, ec);
+    BOOST_TEST(!ec);
+    return res;
+}
+
+std::vector<std::string> make_inputs()
+{
+    // パディングが 1 ブロックと 2 ブロックになる境目を含める
+    std::mt19937 gen(12345);
+    std::vector<std::string> inputs;
+    for(std::size_t len : { 0, 1, 3, 55, 56, 63, 64, 65, 119, 120, 128, 1000, 4096, 10000 }) {
+        std::string str(len, '\0');
+        for(auto & ch : str)
+            ch = static_cast<char>(gen());
+        inputs.push_back(str);
+    }
+    inputs.push_back("abc");
+    return inputs;
+}
+
+template <typename Batch, typename Context, std::size_t N>
+void check_batch(Batch & batch)
+{
+    auto inputs = make_inputs();
+    auto digests = batch.compute(inputs);
+    BOOST_TEST(digests.size() == inputs.size());
+    for(std::size_t i = 0; i < inputs.size(); ++i)
+        BOOST_TEST((digests[i] == digest_of<Context, N>(inputs[i])), "length " << inputs[i].size());
+}
+
+BOOST_AUTO_TEST_CASE(sha256)
+{
+    acqua::iostreams::crypto::sha256_batch batch;
+    batch.multi_buffer(false);
+    check_batch<decltype(batch), acqua::iostreams::crypto::sha256_context, 32>(batch);
+}
+
+BOOST_AUTO_TEST_CASE(sha256_multi_buffer)
+{
+    acqua::iostreams::crypto::sha256_batch batch;
+    batch.multi_buffer(true);
+    if (!batch.multi_buffer())
+        return;
+    check_batch<decltype(batch), acqua::iostreams::crypto::sha256_context, 32>(batch);
+}
+
+BOOST_AUTO_TEST_CASE(sha256_threads)
+{
+    acqua::iostreams::crypto::sha256_batch batch(3);
+    BOOST_TEST(batch.threads() == 3u);
+    check_batch<decltype(batch), acqua::iostreams::crypto::sha256_context, 32>(batch);
+    batch.multi_buffer(false);
+    check_batch<decltype(batch), acqua::iostreams::crypto::sha256_context, 32>(batch);
+}
+
+BOOST_AUTO_TEST_CASE(md5)
+{
+    acqua::iostreams::crypto::md5_batch batch(2);
+    BOOST_TEST(!batch.multi_buffer());
+    check_batch<decltype(batch), acqua::iostreams::crypto::md5_context, 16>(batch);
+}
+
+
+using digest_type = std::array<unsigned char, 32>;
+
+digest_type reference_tree(std::vector<std::string> const & chunks, std::size_t beg, std::size_t end)
+{
+    using context = acqua::iostreams::crypto::sha256_context;
+    if (end - beg == 1)
+        return digest_of<context, 32>(std::string(1, '\x00') + chunks[beg]);
+    std::size_t k = 1;
+    while(k * 2 < end - beg)
+        k *= 2;
+    auto lhs = reference_tree(chunks, beg, beg + k);
+    auto rhs = reference_tree(chunks, beg + k, end);
+    return digest_of<context, 32>(std::string(1, '\x01') + std::string(lhs.begin(), lhs.end()) + std::string(rhs.begin(), rhs.end()));
+}
+
+digest_type reference_tree(std::string const & str, std::size_t chunk_size)
+{
+    std::vector<std::string> chunks;
+    for(std::size_t i = 0; i < str.size(); i += chunk_size)
+        chunks.push_back(str.substr(i, chunk_size));
+    if (chunks.empty())
+        chunks.push_back("");
+    return reference_tree(chunks, 0, chunks.size());
+}
+
+BOOST_AUTO_TEST_CASE(tree_hash)
+{
+    std::mt19937 gen(54321);
+    std::string str(5000, '\0');
+    for(auto & ch : str)
+        ch = static_cast<char>(gen());
+
+    for(std::size_t threads : { 1, 2 }) {
+        for(std::size_t len : { 0, 1, 100, 128, 129, 1000, 1024, 5000 }) {
+            acqua::iostreams::crypto::sha256_tree_hash tree(128, threads);
+            boost::system::error_code ec;
+            tree.init(ec);
+            // 半端な長さに分けて渡す
+            for(std::size_t i = 0; i < len; i += 77)
+                tree.update(str.data() + i, std::min<std::size_t>(77, len - i), ec);
+            digest_type res;
+            tree.finish(res.data(), res.size(), ec);
+            BOOST_TEST(!ec);
+            BOOST_TEST((res == reference_tree(str.substr(0, len), 128)), "length " << len << " threads " << threads);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(tree_filter)
+{
+    std::string str(3 * 1024 * 1024 + 10, 'x');
+    digest_type buf;
+    do {
+        std::ostringstream oss;
+        boost::iostreams::filtering_ostream out;
+        out.push(acqua::iostreams::crypto::sha256_tree_filter(buf));
+        out.push(oss);
+        out << str;
+    } while(false);
+    BOOST_TEST((buf == reference_tree(str, acqua::iostreams::crypto::sha256_tree_hash::default_chunk_size)));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
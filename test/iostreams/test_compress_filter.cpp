@@ -0,0 +1,192 @@
+#include <acqua/iostreams/zstd_filter.hpp>
+#include <acqua/iostreams/lz4_filter.hpp>
+#include <acqua/iostreams/fused_filter.hpp>
+#include <acqua/iostreams/transferred_counter.hpp>
+#include <acqua/iostreams/crypto/sha256_filter.hpp>
+#include <boost/test/included/unit_test.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+#include <boost/iostreams/device/array.hpp>
+#include <boost/iostreams/device/back_inserter.hpp>
+#include <boost/iostreams/copy.hpp>
+#include <random>
+#include <sstream>
+
+BOOST_AUTO_TEST_SUITE(compress_filter)
+
+//! 適度に圧縮できるデータ
+std::string make_data(std::size_t size)
+{
+    std::mt19937 gen(2016);
+    std::string str;
+    while(str.size() < size)
+        str += "line " + std::to_string(gen() % 1000) + ": the quick brown fox jumps over the lazy dog\n";
+    str.resize(size);
+    return str;
+}
+
+template <typename Filter>
+std::string write_through(Filter filter, std::string const & data)
+{
+    std::string res;
+    do {
+        boost::iostreams::filtering_ostream out;
+        out.push(filter);
+        out.push(boost::iostreams::back_inserter(res));
+        out.write(data.data(), static_cast<std::streamsize>(data.size()));
+    } while(false);
+    return res;
+}
+
+template <typename Filter>
+std::string read_through(Filter filter, std::string const & data)
+{
+    boost::iostreams::filtering_istream in;
+    in.push(filter);
+    in.push(boost::iostreams::array_source(data.data(), data.size()));
+    std::ostringstream oss;
+    boost::iostreams::copy(in, oss);
+    return oss.str();
+}
+
+BOOST_AUTO_TEST_CASE(zstd_output_filter)
+{
+    for(std::size_t size : { 0, 1, 1000, 300000 }) {
+        auto data = make_data(size);
+        auto comp = write_through(acqua::iostreams::zstd_compressor(), data);
+        if (size >= 1000)
+            BOOST_TEST(comp.size() < data.size() / 2);
+        BOOST_TEST(write_through(acqua::iostreams::zstd_decompressor(), comp) == data);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(zstd_input_filter)
+{
+    auto data = make_data(300000);
+    auto comp = read_through(acqua::iostreams::zstd_compressor(acqua::iostreams::zstd_params(19, 0, true)), data);
+    BOOST_TEST(read_through(acqua::iostreams::zstd_decompressor(), comp) == data);
+}
+
+BOOST_AUTO_TEST_CASE(zstd_workers)
+{
+    auto data = make_data(3 * 1024 * 1024);
+    auto comp = write_through(acqua::iostreams::zstd_compressor(acqua::iostreams::zstd_params(3, 2)), data);
+    BOOST_TEST(read_through(acqua::iostreams::zstd_decompressor(), comp) == data);
+}
+
+BOOST_AUTO_TEST_CASE(zstd_concatenated_frames)
+{
+    auto a = make_data(5000);
+    auto b = make_data(7000);
+    auto comp = write_through(acqua::iostreams::zstd_compressor(), a) + write_through(acqua::iostreams::zstd_compressor(), b);
+    BOOST_TEST(write_through(acqua::iostreams::zstd_decompressor(), comp) == a + b);
+}
+
+BOOST_AUTO_TEST_CASE(zstd_truncated)
+{
+    auto comp = write_through(acqua::iostreams::zstd_compressor(), make_data(10000));
+    comp.resize(comp.size() - 3);
+    BOOST_CHECK_THROW(read_through(acqua::iostreams::zstd_decompressor(), comp), boost::system::system_error);
+}
+
+BOOST_AUTO_TEST_CASE(zstd_dictionary)
+{
+    // 似た形の小さなメッセージ
+    std::mt19937 gen(42);
+    std::vector<std::string> samples;
+    for(int i = 0; i < 2000; ++i) {
+        samples.push_back("{\"event\":\"order." + std::string(gen() % 2 ? "created" : "updated") +
+                          "\",\"id\":" + std::to_string(gen() % 100000) +
+                          ",\"customer\":{\"name\":\"user" + std::to_string(gen() % 1000) +
+                          "\",\"country\":\"JP\"},\"amount\":" + std::to_string(gen() % 10000) + "}");
+    }
+    auto dict = std::make_shared<acqua::iostreams::zstd_dictionary const>(
+        acqua::iostreams::zstd_dictionary::train(samples, 4096));
+    BOOST_TEST(!dict->content().empty());
+
+    acqua::iostreams::zstd_params params;
+    params.dictionary = dict;
+    std::size_t plain = 0, with_dict = 0;
+    for(int i = 0; i < 10; ++i) {
+        auto const & msg = samples[static_cast<std::size_t>(i)];
+        plain += write_through(acqua::iostreams::zstd_compressor(), msg).size();
+        auto comp = write_through(acqua::iostreams::zstd_compressor(params), msg);
+        with_dict += comp.size();
+        BOOST_TEST(write_through(acqua::iostreams::zstd_decompressor(dict), comp) == msg);
+    }
+    BOOST_TEST(with_dict * 2 < plain);
+}
+
+BOOST_AUTO_TEST_CASE(lz4)
+{
+    for(std::size_t size : { 0, 1, 1000, 300000 }) {
+        auto data = make_data(size);
+        auto comp = write_through(acqua::iostreams::lz4_compressor(), data);
+        if (size >= 1000)
+            BOOST_TEST(comp.size() < data.size() / 2);
+        BOOST_TEST(write_through(acqua::iostreams::lz4_decompressor(), comp) == data);
+        BOOST_TEST(read_through(acqua::iostreams::lz4_decompressor(), comp) == data);
+    }
+
+    auto data = make_data(300000);
+    auto comp = read_through(acqua::iostreams::lz4_compressor(acqua::iostreams::lz4_params(9, 256 * 1024, true)), data);
+    BOOST_TEST(read_through(acqua::iostreams::lz4_decompressor(), comp) == data);
+
+    comp.resize(comp.size() - 3);
+    BOOST_CHECK_THROW(read_through(acqua::iostreams::lz4_decompressor(), comp), boost::system::system_error);
+}
+
+BOOST_AUTO_TEST_CASE(fused)
+{
+    auto data = make_data(200000);
+    std::array<unsigned char, 32> expected;
+    std::size_t expected_size = 0;
+    write_through(acqua::iostreams::sha256_filter(expected), data);
+
+    // 圧縮しながら、圧縮前のデータを数えてハッシュを計算する
+    std::array<unsigned char, 32> digest;
+    std::size_t size = 0;
+    auto comp = write_through(acqua::iostreams::fuse(acqua::iostreams::zstd_compressor(),
+                                                     acqua::iostreams::sha256_filter(digest),
+                                                     acqua::iostreams::transferred_counter(size)), data);
+    BOOST_TEST(size == data.size());
+    BOOST_TEST((digest == expected));
+
+    // 伸長しながら、伸長後のデータを数えてハッシュを計算する
+    digest.fill(0);
+    auto res = read_through(acqua::iostreams::fuse(acqua::iostreams::zstd_decompressor(),
+                                                   acqua::iostreams::sha256_filter(digest),
+                                                   acqua::iostreams::transferred_counter(expected_size)), comp);
+    BOOST_TEST(res == data);
+    BOOST_TEST(expected_size == data.size());
+    BOOST_TEST((digest == expected));
+}
+
+BOOST_AUTO_TEST_CASE(fused_device)
+{
+    auto data = make_data(200000);
+    std::array<unsigned char, 32> expected;
+    write_through(acqua::iostreams::sha256_filter(expected), data);
+    auto comp = write_through(acqua::iostreams::zstd_compressor(), data);
+
+    // 出力のチェインで伸長しながら、シンクに書き出す伸長後のデータを数えてハッシュを計算する
+    std::array<unsigned char, 32> digest;
+    std::size_t size = 0;
+    auto res = write_through(acqua::iostreams::fuse_device(acqua::iostreams::zstd_decompressor(),
+                                                           acqua::iostreams::sha256_filter(digest),
+                                                           acqua::iostreams::transferred_counter(size)), comp);
+    BOOST_TEST(res == data);
+    BOOST_TEST(size == data.size());
+    BOOST_TEST((digest == expected));
+
+    // 入力のチェインで圧縮しながら、ソースから読み込んだ圧縮前のデータを数える
+    size = 0;
+    digest.fill(0);
+    auto lz4 = read_through(acqua::iostreams::fuse_device(acqua::iostreams::lz4_compressor(),
+                                                          acqua::iostreams::sha256_filter(digest),
+                                                          acqua::iostreams::transferred_counter(size)), data);
+    BOOST_TEST(read_through(acqua::iostreams::lz4_decompressor(), lz4) == data);
+    BOOST_TEST(size == data.size());
+    BOOST_TEST((digest == expected));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -79,4 +79,33 @@ BOOST_AUTO_TEST_CASE(hmac_sha256_output_filter)
     BOOST_TEST(boost::lexical_cast<std::string>(acqua::hexstring(buf)) == "f7bc83f430538424b13298e6aa6fb143ef4d59a14946175997479dbc2d1a3cd8");
 }
 
+BOOST_AUTO_TEST_CASE(hmac_sha256_long_key)
+{
+    // RFC 4231 Test Case 6
+    std::string key(131, '\xaa');
+    std::uint8_t buf[32];
+    do {
+        boost::iostreams::filtering_ostream out;
+        out.push(acqua::iostreams::hmac_sha256_filter(buf, key));
+        out.push(boost::iostreams::null_sink());
+        out << "Test Using Larger Than Block-Size Key - Hash Key First";
+    } while(0);
+    BOOST_TEST(boost::lexical_cast<std::string>(acqua::hexstring(buf)) == "60e431591ee0b67f0d8a26aacbf5b77f8e0bc6213728c5140546040f0ee37f54");
+}
+
+BOOST_AUTO_TEST_CASE(hmac_sha256_key_reuse)
+{
+    acqua::iostreams::hmac_sha256_key key(std::string("key"));
+    for(int i = 0; i < 3; ++i) {
+        std::uint8_t buf[32];
+        do {
+            boost::iostreams::filtering_ostream out;
+            out.push(acqua::iostreams::hmac_sha256_filter(buf, key));
+            out.push(boost::iostreams::null_sink());
+            out << "The quick brown fox jumps over the lazy dog";
+        } while(0);
+        BOOST_TEST(boost::lexical_cast<std::string>(acqua::hexstring(buf)) == "f7bc83f430538424b13298e6aa6fb143ef4d59a14946175997479dbc2d1a3cd8");
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
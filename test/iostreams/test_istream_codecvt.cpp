@@ -128,4 +128,52 @@ BOOST_AUTO_TEST_CASE(istream_codecvt_utf8_sjis_multiline)
     } while(false);
 }
 
+BOOST_AUTO_TEST_CASE(istream_codecvt_block)
+{
+    std::string src;
+    std::u16string u16;
+    std::u32string u32;
+    for(int i = 0; i < 200; ++i) {
+        src += "ascii text for the fast path, ";
+        u16 += u"ascii text for the fast path, ";
+        u32 += U"ascii text for the fast path, ";
+        src += "吾輩は猫である。\xf0\x9f\x90\x88 ";
+        u16 += u"吾輩は猫である。\U0001F408 ";
+        u32 += U"吾輩は猫である。\U0001F408 ";
+    }
+
+    // read() に渡す大きさが小さくても、文字の途中で切れずにすべて返る
+    for(std::streamsize n : { 1, 3, 7, 4096 }) {
+        std::istringstream iss(src);
+        auto cvt = acqua::iostreams::istream_code_converter<char16_t>(iss.rdbuf());
+        std::u16string dst;
+        char16_t buf[4096];
+        for(std::streamsize len; (len = cvt.read(buf, n)) != EOF; )
+            dst.append(buf, static_cast<std::size_t>(len));
+        BOOST_CHECK(dst == u16);
+    }
+
+    for(std::streamsize n : { 1, 4096 }) {
+        std::basic_istringstream<char32_t> iss(u32);
+        auto cvt = acqua::iostreams::istream_code_converter<char>(iss.rdbuf());
+        std::string dst;
+        char buf[4096];
+        for(std::streamsize len; (len = cvt.read(buf, n)) != EOF; )
+            dst.append(buf, static_cast<std::size_t>(len));
+        BOOST_CHECK(dst == src);
+    }
+}
+
+
+BOOST_AUTO_TEST_CASE(istream_codecvt_illegal)
+{
+    // 冗長な符号、サロゲート、途中で終わる文字は読み飛ばす
+    std::istringstream iss("a\xc0\xaf" "b\xed\xa0\x80" "c\xe3\x81");
+    auto cvt = acqua::iostreams::istream_code_converter<char32_t>(iss.rdbuf());
+    char32_t buf[16];
+    std::streamsize len = cvt.read(buf, 16);
+    BOOST_CHECK(std::u32string(buf, buf + std::max<std::streamsize>(len, 0)) == U"abc");
+    BOOST_CHECK_EQUAL(cvt.read(buf, 16), EOF);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,199 @@
+#include <acqua/iostreams/json_adapt_struct.hpp>
+#include <acqua/iostreams/json_parser.hpp>
+#include <acqua/iostreams/json_writer.hpp>
+#include <boost/test/included/unit_test.hpp>
+#include <boost/iostreams/stream.hpp>
+#include <boost/iostreams/copy.hpp>
+#include <boost/iostreams/device/back_inserter.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <boost/property_tree/json_parser.hpp>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace test_json_adapt_struct {
+
+struct friend_type
+{
+    int id;
+    std::string name;
+};
+
+struct record
+{
+    std::string _id;
+    unsigned index;
+    bool isActive;
+    int age;
+    std::string name;
+    double latitude;
+    double longitude;
+    std::vector<std::string> tags;
+    std::vector<friend_type> friends;
+    std::string favoriteFruit;
+};
+
+struct values
+{
+    boost::optional<int> opt;
+    signed char small;
+    unsigned long big;
+    float ratio;
+    std::map<std::string, int> counts;
+};
+
+}
+
+BOOST_FUSION_ADAPT_STRUCT(
+    test_json_adapt_struct::friend_type,
+    id, name)
+
+BOOST_FUSION_ADAPT_STRUCT(
+    test_json_adapt_struct::record,
+    _id, index, isActive, age, name, latitude, longitude, tags, friends, favoriteFruit)
+
+BOOST_FUSION_ADAPT_STRUCT(
+    test_json_adapt_struct::values,
+    opt, small, big, ratio, counts)
+
+BOOST_AUTO_TEST_SUITE(json_adapt_struct)
+
+namespace {
+
+using namespace test_json_adapt_struct;
+
+template <typename T>
+void parse(T & val, std::string const & str)
+{
+    acqua::iostreams::json_parser<T> parser(val);
+    parser.write(str.data(), static_cast<std::streamsize>(str.size()));
+}
+
+template <typename T>
+std::string serialize(T const & val)
+{
+    std::string out;
+    boost::iostreams::stream<acqua::iostreams::json_writer<T> > in(val);
+    boost::iostreams::copy(in, boost::iostreams::back_inserter(out));
+    return out;
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(sample)
+{
+    std::vector<record> records;
+    boost::property_tree::ptree tree;
+    do {
+        std::ifstream ifs("sample.json");
+        std::string str((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+        parse(records, str);
+        std::istringstream iss(str);
+        boost::property_tree::read_json(iss, tree);
+    } while(false);
+
+    BOOST_REQUIRE_EQUAL(records.size(), tree.size());
+    auto it = tree.begin();
+    for(auto const & rec : records) {
+        auto const & node = (it++)->second;
+        BOOST_CHECK_EQUAL(rec._id, node.get<std::string>("_id"));
+        BOOST_CHECK_EQUAL(rec.index, node.get<unsigned>("index"));
+        BOOST_CHECK_EQUAL(rec.isActive, node.get<bool>("isActive"));
+        BOOST_CHECK_EQUAL(rec.age, node.get<int>("age"));
+        BOOST_CHECK_EQUAL(rec.name, node.get<std::string>("name"));
+        BOOST_CHECK_EQUAL(rec.latitude, node.get<double>("latitude"));
+        BOOST_CHECK_EQUAL(rec.longitude, node.get<double>("longitude"));
+        BOOST_CHECK_EQUAL(rec.favoriteFruit, node.get<std::string>("favoriteFruit"));
+
+        auto const & tags = node.get_child("tags");
+        BOOST_REQUIRE_EQUAL(rec.tags.size(), tags.size());
+        auto tag = tags.begin();
+        for(auto const & e : rec.tags)
+            BOOST_CHECK_EQUAL(e, (tag++)->second.data());
+
+        auto const & friends = node.get_child("friends");
+        BOOST_REQUIRE_EQUAL(rec.friends.size(), friends.size());
+        auto fr = friends.begin();
+        for(auto const & e : rec.friends) {
+            BOOST_CHECK_EQUAL(e.id, fr->second.get<int>("id"));
+            BOOST_CHECK_EQUAL(e.name, fr->second.get<std::string>("name"));
+            ++fr;
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(unknown_keys)
+{
+    friend_type fr = { -1, "unchanged" };
+    parse(fr, R"({"skip": {"a": [1, {"id": 5}, "x"], "name": "no"}, "list": [[], {}], "id": 7, "extra": null})");
+    BOOST_CHECK_EQUAL(fr.id, 7);
+    BOOST_CHECK_EQUAL(fr.name, "unchanged");
+
+    // 宣言と違う順でも格納できる
+    parse(fr, R"({"name": "Le Flowers", "id": 3})");
+    BOOST_CHECK_EQUAL(fr.id, 3);
+    BOOST_CHECK_EQUAL(fr.name, "Le Flowers");
+}
+
+BOOST_AUTO_TEST_CASE(values_)
+{
+    values val = {};
+    parse(val, R"({"opt": 5, "small": -128, "big": 18446744073709551615, "ratio": 2, "counts": {"a": 1, "b": 2.0}})");
+    BOOST_REQUIRE(val.opt);
+    BOOST_CHECK_EQUAL(*val.opt, 5);
+    BOOST_CHECK_EQUAL(val.small, -128);
+    BOOST_CHECK_EQUAL(val.big, 18446744073709551615UL);
+    BOOST_CHECK_EQUAL(val.ratio, 2.0f);
+    BOOST_REQUIRE_EQUAL(val.counts.size(), 2u);
+    BOOST_CHECK_EQUAL(val.counts["a"], 1);
+    BOOST_CHECK_EQUAL(val.counts["b"], 2);
+
+    parse(val, R"({"opt": null})");
+    BOOST_CHECK(!val.opt);
+}
+
+BOOST_AUTO_TEST_CASE(type_error)
+{
+    using acqua::iostreams::json::type_error;
+
+    friend_type fr;
+    BOOST_CHECK_THROW(parse(fr, R"({"id": "1"})"), type_error);
+    BOOST_CHECK_THROW(parse(fr, R"({"id": 1.5})"), type_error);
+    BOOST_CHECK_THROW(parse(fr, R"({"id": 2147483648})"), type_error);
+    BOOST_CHECK_THROW(parse(fr, R"({"name": 1})"), type_error);
+    BOOST_CHECK_THROW(parse(fr, R"([])"), type_error);
+
+    values val;
+    BOOST_CHECK_THROW(parse(val, R"({"small": 128})"), type_error);
+    BOOST_CHECK_THROW(parse(val, R"({"big": -1})"), type_error);
+    BOOST_CHECK_THROW(parse(val, R"({"counts": []})"), type_error);
+
+    std::vector<friend_type> list;
+    BOOST_CHECK_THROW(parse(list, R"([{"id": 0}, 1])"), type_error);
+}
+
+BOOST_AUTO_TEST_CASE(writer)
+{
+    values val = {};
+    val.small = -3;
+    val.big = 18446744073709551615UL;
+    val.ratio = 0.5f;
+    val.counts["x"] = 10;
+    BOOST_CHECK_EQUAL(serialize(val), R"({"opt":null,"small":-3,"big":18446744073709551615,"ratio":0.5,"counts":{"x":10}})");
+
+    std::vector<record> records;
+    do {
+        std::ifstream ifs("sample.json");
+        std::string str((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+        parse(records, str);
+    } while(false);
+
+    std::string first = serialize(records);
+    std::vector<record> again;
+    parse(again, first);
+    BOOST_CHECK_EQUAL(again.size(), records.size());
+    BOOST_CHECK_EQUAL(serialize(again), first);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
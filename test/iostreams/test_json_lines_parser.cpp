@@ -0,0 +1,165 @@
+extern "C" {
+#include <stdlib.h>
+#include <unistd.h>
+}
+
+#include <acqua/iostreams/json_lines_parser.hpp>
+#include <acqua/iostreams/json_adapt_boost_ptree.hpp>
+#include <acqua/iostreams/json_adapt_struct.hpp>
+#include <boost/test/included/unit_test.hpp>
+#include <boost/iostreams/stream.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace test_json_lines_parser {
+
+struct line
+{
+    long index;
+    std::string name;
+};
+
+}
+
+BOOST_FUSION_ADAPT_STRUCT(test_json_lines_parser::line, index, name)
+
+BOOST_AUTO_TEST_SUITE(json_lines_parser)
+
+namespace {
+
+using test_json_lines_parser::line;
+
+std::string make_lines(std::size_t n)
+{
+    std::ostringstream oss;
+    for(std::size_t i = 0; i < n; ++i)
+        oss << "{\"index\": " << i << ", \"name\": \"" << std::string(i % 37, 'x') << "\"}\n";
+    return oss.str();
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(sink)
+{
+    std::string const str = "{\"a\": 1}\n\n[1, 2]\r\n  \"str\"\n{\"a\": {\"b\": true}}\n12";
+
+    // 区切りがどこにあっても同じレコードになる
+    for(std::size_t step = 1; step <= str.size(); ++step) {
+        std::vector<boost::property_tree::ptree> records;
+        acqua::iostreams::json_lines_parser<boost::property_tree::ptree> parser(
+            [&records](boost::property_tree::ptree & json) { records.push_back(std::move(json)); });
+        for(std::size_t pos = 0; pos < str.size(); pos += step)
+            parser.write(str.data() + pos, static_cast<std::streamsize>(std::min(step, str.size() - pos)));
+        BOOST_CHECK_EQUAL(parser.count(), 4u);
+        parser.close();
+        BOOST_CHECK_EQUAL(parser.count(), 5u);
+
+        BOOST_REQUIRE_EQUAL(records.size(), 5u);
+        BOOST_CHECK_EQUAL(records[0].get<int>("a"), 1);
+        BOOST_CHECK_EQUAL(records[1].size(), 2u);
+        BOOST_CHECK_EQUAL(records[2].data(), "str");
+        BOOST_CHECK_EQUAL(records[3].get<bool>("a.b"), true);
+        BOOST_CHECK(records[3].find("b") == records[3].not_found());
+        BOOST_CHECK_EQUAL(records[4].data(), "12");
+    }
+}
+
+BOOST_AUTO_TEST_CASE(stream)
+{
+    std::vector<line> records;
+    do {
+        boost::iostreams::stream<acqua::iostreams::json_lines_parser<line> > out(
+            [&records](line & rec) { records.push_back(rec); });
+        out << make_lines(100);
+    } while(false);
+
+    BOOST_REQUIRE_EQUAL(records.size(), 100u);
+    for(std::size_t i = 0; i < records.size(); ++i) {
+        BOOST_CHECK_EQUAL(records[i].index, static_cast<long>(i));
+        BOOST_CHECK_EQUAL(records[i].name.size(), i % 37);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(parallel_ordered)
+{
+    std::string const str = make_lines(5000);
+    acqua::iostreams::json_lines_options opts;
+    opts.threads = 4;
+    opts.chunk_size = 1000;
+
+    long next = 0;
+    acqua::iostreams::parse_json_lines<line>(str.data(), str.size(), [&next](line & rec) {
+        BOOST_REQUIRE_EQUAL(rec.index, next);
+        ++next;
+    }, opts);
+    BOOST_CHECK_EQUAL(next, 5000);
+}
+
+BOOST_AUTO_TEST_CASE(parallel_unordered)
+{
+    std::string const str = make_lines(5000);
+    acqua::iostreams::json_lines_options opts;
+    opts.threads = 4;
+    opts.chunk_size = 1000;
+    opts.ordered = false;
+
+    std::atomic<long> count(0), sum(0);
+    acqua::iostreams::parse_json_lines<line>(str.data(), str.size(), [&](line & rec) {
+        ++count;
+        sum += rec.index;
+    }, opts);
+    BOOST_CHECK_EQUAL(count.load(), 5000);
+    BOOST_CHECK_EQUAL(sum.load(), 4999L * 5000 / 2);
+}
+
+BOOST_AUTO_TEST_CASE(error)
+{
+    std::string str = make_lines(3000);
+    std::size_t pos = str.find("{\"index\": 2000,");
+    str[pos + 1] = '!';
+
+    acqua::iostreams::json_lines_options opts;
+    opts.threads = 3;
+    opts.chunk_size = 500;
+
+    // 誤りのある行より前のレコードは、すべて順に渡る
+    long next = 0;
+    BOOST_CHECK_THROW(acqua::iostreams::parse_json_lines<line>(str.data(), str.size(), [&next](line & rec) {
+        BOOST_REQUIRE_EQUAL(rec.index, next);
+        ++next;
+    }, opts), acqua::iostreams::json::syntax_error);
+    BOOST_CHECK_EQUAL(next, 2000);
+}
+
+BOOST_AUTO_TEST_CASE(file)
+{
+    char path[] = "/tmp/test_json_lines_XXXXXX";
+    int fd = ::mkstemp(path);
+    BOOST_REQUIRE(fd >= 0);
+    ::close(fd);
+    do {
+        std::ofstream ofs(path);
+        ofs << make_lines(1000);
+    } while(false);
+
+    acqua::iostreams::json_lines_options opts;
+    opts.threads = 2;
+    opts.chunk_size = 4096;
+
+    std::size_t count = 0;
+    acqua::iostreams::parse_json_lines_file<boost::property_tree::ptree>(path, [&count](boost::property_tree::ptree & json) {
+        BOOST_CHECK_EQUAL(json.get<std::size_t>("index"), count);
+        ++count;
+    }, opts);
+    BOOST_CHECK_EQUAL(count, 1000u);
+    std::remove(path);
+
+    BOOST_CHECK_THROW(acqua::iostreams::parse_json_lines_file<line>(path, [](line &) {}, opts), boost::system::system_error);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -1,4 +1,5 @@
 #include <acqua/iostreams/json_parser.hpp>
+#include <acqua/iostreams/json_tokenizer.hpp>
 #include <acqua/iostreams/json_adapt_boost_ptree.hpp>
 #include <boost/test/included/unit_test.hpp>
 #include <sstream>
@@ -6,6 +7,56 @@
 #include <boost/iostreams/copy.hpp>
 #include <boost/property_tree/ptree.hpp>
 #include <boost/property_tree/json_parser.hpp>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <random>
+
+namespace {
+
+//! 呼び出された順に、イベントを文字列にして記録する
+struct recorder : acqua::iostreams::json::sax_handler
+{
+    void null() { log += "null "; }
+    void boolean(bool flag) { log += flag ? "true " : "false "; }
+    void number(long val) { log += "l:" + std::to_string(val) + " "; }
+    void number(double val) { std::ostringstream oss; oss << "d:" << val << " "; log += oss.str(); }
+    void string(view_type str) { log += "s:" + str.to_string() + " "; ptrs.push_back(str.data()); }
+    void key(view_type str) { log += "k:" + str.to_string() + " "; ptrs.push_back(str.data()); }
+    void start_object() { log += "{ "; }
+    void end_object() { log += "} "; }
+    void start_array() { log += "[ "; }
+    void end_array() { log += "] "; }
+
+    std::string log;
+    std::vector<char const *> ptrs;
+};
+
+//! 数値を型ごとに記録する
+struct number_recorder : acqua::iostreams::json::sax_handler
+{
+    void number(long val) { log += "l:" + std::to_string(val) + " "; }
+    void number(unsigned long val) { log += "u:" + std::to_string(val) + " "; }
+    void number(double val) { reals.push_back(val); log += "d "; }
+    void big_number(view_type str) { log += "b:" + str.to_string() + " "; }
+
+    std::string log;
+    std::vector<double> reals;
+};
+
+std::string tokenize(std::string const & str, std::size_t chunk = std::string::npos)
+{
+    recorder rec;
+    acqua::iostreams::json::basic_tokenizer<recorder> tok(rec);
+    for(std::size_t i = 0; i < str.size(); i += chunk) {
+        std::size_t len = std::min(chunk, str.size() - i);
+        BOOST_TEST(tok.write(str.data() + i, len) == len);
+    }
+    tok.finish();
+    return rec.log;
+}
+
+}
 
 BOOST_AUTO_TEST_SUITE(json_parser)
 
@@ -20,4 +71,185 @@ BOOST_AUTO_TEST_CASE(json_adapt_boost_ptree)
     BOOST_TEST((json1 == json2));
 }
 
+BOOST_AUTO_TEST_CASE(tokenizer_events)
+{
+    std::string str = R"({"a": [1, -2.5, 1e3, true, FALSE, null], "b": {}, "c": [], "d": "x\"y"})";
+    std::string expected = "{ k:a [ l:1 d:-2.5 d:1000 true false null ] k:b { } k:c [ ] k:d s:x\"y } ";
+    BOOST_TEST(tokenize(str) == expected);
+    // どこで区切っても同じになる
+    for(std::size_t chunk = 1; chunk < 8; ++chunk)
+        BOOST_TEST(tokenize(str, chunk) == expected);
+
+    BOOST_TEST(tokenize("  42 ") == "l:42 ");
+    BOOST_TEST(tokenize("42", 1) == "l:42 ");
+    BOOST_TEST(tokenize("12345678901234567890") == "d:1.23457e+19 ");
+}
+
+BOOST_AUTO_TEST_CASE(tokenizer_view)
+{
+    // エスケープのない文字列は入力をそのまま指し、エスケープがあるものと区切りをまたぐものはバッファに集める
+    std::string str = R"(["plain string longer than sixteen bytes", "esc\n", "split"])";
+    std::string expected = "[ s:plain string longer than sixteen bytes s:esc\n s:split ] ";
+    recorder rec;
+    acqua::iostreams::json::basic_tokenizer<recorder> tok(rec);
+    std::size_t half = str.size() - 6;
+    BOOST_TEST(tok.write(str.data(), half) == half);
+    BOOST_TEST(tok.write(str.data() + half, str.size() - half) == str.size() - half);
+    BOOST_TEST(tok.done());
+    BOOST_TEST(rec.log == expected);
+    BOOST_TEST(rec.ptrs.size() == 3u);
+    BOOST_TEST((rec.ptrs[0] == str.data() + 2));
+    BOOST_TEST((rec.ptrs[1] < str.data() || rec.ptrs[1] >= str.data() + str.size()));
+    BOOST_TEST((rec.ptrs[2] < str.data() || rec.ptrs[2] >= str.data() + str.size()));
+
+    rec.log.clear();
+    tok.reset();
+    BOOST_TEST(tok.write(str.data(), str.size()) == str.size());
+    BOOST_TEST(rec.log == expected);
+}
+
+BOOST_AUTO_TEST_CASE(tokenizer_unicode)
+{
+    std::string str = R"(["\u3042\u0041", "\ud83d\ude00", "\ud83d!", "\u00e9\t"])";
+    std::string expected = "[ s:\u3042A s:\U0001F600 s:\uFFFD! s:\u00E9\t ] ";
+    for(std::size_t chunk : { std::string::npos, std::size_t(1), std::size_t(5) })
+        BOOST_TEST(tokenize(str, chunk) == expected);
+}
+
+BOOST_AUTO_TEST_CASE(tokenizer_unpaired_surrogate_split)
+{
+    // 対にならない上位サロゲートの後ろのエスケープが、write() の区切りをまたぐ
+    std::string head = R"(["x\uD800\u)";
+    std::string tail = R"(0041yz"])";
+    std::string expected = "[ s:x\uFFFDAyz ] ";
+    BOOST_TEST(tokenize(head + tail) == expected);
+
+    recorder rec;
+    acqua::iostreams::json::basic_tokenizer<recorder> tok(rec);
+    BOOST_TEST(tok.write(head.data(), head.size()) == head.size());
+    BOOST_TEST(tok.write(tail.data(), tail.size()) == tail.size());
+    tok.finish();
+    BOOST_TEST(rec.log == expected);
+
+    for(std::size_t chunk = 1; chunk < 12; ++chunk)
+        BOOST_TEST(tokenize(head + tail, chunk) == expected);
+    BOOST_TEST(tokenize(R"(["\uD800\uD800\uDC00"])", 3) == "[ s:\uFFFD\U00010000 ] ");
+}
+
+BOOST_AUTO_TEST_CASE(tokenizer_syntax_error)
+{
+    for(char const * str : { "[1,]", "{\"a\" 1}", "[1 2]", "nul", "\"\\x\"", "[\"\\u12g4\"]", "-", "1.", "1e", "1e+", ".5", "1.2.3", "1-2", "--1", "[}", "\"a\nb\"" })
+        BOOST_CHECK_THROW(tokenize(str), acqua::iostreams::json::syntax_error);
+    // 値の後ろには空白しか続かない
+    recorder rec;
+    acqua::iostreams::json::basic_tokenizer<recorder> tok(rec);
+    BOOST_TEST(tok.write("[] x", 4) == 3u);
+    BOOST_TEST(tok.done());
+}
+
+BOOST_AUTO_TEST_CASE(tokenizer_integer)
+{
+    std::string str = "[0, -0, 9223372036854775807, -9223372036854775808, 9223372036854775808, 18446744073709551615, "
+                      "18446744073709551616, -9223372036854775809, 00000000000000000000000042, 123456789012345678901234567890]";
+    std::string expected = "l:0 l:0 l:9223372036854775807 l:-9223372036854775808 u:9223372036854775808 u:18446744073709551615 "
+                           "b:18446744073709551616 b:-9223372036854775809 l:42 b:123456789012345678901234567890 ";
+    for(std::size_t chunk : { str.size(), std::size_t(1), std::size_t(3) }) {
+        number_recorder rec;
+        acqua::iostreams::json::basic_tokenizer<number_recorder> tok(rec);
+        for(std::size_t i = 0; i < str.size(); i += chunk)
+            tok.write(str.data() + i, std::min(chunk, str.size() - i));
+        BOOST_TEST(tok.done());
+        BOOST_TEST(rec.log == expected);
+    }
+
+    // big_number を持たないハンドラは double で受け取る
+    BOOST_TEST(tokenize("18446744073709551616") == "d:1.84467e+19 ");
+}
+
+BOOST_AUTO_TEST_CASE(tokenizer_real)
+{
+    std::vector<std::string> nums = {
+        "0.0", "-0.0", "1.5", "0.1", "3.141592653589793", "1e23", "8.98846567431158e307",
+        "1.7976931348623157e308", "1.7976931348623158e308", "1e309", "2.2250738585072011e-308", "2.2250738585072014e-308",
+        "4.9e-324", "2.4703282292062327e-324", "2.4703282292062328e-324", "1e-400",
+        "9007199254740993e0", "9007199254740993.0", "9007199254740992.5", "0.30000000000000004",
+        "2.22507385850720113605740979670913197593481954635164564e-308",
+        "1.00000000000000011102230246251565404236316680908203125",
+        "1.00000000000000011102230246251565404236316680908203124",
+        "1.00000000000000011102230246251565404236316680908203126",
+        "7.2057594037927933e16", "123456789012345678901234567890e-10", "0.000000000000000000000000000000000000123456789012345678901",
+        "1e0", "1E+2", "+2.5e-3", "4503599627370496.5", "4503599627370497.5",
+    };
+
+    // 乱数の仮数と指数
+    std::mt19937_64 gen(2016);
+    for(int i = 0; i < 20000; ++i) {
+        std::string digits = std::to_string(gen());
+        digits.resize(1 + gen() % digits.size());
+        if (i % 7 == 0)
+            digits += std::to_string(gen());
+        std::size_t dot = gen() % (digits.size() + 1);
+        std::string num = digits.substr(0, dot);
+        if (num.empty())
+            num = "0";
+        if (dot < digits.size())
+            num += "." + digits.substr(dot);
+        num += "e" + std::to_string(static_cast<int>(gen() % 700) - 350);
+        nums.push_back((i % 2) ? "-" + num : num);
+    }
+
+    std::string str = "[";
+    for(auto const & num : nums)
+        str += num + ",";
+    str.back() = ']';
+
+    for(std::size_t chunk : { str.size(), std::size_t(5) }) {
+        number_recorder rec;
+        acqua::iostreams::json::basic_tokenizer<number_recorder> tok(rec);
+        for(std::size_t i = 0; i < str.size(); i += chunk)
+            tok.write(str.data() + i, std::min(chunk, str.size() - i));
+        BOOST_TEST(tok.done());
+        BOOST_TEST_REQUIRE(rec.reals.size() == nums.size());
+        for(std::size_t i = 0; i < nums.size(); ++i) {
+            double expected = std::strtod(nums[i].c_str(), nullptr);
+            BOOST_TEST(std::memcmp(&rec.reals[i], &expected, sizeof(double)) == 0, nums[i]);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(json_parser_chunked)
+{
+    std::ifstream ifs("sample.json");
+    std::string str((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+    boost::property_tree::ptree json1, json2;
+    boost::property_tree::read_json("sample.json", json2);
+    acqua::iostreams::json_parser<boost::property_tree::ptree> json(json1);
+    std::streamsize i = 0;
+    while(json && i < static_cast<std::streamsize>(str.size())) {
+        std::streamsize n = std::min<std::streamsize>(7, static_cast<std::streamsize>(str.size()) - i);
+        BOOST_TEST(json.write(str.data() + i, n) == n);
+        i += n;
+    }
+    BOOST_TEST(!json);
+    BOOST_TEST((json1 == json2));
+    BOOST_TEST(json.write("\n", 1) == 1);
+    BOOST_TEST(json.write("x", 1) == EOF);
+}
+
+BOOST_AUTO_TEST_CASE(json_parser_scalar)
+{
+    // トップレベルの数値は close() で完了する
+    boost::property_tree::ptree json1;
+    do {
+        acqua::iostreams::json_parser<boost::property_tree::ptree> json(json1);
+        boost::iostreams::stream<decltype(json)> out(json);
+        out << "123";
+    } while(false);
+    BOOST_TEST(json1.data() == "123");
+
+    acqua::iostreams::json_parser<boost::property_tree::ptree> json(json1);
+    BOOST_TEST(json.write("[1", 2) == 2);
+    BOOST_CHECK_THROW(json.close(), acqua::iostreams::json::syntax_error);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,216 @@
+#include <acqua/iostreams/json_writer.hpp>
+#include <acqua/iostreams/json_generator.hpp>
+#include <acqua/iostreams/json_tokenizer.hpp>
+#include <acqua/iostreams/json_parser.hpp>
+#include <acqua/iostreams/json_adapt_boost_ptree.hpp>
+#include <boost/test/included/unit_test.hpp>
+#include <boost/iostreams/stream.hpp>
+#include <boost/iostreams/copy.hpp>
+#include <boost/iostreams/device/back_inserter.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <boost/property_tree/json_parser.hpp>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <random>
+#include <sstream>
+
+BOOST_AUTO_TEST_SUITE(json_writer)
+
+namespace {
+
+void generate(acqua::iostreams::json::generator & gen)
+{
+    gen.start_object();
+    gen.key("null");
+    gen.null();
+    gen.key("bool");
+    gen.start_array();
+    gen.boolean(true);
+    gen.boolean(false);
+    gen.end_array();
+    gen.key("num");
+    gen.start_array();
+    gen.number(-9223372036854775807L - 1);
+    gen.number(18446744073709551615UL);
+    gen.number(0.1);
+    gen.number(100.0);
+    gen.number(1e300);
+    gen.end_array();
+    gen.key("str\t");
+    gen.string("a\"b\\c\n\x01\xe3\x81\x82");
+    gen.key("empty");
+    gen.start_object();
+    gen.end_object();
+    gen.end_object();
+}
+
+std::string format(double val)
+{
+    std::string out;
+    acqua::iostreams::json::generator gen(out);
+    gen.number(val);
+    return out;
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(generator_compact)
+{
+    std::string out;
+    acqua::iostreams::json::generator gen(out);
+    generate(gen);
+    BOOST_TEST(out == "{\"null\":null,\"bool\":[true,false],\"num\":[-9223372036854775808,18446744073709551615,0.1,100.0,1e+300],"
+                      "\"str\\t\":\"a\\\"b\\\\c\\n\\u0001\xe3\x81\x82\",\"empty\":{}}");
+}
+
+BOOST_AUTO_TEST_CASE(generator_pretty)
+{
+    std::string out;
+    acqua::iostreams::json::generator gen(out, 2);
+    generate(gen);
+    BOOST_TEST(out ==
+               "{\n"
+               "  \"null\": null,\n"
+               "  \"bool\": [\n"
+               "    true,\n"
+               "    false\n"
+               "  ],\n"
+               "  \"num\": [\n"
+               "    -9223372036854775808,\n"
+               "    18446744073709551615,\n"
+               "    0.1,\n"
+               "    100.0,\n"
+               "    1e+300\n"
+               "  ],\n"
+               "  \"str\\t\": \"a\\\"b\\\\c\\n\\u0001\xe3\x81\x82\",\n"
+               "  \"empty\": {}\n"
+               "}");
+}
+
+BOOST_AUTO_TEST_CASE(shortest_double)
+{
+    BOOST_TEST(format(0.0) == "0.0");
+    BOOST_TEST(format(-0.0) == "-0.0");
+    BOOST_TEST(format(0.3) == "0.3");
+    BOOST_TEST(format(0.1 + 0.2) == "0.30000000000000004");
+    BOOST_TEST(format(-2.5) == "-2.5");
+    BOOST_TEST(format(1e15) == "1000000000000000.0");
+    BOOST_TEST(format(1e16) == "1e+16");
+    BOOST_TEST(format(0.0001) == "0.0001");
+    BOOST_TEST(format(1e-5) == "1e-5");
+    BOOST_TEST(format(5e-324) == "5e-324");
+    BOOST_TEST(format(1.7976931348623157e308) == "1.7976931348623157e+308");
+    BOOST_TEST(format(std::numeric_limits<double>::infinity()) == "null");
+    BOOST_TEST(format(std::numeric_limits<double>::quiet_NaN()) == "null");
+
+    // 読み戻すと同じ値になり、17 桁を超えない
+    std::mt19937_64 gen(2016);
+    for(int i = 0; i < 200000; ++i) {
+        std::uint64_t bits = gen();
+        double val;
+        std::memcpy(&val, &bits, sizeof(val));
+        if (val != val || val - val != 0)
+            continue;
+        std::string str = format(val);
+        double res = std::strtod(str.c_str(), nullptr);
+        BOOST_TEST(std::memcmp(&res, &val, sizeof(val)) == 0, str);
+        BOOST_TEST(str.size() <= 24u);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(reformat)
+{
+    // トークナイザから直接つなぐと整形し直せる
+    std::ifstream ifs("sample.json");
+    std::string src((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+    for(int indent : { 0, 4 }) {
+        std::string out;
+        acqua::iostreams::json::generator gen(out, indent);
+        acqua::iostreams::json::basic_tokenizer<acqua::iostreams::json::generator> tok(gen);
+        tok.write(src.data(), src.size());
+        BOOST_TEST(tok.done());
+        if (indent == 0)
+            BOOST_TEST(out.find('\n') == std::string::npos);
+
+        boost::property_tree::ptree json1, json2;
+        std::istringstream iss(out);
+        boost::property_tree::read_json(iss, json1);
+        boost::property_tree::read_json("sample.json", json2);
+        BOOST_TEST((json1 == json2));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(json_adapt_boost_ptree)
+{
+    boost::property_tree::ptree json1, json2;
+    boost::property_tree::read_json("sample.json", json1);
+
+    std::string out;
+    boost::iostreams::stream<acqua::iostreams::json_writer<boost::property_tree::ptree> > in(json1, 2);
+    boost::iostreams::copy(in, boost::iostreams::back_inserter(out));
+
+    // ptree の値はすべて文字列になる
+    BOOST_TEST(out.find("\"index\": \"0\"") != std::string::npos);
+    acqua::iostreams::json_parser<boost::property_tree::ptree> parser(json2);
+    BOOST_TEST(parser.write(out.data(), static_cast<std::streamsize>(out.size())) == static_cast<std::streamsize>(out.size()));
+    BOOST_TEST((json1 == json2));
+}
+
+BOOST_AUTO_TEST_CASE(json_writer_chunked)
+{
+    boost::property_tree::ptree json;
+    boost::property_tree::read_json("sample.json", json);
+
+    std::string all;
+    acqua::iostreams::json::generator gen(all, 2);
+    acqua::iostreams::json_adapt<boost::property_tree::ptree>::serialize(json, gen);
+
+    // 少しずつ読み出しても、一度に生成したものと同じテキストになる
+    acqua::iostreams::json_writer<boost::property_tree::ptree> writer(json, 2);
+    std::string out;
+    char buf[16];
+    std::streamsize n;
+    while((n = writer.read(buf, sizeof(buf))) != EOF) {
+        BOOST_TEST(n > 0);
+        BOOST_TEST(n <= static_cast<std::streamsize>(sizeof(buf)));
+        out.append(buf, static_cast<std::size_t>(n));
+    }
+    BOOST_TEST(out == all);
+    BOOST_TEST(writer.read(buf, sizeof(buf)) == EOF);
+}
+
+BOOST_AUTO_TEST_CASE(json_writer_depth)
+{
+    using writer_type = acqua::iostreams::json_writer<boost::property_tree::ptree>;
+
+    // 入れ子が max_depth までは書き出せて、超えるとスタックを溢れさせずに depth_error を投げる
+    auto nest = [](int depth) {
+        auto json = std::make_shared<boost::property_tree::ptree>();
+        boost::property_tree::ptree * node = json.get();
+        for(int i = 1; i < depth; ++i)
+            node = &node->push_back(std::make_pair("a", boost::property_tree::ptree()))->second;
+        node->put_value("x");
+        return json;
+    };
+
+    auto read_all = [](writer_type & writer) {
+        std::string out;
+        char buf[256];
+        std::streamsize n;
+        while((n = writer.read(buf, sizeof(buf))) != EOF)
+            out.append(buf, static_cast<std::size_t>(n));
+        return out;
+    };
+
+    writer_type shallow(nest(writer_type::max_depth));
+    auto out = read_all(shallow);
+    BOOST_TEST(std::count(out.begin(), out.end(), '{') == writer_type::max_depth - 1);
+
+    writer_type deep(nest(10000));
+    BOOST_CHECK_THROW(read_all(deep), acqua::iostreams::json::depth_error);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,69 @@
+#include <acqua/iostreams/newline_filter.hpp>
+#include <boost/test/included/unit_test.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+#include <boost/iostreams/copy.hpp>
+#include <sstream>
+
+BOOST_AUTO_TEST_SUITE(newline_filter)
+
+namespace {
+
+namespace io = acqua::iostreams;
+
+template <typename Filter>
+std::string fi(Filter filter, std::string const & str)
+{
+    std::istringstream iss(str);
+    boost::iostreams::filtering_istream in;
+    in.push(filter);
+    in.push(iss);
+    std::ostringstream oss;
+    boost::iostreams::copy(in, oss);
+    return oss.str();
+}
+
+// size 文字ずつ書き込む
+template <typename Filter>
+std::string fo(Filter filter, std::string const & str, std::size_t size = std::string::npos)
+{
+    std::ostringstream oss;
+    do {
+        boost::iostreams::filtering_ostream out;
+        out.push(filter);
+        out.push(oss);
+        for(std::size_t pos = 0; pos < str.size(); pos += size)
+            out.write(str.data() + pos, static_cast<std::streamsize>(std::min(size, str.size() - pos)));
+    } while(false);
+    return oss.str();
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(convert)
+{
+    std::string const str = "a\r\nb\nc\rd\r\n\r\ne\n\r";
+
+    BOOST_TEST(fi(io::newline_filter(io::newline::ln), str) == "a\nb\nc\nd\n\ne\n\n");
+    BOOST_TEST(fo(io::newline_filter(io::newline::ln), str) == "a\nb\nc\nd\n\ne\n\n");
+    BOOST_TEST(fi(io::newline_filter(io::newline::crln), str) == "a\r\nb\r\nc\r\nd\r\n\r\ne\r\n\r\n");
+    BOOST_TEST(fo(io::newline_filter(io::newline::crln), str) == "a\r\nb\r\nc\r\nd\r\n\r\ne\r\n\r\n");
+    BOOST_TEST(fi(io::newline_filter(io::newline::cr), str) == "a\rb\rc\rd\r\re\r\r");
+    BOOST_TEST(fi(io::newline_filter(io::newline::none), str) == "abcde");
+    BOOST_TEST(fi(io::newline_filter(), "") == "");
+}
+
+BOOST_AUTO_TEST_CASE(split)
+{
+    // CRLF が書き込みの区切りをまたいでも、1 つの改行になる
+    std::string str;
+    for(int i = 0; i < 1000; ++i)
+        str += "The quick brown fox jumps over the lazy dog.\r\n";
+    std::string expected = fi(io::newline_filter(io::newline::ln), str);
+    BOOST_TEST(expected.size() == str.size() - 1000);
+
+    for(std::size_t size : { 1, 2, 45, 46, 4096 })
+        BOOST_TEST(fo(io::newline_filter(io::newline::ln), str, size) == expected);
+    BOOST_TEST(fo(io::newline_filter(io::newline::crln), expected, 3) == str);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
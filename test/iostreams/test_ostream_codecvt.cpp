@@ -97,4 +97,31 @@ BOOST_AUTO_TEST_CASE(ostream_codecvt_utf8_sjis_multiline)
 }
 
 
+BOOST_AUTO_TEST_CASE(ostream_codecvt_block)
+{
+    std::string src;
+    std::u16string u16;
+    for(int i = 0; i < 200; ++i) {
+        src += "ascii text for the fast path, 吾輩は猫である。\xf0\x9f\x90\x88 ";
+        u16 += u"ascii text for the fast path, 吾輩は猫である。\U0001F408 ";
+    }
+
+    // write() の区切りが文字の途中にあっても、続きとつないで変換する
+    for(std::size_t n : { 1, 2, 5, 4096 }) {
+        std::basic_ostringstream<char16_t> oss;
+        auto cvt = acqua::iostreams::ostream_code_converter<char>(oss.rdbuf());
+        for(std::size_t pos = 0; pos < src.size(); pos += n)
+            cvt.write(src.data() + pos, static_cast<std::streamsize>(std::min(n, src.size() - pos)));
+        BOOST_CHECK(oss.str() == u16);
+    }
+
+    for(std::size_t n : { 1, 4096 }) {
+        std::ostringstream oss;
+        auto cvt = acqua::iostreams::ostream_code_converter<char16_t>(oss.rdbuf());
+        for(std::size_t pos = 0; pos < u16.size(); pos += n)
+            cvt.write(u16.data() + pos, static_cast<std::streamsize>(std::min(n, u16.size() - pos)));
+        BOOST_CHECK(oss.str() == src);
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -3,6 +3,8 @@
 #include <boost/iostreams/filtering_stream.hpp>
 #include <boost/iostreams/copy.hpp>
 #include <sstream>
+#include <algorithm>
+#include <random>
 
 BOOST_AUTO_TEST_SUITE(qprint_filter)
 
@@ -139,4 +141,96 @@ BOOST_AUTO_TEST_CASE(multiline)
     } while(false);
 }
 
+namespace {
+
+template <typename Filter>
+std::string fi(Filter filter, std::string const & text, std::streamsize buffer_size = -1)
+{
+    std::ostringstream oss;
+    std::istringstream iss(text);
+    boost::iostreams::filtering_istream in;
+    in.push(filter, buffer_size);
+    in.push(iss);
+    boost::iostreams::copy(in, oss);
+    return oss.str();
+}
+
+template <typename Filter>
+std::string fo(Filter filter, std::string const & text, std::streamsize buffer_size = -1)
+{
+    std::ostringstream oss;
+    boost::iostreams::filtering_ostream out;
+    out.push(filter, buffer_size);
+    out.push(oss);
+    out << text;
+    boost::iostreams::close(out);
+    return oss.str();
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(escape)
+{
+    namespace io = acqua::iostreams;
+
+    BOOST_TEST(fo(io::qprint_encoder(), "a=b") == "a=3Db");
+    BOOST_TEST(fo(io::qprint_encoder(), "caf\xc3\xa9") == "caf=C3=A9");
+    BOOST_TEST(fi(io::qprint_encoder(), "caf\xc3\xa9\x7f") == "caf=C3=A9=7F");
+
+    // 改行の直前の空白はエスケープし、CR は取り除く
+    BOOST_TEST(fo(io::qprint_encoder(), "a  \r\nb\t\nc ") == "a =20\nb=09\nc ");
+    BOOST_TEST(fi(io::qprint_encoder(), "a  \r\nb\t\nc ") == "a =20\nb=09\nc ");
+
+    BOOST_TEST(fi(io::qprint_decoder(), "a=3Db caf=c3=A9") == "a=b caf\xc3\xa9");
+    BOOST_TEST(fo(io::qprint_decoder(), "a=3Db caf=c3=A9") == "a=b caf\xc3\xa9");
+
+    // ソフト改行の直後のエスケープ
+    BOOST_TEST(fo(io::qprint_decoder(), "ab=\r\n=41=\n=42=\rc") == "abABc");
+    BOOST_TEST(fi(io::qprint_decoder(), "ab=\r\n=41=\n=42=\rc") == "abABc");
+
+    // 16 進数でないエスケープは、そのまま出力する
+    BOOST_TEST(fo(io::qprint_decoder(), "a=ZZb=4") == "a=ZZb=4");
+    BOOST_TEST(fi(io::qprint_decoder(), "a=ZZb=4") == "a=ZZb=4");
+}
+
+BOOST_AUTO_TEST_CASE(line_length)
+{
+    namespace io = acqua::iostreams;
+
+    // 改行から文字数を数え直す
+    BOOST_TEST(fo(io::qprint_encoder(io::newline::ln, 5), "abc\nabcdefg") == "abc\nabcde=\nfg");
+
+    // エスケープの途中では改行しない
+    BOOST_TEST(fo(io::qprint_encoder(io::newline::crln, 4), "abc==") == "abc=3D=\r\n=3D");
+}
+
+BOOST_AUTO_TEST_CASE(convert_binary)
+{
+    namespace io = acqua::iostreams;
+
+    std::mt19937 gen(1);
+    std::string bin(20000, '\0');
+    for(auto & ch : bin) {
+        // テキストに近い分布にする
+        auto r = static_cast<unsigned int>(gen() % 100);
+        ch = static_cast<char>(r < 70 ? 'a' + r % 26 : r < 80 ? ' ' : r < 85 ? '\n' : r < 88 ? '=' : r < 90 ? '\t' : static_cast<int>(gen() % 256));
+    }
+    std::string text = bin;
+    text.erase(std::remove(text.begin(), text.end(), '\r'), text.end());
+
+    // 1文字ずつ渡しても、まとめて渡しても同じ結果になる
+    std::string encoded = fo(io::qprint_encoder(io::newline::crln, 76), text);
+    BOOST_TEST(fo(io::qprint_encoder(io::newline::crln, 76), text, 1) == encoded);
+    BOOST_TEST(fi(io::qprint_encoder(io::newline::crln, 76), text, 7) == encoded);
+
+    BOOST_TEST(fo(io::qprint_decoder(), encoded) == text);
+    BOOST_TEST(fo(io::qprint_decoder(), encoded, 1) == text);
+    BOOST_TEST(fi(io::qprint_decoder(), encoded, 3) == text);
+
+    std::istringstream iss(encoded);
+    std::string line;
+    while(std::getline(iss, line))
+        BOOST_TEST(line.size() <= 76u + 2u + 1u + 1u);  // 行末のエスケープの超過分と、ソフト改行の '=' と CR
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,90 @@
+#pragma once
+
+/*!
+  operator new と operator delete を、呼び出しを数える malloc/free で置き換える.
+
+  プログラムに1つだけの翻訳単位でインクルードし、その翻訳単位で count_allocation() を定義すること。
+  配列版、nothrow 版、サイズ付きの operator delete もすべて置き換える。
+  インライン展開されると、GCC は標準の new と free の組み合わせとみなして -Wmismatched-new-delete を出すので、展開させない
+ */
+
+#include <cstdlib>
+#include <new>
+
+//! operator new が呼ばれるたびに呼び出される
+void count_allocation() noexcept;
+
+namespace {
+
+__attribute__((noinline)) void * counted_malloc(std::size_t size)
+{
+    count_allocation();
+    if (void * p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+__attribute__((noinline)) void counted_free(void * p) noexcept
+{
+    std::free(p);
+}
+
+}
+
+void * operator new(std::size_t size)
+{
+    return counted_malloc(size);
+}
+
+void * operator new[](std::size_t size)
+{
+    return counted_malloc(size);
+}
+
+void * operator new(std::size_t size, std::nothrow_t const &) noexcept
+{
+    try {
+        return counted_malloc(size);
+    } catch(...) {
+        return nullptr;
+    }
+}
+
+void * operator new[](std::size_t size, std::nothrow_t const &) noexcept
+{
+    try {
+        return counted_malloc(size);
+    } catch(...) {
+        return nullptr;
+    }
+}
+
+void operator delete(void * p) noexcept
+{
+    counted_free(p);
+}
+
+void operator delete[](void * p) noexcept
+{
+    counted_free(p);
+}
+
+void operator delete(void * p, std::size_t) noexcept
+{
+    counted_free(p);
+}
+
+void operator delete[](void * p, std::size_t) noexcept
+{
+    counted_free(p);
+}
+
+void operator delete(void * p, std::nothrow_t const &) noexcept
+{
+    counted_free(p);
+}
+
+void operator delete[](void * p, std::nothrow_t const &) noexcept
+{
+    counted_free(p);
+}
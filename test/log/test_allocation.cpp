@@ -0,0 +1,100 @@
+#include <acqua/log/logging.hpp>
+#include <acqua/log/loggable.hpp>
+#include <boost/test/included/unit_test.hpp>
+#include "counting_new.hpp"
+
+namespace {
+
+thread_local std::size_t allocations = 0;
+
+}
+
+void count_allocation() noexcept
+{
+    ++allocations;
+}
+
+BOOST_AUTO_TEST_SUITE(allocation)
+
+namespace {
+
+//! 書き込みを捨てる streambuf
+struct null_buf
+    : std::streambuf
+{
+    int_type overflow(int_type ch) override
+    {
+        return traits_type::not_eof(ch);
+    }
+
+    std::streamsize xsputn(char const *, std::streamsize n) override
+    {
+        return n;
+    }
+};
+
+struct redirect
+{
+    explicit redirect(std::streambuf * buf)
+        : old_(std::cout.rdbuf(buf)) {}
+
+    ~redirect()
+    {
+        std::cout.rdbuf(old_);
+    }
+
+    std::streambuf * old_;
+};
+
+struct foo
+    : acqua::log::loggable<foo>
+{
+    void run(int i)
+    {
+        LOG(info) << "loggable " << i << ' ' << 3.14;
+    }
+};
+
+void log_lines(int n)
+{
+    std::string str = "string argument";
+    for(int i = 0; i < n; ++i) {
+        LOG(info) << "line " << i << " " << str << " " << 0.5 * i << " " << static_cast<void *>(&str);
+        LOG(warning) << "nested " << [] { LOG(debug) << "inner"; return 1; }();
+        foo().run(i);
+    }
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(sync)
+{
+    null_buf buf;
+    redirect r(&buf);
+
+    log_lines(100);  // バッファを温める
+
+    allocations = 0;
+    log_lines(10000);
+    BOOST_TEST(allocations == 0u);
+}
+
+BOOST_AUTO_TEST_CASE(async)
+{
+    auto logger = acqua::log::core::get_default();
+    null_buf buf;
+    redirect r(&buf);
+
+    logger->set_async(64);
+    for(int i = 0; i < 10; ++i) {
+        log_lines(100);
+        logger->flush();
+    }
+
+    allocations = 0;
+    log_lines(10000);
+    BOOST_TEST(allocations == 0u);
+    logger->set_sync();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
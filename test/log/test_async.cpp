@@ -0,0 +1,191 @@
+#include <acqua/log/logging.hpp>
+#include <boost/test/included/unit_test.hpp>
+#include <atomic>
+#include <sstream>
+#include <thread>
+#include <cstdio>
+
+extern "C" {
+#include <unistd.h>
+}
+
+BOOST_AUTO_TEST_SUITE(async)
+
+namespace {
+
+//! 書き込みを gate が開くまで止める streambuf
+class gated_buf
+    : public std::stringbuf
+{
+public:
+    std::atomic<bool> gate_{true};
+    std::atomic<bool> entered_{false};
+
+protected:
+    std::streamsize xsputn(char const * s, std::streamsize n) override
+    {
+        entered_ = true;
+        while(!gate_)
+            std::this_thread::yield();
+        return std::stringbuf::xsputn(s, n);
+    }
+};
+
+struct redirect
+{
+    explicit redirect(std::streambuf * buf)
+        : old_(std::cout.rdbuf(buf)) {}
+
+    ~redirect()
+    {
+        std::cout.rdbuf(old_);
+    }
+
+    std::streambuf * old_;
+};
+
+std::size_t count_lines(std::string const & str)
+{
+    return static_cast<std::size_t>(std::count(str.begin(), str.end(), '\n'));
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(multi_thread)
+{
+    auto logger = acqua::log::core::get_default();
+    std::stringbuf buf;
+    redirect r(&buf);
+
+    logger->set_async(64);
+    BOOST_TEST(logger->is_async());
+
+    std::vector<std::thread> threads;
+    for(int i = 0; i < 4; ++i) {
+        threads.emplace_back([i] {
+                for(int j = 0; j < 1000; ++j)
+                    LOG(info) << "thread " << i << " line " << j;
+            });
+    }
+    for(auto & th : threads)
+        th.join();
+    logger->flush();
+
+    BOOST_TEST(count_lines(buf.str()) == 4000u);
+    BOOST_TEST(logger->dropped() == 0u);
+    logger->set_sync();
+    BOOST_TEST(!logger->is_async());
+}
+
+BOOST_AUTO_TEST_CASE(drop)
+{
+    auto logger = acqua::log::core::get_default();
+    gated_buf buf;
+    redirect r(&buf);
+
+    logger->set_async(4, acqua::log::overflow_policy::drop);
+    buf.gate_ = false;
+    LOG(info) << "first";
+    while(!buf.entered_)
+        std::this_thread::yield();
+
+    // 書き出しスレッドが止まっている間に、容量を超えて積む
+    for(int i = 0; i < 10; ++i)
+        LOG(info) << "line" << i;
+    buf.gate_ = true;
+    logger->flush();
+
+    BOOST_TEST(count_lines(buf.str()) == 5u);
+    BOOST_TEST(logger->dropped() == 6u);
+    BOOST_TEST(buf.str().find("line3") != std::string::npos);
+    BOOST_TEST(buf.str().find("line4") == std::string::npos);
+    logger->set_sync();
+}
+
+BOOST_AUTO_TEST_CASE(drop_oldest)
+{
+    auto logger = acqua::log::core::get_default();
+    gated_buf buf;
+    redirect r(&buf);
+
+    logger->set_async(4, acqua::log::overflow_policy::drop_oldest);
+    buf.gate_ = false;
+    LOG(info) << "first";
+    while(!buf.entered_)
+        std::this_thread::yield();
+
+    for(int i = 0; i < 10; ++i)
+        LOG(info) << "line" << i;
+    buf.gate_ = true;
+    logger->flush();
+
+    BOOST_TEST(count_lines(buf.str()) == 5u);
+    BOOST_TEST(logger->dropped() == 6u);
+    BOOST_TEST(buf.str().find("line5") == std::string::npos);
+    BOOST_TEST(buf.str().find("line6") != std::string::npos);
+    BOOST_TEST(buf.str().find("line9") != std::string::npos);
+    logger->set_sync();
+}
+
+BOOST_AUTO_TEST_CASE(block)
+{
+    auto logger = acqua::log::core::get_default();
+    gated_buf buf;
+    redirect r(&buf);
+
+    logger->set_async(4, acqua::log::overflow_policy::block);
+    buf.gate_ = false;
+    LOG(info) << "first";
+    while(!buf.entered_)
+        std::this_thread::yield();
+
+    // 満杯になると push() は空きを待つ. 書き出しが再開すれば、捨てずにすべて書き出す
+    std::thread th([] {
+            for(int i = 0; i < 20; ++i)
+                LOG(info) << "line" << i;
+        });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    buf.gate_ = true;
+    th.join();
+    logger->flush();
+
+    BOOST_TEST(count_lines(buf.str()) == 21u);
+    BOOST_TEST(logger->dropped() == 0u);
+    logger->set_sync();
+}
+
+BOOST_AUTO_TEST_CASE(console_writev)
+{
+    auto logger = acqua::log::core::get_default();
+
+    // 標準出力の記述子を一時ファイルに向けて、まとめて writev(2) された行を読み戻す
+    std::cout.flush();
+    std::fflush(stdout);
+    std::FILE * tmp = std::tmpfile();
+    BOOST_REQUIRE(tmp);
+    int saved = ::dup(STDOUT_FILENO);
+    ::dup2(::fileno(tmp), STDOUT_FILENO);
+
+    logger->set_async(64);
+    for(int i = 0; i < 100; ++i)
+        LOG(info) << "writev " << i;
+    logger->flush();
+    logger->set_sync();
+
+    std::fflush(stdout);
+    ::dup2(saved, STDOUT_FILENO);
+    ::close(saved);
+
+    std::string str;
+    char data[4096];
+    std::rewind(tmp);
+    for(std::size_t n; (n = std::fread(data, 1, sizeof(data), tmp)) > 0; )
+        str.append(data, n);
+    std::fclose(tmp);
+
+    BOOST_TEST(count_lines(str) == 100u);
+    BOOST_TEST(str.find("writev 0\n") != std::string::npos);
+    BOOST_TEST(str.find("writev 99\n") != std::string::npos);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
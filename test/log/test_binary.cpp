@@ -0,0 +1,135 @@
+#include <acqua/log/binary.hpp>
+#include <acqua/log/binary_decoder.hpp>
+#include <boost/test/included/unit_test.hpp>
+#include <boost/filesystem.hpp>
+#include <sstream>
+#include <thread>
+
+BOOST_AUTO_TEST_SUITE(binary)
+
+namespace {
+
+struct fixture
+{
+    fixture()
+        : path_((boost::filesystem::temp_directory_path() / boost::filesystem::unique_path()).string()) {}
+
+    ~fixture()
+    {
+        boost::filesystem::remove(path_);
+    }
+
+    std::string path_;
+};
+
+void hello(int i)
+{
+    BLOG(info, "hello {} {}", i, "world");
+}
+
+}
+
+BOOST_FIXTURE_TEST_CASE(encode_decode, fixture)
+{
+    hello(0);  // ファイルを開く前に登録された呼び出し元も、open() で書き出される
+    acqua::log::binary::open(path_, 1024 * 1024);
+    hello(1);
+    std::string str = "str";
+    int x = 0;
+    BLOG(warning, "i={} u={} d={} b={} c={} s={} p={} extra", -5, 7u, 0.25, true, 'z', str, static_cast<void *>(nullptr));
+    BLOG(debug, "no args");
+    hello(2);
+    (void)x;
+    acqua::log::binary::close();
+
+    acqua::log::binary::decoder decoder(path_);
+    std::ostringstream oss;
+    BOOST_TEST(decoder.write(oss, "[%L] %v") == 4u);
+    BOOST_TEST(oss.str() ==
+               "[info] hello 1 world\n"
+               "[warning] i=-5 u=7 d=0.25 b=true c=z s=str p=0x0 extra\n"
+               "[debug] no args\n"
+               "[info] hello 2 world\n");
+}
+
+BOOST_FIXTURE_TEST_CASE(null_string, fixture)
+{
+    acqua::log::binary::open(path_, 1024 * 1024);
+    char const * cstr = nullptr;
+    char * str = nullptr;
+    BLOG(info, "a=[{}] b=[{}] c={}", cstr, str, 1);
+    acqua::log::binary::close();
+
+    acqua::log::binary::decoder decoder(path_);
+    std::ostringstream oss;
+    BOOST_TEST(decoder.write(oss, "%v") == 1u);
+    BOOST_TEST(oss.str() == "a=[] b=[] c=1\n");
+}
+
+BOOST_FIXTURE_TEST_CASE(record_fields, fixture)
+{
+    acqua::log::binary::open(path_, 1024 * 1024);
+    auto before = boost::posix_time::microsec_clock::local_time();
+    hello(3);
+    acqua::log::binary::close();
+
+    acqua::log::binary::decoder decoder(path_);
+    decoder.for_each([&](acqua::log::binary::decoder::record & rec) {
+            BOOST_TEST(rec.level == acqua::log::info);
+            BOOST_TEST(std::string(rec.file) == __FILE__);
+            BOOST_TEST(rec.tid != 0u);
+            BOOST_TEST((rec.now() - before).total_milliseconds() < 1000);
+            BOOST_TEST(rec.message() == "hello 3 world");
+        });
+}
+
+BOOST_FIXTURE_TEST_CASE(multi_thread, fixture)
+{
+    acqua::log::binary::open(path_, 1024 * 1024);
+    std::vector<std::thread> threads;
+    for(int i = 0; i < 4; ++i)
+        threads.emplace_back([] { for(int j = 0; j < 1000; ++j) hello(j); });
+    for(auto & th : threads)
+        th.join();
+    acqua::log::binary::close();
+
+    acqua::log::binary::decoder decoder(path_);
+    std::size_t sum = 0;
+    BOOST_TEST(decoder.for_each([&](acqua::log::binary::decoder::record &) { ++sum; }) == 4000u);
+}
+
+BOOST_FIXTURE_TEST_CASE(unfinished_record, fixture)
+{
+    acqua::log::binary::open(path_, 1024 * 1024);
+    hello(1);
+
+    // 確保したまま size を書き込まなかったレコードは読み飛ばして、後のレコードを読む
+    auto * file = acqua::log::detail::binary_state::instance().file.load();
+    char * out = file->reserve(acqua::log::detail::binary_align(sizeof(acqua::log::detail::binary_header) + 9 + 9));
+    BOOST_REQUIRE(out != nullptr);
+    acqua::log::detail::binary_header hdr{0, 1, 0, 0, 0};
+    acqua::log::detail::binary_put(out, hdr);
+    acqua::log::detail::binary_put_args(out, 24, 1);
+
+    hello(2);
+    acqua::log::binary::close();
+
+    acqua::log::binary::decoder decoder(path_);
+    std::ostringstream oss;
+    BOOST_TEST(decoder.write(oss, "%v") == 2u);
+    BOOST_TEST(oss.str() == "hello 1 world\nhello 2 world\n");
+}
+
+BOOST_FIXTURE_TEST_CASE(overflow, fixture)
+{
+    acqua::log::binary::open(path_, 4096);
+    for(int i = 0; i < 100; ++i)
+        hello(i);
+    BOOST_TEST(acqua::log::binary::dropped() > 0u);
+    acqua::log::binary::close();
+
+    acqua::log::binary::decoder decoder(path_);
+    BOOST_TEST(decoder.for_each([](acqua::log::binary::decoder::record &) {}) > 0u);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
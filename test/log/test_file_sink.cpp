@@ -0,0 +1,222 @@
+#include <acqua/log/logging.hpp>
+#include <boost/test/included/unit_test.hpp>
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include <thread>
+
+BOOST_AUTO_TEST_SUITE(file_sink)
+
+namespace {
+
+using sink_type = acqua::log::sinks::file_sink<char, std::mutex>;
+
+struct fixture
+{
+    fixture()
+        : dir_(boost::filesystem::temp_directory_path() / boost::filesystem::unique_path())
+    {
+        boost::filesystem::create_directories(dir_);
+    }
+
+    ~fixture()
+    {
+        boost::filesystem::remove_all(dir_);
+    }
+
+    std::string path(char const * name) const
+    {
+        return (dir_ / name).string();
+    }
+
+    std::vector<std::string> files() const
+    {
+        std::vector<std::string> vec;
+        for(auto it = boost::filesystem::directory_iterator(dir_); it != boost::filesystem::directory_iterator(); ++it)
+            vec.push_back(it->path().filename().string());
+        std::sort(vec.begin(), vec.end());
+        return vec;
+    }
+
+    boost::filesystem::path dir_;
+};
+
+std::string read_file(std::string const & path)
+{
+    std::ifstream ifs(path);
+    return std::string(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+}
+
+}
+
+BOOST_FIXTURE_TEST_CASE(buffered, fixture)
+{
+    sink_type sink(path("test.log"));
+    sink.flush_interval(std::chrono::hours(1));
+    sink.write("abc", 3);
+    sink.write("defg", 4);
+    BOOST_TEST(read_file(path("test.log")) == "");  // まだバッファの中にある
+    sink.flush();
+    BOOST_TEST(read_file(path("test.log")) == "abc\ndefg\n");
+
+    // バッファが溢れると、書き出しスレッドが書き出す
+    sink.buffer_size(8);
+    sink.write("0123456789", 10);
+    for(int i = 0; i < 100 && read_file(path("test.log")).size() < 20; ++i)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    BOOST_TEST(read_file(path("test.log")) == "abc\ndefg\n0123456789\n");
+}
+
+BOOST_FIXTURE_TEST_CASE(rotate_size, fixture)
+{
+    {
+        sink_type sink(path("test.log"));
+        sink.buffer_size(0);
+        sink.rotate_size(10);
+        sink.max_files(2);
+        for(int i = 0; i < 5; ++i) {
+            sink.write("0123456789", 10);
+            sink.flush();
+        }
+    }
+
+    // 5回ローテートして、新しい2つだけが残る
+    auto vec = files();
+    BOOST_TEST(vec.size() == 3u);
+    BOOST_TEST(vec.front() == "test.log");
+    BOOST_TEST(read_file(path("test.log")) == "");
+    BOOST_TEST(read_file((dir_ / vec[1]).string()) == "0123456789\n");
+}
+
+BOOST_FIXTURE_TEST_CASE(idle_flush, fixture)
+{
+    // 書き込みが途絶えても、flush_interval が経てば書き出す
+    sink_type sink(path("test.log"));
+    sink.flush_interval(std::chrono::milliseconds(20));
+    sink.write("abc", 3);
+    for(int i = 0; i < 100 && read_file(path("test.log")).empty(); ++i)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    BOOST_TEST(read_file(path("test.log")) == "abc\n");
+}
+
+BOOST_FIXTURE_TEST_CASE(rotate_retry, fixture)
+{
+    sink_type sink(path("test.log"));
+    sink.buffer_size(0);
+    sink.rotate_size(10);
+    sink.rotate_retry(std::chrono::hours(1));
+
+    // ファイルがないので改名に失敗する
+    ::unlink(path("test.log").c_str());
+    sink.write("0123456789", 10);
+    sink.flush();
+    BOOST_TEST(files().empty());
+
+    // 失敗した後は、rotate_retry の間はローテートを試みない
+    std::ofstream(path("test.log")).close();
+    sink.write("0123456789", 10);
+    sink.flush();
+    BOOST_TEST(files() == std::vector<std::string>{"test.log"});
+}
+
+BOOST_FIXTURE_TEST_CASE(rotate_on_flusher, fixture)
+{
+    sink_type sink(path("test.log"));
+    sink.flush_interval(std::chrono::hours(1));
+    sink.rotate_size(10);
+
+    // 書き込んだスレッドではローテートせず、書き出しスレッドが改名する
+    sink.write("0123456789", 10);
+    for(int i = 0; i < 100 && files().size() < 2; ++i)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    auto vec = files();
+    BOOST_TEST(vec.size() == 2u);
+    BOOST_TEST(read_file(path("test.log")) == "");
+    BOOST_TEST(read_file((dir_ / vec.back()).string()) == "0123456789\n");
+}
+
+BOOST_FIXTURE_TEST_CASE(writev, fixture)
+{
+    sink_type sink(path("test.log"));
+    sink.use_writev(true);
+
+    std::string lines[] = { "first", "second", "third" };
+    struct ::iovec iov[3];
+    for(int i = 0; i < 3; ++i) {
+        iov[i].iov_base = &lines[i][0];
+        iov[i].iov_len = lines[i].size();
+    }
+    sink.write(iov, 3);
+    BOOST_TEST(read_file(path("test.log")) == "first\nsecond\nthird\n");
+}
+
+BOOST_FIXTURE_TEST_CASE(logger, fixture)
+{
+    struct file_tag {};
+    auto lg = acqua::log::core::get<file_tag>();
+    lg->set_format("%L %v");
+    auto sink = std::make_shared<sink_type>(path("a.log"));
+    lg->push(sink);
+    lg->set_async(1024);
+
+    std::atomic<bool> stop{false};
+    std::thread th([&] {
+            // ログの出力中にシンクを付け外しする
+            auto other = std::make_shared<sink_type>(path("b.log"));
+            while(!stop) {
+                lg->push(other);
+                std::this_thread::yield();
+                lg->remove(*other);
+            }
+        });
+
+    for(int i = 0; i < 10000; ++i)
+        lg->make_line_logger(acqua::log::info, "", "", 0) << i;
+    lg->flush();
+    stop = true;
+    th.join();
+
+    auto str = read_file(path("a.log"));
+    BOOST_TEST(std::count(str.begin(), str.end(), '\n') == 10000);
+    BOOST_TEST(str.compare(0, 11, "info 0\ninfo") == 0);
+    lg->set_sync();
+    acqua::log::core::remove<file_tag>();
+}
+
+BOOST_AUTO_TEST_CASE(modify_from_sink)
+{
+    struct reentrant_tag {};
+    using logger_type = acqua::log::core::logger;
+    auto logger = acqua::log::core::get<reentrant_tag>();
+
+    // write() の中から同じロガーのシンクを変更すると、待ち合わせずに std::logic_error になる
+    struct reentrant_sink
+        : logger_type::sink_type
+    {
+        explicit reentrant_sink(logger_type & logger)
+            : logger_(logger) {}
+
+        void write(char const *, std::size_t) const override
+        {
+            ++calls_;
+            try {
+                logger_.pop();
+            } catch(std::logic_error const &) {
+                ++rejected_;
+            }
+        }
+
+        logger_type & logger_;
+        mutable int calls_ = 0;
+        mutable int rejected_ = 0;
+    };
+
+    auto sink = std::make_shared<reentrant_sink>(*logger);
+    logger->push(sink);
+    logger->make_line_logger(acqua::log::info, "", "", 0) << "line";
+    BOOST_TEST(sink->calls_ == 1);
+    BOOST_TEST(sink->rejected_ == 1);
+    BOOST_TEST(logger->remove(*sink));
+    acqua::log::core::remove<reentrant_tag>();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
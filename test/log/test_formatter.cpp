@@ -0,0 +1,99 @@
+#include <acqua/log/logging.hpp>
+#include <boost/test/included/unit_test.hpp>
+#include <sstream>
+
+BOOST_AUTO_TEST_SUITE(formatter)
+
+namespace {
+
+boost::posix_time::ptime current;
+
+//! 時刻を固定したログバッファ
+struct fixed_buffer
+    : acqua::log::detail::string_ostream<char>
+    , acqua::log::detail::formatter<fixed_buffer, boost::posix_time::ptime>
+{
+    static boost::posix_time::ptime now()
+    {
+        return current;
+    }
+
+    std::string const & message() const
+    {
+        return str();
+    }
+
+    acqua::log::severity_type level = acqua::log::warning;
+    char const * func = "func";
+    char const * file = "file.cpp";
+    unsigned int line = 10;
+    std::thread::id tid;
+};
+
+std::string format(acqua::log::detail::compiled_format<char> const & fmt, std::string const & msg)
+{
+    fixed_buffer buf;
+    buf << msg;
+    std::ostringstream os;
+    buf.format(os, fmt);
+    return os.str();
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(compile)
+{
+    acqua::log::detail::compiled_format<char> fmt("%F %T.%U [%-8L] - %v");
+    auto const & fields = fmt.fields();
+    BOOST_TEST(fields.size() == 9u);
+    BOOST_TEST(fields[0].code == 'F');
+    BOOST_TEST(fields[1].code == 0);
+    BOOST_TEST(std::string(fmt.literal(fields[1]), fields[1].len) == " ");
+    BOOST_TEST(fields[2].code == 'T');
+    BOOST_TEST(fields[4].code == 'U');
+    BOOST_TEST(fields[6].code == 'L');
+    BOOST_TEST(fields[6].left);
+    BOOST_TEST(fields[6].width == 8);
+    // %U の手前までが秒単位のフィールド
+    BOOST_TEST(fmt.prefix() == 4u);
+    BOOST_TEST(fmt.str() == "%F %T.%U [%-8L] - %v");
+}
+
+BOOST_AUTO_TEST_CASE(cached_prefix)
+{
+    acqua::log::detail::compiled_format<char> fmt("%F %T.%U [%L] - %v");
+    acqua::log::detail::compiled_format<char> fmt2("%Y/%02d %T.%u %v");
+
+    current = boost::posix_time::time_from_string("2016-03-04 05:06:07.123456");
+    BOOST_TEST(format(fmt, "a") == "2016-03-04 05:06:07.123 [warning] - a");
+    BOOST_TEST(format(fmt2, "b") == "2016/04 05:06:07.123456 b");
+
+    // 同じ秒の中では、ミリ秒以下だけが変わる
+    current = boost::posix_time::time_from_string("2016-03-04 05:06:07.999000");
+    BOOST_TEST(format(fmt, "c") == "2016-03-04 05:06:07.999 [warning] - c");
+
+    current = boost::posix_time::time_from_string("2016-03-04 05:06:08.000001");
+    BOOST_TEST(format(fmt, "d") == "2016-03-04 05:06:08.000 [warning] - d");
+    BOOST_TEST(format(fmt2, "e") == "2016/04 05:06:08.000001 e");
+
+    // 書式を作り直すと、キャッシュは使われない
+    fmt.compile("%T %v");
+    BOOST_TEST(format(fmt, "f") == "05:06:08 f");
+}
+
+BOOST_AUTO_TEST_CASE(width)
+{
+    acqua::log::detail::compiled_format<char> fmt("[%-8L][%8L][%05d]%v");
+    current = boost::posix_time::time_from_string("2016-03-04 05:06:07");
+    BOOST_TEST(format(fmt, "x") == "[warning ][ warning][00004]x");
+}
+
+BOOST_AUTO_TEST_CASE(now)
+{
+    auto a = acqua::log::detail::logging_buffer<char>::now();
+    auto b = boost::posix_time::microsec_clock::local_time();
+    BOOST_TEST((b - a).total_milliseconds() < 1000);
+    BOOST_TEST(a <= acqua::log::detail::logging_buffer<char>::now());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,212 @@
+#define ACQUA_LOG_LIMITER_CLOCK manual_clock
+#include <acqua/log/logging.hpp>
+#include <acqua/log/loggable.hpp>
+#include <boost/test/included/unit_test.hpp>
+#include <algorithm>
+#include <atomic>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+//! 間引きの時刻を、テストから進める時計
+struct manual_clock
+{
+    using duration = std::chrono::nanoseconds;
+    using rep = duration::rep;
+    using period = duration::period;
+    using time_point = std::chrono::time_point<manual_clock>;
+    static const bool is_steady = true;
+
+    static time_point now() noexcept
+    {
+        return time_point(duration(ticks.load()));
+    }
+
+    static void advance(duration d) noexcept
+    {
+        ticks.fetch_add(d.count());
+    }
+
+    static std::atomic<rep> ticks;
+};
+
+std::atomic<manual_clock::rep> manual_clock::ticks{0};
+
+BOOST_AUTO_TEST_SUITE(rate_limit)
+
+namespace {
+
+int evaluated = 0;
+
+int count()
+{
+    return ++evaluated;
+}
+
+struct redirect
+{
+    explicit redirect(std::streambuf * buf)
+        : old_(std::cout.rdbuf(buf))
+    {
+        // 捨てた行数は report_suppressed() で明示的に書き出す
+        acqua::log::core::suppressed_interval(std::chrono::nanoseconds(0));
+    }
+
+    ~redirect()
+    {
+        std::cout.rdbuf(old_);
+    }
+
+    std::streambuf * old_;
+};
+
+std::size_t lines(std::string const & str)
+{
+    return static_cast<std::size_t>(std::count(str.begin(), str.end(), '\n'));
+}
+
+struct test_tag {};
+
+struct foo
+    : acqua::log::loggable<foo, test_tag>
+{
+    void run()
+    {
+        for(int i = 0; i < 10; ++i)
+            LOG_EVERY_N(info, 5) << count();
+    }
+};
+
+}
+
+BOOST_AUTO_TEST_CASE(every_n)
+{
+    std::stringbuf buf;
+    redirect r(&buf);
+
+    evaluated = 0;
+    for(int i = 0; i < 10; ++i)
+        LOG_EVERY_N(warning, 3) << count();
+    BOOST_TEST(evaluated == 4);
+    BOOST_TEST(lines(buf.str()) == 4u);
+    BOOST_TEST(buf.str().find("(2 suppressed) 2") != std::string::npos);
+
+    // 呼び出し元ごとに状態を持つ
+    evaluated = 0;
+    foo().run();
+    BOOST_TEST(evaluated == 2);
+}
+
+BOOST_AUTO_TEST_CASE(first_n)
+{
+    std::stringbuf buf;
+    redirect r(&buf);
+
+    evaluated = 0;
+    for(int i = 0; i < 2; ++i) {
+        for(int j = 0; j < 10; ++j)
+            LOG_FIRST_N(warning, 3, std::chrono::milliseconds(200)) << count();
+        if (i == 0)
+            manual_clock::advance(std::chrono::milliseconds(250));
+    }
+    BOOST_TEST(evaluated == 6);
+    BOOST_TEST(lines(buf.str()) == 6u);
+    BOOST_TEST(buf.str().find("(7 suppressed) 4") != std::string::npos);
+}
+
+BOOST_AUTO_TEST_CASE(token_bucket)
+{
+    std::stringbuf buf;
+    redirect r(&buf);
+
+    evaluated = 0;
+    for(int i = 0; i < 101; ++i) {
+        if (i == 100) {
+            BOOST_TEST(evaluated == 5);
+            manual_clock::advance(std::chrono::milliseconds(250));
+        }
+        LOG_RATE(warning, 10, 5) << count();
+    }
+    BOOST_TEST(evaluated == 6);
+    BOOST_TEST(buf.str().find("(95 suppressed) 6") != std::string::npos);
+}
+
+BOOST_AUTO_TEST_CASE(report)
+{
+    std::stringbuf buf;
+    redirect r(&buf);
+
+    // 前のテストで捨てた行数を書き出しておく
+    acqua::log::core::report_suppressed();
+    buf.str("");
+
+    evaluated = 0;
+    for(int i = 0; i < 10; ++i)
+        LOG_FIRST_N(warning, 2, std::chrono::seconds(1)) << count();
+    BOOST_TEST(evaluated == 2);
+    BOOST_TEST(lines(buf.str()) == 2u);
+
+    // 次の行が出力されなくても、捨てた行数を書き出す
+    acqua::log::core::report_suppressed();
+    BOOST_TEST(lines(buf.str()) == 3u);
+    BOOST_TEST(buf.str().find("(8 suppressed)\n") != std::string::npos);
+
+    // 書き出した分は、次の行の先頭には付けない
+    acqua::log::core::report_suppressed();
+    BOOST_TEST(lines(buf.str()) == 3u);
+    manual_clock::advance(std::chrono::seconds(1));
+    LOG_FIRST_N(warning, 2, std::chrono::seconds(1)) << count();
+    BOOST_TEST(evaluated == 3);
+    BOOST_TEST(buf.str().find("suppressed) 3") == std::string::npos);
+}
+
+BOOST_AUTO_TEST_CASE(report_interval)
+{
+    std::stringbuf buf;
+    redirect r(&buf);
+
+    for(int i = 0; i < 10; ++i)
+        LOG_EVERY_N(warning, 100) << i;
+    acqua::log::core::suppressed_interval(std::chrono::milliseconds(10));
+    auto logger = acqua::log::core::get_default();
+    for(int i = 0; i < 500 && buf.str().find("(9 suppressed)") == std::string::npos; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        logger->flush();
+    }
+    acqua::log::core::suppressed_interval(std::chrono::nanoseconds(0));
+    BOOST_TEST(buf.str().find("(9 suppressed)") != std::string::npos);
+}
+
+BOOST_AUTO_TEST_CASE(multi_thread)
+{
+    std::stringbuf buf;
+    redirect r(&buf);
+
+    std::atomic<int> admitted{0};
+    std::vector<std::thread> threads;
+    for(int i = 0; i < 4; ++i) {
+        threads.emplace_back([&admitted]() {
+                for(int j = 0; j < 1000; ++j)
+                    LOG_EVERY_N(warning, 100) << ++admitted;
+            });
+    }
+    for(auto & t : threads)
+        t.join();
+    BOOST_TEST(admitted == 40);
+}
+
+BOOST_AUTO_TEST_CASE(level_filter)
+{
+    auto logger = acqua::log::core::get_default();
+    std::stringbuf buf;
+    redirect r(&buf);
+
+    evaluated = 0;
+    logger->set_level(acqua::log::error);
+    for(int i = 0; i < 10; ++i)
+        LOG_EVERY_N(warning, 1) << count();
+    BOOST_TEST(evaluated == 0);
+    logger->set_level(acqua::log::trace);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,103 @@
+#define ACQUA_LOG_MIN_SEVERITY 1
+#include <acqua/log/logging.hpp>
+#include <acqua/log/loggable.hpp>
+#include <boost/test/included/unit_test.hpp>
+#include <sstream>
+
+BOOST_AUTO_TEST_SUITE(severity)
+
+namespace {
+
+int evaluated = 0;
+
+int count()
+{
+    return ++evaluated;
+}
+
+struct redirect
+{
+    explicit redirect(std::streambuf * buf)
+        : old_(std::cout.rdbuf(buf)) {}
+
+    ~redirect()
+    {
+        std::cout.rdbuf(old_);
+    }
+
+    std::streambuf * old_;
+};
+
+struct test_tag {};
+
+struct foo
+    : acqua::log::loggable<foo, test_tag>
+{
+    void run()
+    {
+        LOG(info) << count();
+        LOG(error) << count();
+    }
+};
+
+}
+
+BOOST_AUTO_TEST_CASE(runtime_level)
+{
+    auto logger = acqua::log::core::get_default();
+    std::stringbuf buf;
+    redirect r(&buf);
+
+    evaluated = 0;
+    logger->set_level(acqua::log::warning);
+    BOOST_TEST(logger->get_level() == acqua::log::warning);
+    LOG(info) << count();
+    LOG(notice) << count();
+    BOOST_TEST(evaluated == 0);
+    BOOST_TEST(buf.str().empty());
+
+    LOG(warning) << count();
+    LOG(emerg) << count();
+    BOOST_TEST(evaluated == 2);
+    BOOST_TEST(buf.str().find("[warning]") != std::string::npos);
+    BOOST_TEST(buf.str().find("[emerg]") != std::string::npos);
+
+    logger->set_level(acqua::log::trace);
+}
+
+BOOST_AUTO_TEST_CASE(compile_time_floor)
+{
+    std::stringbuf buf;
+    redirect r(&buf);
+
+    evaluated = 0;
+    LOG(trace) << count();
+    BOOST_TEST(evaluated == 0);
+    LOG(debug) << count();
+    BOOST_TEST(evaluated == 1);
+}
+
+BOOST_AUTO_TEST_CASE(loggable_level)
+{
+    auto logger = acqua::log::core::get<test_tag>();
+    std::stringbuf buf;
+    redirect r(&buf);
+
+    evaluated = 0;
+    logger->set_level(acqua::log::error);
+    foo().run();
+    BOOST_TEST(evaluated == 1);
+
+    // 別のロガーには影響しない
+    LOG(info) << count();
+    BOOST_TEST(evaluated == 2);
+
+    // if-else の中でも1つの式として使える
+    if (evaluated)
+        LOG(info) << count();
+    else
+        BOOST_FAIL("dangling else");
+    BOOST_TEST(evaluated == 3);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -1,5 +1,6 @@
 #include <acqua/utility/string_cast.hpp>
 #include <boost/test/included/unit_test.hpp>
+#include <list>
 #include <string>
 #include <sstream>
 
@@ -20,4 +21,27 @@ BOOST_AUTO_TEST_CASE(string)
     BOOST_TEST(acqua::string_cast<std::string>("hello") == "hello");
 }
 
+BOOST_AUTO_TEST_CASE(utf)
+{
+    std::string str = "ascii text for the fast path, 吾輩は猫である。\xf0\x9f\x90\x88";
+    std::u16string u16 = u"ascii text for the fast path, 吾輩は猫である。\U0001F408";
+    std::u32string u32 = U"ascii text for the fast path, 吾輩は猫である。\U0001F408";
+
+    BOOST_CHECK(acqua::string_cast<std::u16string>(str) == u16);
+    BOOST_CHECK(acqua::string_cast<std::u32string>(str) == u32);
+    BOOST_CHECK(acqua::string_cast<std::string>(u16) == str);
+    BOOST_CHECK(acqua::string_cast<std::string>(u32) == str);
+    BOOST_CHECK(acqua::string_cast<std::u32string>(u16) == u32);
+    BOOST_CHECK(acqua::string_cast<std::u16string>(u32) == u16);
+    BOOST_CHECK(acqua::string_cast<std::wstring>(str) == acqua::string_cast<std::wstring>(u32));
+
+    // 連続していないイテレータは 1 文字ずつ変換する
+    std::list<char> list(str.begin(), str.end());
+    BOOST_CHECK(acqua::string_cast<std::u16string>(list.begin(), list.end()) == u16);
+
+    std::ostringstream oss;
+    oss << acqua::string_cast(u16);
+    BOOST_CHECK(oss.str() == str);
+}
+
 BOOST_AUTO_TEST_SUITE_END()